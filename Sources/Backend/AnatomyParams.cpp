@@ -22,14 +22,49 @@
 #include "AnatomyParams.h"
 #include "Dsp.h"
 
-VocalTract *AnatomyParams::referenceVocalTract = new VocalTract();
-
-
 // ****************************************************************************
 // Constructor.
 // ****************************************************************************
 
 AnatomyParams::AnatomyParams()
+{
+  referenceVocalTract = new VocalTract();
+  ownsReferenceVocalTract = true;
+  initParams();
+}
+
+
+// ****************************************************************************
+// Constructor for a temporary object that uses the reference vocal tract of
+// another object.
+// ****************************************************************************
+
+AnatomyParams::AnatomyParams(VocalTract *referenceVocalTract)
+{
+  this->referenceVocalTract = referenceVocalTract;
+  ownsReferenceVocalTract = false;
+  initParams();
+}
+
+
+// ****************************************************************************
+// Destructor.
+// ****************************************************************************
+
+AnatomyParams::~AnatomyParams()
+{
+  if (ownsReferenceVocalTract)
+  {
+    delete referenceVocalTract;
+  }
+}
+
+
+// ****************************************************************************
+// Init the parameter descriptions and values.
+// ****************************************************************************
+
+void AnatomyParams::initParams()
 {
   Param p[NUM_ANATOMY_PARAMS] =
   {
@@ -489,7 +524,7 @@ void AnatomyParams::setFor(VocalTract *tract)
   VocalTract::Anatomy *origAnatomy = &referenceVocalTract->anatomy;
   Point3D *P = NULL;    // Array of 3D points
 
-  AnatomyParams origAnatomyParams;
+  AnatomyParams origAnatomyParams(referenceVocalTract);
   origAnatomyParams.getFrom(referenceVocalTract);
 
   // Restrict the parameters first.
@@ -1228,7 +1263,7 @@ double AnatomyParams::transformY(AnatomyParams *origAnatomy, double origY)
 void AnatomyParams::adaptArticulation(double *oldParams, double *newParams)
 {
   int i;
-  AnatomyParams origAnatomyParams;
+  AnatomyParams origAnatomyParams(referenceVocalTract);
   origAnatomyParams.getFrom(referenceVocalTract);
   
   double heightScale = param[PHARYNX_LENGTH].x / origAnatomyParams.param[PHARYNX_LENGTH].x;
@@ -75,6 +75,7 @@ public:
 
 public:
   AnatomyParams();
+  ~AnatomyParams();
   void restrictParams();
   void calcFromAge(int age_month, bool isMale);
   void getFrom(VocalTract *tract);
@@ -93,7 +94,23 @@ public:
   // **************************************************************************
 
 private:
-  static VocalTract *referenceVocalTract;
+  // Each object has its own reference vocal tract (it is modified in
+  // adjustTongueRootCalculation()), so that objects can be used on
+  // different threads.
+  VocalTract *referenceVocalTract;
+  bool ownsReferenceVocalTract;
+
+  // **************************************************************************
+  // Private functions.
+  // **************************************************************************
+
+private:
+  // Temporary parameter set that just borrows the given reference tract.
+  AnatomyParams(VocalTract *referenceVocalTract);
+  void initParams();
+
+  AnatomyParams(const AnatomyParams &) = delete;
+  AnatomyParams &operator=(const AnatomyParams &) = delete;
 };
 
 #endif
@@ -0,0 +1,396 @@
+#include "CompiledSpeaker.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <chrono>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+// ****************************************************************************
+// Helpers for the sequential writing and reading of the binary data.
+// ****************************************************************************
+
+static const char MAGIC[8] = { 'V', 'T', 'L', 'S', 'P', 'K', 'R', 0 };
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+namespace
+{
+  class BinaryWriter
+  {
+  public:
+    string data;
+
+    void put(const void *p, size_t size) { data.append((const char*)p, size); }
+    void putU32(uint32_t x) { put(&x, sizeof(x)); }
+    void putU64(uint64_t x) { put(&x, sizeof(x)); }
+    void putDouble(double x) { put(&x, sizeof(x)); }
+    void putString(const string &st) { putU32((uint32_t)st.size()); put(st.data(), st.size()); }
+  };
+
+  class BinaryReader
+  {
+  public:
+    const char *pos;
+    const char *end;
+    bool ok;
+
+    BinaryReader(const char *data, size_t size) : pos(data), end(data + size), ok(true) {}
+
+    void get(void *p, size_t size)
+    {
+      if ((ok == false) || ((size_t)(end - pos) < size))
+      {
+        ok = false;
+        memset(p, 0, size);
+        return;
+      }
+      memcpy(p, pos, size);
+      pos += size;
+    }
+    uint32_t getU32() { uint32_t x; get(&x, sizeof(x)); return x; }
+    uint64_t getU64() { uint64_t x; get(&x, sizeof(x)); return x; }
+    double getDouble() { double x; get(&x, sizeof(x)); return x; }
+    string getString()
+    {
+      uint32_t length = getU32();
+      if ((ok == false) || ((size_t)(end - pos) < length))
+      {
+        ok = false;
+        return string();
+      }
+      string st(pos, length);
+      pos += length;
+      return st;
+    }
+  };
+}
+
+
+// ****************************************************************************
+/// Returns the name of the compiled file for the given speaker file.
+// ****************************************************************************
+
+string CompiledSpeaker::getFileName(const string &speakerFileName)
+{
+  return speakerFileName + ".bin";
+}
+
+
+// ****************************************************************************
+/// Writes the compiled version of the speaker model that was just read from
+/// speakerFileName.
+/// The file is first written under a temporary name and then renamed, so that
+/// concurrently starting processes never see a partial file.
+// ****************************************************************************
+
+bool CompiledSpeaker::save(const string &speakerFileName, const SpeakerModel &model)
+{
+  int i, k;
+
+  BinaryWriter w;
+
+  // ****************************************************************
+  // Header.
+  // ****************************************************************
+
+  w.put(MAGIC, sizeof(MAGIC));
+  w.putU32(FORMAT_VERSION);
+  w.putU32(BYTE_ORDER_MARK);
+  w.putU32((uint32_t)sizeof(VocalTract::Anatomy));
+  w.putU32((uint32_t)VocalTract::NUM_PARAMS);
+  w.putU64(model.sourceSize);
+  w.putU64(model.sourceHash);
+
+  // ****************************************************************
+  // Vocal tract: anatomy, parameter definitions and shapes.
+  // ****************************************************************
+
+  w.put(&model.anatomy, sizeof(VocalTract::Anatomy));
+
+  for (i = 0; i < VocalTract::NUM_PARAMS; i++)
+  {
+    const VocalTract::Param *p = &model.param[i];
+    w.putDouble(p->x);
+    w.putDouble(p->limitedX);
+    w.putDouble(p->min);
+    w.putDouble(p->max);
+    w.putDouble(p->neutral);
+    w.putString(p->abbr);
+    w.putString(p->name);
+  }
+
+  w.putU32((uint32_t)model.shapes.size());
+  for (i = 0; i < (int)model.shapes.size(); i++)
+  {
+    w.putString(model.shapes[i].name);
+    w.put(model.shapes[i].param, sizeof(model.shapes[i].param));
+  }
+
+  // ****************************************************************
+  // Glottis models.
+  // ****************************************************************
+
+  w.putU32((uint32_t)NUM_GLOTTIS_MODELS);
+  w.putU32((uint32_t)model.selectedGlottis);
+
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    Glottis *g = model.glottis[i];
+    w.putString(g->getName());
+
+    w.putU32((uint32_t)g->staticParam.size());
+    for (k = 0; k < (int)g->staticParam.size(); k++)
+    {
+      w.putDouble(g->staticParam[k].x);
+    }
+
+    w.putU32((uint32_t)g->controlParam.size());
+    w.putU32((uint32_t)g->shape.size());
+    for (k = 0; k < (int)g->shape.size(); k++)
+    {
+      w.putString(g->shape[k].name);
+      w.put(g->shape[k].controlParam.data(), g->shape[k].controlParam.size() * sizeof(double));
+    }
+  }
+
+  // ****************************************************************
+  // Write the data.
+  // ****************************************************************
+
+  string fileName = getFileName(speakerFileName);
+  string tempFileName = fileName + "." +
+    to_string((long long)chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+
+  ofstream os(tempFileName.c_str(), ios::binary);
+  if (!os)
+  {
+    return false;
+  }
+  os.write(w.data.data(), w.data.size());
+  os.close();
+  if (!os)
+  {
+    remove(tempFileName.c_str());
+    return false;
+  }
+
+#ifdef WIN32
+  remove(fileName.c_str());
+#endif
+  if (rename(tempFileName.c_str(), fileName.c_str()) != 0)
+  {
+    remove(tempFileName.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+// ****************************************************************************
+/// Loads the speaker from its compiled file, if there is an up-to-date one.
+/// The size and hash of the speaker file must already be set in the model.
+/// Returns false if there is no up-to-date file. The model is then left
+/// unchanged and must be read from the XML file.
+// ****************************************************************************
+
+bool CompiledSpeaker::load(const string &speakerFileName, SpeakerModel &model)
+{
+  string fileName = getFileName(speakerFileName);
+  bool ok = false;
+
+#ifdef WIN32
+  ifstream is(fileName.c_str(), ios::binary);
+  if (!is)
+  {
+    return false;
+  }
+  string data((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+  ok = parse(data.data(), data.size(), model);
+#else
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat st;
+  if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+  {
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+    {
+      ok = parse((const char*)data, (size_t)st.st_size, model);
+      munmap(data, (size_t)st.st_size);
+    }
+  }
+  close(fd);
+#endif
+
+  return ok;
+}
+
+
+// ****************************************************************************
+/// Gets the size and a 64 bit FNV-1a hash of the given file.
+// ****************************************************************************
+
+bool CompiledSpeaker::getSourceInfo(const string &speakerFileName, uint64_t &size, uint64_t &hash)
+{
+  ifstream is(speakerFileName.c_str(), ios::binary);
+  if (!is)
+  {
+    return false;
+  }
+
+  char buffer[65536];
+  size = 0;
+  hash = 14695981039346656037ULL;
+
+  while (is)
+  {
+    is.read(buffer, sizeof(buffer));
+    streamsize n = is.gcount();
+    for (streamsize i = 0; i < n; i++)
+    {
+      hash ^= (unsigned char)buffer[i];
+      hash *= 1099511628211ULL;
+    }
+    size += (uint64_t)n;
+  }
+
+  return true;
+}
+
+
+// ****************************************************************************
+/// Reads the model from the memory image of a compiled speaker file.
+// ****************************************************************************
+
+bool CompiledSpeaker::parse(const char *data, size_t size, SpeakerModel &model)
+{
+  int i, k;
+  BinaryReader r(data, size);
+
+  // ****************************************************************
+  // Check the header.
+  // ****************************************************************
+
+  char magic[sizeof(MAGIC)];
+  r.get(magic, sizeof(magic));
+  if ((r.ok == false) || (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) ||
+    (r.getU32() != FORMAT_VERSION) ||
+    (r.getU32() != BYTE_ORDER_MARK) ||
+    (r.getU32() != (uint32_t)sizeof(VocalTract::Anatomy)) ||
+    (r.getU32() != (uint32_t)VocalTract::NUM_PARAMS) ||
+    (r.getU64() != model.sourceSize) ||
+    (r.getU64() != model.sourceHash) ||
+    (r.ok == false))
+  {
+    return false;
+  }
+
+  // ****************************************************************
+  // Read everything into temporary objects first.
+  // ****************************************************************
+
+  VocalTract::Anatomy anatomy;
+  r.get(&anatomy, sizeof(anatomy));
+
+  VocalTract::Param param[VocalTract::NUM_PARAMS];
+  for (i = 0; i < VocalTract::NUM_PARAMS; i++)
+  {
+    param[i].x = r.getDouble();
+    param[i].limitedX = r.getDouble();
+    param[i].min = r.getDouble();
+    param[i].max = r.getDouble();
+    param[i].neutral = r.getDouble();
+    param[i].abbr = r.getString();
+    param[i].name = r.getString();
+  }
+
+  uint32_t numShapes = r.getU32();
+  if ((r.ok == false) || (numShapes > size))
+  {
+    return false;
+  }
+  vector<VocalTract::Shape> shapes(numShapes);
+  for (i = 0; i < (int)numShapes; i++)
+  {
+    shapes[i].name = r.getString();
+    r.get(shapes[i].param, sizeof(shapes[i].param));
+  }
+
+  if (((int)r.getU32() != NUM_GLOTTIS_MODELS) || (r.ok == false))
+  {
+    return false;
+  }
+  int selected = (int)r.getU32();
+
+  vector< vector<double> > staticParams(NUM_GLOTTIS_MODELS);
+  vector< vector<Glottis::Shape> > glottisShapes(NUM_GLOTTIS_MODELS);
+
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    if ((r.getString() != model.glottis[i]->getName()) ||
+      (r.getU32() != (uint32_t)model.glottis[i]->staticParam.size()))
+    {
+      return false;
+    }
+    staticParams[i].resize(model.glottis[i]->staticParam.size());
+    for (k = 0; k < (int)staticParams[i].size(); k++)
+    {
+      staticParams[i][k] = r.getDouble();
+    }
+
+    uint32_t numControlParams = r.getU32();
+    uint32_t numGlottisShapes = r.getU32();
+    if ((r.ok == false) || (numControlParams != (uint32_t)model.glottis[i]->controlParam.size()) ||
+      (numGlottisShapes > size))
+    {
+      return false;
+    }
+    glottisShapes[i].resize(numGlottisShapes);
+    for (k = 0; k < (int)numGlottisShapes; k++)
+    {
+      glottisShapes[i][k].name = r.getString();
+      glottisShapes[i][k].controlParam.resize(numControlParams);
+      r.get(glottisShapes[i][k].controlParam.data(), numControlParams * sizeof(double));
+    }
+  }
+
+  if ((r.ok == false) || (r.pos != r.end) || (selected < 0) || (selected >= NUM_GLOTTIS_MODELS))
+  {
+    return false;
+  }
+
+  // ****************************************************************
+  // Everything is valid: take over the data.
+  // ****************************************************************
+
+  model.anatomy = anatomy;
+  for (i = 0; i < VocalTract::NUM_PARAMS; i++)
+  {
+    model.param[i] = param[i];
+  }
+  model.shapes = shapes;
+
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    for (k = 0; k < (int)staticParams[i].size(); k++)
+    {
+      model.glottis[i]->staticParam[k].x = staticParams[i][k];
+    }
+    model.glottis[i]->shape = glottisShapes[i];
+  }
+  model.selectedGlottis = selected;
+
+  return true;
+}
@@ -0,0 +1,51 @@
+#ifndef __COMPILED_SPEAKER_H__
+#define __COMPILED_SPEAKER_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "SpeakerModel.h"
+
+using namespace std;
+
+// ****************************************************************************
+/// Binary ("compiled") version of a .speaker file.
+/// It contains the vocal tract anatomy, the parameter definitions, the shape
+/// list and the data of the glottis models of a SpeakerModel exactly as they
+/// are after reading the XML file, so that a speaker can be loaded without any XML parsing.
+/// The file is stored next to the speaker file (<speaker file>.bin) and is
+/// only used when its format version and the size and hash of the speaker
+/// file it was made from still match. It is read through a memory mapping.
+// ****************************************************************************
+
+class CompiledSpeaker
+{
+  // **************************************************************************
+  // Public data.
+  // **************************************************************************
+
+public:
+  static const uint32_t FORMAT_VERSION = 1;
+
+  // **************************************************************************
+  // Public functions.
+  // **************************************************************************
+
+public:
+  static string getFileName(const string &speakerFileName);
+
+  static bool getSourceInfo(const string &speakerFileName, uint64_t &size, uint64_t &hash);
+
+  static bool save(const string &speakerFileName, const SpeakerModel &model);
+  static bool load(const string &speakerFileName, SpeakerModel &model);
+
+  // **************************************************************************
+  // Private functions.
+  // **************************************************************************
+
+private:
+  static bool parse(const char *data, size_t size, SpeakerModel &model);
+};
+
+#endif
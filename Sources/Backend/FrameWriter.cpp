@@ -0,0 +1,566 @@
+#include "FrameWriter.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <stdint.h>
+
+using namespace std;
+
+// ****************************************************************************
+// A minimal PNG encoder: the image data are compressed with a single deflate
+// block with the fixed Huffman codes. Matches are only searched at the
+// distance of one pixel and of one row, which captures the large uniform
+// areas of the rendered pictures well enough.
+// ****************************************************************************
+
+namespace
+{
+  uint32_t crcTable[256];
+  once_flag crcTableFlag;
+
+  void initCrcTable()
+  {
+    uint32_t c;
+    int n, k;
+
+    for (n = 0; n < 256; n++)
+    {
+      c = (uint32_t)n;
+      for (k = 0; k < 8; k++)
+      {
+        c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+      }
+      crcTable[n] = c;
+    }
+  }
+
+  uint32_t updateCrc(uint32_t crc, const unsigned char *data, size_t size)
+  {
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+      crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+  }
+
+  void putU32BigEndian(string &st, uint32_t x)
+  {
+    st += (char)(x >> 24);
+    st += (char)(x >> 16);
+    st += (char)(x >> 8);
+    st += (char)x;
+  }
+
+  void putChunk(string &png, const char *type, const string &data)
+  {
+    putU32BigEndian(png, (uint32_t)data.size());
+    size_t start = png.size();
+    png.append(type, 4);
+    png += data;
+
+    uint32_t crc = updateCrc(0xFFFFFFFFu, (const unsigned char*)png.data() + start, png.size() - start);
+    putU32BigEndian(png, crc ^ 0xFFFFFFFFu);
+  }
+
+  // Writes the bits LSB first as required by deflate.
+  class BitWriter
+  {
+  public:
+    string &data;
+    uint32_t bitBuffer;
+    int numBits;
+
+    BitWriter(string &st) : data(st), bitBuffer(0), numBits(0) {}
+
+    void putBits(uint32_t bits, int n)
+    {
+      bitBuffer |= bits << numBits;
+      numBits += n;
+      while (numBits >= 8)
+      {
+        data += (char)(bitBuffer & 0xFF);
+        bitBuffer >>= 8;
+        numBits -= 8;
+      }
+    }
+
+    // Huffman codes are stored with their most significant bit first.
+    void putCode(uint32_t code, int n)
+    {
+      uint32_t reversed = 0;
+      int i;
+      for (i = 0; i < n; i++)
+      {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+      }
+      putBits(reversed, n);
+    }
+
+    void flush()
+    {
+      if (numBits > 0)
+      {
+        data += (char)(bitBuffer & 0xFF);
+      }
+      bitBuffer = 0;
+      numBits = 0;
+    }
+  };
+
+  void putLiteral(BitWriter &w, int symbol)
+  {
+    if (symbol < 144) { w.putCode(0x30 + symbol, 8); }
+    else
+    if (symbol < 256) { w.putCode(0x190 + symbol - 144, 9); }
+    else
+    if (symbol < 280) { w.putCode(symbol - 256, 7); }
+    else { w.putCode(0xC0 + symbol - 280, 8); }
+  }
+
+  void putMatch(BitWriter &w, int length, int distance)
+  {
+    static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27,
+      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+      2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97,
+      129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+      16385, 24577 };
+    static const int DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5,
+      6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    int i = 28;
+    while (LENGTH_BASE[i] > length) { i--; }
+    putLiteral(w, 257 + i);
+    w.putBits(length - LENGTH_BASE[i], LENGTH_EXTRA[i]);
+
+    i = 29;
+    while (DISTANCE_BASE[i] > distance) { i--; }
+    w.putCode(i, 5);
+    w.putBits(distance - DISTANCE_BASE[i], DISTANCE_EXTRA[i]);
+  }
+
+  // Returns the zlib stream of the given data.
+  string compress(const unsigned char *data, size_t size, size_t rowSize)
+  {
+    const int MIN_MATCH = 3;
+    const int MAX_MATCH = 258;
+    const size_t MAX_DISTANCE = 32768;
+
+    string out;
+    out.reserve(size / 4 + 64);
+    out += (char)0x78;    // Deflate with a 32K window
+    out += (char)0x01;    // No dictionary, fastest compression level
+
+    BitWriter w(out);
+    w.putBits(1, 1);      // Final block
+    w.putBits(1, 2);      // Fixed Huffman codes
+
+    size_t distances[2] = { 3, rowSize };
+    size_t pos = 0;
+    size_t distance, bestDistance;
+    int k, length, bestLength, maxLength;
+
+    while (pos < size)
+    {
+      bestLength = 0;
+      bestDistance = 0;
+      maxLength = (int)min((size_t)MAX_MATCH, size - pos);
+
+      for (k = 0; k < 2; k++)
+      {
+        distance = distances[k];
+        if ((distance > pos) || (distance > MAX_DISTANCE))
+        {
+          continue;
+        }
+        length = 0;
+        while ((length < maxLength) && (data[pos + length] == data[pos + length - distance]))
+        {
+          length++;
+        }
+        if (length > bestLength)
+        {
+          bestLength = length;
+          bestDistance = distance;
+        }
+      }
+
+      if (bestLength >= MIN_MATCH)
+      {
+        putMatch(w, bestLength, (int)bestDistance);
+        pos += bestLength;
+      }
+      else
+      {
+        putLiteral(w, data[pos]);
+        pos++;
+      }
+    }
+
+    putLiteral(w, 256);   // End of block
+    w.flush();
+
+    // Adler-32 checksum of the uncompressed data.
+    uint32_t a = 1, b = 0;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+      a = (a + data[i]) % 65521;
+      b = (b + a) % 65521;
+    }
+    putU32BigEndian(out, (b << 16) | a);
+
+    return out;
+  }
+}
+
+
+// ****************************************************************************
+/// Constructor. With numThreads = 0, one encoder thread per hardware thread
+/// is started.
+// ****************************************************************************
+
+FrameWriter::FrameWriter(int width, int height, Format format, int numThreads)
+{
+  int i;
+
+  this->width = width;
+  this->height = height;
+  this->format = format;
+  frameSize = (size_t)width*height*3;
+  finished = false;
+  failed = false;
+
+  if (numThreads < 1)
+  {
+    numThreads = (int)thread::hardware_concurrency();
+    if (numThreads < 1) { numThreads = 1; }
+  }
+
+  // Two buffers per thread, so that the caller can render the next frame
+  // while all threads are busy.
+  buffers.resize(2*numThreads + 1);
+  for (i = 0; i < (int)buffers.size(); i++)
+  {
+    buffers[i].resize(frameSize);
+    freeBuffers.push_back(&buffers[i][0]);
+  }
+
+  for (i = 0; i < numThreads; i++)
+  {
+    threads.push_back(thread(&FrameWriter::encodeFrames, this));
+  }
+}
+
+
+// ****************************************************************************
+/// Destructor. Waits until all submitted frames are written.
+// ****************************************************************************
+
+FrameWriter::~FrameWriter()
+{
+  finish();
+}
+
+
+// ****************************************************************************
+/// Opens the file for the format RAW_VIDEO.
+// ****************************************************************************
+
+bool FrameWriter::openVideo(const string &fileName)
+{
+  video.open(fileName.c_str(), ios::binary | ios::trunc);
+  return (bool)video;
+}
+
+
+// ****************************************************************************
+/// Returns a free frame buffer of width*height*3 bytes. Blocks until one of
+/// the submitted frames was written if all buffers are in use.
+// ****************************************************************************
+
+unsigned char *FrameWriter::getBuffer()
+{
+  unique_lock<mutex> lock(jobMutex);
+  while (freeBuffers.empty())
+  {
+    bufferFreed.wait(lock);
+  }
+  unsigned char *buffer = freeBuffers.back();
+  freeBuffers.pop_back();
+  return buffer;
+}
+
+
+// ****************************************************************************
+/// Queues a buffer from getBuffer() for writing. The file name is ignored
+/// for RAW_VIDEO, where the frame is written at the position of frameIndex.
+// ****************************************************************************
+
+void FrameWriter::submit(unsigned char *buffer, const string &fileName, int frameIndex)
+{
+  Job job;
+  job.buffer = buffer;
+  job.fileName = fileName;
+  job.frameIndex = frameIndex;
+
+  lock_guard<mutex> lock(jobMutex);
+  jobs.push_back(job);
+  jobAdded.notify_one();
+}
+
+
+// ****************************************************************************
+/// Waits until all submitted frames are written and stops the threads.
+/// Returns false if any frame could not be written.
+// ****************************************************************************
+
+bool FrameWriter::finish()
+{
+  {
+    lock_guard<mutex> lock(jobMutex);
+    finished = true;
+    jobAdded.notify_all();
+  }
+
+  int i;
+  for (i = 0; i < (int)threads.size(); i++)
+  {
+    threads[i].join();
+  }
+  threads.clear();
+
+  if (video.is_open())
+  {
+    video.close();
+    if (!video) { failed = true; }
+  }
+
+  return (failed == false);
+}
+
+
+// ****************************************************************************
+/// Thread function of the encoders.
+// ****************************************************************************
+
+void FrameWriter::encodeFrames()
+{
+  Job job;
+  bool ok;
+
+  while (true)
+  {
+    {
+      unique_lock<mutex> lock(jobMutex);
+      while ((jobs.empty()) && (finished == false))
+      {
+        jobAdded.wait(lock);
+      }
+      if (jobs.empty())
+      {
+        return;
+      }
+      job = jobs.front();
+      jobs.pop_front();
+    }
+
+    if (format == RAW_VIDEO)
+    {
+      lock_guard<mutex> lock(videoMutex);
+      video.seekp((streamoff)job.frameIndex*(streamoff)frameSize);
+      video.write((const char*)job.buffer, frameSize);
+      ok = (bool)video;
+    }
+    else
+    {
+      ok = writeImage(job.buffer, width, height, format, job.fileName);
+    }
+
+    lock_guard<mutex> lock(jobMutex);
+    if (ok == false)
+    {
+      failed = true;
+    }
+    freeBuffers.push_back(job.buffer);
+    bufferFreed.notify_one();
+  }
+}
+
+
+// ****************************************************************************
+/// Writes a single RGB image (top row first) in the given format.
+/// RAW_VIDEO is treated like RAW.
+// ****************************************************************************
+
+bool FrameWriter::writeImage(const unsigned char *rgb, int width, int height,
+  Format format, const string &fileName)
+{
+  ofstream os(fileName.c_str(), ios::binary);
+  if (!os)
+  {
+    printf("Error: Failed to open the file %s for writing!\n", fileName.c_str());
+    return false;
+  }
+
+  bool ok;
+  if (format == BMP)
+  {
+    ok = writeBmp(rgb, width, height, os);
+  }
+  else
+  if (format == PNG)
+  {
+    ok = writePng(rgb, width, height, os);
+  }
+  else
+  {
+    os.write((const char*)rgb, (size_t)width*height*3);
+    ok = (bool)os;
+  }
+
+  os.close();
+  return (ok) && ((bool)os);
+}
+
+
+// ****************************************************************************
+/// Returns the format for the extension of the given file name (BMP for an
+/// unknown extension).
+// ****************************************************************************
+
+FrameWriter::Format FrameWriter::getFormatFromFileName(const string &fileName)
+{
+  size_t pos = fileName.find_last_of('.');
+  if (pos == string::npos)
+  {
+    return BMP;
+  }
+
+  string ext = fileName.substr(pos + 1);
+  size_t i;
+  for (i = 0; i < ext.size(); i++)
+  {
+    ext[i] = (char)tolower((unsigned char)ext[i]);
+  }
+
+  if (ext == "png") { return PNG; }
+  if ((ext == "rgb") || (ext == "raw")) { return RAW; }
+  return BMP;
+}
+
+
+// ****************************************************************************
+/// Returns the file name extension for the given format.
+// ****************************************************************************
+
+string FrameWriter::getExtension(Format format)
+{
+  switch (format)
+  {
+  case PNG: return "png";
+  case RAW: return "rgb";
+  case RAW_VIDEO: return "rgb";
+  default: return "bmp";
+  }
+}
+
+
+// ****************************************************************************
+/// Writes an uncompressed 24 bit BMP file.
+// ****************************************************************************
+
+bool FrameWriter::writeBmp(const unsigned char *rgb, int width, int height, ofstream &os)
+{
+  int rowSize = (width*3 + 3) & ~3;
+  uint32_t imageSize = (uint32_t)rowSize*height;
+  unsigned char header[54];
+  int x, y;
+
+  memset(header, 0, sizeof(header));
+
+  uint32_t values[] = {
+    54 + imageSize,   // File size (at offset 2)
+    0,                // Reserved
+    54,               // Offset of the pixel data
+    40,               // Size of the info header
+    (uint32_t)width,
+    (uint32_t)height, // Positive = bottom-up rows
+  };
+  header[0] = 'B';
+  header[1] = 'M';
+  for (x = 0; x < 6; x++)
+  {
+    for (y = 0; y < 4; y++)
+    {
+      header[2 + x*4 + y] = (unsigned char)(values[x] >> (8*y));
+    }
+  }
+  header[26] = 1;     // Planes
+  header[28] = 24;    // Bits per pixel
+  for (y = 0; y < 4; y++)
+  {
+    header[34 + y] = (unsigned char)(imageSize >> (8*y));
+  }
+
+  os.write((const char*)header, sizeof(header));
+
+  vector<unsigned char> row(rowSize, 0);
+  const unsigned char *src;
+
+  for (y = height - 1; y >= 0; y--)
+  {
+    src = rgb + (size_t)y*width*3;
+    for (x = 0; x < width; x++)
+    {
+      row[x*3 + 0] = src[x*3 + 2];
+      row[x*3 + 1] = src[x*3 + 1];
+      row[x*3 + 2] = src[x*3 + 0];
+    }
+    os.write((const char*)&row[0], rowSize);
+  }
+
+  return (bool)os;
+}
+
+
+// ****************************************************************************
+/// Writes an 8 bit RGB PNG file.
+// ****************************************************************************
+
+bool FrameWriter::writePng(const unsigned char *rgb, int width, int height, ofstream &os)
+{
+  static const char SIGNATURE[8] = { (char)0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  call_once(crcTableFlag, initCrcTable);
+
+  // Image data: each row is preceded by its filter type (0 = none).
+  size_t rowSize = (size_t)width*3 + 1;
+  vector<unsigned char> data(rowSize*height);
+  int y;
+  for (y = 0; y < height; y++)
+  {
+    data[y*rowSize] = 0;
+    memcpy(&data[y*rowSize + 1], rgb + (size_t)y*width*3, (size_t)width*3);
+  }
+
+  string header;
+  putU32BigEndian(header, (uint32_t)width);
+  putU32BigEndian(header, (uint32_t)height);
+  header += (char)8;    // Bit depth
+  header += (char)2;    // Color type RGB
+  header += (char)0;    // Compression
+  header += (char)0;    // Filter
+  header += (char)0;    // No interlace
+
+  string png(SIGNATURE, sizeof(SIGNATURE));
+  putChunk(png, "IHDR", header);
+  putChunk(png, "IDAT", compress(&data[0], data.size(), rowSize));
+  putChunk(png, "IEND", string());
+
+  os.write(png.data(), png.size());
+  return (bool)os;
+}
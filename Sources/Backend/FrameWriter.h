@@ -0,0 +1,104 @@
+#ifndef __FRAME_WRITER_H__
+#define __FRAME_WRITER_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+
+using namespace std;
+
+// ****************************************************************************
+/// Writes a sequence of rendered RGB frames (8 bit per channel, top row
+/// first) in the background. The frames are encoded by a pool of threads
+/// while the caller renders the next frames. The frame buffers come from a
+/// fixed pool (getBuffer()), so that no memory is allocated per frame and
+/// the caller blocks when the encoders fall behind.
+///
+/// The frames are written either as a sequence of image files (BMP, PNG or
+/// headerless RGB) or, with RAW_VIDEO, into one file of concatenated rgb24
+/// frames that can be piped into a video encoder, e.g.
+/// ffmpeg -f rawvideo -pix_fmt rgb24 -s 400x400 -r 50 -i vt.rgb vt.mp4
+// ****************************************************************************
+
+class FrameWriter
+{
+  // **************************************************************************
+  // Public data.
+  // **************************************************************************
+
+public:
+  enum Format
+  {
+    BMP,
+    PNG,
+    RAW,          ///< Headerless rgb24 file per frame.
+    RAW_VIDEO,    ///< All frames in one rgb24 file.
+    NUM_FORMATS
+  };
+
+  // **************************************************************************
+  // Public functions.
+  // **************************************************************************
+
+public:
+  FrameWriter(int width, int height, Format format, int numThreads = 0);
+  ~FrameWriter();
+
+  bool openVideo(const string &fileName);
+  unsigned char *getBuffer();
+  void submit(unsigned char *buffer, const string &fileName, int frameIndex);
+  bool finish();
+
+  static bool writeImage(const unsigned char *rgb, int width, int height,
+    Format format, const string &fileName);
+  static Format getFormatFromFileName(const string &fileName);
+  static string getExtension(Format format);
+
+  // **************************************************************************
+  // Private data.
+  // **************************************************************************
+
+private:
+  struct Job
+  {
+    unsigned char *buffer;
+    string fileName;
+    int frameIndex;
+  };
+
+  int width;
+  int height;
+  Format format;
+  size_t frameSize;
+
+  vector< vector<unsigned char> > buffers;
+  vector<unsigned char*> freeBuffers;
+  deque<Job> jobs;
+  vector<thread> threads;
+  mutex jobMutex;
+  condition_variable jobAdded;
+  condition_variable bufferFreed;
+  bool finished;
+  bool failed;
+
+  ofstream video;
+  mutex videoMutex;
+
+  // **************************************************************************
+  // Private functions.
+  // **************************************************************************
+
+private:
+  void encodeFrames();
+  static bool writeBmp(const unsigned char *rgb, int width, int height, ofstream &os);
+  static bool writePng(const unsigned char *rgb, int width, int height, ofstream &os);
+
+  FrameWriter(const FrameWriter &) = delete;
+  FrameWriter &operator=(const FrameWriter &) = delete;
+};
+
+#endif
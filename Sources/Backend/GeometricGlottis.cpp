@@ -141,7 +141,7 @@ string GeometricGlottis::getName()
 
 void GeometricGlottis::resetMotion()
 {
-  supraglottalPressureFilter.createChebyshev(25.0/(double)SAMPLING_RATE, false, 4);
+  supraglottalPressureFilter.createChebyshev(25.0/(double)samplingRate, false, 4);
   supraglottalPressureFilter.resetBuffers();
 
   time_s = 0.0;
@@ -149,6 +149,43 @@ void GeometricGlottis::resetMotion()
   supraglottalPressure_dPa = 0.0;
 }
 
+
+// ****************************************************************************
+/// Saves the dynamic state of the simulation (see Glottis::saveMotionState()):
+/// the phase and time of the oscillation and the filtered supraglottal 
+/// pressure.
+// ****************************************************************************
+
+void GeometricGlottis::saveMotionState(MotionState &state)
+{
+  Glottis::saveMotionState(state);
+
+  state.value.push_back(phase);
+  state.value.push_back(time_s);
+  state.value.push_back(supraglottalPressure_dPa);
+  state.filter = supraglottalPressureFilter;
+}
+
+
+// ****************************************************************************
+/// Continues the simulation from a state saved with saveMotionState().
+// ****************************************************************************
+
+bool GeometricGlottis::restoreMotionState(const MotionState &state)
+{
+  if ((state.value.size() != 3) || (Glottis::restoreMotionState(state) == false))
+  {
+    return false;
+  }
+
+  phase = state.value[0];
+  time_s = state.value[1];
+  supraglottalPressure_dPa = state.value[2];
+  supraglottalPressureFilter = state.filter;
+
+  return true;
+}
+
 // ****************************************************************************
 // ****************************************************************************
 
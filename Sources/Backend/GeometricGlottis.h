@@ -92,6 +92,8 @@ public:
   void calcGeometry();
   void getTubeData(double *length_cm, double *area_cm2);
   int getApertureParamIndex();
+  void saveMotionState(MotionState &state);
+  bool restoreMotionState(const MotionState &state);
 
   virtual double getAspirationStrength_dB();
 
@@ -2255,11 +2255,11 @@ void GesturalScore::addClosingGesture(GestureType gestureType, string gestureNam
 bool GesturalScore::hasVocalTactClosure(GestureType gestureType, string gestureName,
   double gestureBegin_s, double gestureEnd_s, double testTime_s)
 {
-  static GestureSequence storedGestures;
-  static Tube tube;
-  static Gesture g;
-  static double tractParams[VocalTract::NUM_PARAMS];
-  static double glottisParams[Glottis::MAX_CONTROL_PARAMS];
+  GestureSequence storedGestures;
+  Tube tube;
+  Gesture g;
+  double tractParams[VocalTract::NUM_PARAMS];
+  double glottisParams[Glottis::MAX_CONTROL_PARAMS];
   Tube::Section *ts = NULL;
   int i;
   bool hasClosure = false;
@@ -2471,10 +2471,10 @@ bool GesturalScore::hasVelicOpening(double gestureBegin_s, double gestureEnd_s,
 {
   const double VELIC_OPENING_THRESHOLD = 0.01;  // Minimally open port (1% of maximum value).
 
-  static GestureSequence storedGestures;
-  static Gesture g;
-  static double tractParams[VocalTract::NUM_PARAMS];
-  static double glottisParams[Glottis::MAX_CONTROL_PARAMS];
+  GestureSequence storedGestures;
+  Gesture g;
+  double tractParams[VocalTract::NUM_PARAMS];
+  double glottisParams[Glottis::MAX_CONTROL_PARAMS];
   bool hasOpening = false;
 
   // Store the old state of the velic gesture tier.
@@ -3756,8 +3756,7 @@ void GesturalScore::getTube(Tube &tube)
       {
         vocalTract->param[i].x = tractParamCurve[i][neededLeftIndex + 1];
       }
-      vocalTract->calculateAll();
-      vocalTract->getTube(rightTube);
+      vocalTract->calculateTube(rightTube);
 
       leftTubeIndex = neededLeftIndex;
     }
@@ -3768,16 +3767,14 @@ void GesturalScore::getTube(Tube &tube)
       {
         vocalTract->param[i].x = tractParamCurve[i][neededLeftIndex];
       }
-      vocalTract->calculateAll();
-      vocalTract->getTube(leftTube);
+      vocalTract->calculateTube(leftTube);
 
       // Get the right tube
       for (i=0; i < VocalTract::NUM_PARAMS; i++)
       {
         vocalTract->param[i].x = tractParamCurve[i][neededLeftIndex + 1];
       }
-      vocalTract->calculateAll();
-      vocalTract->getTube(rightTube);
+      vocalTract->calculateTube(rightTube);
 
       leftTubeIndex = neededLeftIndex;
     }
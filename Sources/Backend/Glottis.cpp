@@ -20,6 +20,7 @@
 // ****************************************************************************
 
 #include "Glottis.h"
+#include "Constants.h"
 
 #include <iomanip>
 #include <cstdio>
@@ -27,6 +28,28 @@
 // This constant should have the same value as the same constant in Tube.h/cpp
 const double Glottis::DEFAULT_ASPIRATION_STRENGTH_DB = -40.0;
 
+// ****************************************************************************
+/// Constructor.
+// ****************************************************************************
+
+Glottis::Glottis()
+{
+  samplingRate = SAMPLING_RATE;
+  hasStoredControlParams = false;
+}
+
+
+// ****************************************************************************
+/// Sets the sampling rate of the simulation. The filters of the model are
+/// recreated for the new rate with the next call of resetMotion().
+/// The time step itself is passed to incTime().
+// ****************************************************************************
+
+void Glottis::setSamplingRate(int samplingRate_Hz)
+{
+  samplingRate = samplingRate_Hz;
+}
+
 // ****************************************************************************
 /// Default implementation.
 // ****************************************************************************
@@ -235,6 +258,21 @@ bool Glottis::writeToXml(ostream &os, int initialIndent, bool isSelected)
 }
 
 
+// ****************************************************************************
+/// Copies the parameter values and shapes from a glottis of the same type,
+/// e.g., to set up a second instance of an already loaded speaker.
+// ****************************************************************************
+
+void Glottis::copyParamsFrom(const Glottis *glottis)
+{
+  staticParam = glottis->staticParam;
+  controlParam = glottis->controlParam;
+  derivedParam = glottis->derivedParam;
+  shape = glottis->shape;
+  savedState = glottis->savedState;
+}
+
+
 // ****************************************************************************
 /// Reads the glottis data and shapes from the given XML-structure.
 // ****************************************************************************
@@ -512,4 +550,59 @@ void Glottis::restoreControlParams()
 }
 
 
+// ****************************************************************************
+/// Saves the dynamic state of the simulation, i.e., the current control and 
+/// derived parameter values. Derived models with further state variables
+/// extend this function.
+// ****************************************************************************
+
+void Glottis::saveMotionState(MotionState &state)
+{
+  int i;
+
+  state.controlParam.resize(controlParam.size());
+  for (i = 0; i < (int)controlParam.size(); i++)
+  {
+    state.controlParam[i] = controlParam[i].x;
+  }
+
+  state.derivedParam.resize(derivedParam.size());
+  for (i = 0; i < (int)derivedParam.size(); i++)
+  {
+    state.derivedParam[i] = derivedParam[i].x;
+  }
+
+  state.value.clear();
+}
+
+
+// ****************************************************************************
+/// Continues the simulation from a state saved with saveMotionState().
+/// Returns false (and leaves the model unchanged) if the state was saved from
+/// another type of glottis model.
+// ****************************************************************************
+
+bool Glottis::restoreMotionState(const MotionState &state)
+{
+  if ((state.controlParam.size() != controlParam.size()) ||
+    (state.derivedParam.size() != derivedParam.size()))
+  {
+    return false;
+  }
+
+  int i;
+  for (i = 0; i < (int)controlParam.size(); i++)
+  {
+    controlParam[i].x = state.controlParam[i];
+  }
+
+  for (i = 0; i < (int)derivedParam.size(); i++)
+  {
+    derivedParam[i].x = state.derivedParam[i];
+  }
+
+  return true;
+}
+
+
 // ****************************************************************************
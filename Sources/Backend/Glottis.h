@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "XmlNode.h"
+#include "IirFilter.h"
 
 using namespace std;
 
@@ -74,6 +75,15 @@ public:
     vector<Shape> shape;
   };
 
+  // Dynamic state of the model during a simulation (see saveMotionState()).
+  struct MotionState
+  {
+    vector<double> controlParam;
+    vector<double> derivedParam;
+    vector<double> value;       ///< State variables of the derived model
+    IirFilter filter;           ///< Pressure filter of the derived model
+  };
+
   // **************************************************************************
 
   vector<Parameter> staticParam;
@@ -88,6 +98,7 @@ public:
   // **************************************************************************
 
 public:
+  Glottis();
   virtual ~Glottis() {}
   virtual string getName() = 0;
   virtual void resetMotion() = 0;
@@ -103,6 +114,7 @@ public:
   void clearUnsavedChanges();
   bool writeToXml(ostream &os, int initialIndent, bool isSelected);
   bool readFromXml(XmlNode &node);
+  void copyParamsFrom(const Glottis *glottis);
 
   void printParamNames(ostream &os);
   void printParamValues(ostream& os, double glottalFlow_cm3_s,
@@ -113,6 +125,20 @@ public:
   void storeControlParams();
   void restoreControlParams();
 
+  virtual void saveMotionState(MotionState &state);
+  virtual bool restoreMotionState(const MotionState &state);
+
+  void setSamplingRate(int samplingRate_Hz);
+  int getSamplingRate() { return samplingRate; }
+
+  // **************************************************************************
+  // Protected data.
+  // **************************************************************************
+
+protected:
+  /// Sampling rate in Hz for the filters of the derived models.
+  int samplingRate;
+
   // **************************************************************************
   // Private data.
   // **************************************************************************
@@ -0,0 +1,289 @@
+#include "SpeakerModel.h"
+
+#include "CompiledSpeaker.h"
+#include "XmlHelper.h"
+#include "XmlNode.h"
+#include "GeometricGlottis.h"
+#include "TwoMassModel.h"
+#include "TriangularGlottis.h"
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+// ****************************************************************************
+// The speakers that are currently in use, so that all instances that load the
+// same (unchanged) speaker file share one model. The entries do not keep the
+// models alive.
+// ****************************************************************************
+
+static mutex loadedSpeakersMutex;
+static map<string, weak_ptr<const SpeakerModel> > loadedSpeakers;
+
+
+// ****************************************************************************
+/// Constructor. Creates the glottis models with their default parameters.
+// ****************************************************************************
+
+SpeakerModel::SpeakerModel()
+{
+  int i;
+
+  sourceSize = 0;
+  sourceHash = 0;
+
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    glottis[i] = newGlottis(i);
+  }
+  selectedGlottis = GEOMETRIC_GLOTTIS;
+}
+
+
+// ****************************************************************************
+/// Destructor.
+// ****************************************************************************
+
+SpeakerModel::~SpeakerModel()
+{
+  int i;
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    delete glottis[i];
+  }
+}
+
+
+// ****************************************************************************
+/// Returns the model of the given speaker file. A model that is already in
+/// use is shared if the file did not change in the meantime. Otherwise, the
+/// model is read from the compiled speaker file or, if there is no
+/// up-to-date one, from the XML file. Returns NULL if the file can't be read.
+// ****************************************************************************
+
+shared_ptr<const SpeakerModel> SpeakerModel::load(const string &speakerFileName)
+{
+  uint64_t sourceSize, sourceHash;
+
+  if (CompiledSpeaker::getSourceInfo(speakerFileName, sourceSize, sourceHash) == false)
+  {
+    printf("Error: Failed to open the speaker file %s!\n", speakerFileName.c_str());
+    return shared_ptr<const SpeakerModel>();
+  }
+
+  lock_guard<mutex> lock(loadedSpeakersMutex);
+
+  shared_ptr<const SpeakerModel> loaded = loadedSpeakers[speakerFileName].lock();
+  if ((loaded) && (loaded->sourceSize == sourceSize) && (loaded->sourceHash == sourceHash))
+  {
+    return loaded;
+  }
+
+  shared_ptr<SpeakerModel> model(new SpeakerModel());
+  model->fileName = speakerFileName;
+  model->sourceSize = sourceSize;
+  model->sourceHash = sourceHash;
+
+  if (CompiledSpeaker::load(speakerFileName, *model) == false)
+  {
+    if (model->readFromXml(speakerFileName) == false)
+    {
+      return shared_ptr<const SpeakerModel>();
+    }
+
+    // Write the compiled speaker file for the next time. It does not matter
+    // if that fails (e.g., in a read-only directory).
+    CompiledSpeaker::save(speakerFileName, *model);
+  }
+
+  model->initReferenceVocalTract();
+  loadedSpeakers[speakerFileName] = model;
+
+  return model;
+}
+
+
+// ****************************************************************************
+/// Returns a new model with the current anatomy, parameter definitions and
+/// shapes of the given vocal tract and the parameters of the given glottis
+/// models, e.g., after the anatomy was adapted with AnatomyParams.
+// ****************************************************************************
+
+shared_ptr<const SpeakerModel> SpeakerModel::createFrom(VocalTract *vocalTract,
+  Glottis *glottis[], int selectedGlottis)
+{
+  int i;
+  shared_ptr<SpeakerModel> model(new SpeakerModel());
+
+  model->setVocalTractData(vocalTract);
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    model->glottis[i]->copyParamsFrom(glottis[i]);
+  }
+  model->selectedGlottis = selectedGlottis;
+  model->initReferenceVocalTract();
+
+  return model;
+}
+
+
+// ****************************************************************************
+/// Creates a new vocal tract of this speaker. It is owned by the caller and
+/// shares the reference surfaces of this speaker.
+// ****************************************************************************
+
+VocalTract *SpeakerModel::createVocalTract() const
+{
+  return new VocalTract(referenceVocalTract);
+}
+
+
+// ****************************************************************************
+/// Creates a new glottis of the given model type (GlottisModel) with the
+/// parameters and shapes of this speaker. It is owned by the caller.
+// ****************************************************************************
+
+Glottis *SpeakerModel::createGlottis(int index) const
+{
+  Glottis *g = newGlottis(index);
+  g->copyParamsFrom(glottis[index]);
+  g->resetMotion();
+  g->calcGeometry();
+  g->clearUnsavedChanges();
+  return g;
+}
+
+
+// ****************************************************************************
+/// Creates a glottis of the given model type with default parameters.
+// ****************************************************************************
+
+Glottis *SpeakerModel::newGlottis(int index)
+{
+  switch (index)
+  {
+  case TWO_MASS_MODEL: return new TwoMassModel();
+  case TRIANGULAR_GLOTTIS: return new TriangularGlottis();
+  default: return new GeometricGlottis();
+  }
+}
+
+
+// ****************************************************************************
+/// Reads the vocal tract and glottis data from the XML speaker file.
+// ****************************************************************************
+
+bool SpeakerModel::readFromXml(const string &speakerFileName)
+{
+  vector<XmlError> xmlErrors;
+  XmlNode *rootNode = xmlParseFile(speakerFileName, "speaker", &xmlErrors);
+  if (rootNode == NULL)
+  {
+    xmlPrintErrors(xmlErrors);
+    return false;
+  }
+
+  // ****************************************************************
+  // Load the data for the glottis models.
+  // ****************************************************************
+
+  // This may be overwritten later.
+  selectedGlottis = GEOMETRIC_GLOTTIS;
+
+  XmlNode *glottisModelsNode = rootNode->getChildElement("glottis_models");
+  if (glottisModelsNode != NULL)
+  {
+    int i;
+    XmlNode *glottisNode;
+
+    for (i=0; (i < (int)glottisModelsNode->childElement.size()) && (i < NUM_GLOTTIS_MODELS); i++)
+    {
+      glottisNode = glottisModelsNode->childElement[i];
+      if (glottisNode->getAttributeString("type") == glottis[i]->getName())
+      {
+        if (glottisNode->getAttributeInt("selected") == 1)
+        {
+          selectedGlottis = i;
+        }
+        if (glottis[i]->readFromXml(*glottisNode) == false)
+        {
+          printf("Error: Failed to read glottis data for glottis model %d!\n", i);
+          delete rootNode;
+          return false;
+        }
+      }
+      else
+      {
+        printf("Error: The type of the glottis model %d in the speaker file is '%s' "
+          "but should be '%s'!\n", i,
+          glottisNode->getAttributeString("type").c_str(),
+          glottis[i]->getName().c_str());
+
+        delete rootNode;
+        return false;
+      }
+    }
+  }
+  else
+  {
+    printf("Warning: No glottis model data found in the speaker file %s!\n", speakerFileName.c_str());
+  }
+
+  // ****************************************************************
+  // Load the vocal tract anatomy and vocal tract shapes. The XML
+  // readers need a complete vocal tract to work on.
+  // ****************************************************************
+
+  VocalTract *vocalTract = new VocalTract();
+
+  try
+  {
+    vocalTract->readFromXml(rootNode, speakerFileName);
+  }
+  catch (std::string st)
+  {
+    printf("%s\n", st.c_str());
+    printf("Error reading the anatomy data from %s.\n", speakerFileName.c_str());
+    delete vocalTract;
+    delete rootNode;
+    return false;
+  }
+
+  setVocalTractData(vocalTract);
+
+  delete vocalTract;
+  delete rootNode;
+
+  return true;
+}
+
+
+// ****************************************************************************
+/// Takes the anatomy, parameter definitions and shapes of the vocal tract.
+// ****************************************************************************
+
+void SpeakerModel::setVocalTractData(VocalTract *vocalTract)
+{
+  int i;
+
+  anatomy = vocalTract->anatomy;
+  for (i = 0; i < VocalTract::NUM_PARAMS; i++)
+  {
+    param[i] = vocalTract->param[i];
+  }
+  shapes = vocalTract->shapes;
+}
+
+
+// ****************************************************************************
+/// Calculates the vocal tract that holds the reference surfaces of the
+/// anatomy for all vocal tracts of this speaker (see createVocalTract()).
+/// Must be called when the data of the model are complete.
+// ****************************************************************************
+
+void SpeakerModel::initReferenceVocalTract()
+{
+  referenceVocalTract.reset(new VocalTract(anatomy, param, shapes));
+}
@@ -0,0 +1,92 @@
+#ifndef __SPEAKER_MODEL_H__
+#define __SPEAKER_MODEL_H__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+#include "VocalTract.h"
+#include "Glottis.h"
+
+using namespace std;
+
+enum GlottisModel
+{
+  GEOMETRIC_GLOTTIS,
+  TWO_MASS_MODEL,
+  TRIANGULAR_GLOTTIS,
+  NUM_GLOTTIS_MODELS
+};
+
+// ****************************************************************************
+/// The immutable data of a loaded speaker: the vocal tract anatomy, the
+/// parameter definitions, the shape library and the parameter sets of the
+/// glottis models.
+/// A SpeakerModel is shared (as shared_ptr<const SpeakerModel>) by all
+/// VocalTractLab objects and worker threads that use the same speaker and is
+/// never changed after its creation. Each user creates its own mutable
+/// vocal tract and glottis objects with createVocalTract() and
+/// createGlottis(), which involves no file access or XML parsing. The vocal
+/// tracts share the reference surfaces of the anatomy (see 
+/// VocalTract::initReferenceSurfaces()), which are calculated only once.
+// ****************************************************************************
+
+class SpeakerModel
+{
+  // **************************************************************************
+  // Public data.
+  // **************************************************************************
+
+public:
+  string fileName;
+  uint64_t sourceSize;      ///< Size of the speaker file.
+  uint64_t sourceHash;      ///< Hash of the speaker file contents.
+
+  VocalTract::Anatomy anatomy;
+  VocalTract::Param param[VocalTract::NUM_PARAMS];
+  vector<VocalTract::Shape> shapes;
+
+  /// Only hold the parameters and shapes of the models; they are never
+  /// used for a simulation.
+  Glottis *glottis[NUM_GLOTTIS_MODELS];
+  int selectedGlottis;
+
+  // **************************************************************************
+  // Private data.
+  // **************************************************************************
+
+private:
+  /// Holds the reference surfaces for all vocal tracts of this speaker.
+  shared_ptr<const VocalTract> referenceVocalTract;
+
+  // **************************************************************************
+  // Public functions.
+  // **************************************************************************
+
+public:
+  SpeakerModel();
+  ~SpeakerModel();
+
+  static shared_ptr<const SpeakerModel> load(const string &speakerFileName);
+  static shared_ptr<const SpeakerModel> createFrom(VocalTract *vocalTract,
+    Glottis *glottis[], int selectedGlottis);
+
+  VocalTract *createVocalTract() const;
+  Glottis *createGlottis(int index) const;
+
+  // **************************************************************************
+  // Private functions.
+  // **************************************************************************
+
+private:
+  static Glottis *newGlottis(int index);
+  bool readFromXml(const string &speakerFileName);
+  void setVocalTractData(VocalTract *vocalTract);
+  void initReferenceVocalTract();
+
+  SpeakerModel(const SpeakerModel &) = delete;
+  SpeakerModel &operator=(const SpeakerModel &) = delete;
+};
+
+#endif
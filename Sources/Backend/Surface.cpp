@@ -20,18 +20,15 @@
 // ****************************************************************************
 
 #include "Surface.h"
+#include "SurfaceKernels.h"
 #include <cmath>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 using namespace std;
 
 
-// Borders for the tile wall.
-
-const double Surface::STANDARD_TILE_WIDTH = 0.5;
-const double Surface::STANDARD_TILE_HEIGHT = 0.5;
-
 const double Surface::STANDARD_CREASE_ANGLE_DEGREE = 70.0;
 
 // ****************************************************************************
@@ -90,6 +87,9 @@ void Surface::clear()
   if (edge != NULL)     { delete [] edge; }
   if (sequence != NULL) { delete [] sequence; }
 
+  boundingBoxNode.clear();
+  nodeTriangle.clear();
+
   numRibs      = 0;
   numRibPoints = 0;
   numTriangles = 0;
@@ -219,7 +219,6 @@ void Surface::init(int ribs, int ribPoints)
 
   for (i=0; i < numVertices; i++)
   {
-    vertex[i].reserved = 0;
     vertex[i].numAssociates = 0;
 
     for (j=0; j < NUM_ASSOCIATED_TRIANGLES; j++)
@@ -247,12 +246,6 @@ void Surface::init(int ribs, int ribPoints)
   	triangle[i].distance = 0.0;
     sequence[i] = i;
   }
-
-  for (i=0; i < numEdges; i++)
-  {
-    edge[i].isIntersected = false;
-    edge[i].intersection.set(0.0, 0.0);
-  }
 }
 
 // ****************************************************************************
@@ -602,116 +595,195 @@ bool Surface::saveAsObjFile(const string &fileName)
 }
 
 // ****************************************************************************
-/// @brief Assign the triangles to the tiles.
+/// @brief Builds or refits the bounding box tree of the triangles.
 ///
-/// Each triangle is assigned to all tiles that are overlapped by the triangles'
-/// bounding box. This function must be called before getTriangleList() !
+/// The tree is built once for the topology of the surface (the triangles
+/// never change between the frames), and afterwards only the bounding boxes
+/// of its nodes are refitted to the current vertex positions. This function 
+/// must be called before getTriangleList() and getTriangleIntersections() 
+/// whenever the vertices have moved !
 // ****************************************************************************
 
 void Surface::prepareIntersections()
 {
-  const double EXTREME = 1000000.0;
-  const double EPSILON = 0.1;
-  int i, x, y;
-  Point3D *Q;
+  int i, x;
 
-  // Find the bounding box of the surface.
+  // The vertices and triangles as structure of arrays for the kernels in
+  // getTriangleIntersections().
 
-  leftBorder = EXTREME;
-  rightBorder = -EXTREME;
-  bottomBorder = EXTREME;
-  topBorder = -EXTREME;
+  vertexX.resize(numVertices);
+  vertexY.resize(numVertices);
+  vertexZ.resize(numVertices);
 
   for (i=0; i < numVertices; i++)
   {
-    Q = &vertex[i].coord;
-    if (Q->x < leftBorder)   { leftBorder = Q->x; }
-    if (Q->x > rightBorder)  { rightBorder = Q->x; }
-    if (Q->y < bottomBorder) { bottomBorder = Q->y; }
-    if (Q->y > topBorder)    { topBorder = Q->y; }
+    vertexX[i] = vertex[i].coord.x;
+    vertexY[i] = vertex[i].coord.y;
+    vertexZ[i] = vertex[i].coord.z;
+  }
+
+  triangleNormalX.resize(numTriangles);
+  triangleNormalY.resize(numTriangles);
+  triangleNormalZ.resize(numTriangles);
+  for (x=0; x < 3; x++)
+  {
+    triangleVertex[x].resize(numTriangles);
+    triangleEdgeStart[x].resize(numTriangles);
+    triangleEdgeEnd[x].resize(numTriangles);
+  }
+
+  Point3D normal;
+  int v0, v1, v2;
+
+  for (i=0; i < numTriangles; i++)
+  {
+    v0 = triangle[i].vertex[0];
+    v1 = triangle[i].vertex[1];
+    v2 = triangle[i].vertex[2];
+    normal = crossProduct(vertex[v1].coord - vertex[v0].coord, vertex[v2].coord - vertex[v0].coord);
+    triangleNormalX[i] = normal.x;
+    triangleNormalY[i] = normal.y;
+    triangleNormalZ[i] = normal.z;
+
+    for (x=0; x < 3; x++)
+    {
+      triangleVertex[x][i] = triangle[i].vertex[x];
+      triangleEdgeStart[x][i] = edge[ triangle[i].edge[x] ].vertex[0];
+      triangleEdgeEnd[x][i] = edge[ triangle[i].edge[x] ].vertex[1];
+    }
   }
 
-  leftBorder-= EPSILON;
-  bottomBorder-= EPSILON;
-  rightBorder+= EPSILON;
-  topBorder+= EPSILON;
+  // Build the tree for the first geometry of the surface (it is cleared
+  // together with the triangles).
 
-  numTilesX = (int)((rightBorder - leftBorder) / STANDARD_TILE_WIDTH) + 1;
-  numTilesY = (int)((topBorder - bottomBorder) / STANDARD_TILE_HEIGHT) + 1;
+  if ((boundingBoxNode.empty()) && (numTriangles > 0))
+  {
+    vector<double> centroidX(numTriangles);
+    vector<double> centroidY(numTriangles);
 
-  if (numTilesX < 1) { numTilesX = 1; }
-  if (numTilesY < 1) { numTilesY = 1; }
-  if (numTilesX > MAX_TILES_X) { numTilesX = MAX_TILES_X; }
-  if (numTilesY > MAX_TILES_Y) { numTilesY = MAX_TILES_Y; }
+    nodeTriangle.resize(numTriangles);
+    for (i=0; i < numTriangles; i++)
+    {
+      nodeTriangle[i] = i;
+      centroidX[i] = (vertexX[triangleVertex[0][i]] + vertexX[triangleVertex[1][i]] + 
+        vertexX[triangleVertex[2][i]]) / 3.0;
+      centroidY[i] = (vertexY[triangleVertex[0][i]] + vertexY[triangleVertex[1][i]] + 
+        vertexY[triangleVertex[2][i]]) / 3.0;
+    }
 
-  tileWidth = (rightBorder - leftBorder) / (double)numTilesX;
-  tileHeight = (topBorder - bottomBorder) / (double)numTilesY;
+    boundingBoxNode.reserve(2*numTriangles / MAX_LEAF_TRIANGLES + 1);
+    buildBoundingBoxTree(0, numTriangles, &centroidX[0], &centroidY[0]);
+  }
 
-  // Make all tiles empty.
+  refitBoundingBoxTree();
+}
+
+// ****************************************************************************
+/// @brief Creates the node for the numEntries triangles in nodeTriangle 
+/// starting at firstEntry and (recursively) its children, and returns its
+/// index. 
+///
+/// Inner nodes split their triangles at the median of the triangle 
+/// centroids along the axis where the centroids are spread most. The 
+/// bounding boxes are set by refitBoundingBoxTree().
+// ****************************************************************************
 
-  for (x=0; x < numTilesX; x++)
+int Surface::buildBoundingBoxTree(int firstEntry, int numEntries, 
+  const double *centroidX, const double *centroidY)
+{
+  int nodeIndex = (int)boundingBoxNode.size();
+  int i;
+
+  boundingBoxNode.push_back(BoundingBoxNode());
+  boundingBoxNode[nodeIndex].secondChild = -1;
+  boundingBoxNode[nodeIndex].firstTriangle = firstEntry;
+  boundingBoxNode[nodeIndex].numTriangles = numEntries;
+
+  if (numEntries <= MAX_LEAF_TRIANGLES)
   {
-    for (y=0; y < numTilesY; y++) { tile[x][y].numTriangles = 0; }
+    return nodeIndex;
   }
 
-  // Fill the tiles with the triangles.
+  // Split along the axis with the bigger spread of the centroids.
 
-  double minX, maxX, minY, maxY;
-  int leftTile, rightTile, bottomTile, topTile;
-  Point3D P;
+  double minX = centroidX[nodeTriangle[firstEntry]];
+  double maxX = minX;
+  double minY = centroidY[nodeTriangle[firstEntry]];
+  double maxY = minY;
 
-  for (i=0; i < numTriangles; i++)
+  for (i=firstEntry+1; i < firstEntry + numEntries; i++)
   {
-    // Get the bounding box of triangle i.
-    minX = minY = EXTREME;
-    maxX = maxY = -EXTREME;
+    if (centroidX[nodeTriangle[i]] < minX) { minX = centroidX[nodeTriangle[i]]; }
+    if (centroidX[nodeTriangle[i]] > maxX) { maxX = centroidX[nodeTriangle[i]]; }
+    if (centroidY[nodeTriangle[i]] < minY) { minY = centroidY[nodeTriangle[i]]; }
+    if (centroidY[nodeTriangle[i]] > maxY) { maxY = centroidY[nodeTriangle[i]]; }
+  }
 
-    for (x=0; x < 3; x++)
-    {
-      P = vertex[ triangle[i].vertex[x] ].coord;
-      if (P.x < minX) { minX = P.x; }
-      if (P.x > maxX) { maxX = P.x; }
-      if (P.y < minY) { minY = P.y; }
-      if (P.y > maxY) { maxY = P.y; }
-    }
+  const double *centroid = (maxX - minX >= maxY - minY) ? centroidX : centroidY;
+  int *first = &nodeTriangle[firstEntry];
+  int numFirstEntries = numEntries / 2;
 
-    minX-= EPSILON;
-    maxX+= EPSILON;
-    minY-= EPSILON;
-    maxY+= EPSILON;
+  nth_element(first, first + numFirstEntries, first + numEntries, 
+    [centroid](int a, int b) { return centroid[a] < centroid[b]; });
 
-    // Add the triangle index to all tiles overlapping the bounding box.
+  // The first child directly follows this node.
 
-    leftTile   = (int)((minX - leftBorder) / tileWidth);
-    rightTile  = (int)((maxX - leftBorder) / tileWidth);
-    bottomTile = (int)((minY - bottomBorder) / tileHeight);
-    topTile    = (int)((maxY - bottomBorder) / tileHeight);
+  buildBoundingBoxTree(firstEntry, numFirstEntries, centroidX, centroidY);
+  int secondChild = buildBoundingBoxTree(firstEntry + numFirstEntries, 
+    numEntries - numFirstEntries, centroidX, centroidY);
 
-    if (leftTile < 0)   { leftTile = 0; }
-    if (rightTile < 0)  { rightTile = 0; }
-    if (bottomTile < 0) { bottomTile = 0; }
-    if (topTile < 0)    { topTile = 0; }
-    if (leftTile >= numTilesX)  { leftTile = numTilesX - 1; }
-    if (rightTile >= numTilesX) { rightTile = numTilesX - 1; }
-    if (bottomTile >= numTilesY) { bottomTile = numTilesY - 1; }
-    if (topTile >= numTilesY)    { topTile = numTilesY - 1; }
+  boundingBoxNode[nodeIndex].secondChild = secondChild;
+  boundingBoxNode[nodeIndex].firstTriangle = 0;
+  boundingBoxNode[nodeIndex].numTriangles = 0;
 
-    for (x=leftTile; x <= rightTile; x++)
+  return nodeIndex;
+}
+
+// ****************************************************************************
+/// @brief Sets the bounding boxes of all nodes of the tree for the current
+/// vertex positions.
+///
+/// The nodes are processed in reverse order, so that the children are 
+/// always refitted before their parent.
+// ****************************************************************************
+
+void Surface::refitBoundingBoxTree()
+{
+  int i, k, t;
+  BoundingBoxNode *node;
+
+  for (i=(int)boundingBoxNode.size()-1; i >= 0; i--)
+  {
+    node = &boundingBoxNode[i];
+
+    if (node->secondChild == -1)
     {
-      for (y=bottomTile; y <= topTile; y++)
+      t = nodeTriangle[node->firstTriangle];
+      node->minX = node->maxX = vertexX[triangleVertex[0][t]];
+      node->minY = node->maxY = vertexY[triangleVertex[0][t]];
+
+      for (k=0; k < 3*node->numTriangles; k++)
       {
-        if (tile[x][y].numTriangles < MAX_TILE_TRIANGLES)
-        {
-          tile[x][y].triangle[ tile[x][y].numTriangles ] = i;
-          tile[x][y].numTriangles++;
-        }
-        else
-        {
-          // Error !
-          printf("Too many triangles for one tile !\n");
-        }
+        t = nodeTriangle[node->firstTriangle + k/3];
+        double x = vertexX[triangleVertex[k % 3][t]];
+        double y = vertexY[triangleVertex[k % 3][t]];
+
+        if (x < node->minX) { node->minX = x; }
+        if (x > node->maxX) { node->maxX = x; }
+        if (y < node->minY) { node->minY = y; }
+        if (y > node->maxY) { node->maxY = y; }
       }
     }
+    else
+    {
+      const BoundingBoxNode &a = boundingBoxNode[i+1];
+      const BoundingBoxNode &b = boundingBoxNode[node->secondChild];
+
+      node->minX = (a.minX < b.minX) ? a.minX : b.minX;
+      node->maxX = (a.maxX > b.maxX) ? a.maxX : b.maxX;
+      node->minY = (a.minY < b.minY) ? a.minY : b.minY;
+      node->maxY = (a.maxY > b.maxY) ? a.maxY : b.maxY;
+    }
   }
 }
   
@@ -725,205 +797,82 @@ void Surface::prepareIntersections()
 /// with the intersecting plane parameters.
 /// The function returns false, when \a MAX_ENTRIES is smaller than the actual
 /// necessary number of entries.
-/// @param indexList The list to be filled with the triangle indices. Triangles
-/// may occur multiple times in the list, when they overlap muliple tiles.
+/// @param indexList The list to be filled with the triangle indices. Each
+/// triangle occurs at most once in the list.
 /// @param numEntries Returns the number of list entries.
 /// @param MAX_ENTRIES The maximal number of entries to be put in the list.
 // ****************************************************************************
   
 bool Surface::getTriangleList(int *indexList, int &numEntries, int MAX_ENTRIES)
 {
-  int i;
-  double x, y;
-  int tileX, tileY;         // Index of the current tile
-  double nextBorderX, nextBorderY;
-  double deltaX, deltaY;
-  Tile *t = NULL;
-  int *source;
+  return getTriangleList(indexList, numEntries, MAX_ENTRIES, intersectionState);
+}
 
-  Point2D Q = linePoint;
-  Point2D v = lineVector;
+// ****************************************************************************
+/// @brief The same as getTriangleList(int *indexList, int &numEntries, 
+/// int MAX_ENTRIES) for the intersecting plane defined by the call of
+/// prepareIntersection(Point2D Q, Point2D v, IntersectionState &state).
+// ****************************************************************************
+  
+bool Surface::getTriangleList(int *indexList, int &numEntries, int MAX_ENTRIES, 
+  const IntersectionState &state)
+{
+  // Margin around the bounding boxes, which is much larger than the 
+  // tolerances of the intersection tests.
+  const double EPSILON = 0.001;
+  // Because of the median split, the depth of the tree is below 
+  // log2(numTriangles) + 1.
+  const int MAX_STACK_SIZE = 64;
+
+  int stack[MAX_STACK_SIZE];
+  int stackSize = 0;
+  int i, k;
+  const BoundingBoxNode *node;
 
-  numEntries = 0;
+  // The (unit) normal of the intersecting line.
+  double nx = -state.lineVector.y;
+  double ny = state.lineVector.x;
+  double lineDistance = nx*state.linePoint.x + ny*state.linePoint.y;
+  double distance, radius;
 
-  // ****************************************************************
-  // A rather horizontal intersection line.
-  // ****************************************************************
+  numEntries = 0;
+  if (boundingBoxNode.empty()) { return true; }
 
-  if (fabs(v.y) <= fabs(v.x)*tileHeight / tileWidth)
+  k = 0;
+  while (k != -1)
   {
-    // The vector v must be directed to the right !
-    if (v.x < 0.0)
-    {
-      v.x = -v.x;
-      v.y = -v.y;
-    }
+    node = &boundingBoxNode[k];
 
-    y = Q.y + (leftBorder - Q.x)*v.y / v.x;
-    deltaY = v.y*tileWidth / v.x;
-    tileY = (int)((y - bottomBorder) / tileHeight);
+    // Does the line pass the bounding box ? The distance of the box center
+    // from the line is compared with the half extent of the box along the
+    // line normal.
 
-    // v.y > 0.0 ****************************************************
+    distance = nx*0.5*(node->minX + node->maxX) + ny*0.5*(node->minY + node->maxY) - lineDistance;
+    radius = 0.5*(fabs(nx)*(node->maxX - node->minX) + fabs(ny)*(node->maxY - node->minY));
 
-    if (v.y > 0.0)
+    if (fabs(distance) <= radius + EPSILON)
     {
-      nextBorderY = bottomBorder + (double)(tileY+1)*tileHeight;
-
-      for (tileX=0; tileX < numTilesX; tileX++)
+      if (node->secondChild == -1)
       {
-        if ((tileY >= 0) && (tileY < numTilesY))
+        if (numEntries + node->numTriangles > MAX_ENTRIES) { return false; }
+        for (i=0; i < node->numTriangles; i++)
         {
-          t = &tile[tileX][tileY];
-          if (numEntries + t->numTriangles > MAX_ENTRIES) { return false; }
-          source = &t->triangle[0];
-          for (i=t->numTriangles-1; i >= 0; i--) { *indexList++ = *source++; }
-          numEntries+= t->numTriangles;
+          indexList[numEntries++] = nodeTriangle[node->firstTriangle + i];
         }
-
-        if (y + deltaY > nextBorderY)
-        {
-          tileY++;
-          nextBorderY+= tileHeight;
-
-          if ((tileY >= 0) && (tileY < numTilesY))
-          {
-            t = &tile[tileX][tileY];
-            if (numEntries + t->numTriangles > MAX_ENTRIES) { return false; }
-            source = &t->triangle[0];
-            for (i=t->numTriangles-1; i >= 0; i--) { *indexList++ = *source++; }
-            numEntries+= t->numTriangles;
-          }
-        }
-
-        y+= deltaY;
       }
-    }
-    else
-
-    // v.y <= 0.0 ***************************************************
-
-    {
-      nextBorderY = bottomBorder + (double)tileY*tileHeight;
-
-      for (tileX=0; tileX < numTilesX; tileX++)
+      else
       {
-        if ((tileY >= 0) && (tileY < numTilesY))
-        {
-          t = &tile[tileX][tileY];
-          if (numEntries + t->numTriangles > MAX_ENTRIES) { return false; }
-          source = &t->triangle[0];
-          for (i=t->numTriangles-1; i >= 0; i--) { *indexList++ = *source++; }
-          numEntries+= t->numTriangles;
-        }
-
-        if (y + deltaY < nextBorderY)
-        {
-          tileY--;
-          nextBorderY-= tileHeight;
-          t = &tile[tileX][tileY];
-
-          if ((tileY >= 0) && (tileY < numTilesY))
-          {
-            if (numEntries + t->numTriangles > MAX_ENTRIES) { return false; }
-            source = &t->triangle[0];
-            for (i=t->numTriangles-1; i >= 0; i--) { *indexList++ = *source++; }
-            numEntries+= t->numTriangles;
-          }
+        // Continue with the first child and remember the second one.
+        if (stackSize < MAX_STACK_SIZE) 
+        { 
+          stack[stackSize++] = node->secondChild; 
         }
-
-        y+= deltaY;
+        k++;
+        continue;
       }
     }
-  }
-  else
-
-  // ****************************************************************
-  // A rather vertical line.
-  // ****************************************************************
 
-  {
-    // The vector v must be directed upwards !
-    if (v.y < 0.0)
-    {
-      v.x = -v.x;
-      v.y = -v.y;
-    }
-
-    x = Q.x + (bottomBorder - Q.y)*v.x / v.y;
-    deltaX = v.x*tileHeight / v.y;
-    tileX = (int)((x - leftBorder) / tileWidth);
-
-    // v.x > 0.0 ****************************************************
-
-    if (v.x > 0.0)
-    {
-      nextBorderX = leftBorder + (double)(tileX+1)*tileWidth;
-
-      for (tileY=0; tileY < numTilesY; tileY++)
-      {
-        if ((tileX >= 0) && (tileX < numTilesX))
-        {
-          t = &tile[tileX][tileY];
-          if (numEntries + t->numTriangles > MAX_ENTRIES) { return false; }
-          source = &t->triangle[0];
-          for (i=t->numTriangles-1; i >= 0; i--) { *indexList++ = *source++; }
-          numEntries+= t->numTriangles;
-        }
-
-        if (x + deltaX > nextBorderX)
-        {
-          tileX++;
-          nextBorderX+= tileWidth;
-
-          if ((tileX >= 0) && (tileX < numTilesX))
-          {
-            t = &tile[tileX][tileY];
-            if (numEntries + t->numTriangles > MAX_ENTRIES) { return false; }
-            source = &t->triangle[0];
-            for (i=t->numTriangles-1; i >= 0; i--) { *indexList++ = *source++; }
-            numEntries+= t->numTriangles;
-          }
-        }
-
-        x+= deltaX;
-      }
-    }
-    else
-
-    // v.x <= 0.0 ***************************************************
-
-    {
-      nextBorderX = leftBorder + (double)tileX*tileWidth;
-
-      for (tileY=0; tileY < numTilesY; tileY++)
-      {
-        if ((tileX >= 0) && (tileX < numTilesX))
-        {
-          t = &tile[tileX][tileY];
-          if (numEntries + t->numTriangles > MAX_ENTRIES) { return false; }
-          source = &t->triangle[0];
-          for (i=t->numTriangles-1; i >= 0; i--) { *indexList++ = *source++; }
-          numEntries+= t->numTriangles;
-        }
-
-        if (x + deltaX < nextBorderX)
-        {
-          tileX--;
-          nextBorderX-= tileWidth;
-
-          if ((tileX >= 0) && (tileX < numTilesX))
-          {
-            t = &tile[tileX][tileY];
-            if (numEntries + t->numTriangles > MAX_ENTRIES) { return false; }
-            source = &t->triangle[0];
-            for (i=t->numTriangles-1; i >= 0; i--) { *indexList++ = *source++; }
-            numEntries+= t->numTriangles;
-          }
-        }
-
-        x+= deltaX;
-      }
-    }
+    k = (stackSize > 0) ? stack[--stackSize] : -1;
   }
 
   return true;
@@ -940,16 +889,27 @@ bool Surface::getTriangleList(int *indexList, int &numEntries, int MAX_ENTRIES)
 // ****************************************************************************
   
 void Surface::prepareIntersection(Point2D Q, Point2D v)
+{
+  prepareIntersection(Q, v, intersectionState);
+}
+
+// ****************************************************************************
+/// @brief The same as prepareIntersection(Point2D Q, Point2D v), but the
+/// intersecting plane and the intermediate results of the following calls of
+/// getTriangleList() and getTriangleIntersection() are kept in the given
+/// state instead of the surface.
+// ****************************************************************************
+  
+void Surface::prepareIntersection(Point2D Q, Point2D v, IntersectionState &state)
 {
   const double EPSILON = 0.000001;
-  int i;
 
-  for (i=0; i < numVertices; i++) { vertex[i].wasTested = false; }
-  for (i=0; i < numEdges; i++)    { edge[i].wasTested = false; }
+  // The tested vertices and edges are only reset when they are needed.
+  state.needsTestReset = true;
 
   v.normalize();            // Normalisierung ist wichtig !
-  lineVector = v;           // Fr getTriangleIntersection merken
-  linePoint = Q;
+  state.lineVector = v;     // Fr getTriangleIntersection merken
+  state.linePoint = Q;
 
   // Einen Normaleneinheitsvektor bilden, der senkrecht (90 nach links
   // gedreht) auf v steht.
@@ -960,8 +920,8 @@ void Surface::prepareIntersection(Point2D Q, Point2D v)
   // Abstand EPSILON links bzw. rechts der Gerade Q+t*v auf der Hhe von
   // P liegen.
 
-  leftLinePoint  = Q + EPSILON*n;
-  rightLinePoint = Q - EPSILON*n;
+  state.leftLinePoint  = Q + EPSILON*n;
+  state.rightLinePoint = Q - EPSILON*n;
 }
 
 // ****************************************************************************
@@ -978,9 +938,32 @@ void Surface::prepareIntersection(Point2D Q, Point2D v)
 // ****************************************************************************
   
 bool Surface::getTriangleIntersection(int index, Point2D &P0, Point2D &P1, Point2D &n)
+{
+  return getTriangleIntersection(index, P0, P1, n, intersectionState);
+}
+
+// ****************************************************************************
+/// @brief The same as getTriangleIntersection(int index, Point2D &P0, 
+/// Point2D &P1, Point2D &n) for the intersecting plane defined by the call of
+/// prepareIntersection(Point2D Q, Point2D v, IntersectionState &state).
+// ****************************************************************************
+  
+bool Surface::getTriangleIntersection(int index, Point2D &P0, Point2D &P1, Point2D &n,
+  IntersectionState &state)
 {
   int e0, e1, e2;   // Die 3 Kanten des Dreiecks
 
+  if (state.needsTestReset)
+  {
+    state.vertexSide.assign(numVertices, NOT_TESTED);
+    state.edgeState.assign(numEdges, NOT_TESTED);
+    if ((int)state.edgeIntersection.size() < numEdges)
+    {
+      state.edgeIntersection.resize(numEdges);
+    }
+    state.needsTestReset = false;
+  }
+
   e0 = triangle[index].edge[0];
   e1 = triangle[index].edge[1];
   e2 = triangle[index].edge[2];
@@ -988,9 +971,9 @@ bool Surface::getTriangleIntersection(int index, Point2D &P0, Point2D &P1, Point
   int numIntersections = 0;
   Point2D Q[3];
 
-  if (getEdgeIntersection(e0)) { Q[numIntersections++] = edge[e0].intersection; }
-  if (getEdgeIntersection(e1)) { Q[numIntersections++] = edge[e1].intersection; }
-  if (getEdgeIntersection(e2)) { Q[numIntersections++] = edge[e2].intersection; }
+  if (getEdgeIntersection(e0, state)) { Q[numIntersections++] = state.edgeIntersection[e0]; }
+  if (getEdgeIntersection(e1, state)) { Q[numIntersections++] = state.edgeIntersection[e1]; }
+  if (getEdgeIntersection(e2, state)) { Q[numIntersections++] = state.edgeIntersection[e2]; }
 
   if (numIntersections < 2) { return false; }
 
@@ -1009,7 +992,7 @@ bool Surface::getTriangleIntersection(int index, Point2D &P0, Point2D &P1, Point
   // ****************************************************************
 
   n.x = normal.z;
-  n.y = normal.x*lineVector.x + normal.y*lineVector.y;
+  n.y = normal.x*state.lineVector.x + normal.y*state.lineVector.y;
 
   // Bei zwei Schnittpunkten P0 und P1 zurckgeben.
 
@@ -1049,72 +1032,120 @@ bool Surface::getTriangleIntersection(int index, Point2D &P0, Point2D &P1, Point
   return true;
 }
 
+// ****************************************************************************
+/// @brief Returns the intersection data for the triangles in indexList (e.g.,
+/// from getTriangleList()) with the intersecting plane defined by the call of
+/// prepareIntersection(Point2D Q, Point2D v, IntersectionState &state).
+///
+/// The results are the same as those of getTriangleIntersection() for each
+/// triangle, but the sides of all vertices are determined at once in 
+/// state.vertexSide, and the triangles are tested by the SurfaceKernels 
+/// without the caching of the single tests. This function must be called 
+/// after prepareIntersections().
+/// @param indexList The indices of the triangles.
+/// @param numEntries The number of triangles in indexList.
+/// @param result Returns the intersection data of each triangle.
+/// @param state The intersecting plane.
+// ****************************************************************************
+
+void Surface::getTriangleIntersections(const int *indexList, int numEntries, 
+  TriangleIntersection *result, IntersectionState &state)
+{
+  SurfaceKernels::Mesh mesh;
+  int i;
+
+  // The sides of the vertices are the same as those that are determined by
+  // the single tests, so that they can be used by both.
+
+  if ((int)state.vertexSide.size() < numVertices)
+  {
+    state.vertexSide.resize(numVertices, NOT_TESTED);
+  }
+  SurfaceKernels::getVertexSides(numVertices, vertexX.data(), vertexY.data(), 
+    state, state.vertexSide.data());
+
+  mesh.x = vertexX.data();
+  mesh.y = vertexY.data();
+  mesh.z = vertexZ.data();
+  mesh.normalX = triangleNormalX.data();
+  mesh.normalY = triangleNormalY.data();
+  mesh.normalZ = triangleNormalZ.data();
+  for (i=0; i < 3; i++)
+  {
+    mesh.vertex[i] = triangleVertex[i].data();
+    mesh.edgeStart[i] = triangleEdgeStart[i].data();
+    mesh.edgeEnd[i] = triangleEdgeEnd[i].data();
+  }
+
+  SurfaceKernels::intersectTriangles(numEntries, indexList, mesh, 
+    state.vertexSide.data(), state, result);
+}
+
 // ****************************************************************************
 /// @brief This function returns true, if a triangle edge was interesected by 
 /// the intersecting plane. Do not call this function explicitely!
 // ****************************************************************************
 
-bool Surface::getEdgeIntersection(int edgeIndex)
+bool Surface::getEdgeIntersection(int edgeIndex, IntersectionState &state)
 {
-  if (edge[edgeIndex].wasTested) { return edge[edgeIndex].isIntersected; }
+  if (state.edgeState[edgeIndex] != NOT_TESTED) 
+  { 
+    return (state.edgeState[edgeIndex] == INTERSECTED); 
+  }
 
   // The edge must be tested for an intersection.
 
   Point2D w;
   double d;
 
-  edge[edgeIndex].wasTested = true;
-
   int v0 = edge[edgeIndex].vertex[0];
   int v1 = edge[edgeIndex].vertex[1];
 
   // ****************************************************************
   // Is the first vertex left or right from the intersection line ?
-  // Im reserved-Feld jedes Punktes vermerken, ob er links von (res = -1), 
+  // In vertexSide fr jeden Punkt vermerken, ob er links von (res = -1), 
   // rechts von (res = +1) oder (innerhalb einer EPSILON-Umgebung) 
   // auf der Schnittebene liegt (res = 0).
   // ****************************************************************
 
-  if (vertex[v0].wasTested == false)
+  if (state.vertexSide[v0] == NOT_TESTED)
   {
-    vertex[v0].wasTested = true;
-    vertex[v0].reserved = 0;
-
-    w.x = vertex[v0].coord.x - leftLinePoint.x;
-    w.y = vertex[v0].coord.y - leftLinePoint.y;
-    d = w.x*lineVector.y - w.y*lineVector.x;
-    if (d < 0.0) { vertex[v0].reserved = -1; }
-
-    w.x = vertex[v0].coord.x - rightLinePoint.x;
-    w.y = vertex[v0].coord.y - rightLinePoint.y;
-    d = w.x*lineVector.y - w.y*lineVector.x;
-    if (d > 0.0) { vertex[v0].reserved = 1; }
+    state.vertexSide[v0] = 0;
+
+    w.x = vertex[v0].coord.x - state.leftLinePoint.x;
+    w.y = vertex[v0].coord.y - state.leftLinePoint.y;
+    d = w.x*state.lineVector.y - w.y*state.lineVector.x;
+    if (d < 0.0) { state.vertexSide[v0] = -1; }
+
+    w.x = vertex[v0].coord.x - state.rightLinePoint.x;
+    w.y = vertex[v0].coord.y - state.rightLinePoint.y;
+    d = w.x*state.lineVector.y - w.y*state.lineVector.x;
+    if (d > 0.0) { state.vertexSide[v0] = 1; }
   }
 
   // Is the second vertex left or right from the intersection line ?
 
-  if (vertex[v1].wasTested == false)
+  if (state.vertexSide[v1] == NOT_TESTED)
   {
-    vertex[v1].wasTested = true;
-    vertex[v1].reserved = 0;
-
-    w.x = vertex[v1].coord.x - leftLinePoint.x;
-    w.y = vertex[v1].coord.y - leftLinePoint.y;
-    d = w.x*lineVector.y - w.y*lineVector.x;
-    if (d < 0.0) { vertex[v1].reserved = -1; }
-
-    w.x = vertex[v1].coord.x - rightLinePoint.x;
-    w.y = vertex[v1].coord.y - rightLinePoint.y;
-    d = w.x*lineVector.y - w.y*lineVector.x;
-    if (d > 0.0) { vertex[v1].reserved = 1; }
+    state.vertexSide[v1] = 0;
+
+    w.x = vertex[v1].coord.x - state.leftLinePoint.x;
+    w.y = vertex[v1].coord.y - state.leftLinePoint.y;
+    d = w.x*state.lineVector.y - w.y*state.lineVector.x;
+    if (d < 0.0) { state.vertexSide[v1] = -1; }
+
+    w.x = vertex[v1].coord.x - state.rightLinePoint.x;
+    w.y = vertex[v1].coord.y - state.rightLinePoint.y;
+    d = w.x*state.lineVector.y - w.y*state.lineVector.x;
+    if (d > 0.0) { state.vertexSide[v1] = 1; }
   }
 
   // Test the edge for an intersection.
 
-  edge[edgeIndex].isIntersected = false;
+  state.edgeState[edgeIndex] = NOT_INTERSECTED;
 
-  if (((vertex[v0].reserved >= 0) && (vertex[v1].reserved <= 0)) ||
-      ((vertex[v0].reserved <= 0) && (vertex[v1].reserved >= 0)))
+  if (((state.vertexSide[v0] >= 0) && (state.vertexSide[v1] <= 0)) ||
+      ((state.vertexSide[v0] <= 0) && (state.vertexSide[v1] >= 0)))
   {
     // Den Schnittpunkt der Kante mit der Schnittebene genau bestimmen.
     const double EPSILON = 0.000001;
@@ -1125,26 +1156,26 @@ bool Surface::getEdgeIntersection(int edgeIndex)
     P = vertex[v0].coord;
     u = vertex[v1].coord - P;
 
-    R.x = P.x - linePoint.x;
-    R.y = P.y - linePoint.y;
+    R.x = P.x - state.linePoint.x;
+    R.y = P.y - state.linePoint.y;
     R.z = P.z;
 
-    denominator = -u.x*lineVector.y + u.y*lineVector.x;
+    denominator = -u.x*state.lineVector.y + u.y*state.lineVector.x;
 
     if (denominator != 0.0)
     {
       // Liegt der Parameter d der Kante zwischen -EPSILON und 1+EPSILON ?
-      d = (-lineVector.x*R.y + lineVector.y*R.x) / denominator;
+      d = (-state.lineVector.x*R.y + state.lineVector.y*R.x) / denominator;
       if ((d >= -EPSILON) && (d < 1.0+EPSILON))
       {
-        edge[edgeIndex].isIntersected = true;
-        edge[edgeIndex].intersection.x = (lineVector.x*(u.y*R.z - u.z*R.y) + lineVector.y*(u.z*R.x - u.x*R.z)) / denominator;
-        edge[edgeIndex].intersection.y = (-u.x*R.y + u.y*R.x) / denominator;
+        state.edgeState[edgeIndex] = INTERSECTED;
+        state.edgeIntersection[edgeIndex].x = (state.lineVector.x*(u.y*R.z - u.z*R.y) + state.lineVector.y*(u.z*R.x - u.x*R.z)) / denominator;
+        state.edgeIntersection[edgeIndex].y = (-u.x*R.y + u.y*R.x) / denominator;
       }
     }
   }
 
-  return edge[edgeIndex].isIntersected;
+  return (state.edgeState[edgeIndex] == INTERSECTED);
 }
 
 // ****************************************************************************
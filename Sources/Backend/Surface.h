@@ -25,6 +25,7 @@
 #include "Geometry.h"
 #include <fstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -46,15 +47,8 @@ public:
   /// Maximal number of triangles sharing the same vertex
   static const int NUM_ASSOCIATED_TRIANGLES = 6;  
 
-  /// Max. number of tiles in horizontal direction
-  static const int MAX_TILES_X = 15;  
-  /// Max. number of tiles in vertical direction
-  static const int MAX_TILES_Y = 15;  
-  /// Max. number of triangles per tile
-  static const int MAX_TILE_TRIANGLES = 150000 / (MAX_TILES_X*MAX_TILES_Y);
-
-  static const double STANDARD_TILE_WIDTH;    ///< The optimal width of a tile
-  static const double STANDARD_TILE_HEIGHT;   ///< The optimal height of a tile
+  /// Max. number of triangles in a leaf of the bounding box tree
+  static const int MAX_LEAF_TRIANGLES = 4;
 
   /// The default angle that separates between smooth shading and an edge
   static const double STANDARD_CREASE_ANGLE_DEGREE;
@@ -71,8 +65,6 @@ public:
     int numAssociates;
     int associatedTriangle[NUM_ASSOCIATED_TRIANGLES];
     int associatedCorner[NUM_ASSOCIATED_TRIANGLES];
-    int reserved;         // Vertex position in relation to a line: -1=left, +1=right, 0=on the line
-	  bool wasTested;       // Was the vertext position in relation to an intersection line tested ?
   };
 
   // ****************************************************************
@@ -96,23 +88,74 @@ public:
   struct Edge
   {
     int vertex[2];          ///< Indices of the two vertices.
-    bool isIntersected;     ///< Was the edge intersected by the intersecting plane?
-	  bool wasTested; 		    ///< Was the edge already tested for an intersection?
-    Point2D intersection;   ///< Projection of the intersection point on the intersecting plane.
   };
 
   // ****************************************************************
-  /// @brief A tile represents a rectangular part of the bounding box 
-  /// of the surface in the xy-plane.
+  /// @brief The intersecting plane/line and the intermediate results
+  /// of the intersection of the surface with it.
   ///
-  /// A tile contains the indices of all triangles that overlap the
-  /// tile region to allow faster intersection point calculations.
+  /// The surface itself is not changed by an intersection, so that
+  /// it can be intersected by multiple threads at the same time, 
+  /// each with its own IntersectionState.
   // ****************************************************************
 
-  struct Tile
-  {							
-		int numTriangles;				///< Number of triangles overlapping the tile.
-		int triangle[MAX_TILE_TRIANGLES];	///< Indices of the triangles overplapping the tile.
+  struct IntersectionState
+  {
+    IntersectionState() : needsTestReset(true) { }
+
+    Point2D linePoint;        ///< Origin of the intersecting plane/line (in the xy-plane).
+    Point2D leftLinePoint;    ///< The line origin moved to the left (with resprect to the line) by a tiny amount.
+    Point2D rightLinePoint;   ///< The line origin moved to the right (with resprect to the line) by a tiny amount.
+    Point2D lineVector;       ///< Normalized vector specifying the direction of the intersecting line.
+
+    /// Vertex positions in relation to the line: -1=left, +1=right, 
+    /// 0=on the line, NOT_TESTED=not tested yet.
+    std::vector<int> vertexSide;
+    /// Edge states: NOT_TESTED, NOT_INTERSECTED or INTERSECTED.
+    std::vector<int> edgeState;
+    /// Projections of the intersection points of the edges on the 
+    /// intersecting plane.
+    std::vector<Point2D> edgeIntersection;
+    /// Must vertexSide and edgeState be reset before the next test?
+    bool needsTestReset;
+  };
+
+  // ****************************************************************
+  /// The intersection of a triangle with the intersecting plane, as
+  /// returned by getTriangleIntersections().
+  // ****************************************************************
+
+  struct TriangleIntersection
+  {
+    bool isIntersected;
+    Point2D P0;     ///< First point of the intersection line (if isIntersected)
+    Point2D P1;     ///< Second point of the intersection line (if isIntersected)
+    Point2D n;      ///< Projection of the triangle normal (if isIntersected)
+  };
+
+  enum IntersectionTestState
+  {
+    NOT_TESTED = 2,
+    NOT_INTERSECTED,
+    INTERSECTED
+  };
+
+  // ****************************************************************
+  /// @brief A node of the bounding box tree (bounding volume 
+  /// hierarchy) of the triangles in the xy-plane.
+  ///
+  /// The nodes are stored in depth-first order, i.e., the first child
+  /// of an inner node directly follows the node, and all children
+  /// have higher indices than their parent.
+  // ****************************************************************
+
+  struct BoundingBoxNode
+  {
+    double minX, maxX;    ///< The bounding box in the xy-plane.
+    double minY, maxY;
+    int secondChild;      ///< Index of the second child, or -1 for a leaf.
+    int firstTriangle;    ///< First entry of a leaf in nodeTriangle.
+    int numTriangles;     ///< Number of triangles of a leaf.
   };
 
   // ****************************************************************
@@ -128,22 +171,18 @@ public:
   Edge *edge;         ///< Array of edges.
   int *sequence;      ///< Order, in which the triangles must be painted with the painters algorithm.
 
-  // Information about the tiles ************************************
-
-  Tile tile[MAX_TILES_X][MAX_TILES_Y];    ///< 2D array of tiles
-  double leftBorder;    ///< Left border of the surface bounding box.
-  double rightBorder;   ///< Right border of the surface bounding box.
-  double topBorder;     ///< Top border of the surface bounding box.
-  double bottomBorder;  ///< Bottom border of the surface bounding box.
+  // The bounding box tree (set by prepareIntersections()) ***********
 
-  double tileWidth;     ///< With of a tile.
-  double tileHeight;    ///< Height of a tile.
-  int numTilesX;        ///< Number of tiles in x-direction
-  int numTilesY;        ///< Number of tiles in y-direction
+  std::vector<BoundingBoxNode> boundingBoxNode;
+  std::vector<int> nodeTriangle;  ///< Triangle indices of the leaves.
 
   /// The angle that separates between smooth shading and an edge
   double creaseAngle_deg; 
 
+  /// The intersection state used by the intersection functions without
+  /// an explicit state.
+  IntersectionState intersectionState;
+
   // **************************************************************************
   // Public functions.
   // **************************************************************************
@@ -172,13 +211,13 @@ public:
   }
 
   /// Get the coordinates of the given vertex.
-  inline Point3D getVertex(int rib, int ribPoint)
+  inline Point3D getVertex(int rib, int ribPoint) const
   {
     return vertex[rib*numRibPoints + ribPoint].coord;
   }
 
   /// Get the coordinates of the given vertex.
-  inline void getVertex(int rib, int ribPoint, double &x, double &y, double &z)
+  inline void getVertex(int rib, int ribPoint, double &x, double &y, double &z) const
   {
     int adr = rib*numRibPoints + ribPoint;
     x = vertex[adr].coord.x;
@@ -206,18 +245,28 @@ public:
   // New !
   // ****************************************************************
 
-  // Assign the triangles to the tiles.
+  // Builds or refits the bounding box tree of the triangles.
   void prepareIntersections();
   
   // Prepare the intersection for an individual intersection line.
   void prepareIntersection(Point2D Q, Point2D v);
+  void prepareIntersection(Point2D Q, Point2D v, IntersectionState &state);
 
   // Returns a list with potentially interesected triangles. This
   // function must be called after prepareIntersections().
   bool getTriangleList(int *indexList, int &numEntries, int MAX_ENTRIES);
+  bool getTriangleList(int *indexList, int &numEntries, int MAX_ENTRIES, 
+    const IntersectionState &state);
 
   // Returns the intersection data for a single triangle.
   bool getTriangleIntersection(int index, Point2D &P0, Point2D &P1, Point2D &n);
+  bool getTriangleIntersection(int index, Point2D &P0, Point2D &P1, Point2D &n,
+    IntersectionState &state);
+
+  // Returns the intersection data for all triangles in a list (from
+  // getTriangleList()) at once.
+  void getTriangleIntersections(const int *indexList, int numEntries, 
+    TriangleIntersection *result, IntersectionState &state);
 
   void appendToFile(std::ofstream &file);
   void readFromFile(std::ifstream &file, bool initialize);
@@ -227,13 +276,23 @@ public:
   // **************************************************************************
 
 private:
-  Point2D linePoint;        ///< Origin of the intersecting plane/line (in the xy-plane).
-  Point2D leftLinePoint;    ///< The line origin moved to the left (with resprect to the line) by a tiny amount.
-  Point2D rightLinePoint;   ///< The line origin moved to the right (with resprect to the line) by a tiny amount.
-  Point2D lineVector;       ///< Normalized vector specifying the direction of the intersecting line.
+  // The vertices and triangles as structure of arrays for the 
+  // SurfaceKernels (set by prepareIntersections()).
+  std::vector<double> vertexX;
+  std::vector<double> vertexY;
+  std::vector<double> vertexZ;
+  std::vector<double> triangleNormalX;    // Not normalized
+  std::vector<double> triangleNormalY;
+  std::vector<double> triangleNormalZ;
+  std::vector<int> triangleVertex[3];     // The corners of each triangle
+  std::vector<int> triangleEdgeStart[3];  // First vertex of each edge
+  std::vector<int> triangleEdgeEnd[3];    // Second vertex of each edge
 
   void quickSort(int firstIndex, int lastIndex);
-  bool getEdgeIntersection(int edgeIndex);
+  int buildBoundingBoxTree(int firstEntry, int numEntries, 
+    const double *centroidX, const double *centroidY);
+  void refitBoundingBoxTree();
+  bool getEdgeIntersection(int edgeIndex, IntersectionState &state);
 };
 
 // ****************************************************************************
@@ -0,0 +1,530 @@
+// ****************************************************************************
+// Benchmark of the search for the triangles of a surface that may be cut by
+// a cross-section plane: the bounding box tree of Surface, which is refitted
+// per frame, against the uniform tile grid (0.5 cm tiles) that Surface used
+// before. The tile grid is reproduced here as it was.
+// For a sequence of random vocal tract shapes, the profile surfaces are cut
+// at all center line points, as in VocalTract::getCrossProfiles():
+// - Preparation per frame: Surface::prepareIntersections() (the arrays for
+//   the SurfaceKernels and the refit of the tree) against the arrays and the
+//   filling of the tiles, as in the former Surface::prepareIntersections().
+// - Queries per frame: the candidate list and the intersection tests of
+//   Surface::getTriangleIntersections() for all planes.
+// Both methods must find the same intersected triangles. The times are in
+// us per frame (for each frame the fastest of several runs).
+//
+// Usage: SurfaceIndexBenchmark <speaker file> [numShapes]
+// ****************************************************************************
+
+#include "SpeakerModel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+static const int NUM_PROFILE_SURFACES = 10;
+static const int PROFILE_SURFACE[NUM_PROFILE_SURFACES] =
+{
+  VocalTract::UPPER_COVER,
+  VocalTract::UPPER_TEETH,
+  VocalTract::UPPER_LIP,
+  VocalTract::UVULA,
+  VocalTract::LOWER_COVER,
+  VocalTract::LOWER_TEETH,
+  VocalTract::LOWER_LIP,
+  VocalTract::EPIGLOTTIS,
+  VocalTract::LEFT_COVER,
+  VocalTract::RADIATION
+};
+
+// The same as in VocalTract::getCrossProfiles().
+static const int MAX_LIST_ENTRIES = 1024;
+// The fastest of this number of runs is taken for each frame.
+static const int NUM_TRIALS = 5;
+
+enum SearchMethod
+{
+  TILE_GRID,
+  BOUNDING_BOX_TREE,
+  NUM_METHODS
+};
+
+static const char *METHOD_NAMES[NUM_METHODS] =
+{
+  "tile grid",
+  "bounding box tree"
+};
+
+
+// ****************************************************************************
+/// The former tile grid of Surface. Each tile contains all triangles whose
+/// bounding box (plus 1 mm) overlaps the tile, and the tiles along the line
+/// of a plane are collected in the candidate list.
+// ****************************************************************************
+
+class TileGrid
+{
+public:
+  static const int MAX_TILES_X = 15;
+  static const int MAX_TILES_Y = 15;
+  static const int MAX_TILE_TRIANGLES = 150000 / (MAX_TILES_X*MAX_TILES_Y);
+
+  TileGrid();
+  void fill(const Surface &s);
+  bool getTriangleList(Point2D Q, Point2D v, int *indexList, int &numEntries, int MAX_ENTRIES);
+
+private:
+  struct Tile
+  {
+    int numTriangles;
+    int triangle[MAX_TILE_TRIANGLES];
+  };
+
+  vector<Tile> tile;    // Tile (x, y) is at x*MAX_TILES_Y + y.
+  // Copies of the arrays that Surface::prepareIntersections() creates for
+  // the SurfaceKernels.
+  vector<double> vertexCoord[3];
+  vector<double> triangleNormal[3];
+  vector<int> triangleVertex[3];
+  vector<int> triangleEdgeStart[3];
+  vector<int> triangleEdgeEnd[3];
+  double leftBorder;
+  double rightBorder;
+  double topBorder;
+  double bottomBorder;
+  double tileWidth;
+  double tileHeight;
+  int numTilesX;
+  int numTilesY;
+
+  bool addTile(int tileX, int tileY, int *&indexList, int &numEntries, int MAX_ENTRIES);
+};
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+TileGrid::TileGrid() : tile(MAX_TILES_X * MAX_TILES_Y)
+{
+  numTilesX = 0;
+  numTilesY = 0;
+}
+
+
+// ****************************************************************************
+/// Creates the arrays for the SurfaceKernels and assigns the triangles of
+/// the surface to the tiles.
+// ****************************************************************************
+
+void TileGrid::fill(const Surface &s)
+{
+  const double STANDARD_TILE_WIDTH = 0.5;
+  const double STANDARD_TILE_HEIGHT = 0.5;
+  const double EXTREME = 1000000.0;
+  const double EPSILON = 0.1;
+  double minX, maxX, minY, maxY;
+  int leftTile, rightTile, bottomTile, topTile;
+  int i, x, y;
+  Point3D P, normal;
+
+  for (x = 0; x < 3; x++)
+  {
+    vertexCoord[x].resize(s.numVertices);
+    triangleNormal[x].resize(s.numTriangles);
+    triangleVertex[x].resize(s.numTriangles);
+    triangleEdgeStart[x].resize(s.numTriangles);
+    triangleEdgeEnd[x].resize(s.numTriangles);
+  }
+
+  for (i = 0; i < s.numVertices; i++)
+  {
+    vertexCoord[0][i] = s.vertex[i].coord.x;
+    vertexCoord[1][i] = s.vertex[i].coord.y;
+    vertexCoord[2][i] = s.vertex[i].coord.z;
+  }
+
+  for (i = 0; i < s.numTriangles; i++)
+  {
+    const Surface::Triangle &tri = s.triangle[i];
+    normal = crossProduct(s.vertex[tri.vertex[1]].coord - s.vertex[tri.vertex[0]].coord,
+      s.vertex[tri.vertex[2]].coord - s.vertex[tri.vertex[0]].coord);
+    triangleNormal[0][i] = normal.x;
+    triangleNormal[1][i] = normal.y;
+    triangleNormal[2][i] = normal.z;
+
+    for (x = 0; x < 3; x++)
+    {
+      triangleVertex[x][i] = tri.vertex[x];
+      triangleEdgeStart[x][i] = s.edge[tri.edge[x]].vertex[0];
+      triangleEdgeEnd[x][i] = s.edge[tri.edge[x]].vertex[1];
+    }
+  }
+
+  leftBorder = EXTREME;
+  rightBorder = -EXTREME;
+  bottomBorder = EXTREME;
+  topBorder = -EXTREME;
+
+  for (i = 0; i < s.numVertices; i++)
+  {
+    P = s.vertex[i].coord;
+    if (P.x < leftBorder)   { leftBorder = P.x; }
+    if (P.x > rightBorder)  { rightBorder = P.x; }
+    if (P.y < bottomBorder) { bottomBorder = P.y; }
+    if (P.y > topBorder)    { topBorder = P.y; }
+  }
+
+  leftBorder -= EPSILON;
+  bottomBorder -= EPSILON;
+  rightBorder += EPSILON;
+  topBorder += EPSILON;
+
+  numTilesX = (int)((rightBorder - leftBorder) / STANDARD_TILE_WIDTH) + 1;
+  numTilesY = (int)((topBorder - bottomBorder) / STANDARD_TILE_HEIGHT) + 1;
+
+  if (numTilesX < 1) { numTilesX = 1; }
+  if (numTilesY < 1) { numTilesY = 1; }
+  if (numTilesX > MAX_TILES_X) { numTilesX = MAX_TILES_X; }
+  if (numTilesY > MAX_TILES_Y) { numTilesY = MAX_TILES_Y; }
+
+  tileWidth = (rightBorder - leftBorder) / (double)numTilesX;
+  tileHeight = (topBorder - bottomBorder) / (double)numTilesY;
+
+  for (i = 0; i < MAX_TILES_X * MAX_TILES_Y; i++)
+  {
+    tile[i].numTriangles = 0;
+  }
+
+  for (i = 0; i < s.numTriangles; i++)
+  {
+    minX = minY = EXTREME;
+    maxX = maxY = -EXTREME;
+
+    for (x = 0; x < 3; x++)
+    {
+      P = s.vertex[s.triangle[i].vertex[x]].coord;
+      if (P.x < minX) { minX = P.x; }
+      if (P.x > maxX) { maxX = P.x; }
+      if (P.y < minY) { minY = P.y; }
+      if (P.y > maxY) { maxY = P.y; }
+    }
+
+    leftTile   = (int)((minX - EPSILON - leftBorder) / tileWidth);
+    rightTile  = (int)((maxX + EPSILON - leftBorder) / tileWidth);
+    bottomTile = (int)((minY - EPSILON - bottomBorder) / tileHeight);
+    topTile    = (int)((maxY + EPSILON - bottomBorder) / tileHeight);
+
+    leftTile = max(0, min(leftTile, numTilesX - 1));
+    rightTile = max(0, min(rightTile, numTilesX - 1));
+    bottomTile = max(0, min(bottomTile, numTilesY - 1));
+    topTile = max(0, min(topTile, numTilesY - 1));
+
+    for (x = leftTile; x <= rightTile; x++)
+    {
+      for (y = bottomTile; y <= topTile; y++)
+      {
+        Tile &t = tile[x*MAX_TILES_Y + y];
+        if (t.numTriangles < MAX_TILE_TRIANGLES)
+        {
+          t.triangle[t.numTriangles++] = i;
+        }
+      }
+    }
+  }
+}
+
+
+// ****************************************************************************
+/// Appends the triangles of the tile (if it exists) to the list.
+// ****************************************************************************
+
+inline bool TileGrid::addTile(int tileX, int tileY, int *&indexList, int &numEntries,
+  int MAX_ENTRIES)
+{
+  if ((tileX < 0) || (tileX >= numTilesX) || (tileY < 0) || (tileY >= numTilesY))
+  {
+    return true;
+  }
+
+  const Tile &t = tile[tileX*MAX_TILES_Y + tileY];
+  if (numEntries + t.numTriangles > MAX_ENTRIES)
+  {
+    return false;
+  }
+  for (int i = 0; i < t.numTriangles; i++)
+  {
+    *indexList++ = t.triangle[i];
+  }
+  numEntries += t.numTriangles;
+  return true;
+}
+
+
+// ****************************************************************************
+/// Collects the triangles of all tiles along the line Q + t*v (v normalized).
+/// Triangles may occur multiple times in the list.
+// ****************************************************************************
+
+bool TileGrid::getTriangleList(Point2D Q, Point2D v, int *indexList, int &numEntries,
+  int MAX_ENTRIES)
+{
+  double x, y, delta, nextBorder;
+  int tileX, tileY;
+
+  numEntries = 0;
+
+  if (fabs(v.y) <= fabs(v.x)*tileHeight / tileWidth)
+  {
+    // A rather horizontal line, directed to the right.
+    if (v.x < 0.0) { v = -1.0 * v; }
+
+    y = Q.y + (leftBorder - Q.x)*v.y / v.x;
+    delta = v.y*tileWidth / v.x;
+    tileY = (int)((y - bottomBorder) / tileHeight);
+    nextBorder = bottomBorder + (double)(v.y > 0.0 ? tileY + 1 : tileY)*tileHeight;
+
+    for (tileX = 0; tileX < numTilesX; tileX++)
+    {
+      if (!addTile(tileX, tileY, indexList, numEntries, MAX_ENTRIES)) { return false; }
+
+      if ((v.y > 0.0) && (y + delta > nextBorder))
+      {
+        tileY++;
+        nextBorder += tileHeight;
+        if (!addTile(tileX, tileY, indexList, numEntries, MAX_ENTRIES)) { return false; }
+      }
+      else
+      if ((v.y <= 0.0) && (y + delta < nextBorder))
+      {
+        tileY--;
+        nextBorder -= tileHeight;
+        if (!addTile(tileX, tileY, indexList, numEntries, MAX_ENTRIES)) { return false; }
+      }
+      y += delta;
+    }
+  }
+  else
+  {
+    // A rather vertical line, directed upwards.
+    if (v.y < 0.0) { v = -1.0 * v; }
+
+    x = Q.x + (bottomBorder - Q.y)*v.x / v.y;
+    delta = v.x*tileHeight / v.y;
+    tileX = (int)((x - leftBorder) / tileWidth);
+    nextBorder = leftBorder + (double)(v.x > 0.0 ? tileX + 1 : tileX)*tileWidth;
+
+    for (tileY = 0; tileY < numTilesY; tileY++)
+    {
+      if (!addTile(tileX, tileY, indexList, numEntries, MAX_ENTRIES)) { return false; }
+
+      if ((v.x > 0.0) && (x + delta > nextBorder))
+      {
+        tileX++;
+        nextBorder += tileWidth;
+        if (!addTile(tileX, tileY, indexList, numEntries, MAX_ENTRIES)) { return false; }
+      }
+      else
+      if ((v.x <= 0.0) && (x + delta < nextBorder))
+      {
+        tileX--;
+        nextBorder -= tileWidth;
+        if (!addTile(tileX, tileY, indexList, numEntries, MAX_ENTRIES)) { return false; }
+      }
+      x += delta;
+    }
+  }
+
+  return true;
+}
+
+
+// ****************************************************************************
+/// Times the preparation of the surfaces for the current shape of the vocal
+/// tract in us.
+// ****************************************************************************
+
+static double prepare(SearchMethod method, VocalTract &tract, vector<TileGrid> &grid)
+{
+  int k;
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for (k = 0; k < NUM_PROFILE_SURFACES; k++)
+  {
+    Surface &s = tract.surface[PROFILE_SURFACE[k]];
+    if (method == TILE_GRID)
+    {
+      grid[k].fill(s);
+    }
+    else
+    {
+      s.prepareIntersections();
+    }
+  }
+
+  return 1e-3 * chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start).count();
+}
+
+
+// ****************************************************************************
+/// Cuts the prepared surfaces at all center line points and returns the
+/// time in us. When intersected is not NULL, it receives the sorted indices
+/// of the intersected triangles per plane and surface.
+// ****************************************************************************
+
+static double query(SearchMethod method, VocalTract &tract, vector<TileGrid> &grid,
+  long &numCandidates, vector< vector<int> > *intersected)
+{
+  static int indexList[MAX_LIST_ENTRIES];
+  static Surface::TriangleIntersection result[MAX_LIST_ENTRIES];
+  Surface::IntersectionState state;
+  int numEntries;
+  int i, k, n;
+
+  numCandidates = 0;
+  if (intersected != NULL) { intersected->clear(); }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for (i = 0; i < VocalTract::NUM_CENTERLINE_POINTS; i++)
+  {
+    Point2D P = tract.centerLine[i].point;
+    Point2D v = tract.centerLine[i].normal;
+
+    for (k = 0; k < NUM_PROFILE_SURFACES; k++)
+    {
+      Surface &s = tract.surface[PROFILE_SURFACE[k]];
+      s.prepareIntersection(P, v, state);
+      if (method == TILE_GRID)
+      {
+        grid[k].getTriangleList(state.linePoint, state.lineVector, indexList, numEntries,
+          MAX_LIST_ENTRIES);
+      }
+      else
+      {
+        s.getTriangleList(indexList, numEntries, MAX_LIST_ENTRIES, state);
+      }
+      s.getTriangleIntersections(indexList, numEntries, result, state);
+      numCandidates += numEntries;
+
+      if (intersected != NULL)
+      {
+        vector<int> list;
+        for (n = 0; n < numEntries; n++)
+        {
+          if (result[n].isIntersected) { list.push_back(indexList[n]); }
+        }
+        sort(list.begin(), list.end());
+        list.erase(unique(list.begin(), list.end()), list.end());
+        intersected->push_back(list);
+      }
+    }
+  }
+
+  return 1e-3 * chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start).count();
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s <speaker file> [numShapes]\n", argv[0]);
+    return 1;
+  }
+
+  int numShapes = (argc > 2) ? atoi(argv[2]) : 50;
+  if (numShapes < 1) { numShapes = 1; }
+
+  shared_ptr<const SpeakerModel> speaker = SpeakerModel::load(argv[1]);
+  if (!speaker)
+  {
+    printf("Error: The speaker file could not be loaded.\n");
+    return 1;
+  }
+
+  unique_ptr<VocalTract> tract(speaker->createVocalTract());
+  vector<TileGrid> grid(NUM_PROFILE_SURFACES);
+  vector< vector<int> > intersected[NUM_METHODS];
+  double prepare_us[NUM_METHODS] = { 0.0, 0.0 };
+  double query_us[NUM_METHODS] = { 0.0, 0.0 };
+  long numCandidates[NUM_METHODS] = { 0, 0 };
+  long numIntersected = 0;
+  long numMismatches = 0;
+  long n;
+  double min, max, t, best;
+  int i, k, method, trial;
+
+  srand(1);
+  for (i = 0; i < numShapes; i++)
+  {
+    // A random shape in the middle part of the parameter ranges.
+    for (k = 0; k < VocalTract::NUM_PARAMS; k++)
+    {
+      min = tract->param[k].min;
+      max = tract->param[k].max;
+      tract->param[k].x = min + (0.25 + 0.5 * rand() / (double)RAND_MAX) * (max - min);
+    }
+    tract->calculateAll();
+
+    // The tiles are prepared first, because getTriangleIntersections()
+    // needs the arrays of prepareIntersections() for both methods.
+    for (method = NUM_METHODS - 1; method >= 0; method--)
+    {
+      best = 0.0;
+      for (trial = 0; trial < NUM_TRIALS; trial++)
+      {
+        t = prepare((SearchMethod)method, *tract, grid);
+        if ((trial == 0) || (t < best)) { best = t; }
+      }
+      prepare_us[method] += best;
+
+      query((SearchMethod)method, *tract, grid, n, &intersected[method]);
+      numCandidates[method] += n;
+
+      best = 0.0;
+      for (trial = 0; trial < NUM_TRIALS; trial++)
+      {
+        t = query((SearchMethod)method, *tract, grid, n, NULL);
+        if ((trial == 0) || (t < best)) { best = t; }
+      }
+      query_us[method] += best;
+    }
+
+    for (k = 0; k < (int)intersected[0].size(); k++)
+    {
+      numIntersected += intersected[0][k].size();
+      if (intersected[0][k] != intersected[1][k]) { numMismatches++; }
+    }
+  }
+
+  const double numPlanes = (double)numShapes * VocalTract::NUM_CENTERLINE_POINTS;
+
+  printf("%d shapes, %d planes per shape, %d surfaces.\n", numShapes,
+    VocalTract::NUM_CENTERLINE_POINTS, NUM_PROFILE_SURFACES);
+  printf("Intersected triangles per plane: %.1f\n", numIntersected / numPlanes);
+  for (method = 0; method < NUM_METHODS; method++)
+  {
+    printf("%-18s candidates per plane %7.1f, preparation %7.1f us, queries %7.1f us per frame\n",
+      METHOD_NAMES[method], numCandidates[method] / numPlanes,
+      prepare_us[method] / numShapes, query_us[method] / numShapes);
+  }
+
+  if (numMismatches > 0)
+  {
+    printf("Error: The intersected triangles differ for %ld planes.\n", numMismatches);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,292 @@
+#include "SurfaceKernels.h"
+#include "TdsKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define SURFACE_KERNELS_X86_64
+  #include <immintrin.h>
+  #if defined(_MSC_VER)
+    #define TARGET_AVX2
+  #else
+    #define TARGET_AVX2 __attribute__((target("avx2")))
+  #endif
+#endif
+
+// The tolerance for the position of an intersection point on an edge (as in
+// Surface::getEdgeIntersection()).
+static const double EPSILON = 0.000001;
+
+
+// ****************************************************************************
+/// Takes the intersection line of a triangle from the intersection points of
+/// its edges (bit j of edgeMask is set for an intersection of edge j) in the
+/// same way as Surface::getTriangleIntersection().
+// ****************************************************************************
+
+static inline void finishTriangle(int edgeMask, const double *qx, const double *qy,
+  double nx, double ny, Surface::TriangleIntersection &result)
+{
+  Point2D Q[3];
+  int numIntersections = 0;
+  int j;
+
+  // Collect the intersection points without branches, because the edges
+  // are intersected in an unpredictable way.
+  for (j = 0; j < 3; j++)
+  {
+    Q[numIntersections] = Point2D(qx[j], qy[j]);
+    numIntersections+= (edgeMask >> j) & 1;
+  }
+
+  if (numIntersections < 2)
+  {
+    result.isIntersected = false;
+    return;
+  }
+
+  result.isIntersected = true;
+  result.n.x = nx;
+  result.n.y = ny;
+
+  if (numIntersections == 2)
+  {
+    result.P0 = Q[0];
+    result.P1 = Q[1];
+    return;
+  }
+
+  // numIntersections > 2: Take the longest line.
+
+  double l[3];
+  l[0] = (Q[0]-Q[1]).squareMagnitude();
+  l[1] = (Q[1]-Q[2]).squareMagnitude();
+  l[2] = (Q[2]-Q[0]).squareMagnitude();
+
+  if ((l[0] >= l[1]) && (l[0] >= l[2]))
+  {
+    result.P0 = Q[0];
+    result.P1 = Q[1];
+  }
+  else
+  {
+    if (l[1] >= l[2])
+    {
+      result.P0 = Q[1];
+      result.P1 = Q[2];
+    }
+    else
+    {
+      result.P0 = Q[2];
+      result.P1 = Q[0];
+    }
+  }
+}
+
+
+// ****************************************************************************
+/// Intersects the edges of the triangle t with the intersecting line (as
+/// Surface::getEdgeIntersection()).
+// ****************************************************************************
+
+static inline void intersectTriangle(int t, const SurfaceKernels::Mesh &m,
+  const int *vertexSide, const Surface::IntersectionState &s,
+  Surface::TriangleIntersection &result)
+{
+  const double lx = s.lineVector.x;
+  const double ly = s.lineVector.y;
+  int j, a, b;
+  int edgeMask = 0;
+  double ux, uy, uz;
+  double rx, ry, rz;
+  double d, denominator;
+  double qx[3], qy[3];
+
+  for (j = 0; j < 3; j++)
+  {
+    a = m.edgeStart[j][t];
+    b = m.edgeEnd[j][t];
+
+    if (((vertexSide[a] >= 0) && (vertexSide[b] <= 0)) || ((vertexSide[a] <= 0) && (vertexSide[b] >= 0)))
+    {
+      // The edge is X = A + t*u.
+      ux = m.x[b] - m.x[a];
+      uy = m.y[b] - m.y[a];
+      uz = m.z[b] - m.z[a];
+
+      rx = m.x[a] - s.linePoint.x;
+      ry = m.y[a] - s.linePoint.y;
+      rz = m.z[a];
+
+      denominator = -ux*ly + uy*lx;
+      if (denominator != 0.0)
+      {
+        d = (-lx*ry + ly*rx) / denominator;
+        if ((d >= -EPSILON) && (d < 1.0+EPSILON))
+        {
+          edgeMask |= 1 << j;
+          qx[j] = (lx*(uy*rz - uz*ry) + ly*(uz*rx - ux*rz)) / denominator;
+          qy[j] = (-ux*ry + uy*rx) / denominator;
+        }
+      }
+    }
+  }
+
+  finishTriangle(edgeMask, qx, qy, m.normalZ[t], m.normalX[t]*lx + m.normalY[t]*ly, result);
+}
+
+
+// ****************************************************************************
+// Scalar kernels. These are the reference for the vectorized versions and
+// also process the remaining vertices at the end of the arrays.
+// ****************************************************************************
+
+static void getVertexSidesScalar(int n, const double *x, const double *y,
+  const Surface::IntersectionState &s, int *side)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    side[i] = 0;
+    if ((x[i] - s.leftLinePoint.x)*s.lineVector.y - (y[i] - s.leftLinePoint.y)*s.lineVector.x < 0.0)
+    {
+      side[i] = -1;
+    }
+    if ((x[i] - s.rightLinePoint.x)*s.lineVector.y - (y[i] - s.rightLinePoint.y)*s.lineVector.x > 0.0)
+    {
+      side[i] = 1;
+    }
+  }
+}
+
+
+#ifdef SURFACE_KERNELS_X86_64
+
+// ****************************************************************************
+// SSE2 kernel (2 vertices at a time). SSE2 is part of every x86-64 CPU.
+// ****************************************************************************
+
+static void getVertexSidesSse2(int n, const double *x, const double *y,
+  const Surface::IntersectionState &s, int *side)
+{
+  const __m128d lx = _mm_set1_pd(s.lineVector.x);
+  const __m128d ly = _mm_set1_pd(s.lineVector.y);
+  const __m128d leftX = _mm_set1_pd(s.leftLinePoint.x);
+  const __m128d leftY = _mm_set1_pd(s.leftLinePoint.y);
+  const __m128d rightX = _mm_set1_pd(s.rightLinePoint.x);
+  const __m128d rightY = _mm_set1_pd(s.rightLinePoint.y);
+  const __m128d zero = _mm_setzero_pd();
+  int i, left, right;
+
+  for (i = 0; i + 2 <= n; i += 2)
+  {
+    __m128d X = _mm_loadu_pd(x + i);
+    __m128d Y = _mm_loadu_pd(y + i);
+
+    left = _mm_movemask_pd(_mm_cmplt_pd(_mm_sub_pd(_mm_mul_pd(_mm_sub_pd(X, leftX), ly),
+      _mm_mul_pd(_mm_sub_pd(Y, leftY), lx)), zero));
+    right = _mm_movemask_pd(_mm_cmpgt_pd(_mm_sub_pd(_mm_mul_pd(_mm_sub_pd(X, rightX), ly),
+      _mm_mul_pd(_mm_sub_pd(Y, rightY), lx)), zero));
+
+    // +1 for the right side has priority over -1 for the left side.
+    left&= ~right;
+    side[i]     = (right & 1) - (left & 1);
+    side[i + 1] = ((right >> 1) & 1) - ((left >> 1) & 1);
+  }
+
+  getVertexSidesScalar(n - i, x + i, y + i, s, side + i);
+}
+
+
+// ****************************************************************************
+// AVX2 kernel (4 vertices at a time). The same as the SSE2 kernel with wider
+// vectors.
+// ****************************************************************************
+
+TARGET_AVX2 static void getVertexSidesAvx2(int n, const double *x, const double *y,
+  const Surface::IntersectionState &s, int *side)
+{
+  const __m256d lx = _mm256_set1_pd(s.lineVector.x);
+  const __m256d ly = _mm256_set1_pd(s.lineVector.y);
+  const __m256d leftX = _mm256_set1_pd(s.leftLinePoint.x);
+  const __m256d leftY = _mm256_set1_pd(s.leftLinePoint.y);
+  const __m256d rightX = _mm256_set1_pd(s.rightLinePoint.x);
+  const __m256d rightY = _mm256_set1_pd(s.rightLinePoint.y);
+  const __m256d zero = _mm256_setzero_pd();
+  int i, k, left, right;
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m256d X = _mm256_loadu_pd(x + i);
+    __m256d Y = _mm256_loadu_pd(y + i);
+
+    left = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(X, leftX), ly),
+      _mm256_mul_pd(_mm256_sub_pd(Y, leftY), lx)), zero, _CMP_LT_OQ));
+    right = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(X, rightX), ly),
+      _mm256_mul_pd(_mm256_sub_pd(Y, rightY), lx)), zero, _CMP_GT_OQ));
+
+    left&= ~right;
+    for (k = 0; k < 4; k++)
+    {
+      side[i + k] = ((right >> k) & 1) - ((left >> k) & 1);
+    }
+  }
+
+  // Avoid the penalty for mixing AVX and SSE code in the scalar code.
+  _mm256_zeroupper();
+
+  getVertexSidesScalar(n - i, x + i, y + i, s, side + i);
+}
+
+#endif
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+void SurfaceKernels::getVertexSides(int n, const double *x, const double *y,
+  const Surface::IntersectionState &state, int *side)
+{
+#ifdef SURFACE_KERNELS_X86_64
+  const TdsKernels::InstructionSet set = TdsKernels::getInstructionSet();
+  if (set == TdsKernels::AVX2)
+  {
+    getVertexSidesAvx2(n, x, y, state, side);
+    return;
+  }
+  if (set == TdsKernels::SSE2)
+  {
+    getVertexSidesSse2(n, x, y, state, side);
+    return;
+  }
+#endif
+  getVertexSidesScalar(n, x, y, state, side);
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+void SurfaceKernels::intersectTriangles(int n, const int *triangleIndex, const Mesh &mesh,
+  const int *vertexSide, const Surface::IntersectionState &state,
+  Surface::TriangleIntersection *result)
+{
+  int i, t;
+
+  for (i = 0; i < n; i++)
+  {
+    t = triangleIndex[i];
+
+    // Skip the triangles with all corners on the same side of the line.
+    if ((vertexSide[mesh.vertex[0][t]] + vertexSide[mesh.vertex[1][t]] +
+      vertexSide[mesh.vertex[2][t]] == -3) ||
+      (vertexSide[mesh.vertex[0][t]] + vertexSide[mesh.vertex[1][t]] +
+      vertexSide[mesh.vertex[2][t]] == 3))
+    {
+      result[i].isIntersected = false;
+    }
+    else
+    {
+      intersectTriangle(t, mesh, vertexSide, state, result[i]);
+    }
+  }
+}
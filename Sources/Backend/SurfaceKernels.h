@@ -0,0 +1,62 @@
+#ifndef __SURFACE_KERNELS_H__
+#define __SURFACE_KERNELS_H__
+
+#include "Surface.h"
+
+// ****************************************************************************
+/// The intersection of the triangles of a Surface with an intersecting plane
+/// (see Surface::getTriangleIntersections()), written as kernels over the
+/// vertices and triangles of the surface as structure of arrays.
+///
+/// First, the sides of all vertices with respect to the intersecting line
+/// are determined in one pass over the contiguous vertex coordinates. This
+/// kernel has a scalar, an SSE2 and an AVX2 version, which are selected
+/// together with the kernels of TdsModel (see TdsKernels::setInstructionSet()).
+/// Then the triangles with all corners on the same side are skipped, and the
+/// edges of the remaining triangles are intersected with the line. All
+/// versions evaluate exactly the same expressions as
+/// Surface::getTriangleIntersection() (without fused multiply-add), so that
+/// they give bit-identical results.
+// ****************************************************************************
+
+class SurfaceKernels
+{
+  // **************************************************************************
+  // Public data.
+  // **************************************************************************
+
+public:
+  /// The vertices and triangles of a surface as structure of arrays.
+  struct Mesh
+  {
+    const double *x;
+    const double *y;
+    const double *z;
+    const double *normalX;      ///< Triangle normals (not normalized)
+    const double *normalY;
+    const double *normalZ;
+    const int *vertex[3];       ///< Corners of the triangles
+    const int *edgeStart[3];    ///< First vertex of the edges of the triangles
+    const int *edgeEnd[3];      ///< Second vertex of the edges of the triangles
+  };
+
+  // **************************************************************************
+  // Public functions.
+  // **************************************************************************
+
+public:
+  /// Sets side[i] to -1 (left), +1 (right) or 0 (on the line) for the
+  /// position of the n vertices (x[i], y[i]) with respect to the line of the
+  /// given state.
+  static void getVertexSides(int n, const double *x, const double *y,
+    const Surface::IntersectionState &state, int *side);
+
+  /// Intersects the n triangles with the indices in triangleIndex with the
+  /// line of the given state. vertexSide must contain the sides of all
+  /// vertices of the mesh from getVertexSides().
+  static void intersectTriangles(int n, const int *triangleIndex, const Mesh &mesh,
+    const int *vertexSide, const Surface::IntersectionState &state,
+    Surface::TriangleIntersection *result);
+};
+
+#endif
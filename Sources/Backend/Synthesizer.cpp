@@ -26,6 +26,8 @@
 
 using namespace std;
 
+const double Synthesizer::MAX_OUTPUT_CUTOFF_FREQ_RATIO = 0.45;
+
 double max_audio = 0.0;
 
 
@@ -44,14 +46,17 @@ Synthesizer::Synthesizer()
   outputFlow = new double[TDS_BUFFER_LENGTH];
   outputPressure = new double[TDS_BUFFER_LENGTH];
 
-  outputPressureFilter.createChebyshev((double)SYNTHETIC_SPEECH_BANDWIDTH_HZ / (double)SAMPLING_RATE, false, 8);
-
   initialShapesSet = false;
 
   for (i = 0; i < Glottis::MAX_CONTROL_PARAMS; i++)
   {
     prevGlottisParams[i] = 0.0;
+    frameGlottisParams[i] = 0.0;
   }
+
+  frameTube = NULL;
+  frameNumSamples = 0;
+  frameSampleIndex = 0;
 }
 
 
@@ -87,9 +92,22 @@ void Synthesizer::init(Glottis *glottis, VocalTract *vocalTract, TdsModel *tdsMo
 
 void Synthesizer::reset()
 {
+  // The glottis model and the output filter follow the sampling rate
+  // of the TDS model, which may have changed since the last reset.
+  int samplingRate = tdsModel->getSamplingRate();
+  glottis->setSamplingRate(samplingRate);
+
   glottis->resetMotion();
   tdsModel->resetMotion();
 
+  // Keep the cutoff frequency below the Nyquist frequency for low
+  // sampling rates.
+  double cutoffFreq_Hz = SYNTHETIC_SPEECH_BANDWIDTH_HZ;
+  if (cutoffFreq_Hz > MAX_OUTPUT_CUTOFF_FREQ_RATIO * (double)samplingRate)
+  {
+    cutoffFreq_Hz = MAX_OUTPUT_CUTOFF_FREQ_RATIO * (double)samplingRate;
+  }
+  outputPressureFilter.createChebyshev(cutoffFreq_Hz / (double)samplingRate, false, 8);
   outputPressureFilter.resetBuffers();
 
   initialShapesSet = false;
@@ -103,6 +121,94 @@ void Synthesizer::reset()
 }
 
 
+// ****************************************************************************
+/// Returns the number of samples of a chunk of the incremental synthesis 
+/// (NUM_CHUNCK_SAMPLES at SAMPLING_RATE) for the given sampling rate.
+// ****************************************************************************
+
+int Synthesizer::getChunkSamples(int samplingRate)
+{
+  return (int)((double)NUM_CHUNCK_SAMPLES * (double)samplingRate / (double)SAMPLING_RATE + 0.5);
+}
+
+
+// ****************************************************************************
+/// Saves the complete state of the incremental synthesis after the last call
+/// of add() (or the last sample of a frame), i.e., the state of the TDS model,
+/// the glottis model, the previous shapes and the output filter. 
+/// With restoreState(), the synthesis can then be continued from this point
+/// with different frames, e.g., for a search over the continuations of an 
+/// utterance, without synthesizing the common beginning again.
+// ****************************************************************************
+
+void Synthesizer::saveState(State &state)
+{
+  int i;
+
+  tdsModel->saveMotionState(state.tdsState);
+  glottis->saveMotionState(state.glottisState);
+
+  state.prevTube = prevTube;
+  state.tube = tube;
+  for (i = 0; i < Glottis::MAX_CONTROL_PARAMS; i++)
+  {
+    state.prevGlottisParams[i] = prevGlottisParams[i];
+  }
+  state.initialShapesSet = initialShapesSet;
+
+  for (i = 0; i < TDS_BUFFER_LENGTH; i++)
+  {
+    state.outputFlow[i] = outputFlow[i];
+    state.outputPressure[i] = outputPressure[i];
+  }
+  state.outputPressureFilter = outputPressureFilter;
+}
+
+
+// ****************************************************************************
+/// Continues the synthesis from a state saved with saveState(), possibly by
+/// another synthesizer with models of the same speaker. The samples that 
+/// are generated next are exactly the same as those generated after saving
+/// the state for the same frames.
+/// Returns false (and leaves the synthesizer unchanged) if the state was 
+/// saved at another sampling rate or with another type of glottis model.
+// ****************************************************************************
+
+bool Synthesizer::restoreState(const State &state)
+{
+  int i;
+
+  if ((state.tdsState.samplingRate != tdsModel->getSamplingRate()) ||
+    (glottis->restoreMotionState(state.glottisState) == false))
+  {
+    return false;
+  }
+  tdsModel->restoreMotionState(state.tdsState);
+
+  prevTube = state.prevTube;
+  tube = state.tube;
+  for (i = 0; i < Glottis::MAX_CONTROL_PARAMS; i++)
+  {
+    prevGlottisParams[i] = state.prevGlottisParams[i];
+  }
+  initialShapesSet = state.initialShapesSet;
+
+  for (i = 0; i < TDS_BUFFER_LENGTH; i++)
+  {
+    outputFlow[i] = state.outputFlow[i];
+    outputPressure[i] = state.outputPressure[i];
+  }
+  outputPressureFilter = state.outputPressureFilter;
+
+  // A frame that was started, but not finished, is discarded.
+  frameTube = NULL;
+  frameNumSamples = 0;
+  frameSampleIndex = 0;
+
+  return true;
+}
+
+
 // ****************************************************************************
 /// Generate an incremental part of the signal with a duration of numSamples
 /// during which the vocal tract and glottis shapes are interpolated between 
@@ -116,44 +222,185 @@ void Synthesizer::reset()
 void Synthesizer::add(double *newGlottisParams, double *newTractParams, 
   int numSamples, vector<double> &audio)
 {
-  if (vocalTract == NULL)
+  audio.resize((numSamples > 0) ? numSamples : 0);
+  int numWritten = add(newGlottisParams, newTractParams, numSamples, audio.data());
+  audio.resize(numWritten);
+}
+
+
+// ****************************************************************************
+/// Generate an incremental part of the signal with a duration of numSamples
+/// during which the tube and glottis shapes are interpolated between 
+/// the previous shapes (passed to the previous call of this function) and the 
+/// given new shapes.
+/// In the first call of this function (after reset()) the states of the 
+/// glottis and tube are initialized, and no audio is generated.
+/// The value range of the generated audio samples is [-1; +1].
+// ****************************************************************************
+
+void Synthesizer::add(double *newGlottisParams, Tube *newTube, 
+  int numSamples, vector<double> &audio)
+{
+  audio.resize((numSamples > 0) ? numSamples : 0);
+  int numWritten = add(newGlottisParams, newTube, numSamples, audio.data());
+  audio.resize(numWritten);
+}
+
+
+// ****************************************************************************
+/// Same as add() above, but the samples are written into audio, which must
+/// have room for numSamples samples. Nothing is allocated here, so that a
+/// caller with a buffer for the whole signal synthesizes without any memory
+/// allocations.
+/// Returns the number of samples written (numSamples, or 0 when no samples
+/// were generated, as in the first call after reset()).
+// ****************************************************************************
+
+int Synthesizer::add(double *newGlottisParams, double *newTractParams, 
+  int numSamples, double *audio)
+{
+  int i;
+
+  // Calculates the vocal tract and its tube with the new parameters.
+  if (beginFrame(newGlottisParams, newTractParams, numSamples) == false)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < numSamples; i++)
+  {
+    audio[i] = nextSample();
+  }
+
+  return numSamples;
+}
+
+
+// ****************************************************************************
+/// Same as add() above, but with the new tube instead of vocal tract 
+/// parameters.
+// ****************************************************************************
+
+int Synthesizer::add(double *newGlottisParams, Tube *newTube, 
+  int numSamples, double *audio)
+{
+  int i;
+
+  if (beginFrame(newGlottisParams, newTube, numSamples) == false)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < numSamples; i++)
   {
-    return;
+    audio[i] = nextSample();
   }
 
-  static Tube tube;
+  return numSamples;
+}
+
+
+// ****************************************************************************
+/// Same as add() above, but with samples in single precision.
+// ****************************************************************************
+
+int Synthesizer::add(double *newGlottisParams, double *newTractParams, 
+  int numSamples, float *audio)
+{
   int i;
 
-  // Calculate the vocal tract with the new parameters.
+  if (beginFrame(newGlottisParams, newTractParams, numSamples) == false)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < numSamples; i++)
+  {
+    audio[i] = (float)nextSample();
+  }
+
+  return numSamples;
+}
+
+
+// ****************************************************************************
+/// Same as add() above, but with samples in single precision.
+// ****************************************************************************
+
+int Synthesizer::add(double *newGlottisParams, Tube *newTube, 
+  int numSamples, float *audio)
+{
+  int i;
+
+  if (beginFrame(newGlottisParams, newTube, numSamples) == false)
+  {
+    return 0;
+  }
 
+  for (i = 0; i < numSamples; i++)
+  {
+    audio[i] = (float)nextSample();
+  }
+
+  return numSamples;
+}
+
+
+// ****************************************************************************
+/// Generates the next sample of the current frame (see beginFrame()).
+// ****************************************************************************
+
+double Synthesizer::nextSample()
+{
+  double mouthFlow_cm3_s;
+  double nostrilFlow_cm3_s;
+  double skinFlow_cm3_s;
+
+  prepareSample();
+  return finishSample(tdsModel->proceedTimeStep(mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s));
+}
+
+
+// ****************************************************************************
+/// Same as beginFrame() below, but the new tube is calculated from the given
+/// vocal tract parameters (as in add()).
+// ****************************************************************************
+
+bool Synthesizer::beginFrame(double *newGlottisParams, double *newTractParams, 
+  int numSamples)
+{
+  if (vocalTract == NULL)
+  {
+    return false;
+  }
+
+  int i;
   for (i = 0; i < VocalTract::NUM_PARAMS; i++)
   {
     vocalTract->param[i].x = newTractParams[i];
   }
-  vocalTract->calculateAll();
+  vocalTract->calculateTube(&tractTube);
 
-  // Transform the vocal tract model into a tube.
-  vocalTract->getTube(&tube);
-
-  // Synthesize the new audio samples based on the tube model.
-  add(newGlottisParams, &tube, numSamples, audio);
+  return beginFrame(newGlottisParams, &tractTube, numSamples);
 }
 
 
 // ****************************************************************************
-/// Generate an incremental part of the signal with a duration of numSamples
-/// during which the tube and glottis shapes are interpolated between 
-/// the previous shapes (passed to the previous call of this function) and the 
-/// given new shapes.
-/// In the first call of this function (after reset()) the states of the 
-/// glottis and tube are initialized, and no audio is generated.
-/// The value range of the generated audio samples is [-1; +1].
+/// Starts an incremental part of the signal with numSamples samples towards
+/// the given new shapes. The samples are then generated one by one with 
+/// prepareSample(), TdsModel::proceedTimeStep() and finishSample(), as in 
+/// add(). This allows to run the time steps of several synthesizers in 
+/// lockstep (see TdsModelBatch). newTube must stay valid until the last 
+/// sample is finished.
+/// Returns false when there are no samples to generate, i.e., in the first 
+/// call after reset(), which only sets the initial shapes, or when 
+/// numSamples < 1.
 // ****************************************************************************
 
-void Synthesizer::add(double *newGlottisParams, Tube *newTube, 
-  int numSamples, vector<double> &audio)
+bool Synthesizer::beginFrame(double *newGlottisParams, Tube *newTube, 
+  int numSamples)
 {
-  int i, k;
+  int i;
 
   int numGlottisParams = (int)glottis->controlParam.size();
 
@@ -167,141 +414,135 @@ void Synthesizer::add(double *newGlottisParams, Tube *newTube,
     }
 
     initialShapesSet = true;
-    return;
+    return false;
   }
 
   // ****************************************************************
 
   if (numSamples < 1)
   {
-    return;
+    return false;
+  }
+
+  frameTube = newTube;
+  for (i = 0; i < numGlottisParams; i++)
+  {
+    frameGlottisParams[i] = newGlottisParams[i];
   }
+  frameNumSamples = numSamples;
+  frameSampleIndex = 0;
 
-  audio.resize(numSamples);
+  // The static parts of the tube are only set here, once per frame.
+  tube.prepareInterpolation(&prevTube, frameTube);
 
+  return true;
+}
+
+
+// ****************************************************************************
+/// Sets the interpolated tube and glottis shapes for the next sample of the
+/// current frame as the input of the next time step of the TDS model.
+// ****************************************************************************
+
+void Synthesizer::prepareSample()
+{
+  int k;
+  int numGlottisParams = (int)glottis->controlParam.size();
   double ratio, ratio1;
   // Lengths and areas of the glottis sections.
   double length_cm[Tube::NUM_GLOTTIS_SECTIONS];
   double area_cm2[Tube::NUM_GLOTTIS_SECTIONS];
   bool filtering;
   double pressure_dPa[4];
-  
-  // flow velocity
-  double totalFlow_cm3_s;
-  double mouthFlow_cm3_s;
-  double nostrilFlow_cm3_s;
-  double skinFlow_cm3_s;
 
+  ratio = (double)frameSampleIndex / (double)frameNumSamples;
+  ratio1 = 1.0 - ratio;
+
+  // 对vocal tract的tube和glottis在每个sample的维度上进行插值
   // ****************************************************************
-  // Run through all new samples.
+  // Interpolate the tube.
+  // 在前一帧的tube和当前帧的tube之间做插值，ratio与当前帧中的samples顺序成正比，越靠近末尾越大
   // ****************************************************************
-  
-  for (i = 0; i < numSamples; i++)
-  {
-    ratio = (double)i / (double)numSamples;
-    ratio1 = 1.0 - ratio;
-
-    // 对vocal tract的tube和glottis在每个sample的维度上进行插值
-    // ****************************************************************
-    // Interpolate the tube.
-    // 在前一帧的tube和当前帧的tube之间做插值，ratio与当前帧中的samples顺序成正比，越靠近末尾越大
-    // ****************************************************************
-  
-    tube.interpolate(&prevTube, newTube, ratio);
 
-    // ****************************************************************
-    // Interpolate the glottis geometry.
-    // 当前glottis的控制参数受上一帧和当前帧影响
-    // glottis部分似乎与pressure无关
-    // ****************************************************************
+  tube.interpolate(ratio);
 
-    for (k = 0; k < numGlottisParams; k++)
-    {
-      glottis->controlParam[k].x = ratio1 * prevGlottisParams[k] + ratio * newGlottisParams[k];
-    }
+  // ****************************************************************
+  // Interpolate the glottis geometry.
+  // 当前glottis的控制参数受上一帧和当前帧影响
+  // glottis部分似乎与pressure无关
+  // ****************************************************************
 
-    glottis->calcGeometry();
-    glottis->getTubeData(length_cm, area_cm2);
+  for (k = 0; k < numGlottisParams; k++)
+  {
+    glottis->controlParam[k].x = ratio1 * prevGlottisParams[k] + ratio * frameGlottisParams[k];
+  }
 
-    tube.setGlottisGeometry(length_cm, area_cm2);
-    tube.setAspirationStrength(glottis->getAspirationStrength_dB());
+  glottis->calcGeometry();
+  glottis->getTubeData(length_cm, area_cm2);
 
-    // ****************************************************************
-    // Do the acoustic simulation.
-    // filtering只在整个audio的第0个sample为false，应该是做一下初始化之类的工作
-    // ****************************************************************
+  tube.setGlottisGeometry(length_cm, area_cm2);
+  tube.setAspirationStrength(glottis->getAspirationStrength_dB());
 
-    if (tdsModel->getSampleIndex() == 0)
-    {
-      filtering = false;
-    }
-    else
-    {
-      filtering = true;
-    }
+  // ****************************************************************
+  // Do the acoustic simulation.
+  // filtering只在整个audio的第0个sample为false，应该是做一下初始化之类的工作
+  // ****************************************************************
 
-    tdsModel->setTube(&tube, filtering);
-    tdsModel->setFlowSource(0.0, -1);
-    tdsModel->setPressureSource(glottis->controlParam[Glottis::PRESSURE].x, Tube::FIRST_TRACHEA_SECTION);
-
-    // Get the four relevant pressure values for the glottis model:
-    // subglottal, lower glottis, upper glottis, supraglottal.
-
-    pressure_dPa[0] = tdsModel->getSectionPressure(Tube::LAST_TRACHEA_SECTION);
-    pressure_dPa[1] = tdsModel->getSectionPressure(Tube::LOWER_GLOTTIS_SECTION);
-    pressure_dPa[2] = tdsModel->getSectionPressure(Tube::UPPER_GLOTTIS_SECTION);
-    pressure_dPa[3] = tdsModel->getSectionPressure(Tube::FIRST_PHARYNX_SECTION);
-
-    // Increment the time/sample number
-    glottis->incTime(1.0 / (double)SAMPLING_RATE, pressure_dPa);
-
-    totalFlow_cm3_s = tdsModel->proceedTimeStep(mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s);
-
-    int pos = tdsModel->getSampleIndex();
-    k = pos & TDS_BUFFER_MASK;
-    outputFlow[k] = totalFlow_cm3_s;
-    outputPressure[k] = (outputFlow[k] - outputFlow[(k - 1) & TDS_BUFFER_MASK]) / tdsModel->timeStep;
-    // Scale the output to the range [-1, +1].
-    audio[i] = outputPressureFilter.getOutputSample(outputPressure[k]) * 1e-7;
-
-    // try
-    // {
-    //   if ( fabs(audio[i]) > max_audio ) { max_audio = fabs(audio[i]); }
-    //   std::cout << "pos: " << pos << "\ti: "<< i << 
-    //   "\npressure_dPa[0]: " << pressure_dPa[0] << 
-    //   "\npressure_dPa[1]: " << pressure_dPa[0] << 
-    //   "\npressure_dPa[2]: " << pressure_dPa[0] << 
-    //   "\npressure_dPa[3]: " << pressure_dPa[0] << 
-    //   "\noutputFlow[k](totalFlow_cm3_s): " << outputFlow[k] << 
-    //   "\noutputFlow[(k-1) & TDS_BUFFER_MASK]: " << outputFlow[(k-1) & TDS_BUFFER_MASK] << 
-    //   "\nmouthFLow_cm3_s: " << mouthFlow_cm3_s << 
-    //   "\nnostrilFlow_cm3_s: " << nostrilFlow_cm3_s << 
-    //   "\nskinFlow_cm3_s: " << skinFlow_cm3_s << 
-    //   "\noutputPressure: " << outputPressure[k] <<
-    //   "\naudio[i]: " << audio[i] << 
-    //   "\nmax_audio: " << max_audio << endl;
-    //   std::cout << "-----------------------------------------------------------------" << endl; 
-
-    //   if ( fabs(audio[i]) > 600 ) { getchar(); }
-
-    //   if (std::isnan(audio[i]))
-    //   {
-    //     throw -1;
-    //   }
-    // } catch(int e)
-    // {
-    //   exit(-1);
-    // }
+  if (tdsModel->getSampleIndex() == 0)
+  {
+    filtering = false;
+  }
+  else
+  {
+    filtering = true;
   }
 
-  // ****************************************************************
+  tdsModel->setTube(&tube, filtering);
+  tdsModel->setFlowSource(0.0, -1);
+  tdsModel->setPressureSource(glottis->controlParam[Glottis::PRESSURE].x, Tube::FIRST_TRACHEA_SECTION);
 
-  prevTube = *newTube;
-  for (i = 0; i < numGlottisParams; i++)
+  // Get the four relevant pressure values for the glottis model:
+  // subglottal, lower glottis, upper glottis, supraglottal.
+
+  pressure_dPa[0] = tdsModel->getSectionPressure(Tube::LAST_TRACHEA_SECTION);
+  pressure_dPa[1] = tdsModel->getSectionPressure(Tube::LOWER_GLOTTIS_SECTION);
+  pressure_dPa[2] = tdsModel->getSectionPressure(Tube::UPPER_GLOTTIS_SECTION);
+  pressure_dPa[3] = tdsModel->getSectionPressure(Tube::FIRST_PHARYNX_SECTION);
+
+  // Increment the time/sample number
+  glottis->incTime(tdsModel->timeStep, pressure_dPa);
+}
+
+
+// ****************************************************************************
+/// Takes the total radiated flow of the time step of the TDS model and 
+/// returns the next audio sample of the current frame. After the last 
+/// sample of the frame, the new shapes become the previous shapes.
+// ****************************************************************************
+
+double Synthesizer::finishSample(double totalFlow_cm3_s)
+{
+  int i;
+  int numGlottisParams = (int)glottis->controlParam.size();
+
+  int pos = tdsModel->getSampleIndex();
+  int k = pos & TDS_BUFFER_MASK;
+  outputFlow[k] = totalFlow_cm3_s;
+  outputPressure[k] = (outputFlow[k] - outputFlow[(k - 1) & TDS_BUFFER_MASK]) / tdsModel->timeStep;
+  // Scale the output to the range [-1, +1].
+  double sample = outputPressureFilter.getOutputSample(outputPressure[k]) * 1e-7;
+
+  frameSampleIndex++;
+  if (frameSampleIndex == frameNumSamples)
   {
-    prevGlottisParams[i] = newGlottisParams[i];
+    prevTube = *frameTube;
+    for (i = 0; i < numGlottisParams; i++)
+    {
+      prevGlottisParams[i] = frameGlottisParams[i];
+    }
   }
 
+  return sample;
 }
 
 // ****************************************************************************
@@ -335,13 +576,14 @@ void Synthesizer::synthesizeGesturalScore(GesturalScore *gesturalScore,
   TdsModel *tdsModel, vector<double> &audio, bool enableConsoleOutput)
 {
   int i;
-  vector<double> signalPart;
   Glottis *glottis = gesturalScore->glottis;
   VocalTract *vocalTract = gesturalScore->vocalTract;
   double tractParams[VocalTract::NUM_PARAMS];
   double glottisParams[Glottis::MAX_CONTROL_PARAMS];
-  int scoreLength_pt = gesturalScore->getDuration_pt();
-  int numChunks = (int)(scoreLength_pt / NUM_CHUNCK_SAMPLES) + 1;
+  int samplingRate = tdsModel->getSamplingRate();
+  int chunkSamples = getChunkSamples(samplingRate);
+  int scoreLength_pt = (int)(gesturalScore->getScoreDuration_s() * samplingRate);
+  int numChunks = (int)(scoreLength_pt / chunkSamples) + 1;
   double pos_s = 0.0;
 
   Synthesizer *synth = new Synthesizer();
@@ -358,11 +600,14 @@ void Synthesizer::synthesizeGesturalScore(GesturalScore *gesturalScore,
 
   // ****************************************************************
   // Generate the audio signal in small sections of about 2.5 ms 
-  // length each (= 110 samples).
+  // length each (= 110 samples at 44100 Hz).
   // ****************************************************************
 
   synth->init(glottis, vocalTract, tdsModel);
-  audio.resize(0);
+
+  // The signal has a length of numChunks chunks and is allocated at once,
+  // so that no memory is allocated during the synthesis.
+  audio.resize(numChunks * chunkSamples);
 
   if (enableConsoleOutput)
   {
@@ -371,7 +616,7 @@ void Synthesizer::synthesizeGesturalScore(GesturalScore *gesturalScore,
 
   // Get the parameters right at the beginning.
   gesturalScore->getParams(0.0, tractParams, glottisParams);
-  synth->add(glottisParams, tractParams, 0, signalPart);
+  synth->add(glottisParams, tractParams, 0, audio.data());
 
   for (i = 1; i <= numChunks; i++)
   {
@@ -380,10 +625,9 @@ void Synthesizer::synthesizeGesturalScore(GesturalScore *gesturalScore,
       printf(".");
     }
 
-    pos_s = (double)i * NUM_CHUNCK_SAMPLES / SAMPLING_RATE;
+    pos_s = (double)i * chunkSamples / samplingRate;
     gesturalScore->getParams(pos_s, tractParams, glottisParams);
-    synth->add(glottisParams, tractParams, NUM_CHUNCK_SAMPLES, signalPart);
-    audio.insert(audio.end(), signalPart.begin(), signalPart.end());
+    synth->add(glottisParams, tractParams, chunkSamples, &audio[(i - 1) * chunkSamples]);
   }
 
   if (enableConsoleOutput)
@@ -468,8 +712,8 @@ bool Synthesizer::synthesizeTubeSequence(string fileName,
   // Generate the audio signal.
   // ****************************************************************
 
-  vector<double> signalPart;
   int numGlottisParams = (int)glottis->controlParam.size();
+  int audioPos = 0;
   Tube tube;
   double incisorPos = 0.0;
   double velumOpening = 0.0;
@@ -491,7 +735,10 @@ bool Synthesizer::synthesizeTubeSequence(string fileName,
 
   Synthesizer *synth = new Synthesizer();
   synth->init(glottis, NULL, tdsModel);     // Vocal tract model is not needed here (= NULL).
-  audio.resize(0);
+
+  // All states but the first one (which only sets the initial shapes)
+  // add one chunk to the signal.
+  audio.resize((numStates > 1) ? (numStates - 1) * NUM_CHUNCK_SAMPLES : 0);
 
   for (i = 0; (i < numStates) && (stateOk); i++)
   {
@@ -528,8 +775,7 @@ bool Synthesizer::synthesizeTubeSequence(string fileName,
       tube.setPharynxMouthGeometry(tubeLength, tubeArea, tubeArticulator, incisorPos, tongueTipSideElevation);
       tube.setVelumOpening(velumOpening);
 
-      synth->add(glottisParams, &tube, NUM_CHUNCK_SAMPLES, signalPart);
-      audio.insert(audio.end(), signalPart.begin(), signalPart.end());
+      audioPos += synth->add(glottisParams, &tube, NUM_CHUNCK_SAMPLES, audio.data() + audioPos);
     }
     else
     {
@@ -551,6 +797,9 @@ bool Synthesizer::synthesizeTubeSequence(string fileName,
 
   delete synth;
 
+  // Only a corrupted file can end early.
+  audio.resize(audioPos);
+
   if (stateOk)
   {
     printf("The tube sequence was synthesized with %d states.\n", numStates);
@@ -631,17 +880,20 @@ bool Synthesizer::synthesizeTractSequence(string fileName,
   // ****************************************************************
 
   int i;
-  vector<double> signalPart;
   double tractParams[VocalTract::NUM_PARAMS];
   double glottisParams[Glottis::MAX_CONTROL_PARAMS];
   int numGlottisParams = (int)glottis->controlParam.size();
+  int audioPos = 0;
   bool glottisParamsOk = false;
   bool tractParamsOk = false;
   bool stateOk = true;
 
   Synthesizer *synth = new Synthesizer();
   synth->init(glottis, vocalTract, tdsModel);
-  audio.resize(0);
+
+  // All states but the first one (which only sets the initial shapes)
+  // add one chunk to the signal.
+  audio.resize((numStates > 1) ? (numStates - 1) * NUM_CHUNCK_SAMPLES : 0);
 
   for (i = 0; (i < numStates) && (stateOk); i++)
   {
@@ -654,8 +906,7 @@ bool Synthesizer::synthesizeTractSequence(string fileName,
     if ((glottisParamsOk) && (tractParamsOk))
     {
       stateOk = true;
-      synth->add(glottisParams, tractParams, NUM_CHUNCK_SAMPLES, signalPart);
-      audio.insert(audio.end(), signalPart.begin(), signalPart.end());
+      audioPos += synth->add(glottisParams, tractParams, NUM_CHUNCK_SAMPLES, audio.data() + audioPos);
     }
     else
     {
@@ -678,6 +929,9 @@ bool Synthesizer::synthesizeTractSequence(string fileName,
 
   delete synth;
 
+  // Only a corrupted file can end early.
+  audio.resize(audioPos);
+
   if (stateOk)
   {
     printf("The tract sequence was synthesized with %d states.\n", numStates);
@@ -702,7 +956,8 @@ void Synthesizer::synthesizeStaticPhoneme(Glottis *glottis, VocalTract *vocalTra
 {
   int i;
   Synthesizer *synth = new Synthesizer();
-  vector<double> signalPart;
+  int samplingRate = tdsModel->getSamplingRate();
+  int audioPos = 0;
 
   // ****************************************************************
   // Obtain the arrays with tract and glottis parameters.
@@ -733,8 +988,20 @@ void Synthesizer::synthesizeStaticPhoneme(Glottis *glottis, VocalTract *vocalTra
   // Generate the audio signal in three sections.
   // ****************************************************************
 
+  int rampSamples = (int)(0.005 * samplingRate);
+  int decaySamples = (int)(0.030 * samplingRate);
+  int numSamples = 0;
+  if (shortLength)
+  {
+    numSamples = (int)(0.200 * samplingRate);    // 300 ms
+  }
+  else
+  {
+    numSamples = (int)(0.400 * samplingRate);    // 600 ms
+  }
+
   synth->init(glottis, vocalTract, tdsModel);
-  audio.resize(0);
+  audio.resize(20 * rampSamples + numSamples + decaySamples);
 
   // Pressure starts at 0 dPa.
 
@@ -743,8 +1010,7 @@ void Synthesizer::synthesizeStaticPhoneme(Glottis *glottis, VocalTract *vocalTra
   {
     glottisParams[Glottis::FREQUENCY] = 110;
   }
-  synth->add(glottisParams, tractParams, 0, signalPart);
-  audio.insert(audio.end(), signalPart.begin(), signalPart.end());
+  audioPos += synth->add(glottisParams, tractParams, 0, audio.data() + audioPos);
 
   // Pressure rises up to 800 Pa;
 
@@ -752,8 +1018,7 @@ void Synthesizer::synthesizeStaticPhoneme(Glottis *glottis, VocalTract *vocalTra
   {
     double factor = 0.5 * (-cos(M_PI * i / 10.0) + 1.0);
     glottisParams[Glottis::PRESSURE] = 8000.0 * factor;    // in dPa
-    synth->add(glottisParams, tractParams, (int)(0.005 * SAMPLING_RATE), signalPart);
-    audio.insert(audio.end(), signalPart.begin(), signalPart.end());
+    audioPos += synth->add(glottisParams, tractParams, rampSamples, audio.data() + audioPos);
   }
 
   // Stationary part.
@@ -763,18 +1028,7 @@ void Synthesizer::synthesizeStaticPhoneme(Glottis *glottis, VocalTract *vocalTra
   {
     glottisParams[Glottis::FREQUENCY] = 100;
   }
-
-  int numSamples = 0;
-  if (shortLength)
-  {
-    numSamples = (int)(0.200 * SAMPLING_RATE);    // 300 ms
-  }
-  else
-  {
-    numSamples = (int)(0.400 * SAMPLING_RATE);    // 600 ms
-  }
-  synth->add(glottisParams, tractParams, numSamples, signalPart);
-  audio.insert(audio.end(), signalPart.begin(), signalPart.end());
+  audioPos += synth->add(glottisParams, tractParams, numSamples, audio.data() + audioPos);
 
   // Pressure is falling back to zero.
 
@@ -782,16 +1036,14 @@ void Synthesizer::synthesizeStaticPhoneme(Glottis *glottis, VocalTract *vocalTra
   {
     double factor = 0.5 * (cos(M_PI * (i + 1) / 10.0) + 1.0);
     glottisParams[Glottis::PRESSURE] = 8000.0 * factor;    // in dPa
-    synth->add(glottisParams, tractParams, (int)(0.005 * SAMPLING_RATE), signalPart);
-    audio.insert(audio.end(), signalPart.begin(), signalPart.end());
+    audioPos += synth->add(glottisParams, tractParams, rampSamples, audio.data() + audioPos);
   }
 
   // Pressure stays zero until the impulse response of the vocal tract
   // completely decayed.
 
   glottisParams[Glottis::PRESSURE] = 0.0;    // in dPa
-  synth->add(glottisParams, tractParams, (int)(0.030 * SAMPLING_RATE), signalPart);
-  audio.insert(audio.end(), signalPart.begin(), signalPart.end());
+  audioPos += synth->add(glottisParams, tractParams, decaySamples, audio.data() + audioPos);
 
   // ****************************************************************
   // Restore the previous state of the vocal tract and glottis.
@@ -956,10 +1208,9 @@ bool Synthesizer::gesturalScoreToTubeSequenceFile(GesturalScore *gesturalScore,
     {
       gesturalScore->vocalTract->param[k].x = tractParams[k];
     }
-    gesturalScore->vocalTract->calculateAll();
 
     // Transform the vocal tract model into a tube.
-    gesturalScore->vocalTract->getTube(&tube);
+    gesturalScore->vocalTract->calculateTube(&tube);
 
     // Write the new parameters to the file
 
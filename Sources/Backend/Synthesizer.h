@@ -51,6 +51,34 @@ public:
   // This is the default step size for the incremental synthesis 
   // corresponding to about 2.5 ms at our sampling rate of 44100 Hz.
   static const int NUM_CHUNCK_SAMPLES = 110;
+  // Upper limit of the cutoff frequency of the output filter relative to
+  // the sampling rate.
+  static const double MAX_OUTPUT_CUTOFF_FREQ_RATIO;
+
+  static const int TDS_BUFFER_LENGTH = 256;
+  static const int TDS_BUFFER_MASK = 255;
+
+  // The complete state of an incremental synthesis between two frames
+  // (see saveState()).
+  struct State
+  {
+    State() {}
+    // The section pointers of a copy-constructed Tube would point into the 
+    // original, so states can only be assigned.
+    State(const State &) = delete;
+
+    TdsModel::MotionState tdsState;
+    Glottis::MotionState glottisState;
+
+    Tube prevTube;
+    Tube tube;
+    double prevGlottisParams[Glottis::MAX_CONTROL_PARAMS];
+    bool initialShapesSet;
+
+    double outputFlow[TDS_BUFFER_LENGTH];
+    double outputPressure[TDS_BUFFER_LENGTH];
+    IirFilter outputPressureFilter;
+  };
 
   // **************************************************************************
   // Public functions.
@@ -65,6 +93,25 @@ public:
   void add(double *newGlottisParams, double *newTractParams, int numSamples, vector<double> &audio);
   void add(double *newGlottisParams, Tube *newTube, int numSamples, vector<double> &audio);
 
+  // Versions of add() that write into a buffer of the caller with room for 
+  // numSamples samples and return the number of samples written.
+  int add(double *newGlottisParams, double *newTractParams, int numSamples, double *audio);
+  int add(double *newGlottisParams, Tube *newTube, int numSamples, double *audio);
+  int add(double *newGlottisParams, double *newTractParams, int numSamples, float *audio);
+  int add(double *newGlottisParams, Tube *newTube, int numSamples, float *audio);
+
+  // Sample-by-sample version of add().
+  bool beginFrame(double *newGlottisParams, double *newTractParams, int numSamples);
+  bool beginFrame(double *newGlottisParams, Tube *newTube, int numSamples);
+  void prepareSample();
+  double finishSample(double totalFlow_cm3_s);
+
+  static int getChunkSamples(int samplingRate);
+
+  // Branch-and-continue synthesis.
+  void saveState(State &state);
+  bool restoreState(const State &state);
+
   // **************************************************************************
 
   static void copySignal(vector<double> &sourceSignal, Signal16 &targetSignal, 
@@ -98,10 +145,16 @@ private:
 
   Tube prevTube;
   Tube tube;
+  // Target tube of the vocal tract for the current call of add().
+  // Kept per instance so that several synthesizers can run in parallel.
+  Tube tractTube;
   double prevGlottisParams[Glottis::MAX_CONTROL_PARAMS];
 
-  static const int TDS_BUFFER_LENGTH = 256;
-  static const int TDS_BUFFER_MASK = 255;
+  // Target shapes and progress of the current frame (see beginFrame()).
+  Tube *frameTube;
+  double frameGlottisParams[Glottis::MAX_CONTROL_PARAMS];
+  int frameNumSamples;
+  int frameSampleIndex;
 
   double *outputFlow;
   double *outputPressure;
@@ -113,6 +166,7 @@ private:
   // **************************************************************************
 
 private:
+  double nextSample();
   static bool parseTextLine(string line, int numValues, double *values);
 
 };
@@ -0,0 +1,761 @@
+#include "TdsKernels.h"
+#include "Constants.h"
+#include <cmath>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define TDS_KERNELS_X86_64
+  #include <immintrin.h>
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    #define TARGET_AVX2
+  #else
+    #define TARGET_AVX2 __attribute__((target("avx2")))
+  #endif
+#endif
+
+// The radius below which a cross-section is assumed to be elliptical
+// = 6 mm (corresponds to an area of 1.1 cm^2)
+static const double MIN_RADIUS_CM = 0.6;
+
+static bool detectAvx2();
+static TdsKernels::InstructionSet getBestInstructionSet();
+
+// The kernels of all instances use the same instruction set. It is atomic,
+// because it may be changed while other threads run the kernels.
+static std::atomic<TdsKernels::InstructionSet> instructionSet(getBestInstructionSet());
+
+
+// ****************************************************************************
+// Scalar kernels. These are the reference for the vectorized versions and
+// also process the remaining sections at the end of the arrays.
+// ****************************************************************************
+
+static void calcComponentsScalar(int n, const TdsKernels::Parameters &p,
+  double *area, const double *length, const double *volume, double *L,
+  double *C, double *R0, double *R1, double *S, double *circ)
+{
+  int i;
+  double a, b;
+
+  for (i = 0; i < n; i++)
+  {
+    if (area[i] < p.minArea_cm2)
+    {
+      area[i] = p.minArea_cm2;
+    }
+
+    S[i] = 0.0;      // No pressure source at the inlet of the section
+    circ[i] = 2.0*sqrt(area[i] * M_PI);
+
+    // Assume a circular cross-section. If the radius of the circle becomes
+    // smaller than MIN_RADIUS_CM, make the cross-section elliptical with 
+    // MIN_RADIUS_CM being the length of the bigger half-axis. This strongly
+    // increases the viscous resistance just before supraglottal or glottal
+    // closures and makes it roughly equivalent to that of a rectangular slit.
+    a = b = sqrt(area[i] / M_PI);
+    if (a < MIN_RADIUS_CM)
+    {
+      a = MIN_RADIUS_CM;
+      b = area[i] / (M_PI*a);
+    }
+
+    L[i] = (AMBIENT_DENSITY_CGS * 0.5 * length[i]) / area[i];
+    C[i] = volume[i] / (AMBIENT_DENSITY_CGS * SOUND_VELOCITY_CGS * SOUND_VELOCITY_CGS);
+    R0[i] = ((2.0 * AIR_VISCOSITY_CGS * length[i]) * (a * a + b * b)) / (M_PI*a*a*a*b*b*b);
+    R1[i] = R0[i];
+  }
+}
+
+// ****************************************************************************
+
+static void calcWallCoefficientsScalar(int n, const TdsKernels::Parameters &p,
+  const double *circ, const double *length, const double *Mw,
+  const double *Bw, const double *Kw, const double *wallCurrent,
+  const double *wallCurrentRate, const double *wallCurrentRate2,
+  double *alpha, double *beta)
+{
+  const double theta1 = 1.0 - p.theta;
+  int i;
+  double surface;
+  double Lw, Rw, Cw;
+
+  for (i = 0; i < n; i++)
+  {
+    surface = circ[i] * length[i];    // Surface of a cylinder barrel
+    if (surface < p.minArea_cm2)
+    {
+      surface = p.minArea_cm2;
+    }
+
+    Rw = Bw[i] / surface;
+    Lw = Mw[i] / surface;
+    Cw = surface / Kw[i];
+
+    alpha[i] = 1.0 / (Lw / (p.timeStep*p.timeStep*p.theta*p.theta) + Rw / (p.timeStep*p.theta) + 1.0/Cw);
+    beta[i] = alpha[i]*(
+      wallCurrent[i]*(Lw/(p.timeStep*p.timeStep*p.theta*p.theta) + Rw/(p.timeStep*p.theta)) +
+      wallCurrentRate[i]*(Lw*(theta1/p.theta + 1.0)/(p.timeStep*p.theta) + Rw*(theta1/p.theta)) +
+      wallCurrentRate2[i]*Lw*(theta1/p.theta)
+      );
+  }
+}
+
+// ****************************************************************************
+
+static void calcDEScalar(int n, const TdsKernels::Parameters &p,
+  const double *C, const double *alpha, const double *beta,
+  const double *pressure, const double *pressureRate, const double *sourceAmp,
+  double *D, double *E)
+{
+  const double theta1 = 1.0 - p.theta;
+  int i;
+  double d;
+
+  for (i = 0; i < n; i++)
+  {
+    d = p.timeStep*p.theta / (C[i] + alpha[i]);
+    E[i] = d;
+    D[i] = pressure[i] + p.timeStep*theta1*pressureRate[i] - d*(beta[i] - sourceAmp[i]);
+  }
+}
+
+// ****************************************************************************
+
+static void updateStateScalar(int n, const TdsKernels::Parameters &p,
+  const double *netFlow, const double *D, const double *E,
+  const double *alpha, const double *beta, double *pressure,
+  double *pressureRate, double *wallCurrent, double *wallCurrentRate,
+  double *wallCurrentRate2)
+{
+  const double theta1 = 1.0 - p.theta;
+  int i;
+  double oldPressure;
+  double oldCurrent;
+  double oldCurrentRate;
+
+  for (i = 0; i < n; i++)
+  {
+    oldPressure = pressure[i];
+    pressure[i] = D[i] + E[i]*netFlow[i];
+    pressureRate[i] = (pressure[i] - oldPressure)/(p.timeStep*p.theta) - pressureRate[i]*(theta1/p.theta);
+
+    // The current "into the wall".
+
+    oldCurrent = wallCurrent[i];
+    oldCurrentRate = wallCurrentRate[i];
+
+    wallCurrent[i] = pressureRate[i]*alpha[i] + beta[i];
+    wallCurrentRate[i]  = (wallCurrent[i] - oldCurrent)/(p.timeStep*p.theta) - oldCurrentRate*(theta1/p.theta);
+    wallCurrentRate2[i] = (wallCurrentRate[i] - oldCurrentRate)/(p.timeStep*p.theta) - wallCurrentRate2[i]*(theta1/p.theta);
+  }
+}
+
+// ****************************************************************************
+
+static void calcFourthRootsScalar(int n, const double *x, double *root)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    root[i] = sqrt(sqrt(x[i]));
+  }
+}
+
+
+#ifdef TDS_KERNELS_X86_64
+
+// ****************************************************************************
+// SSE2 kernels (2 sections at a time). SSE2 is part of every x86-64 CPU.
+// ****************************************************************************
+
+static void calcComponentsSse2(int n, const TdsKernels::Parameters &p,
+  double *area, const double *length, const double *volume, double *L,
+  double *C, double *R0, double *R1, double *S, double *circ)
+{
+  const __m128d minArea = _mm_set1_pd(p.minArea_cm2);
+  const __m128d minRadius = _mm_set1_pd(MIN_RADIUS_CM);
+  const __m128d pi = _mm_set1_pd(M_PI);
+  const __m128d two = _mm_set1_pd(2.0);
+  const __m128d halfDensity = _mm_set1_pd(AMBIENT_DENSITY_CGS * 0.5);
+  const __m128d compliance = _mm_set1_pd(AMBIENT_DENSITY_CGS * SOUND_VELOCITY_CGS * SOUND_VELOCITY_CGS);
+  const __m128d viscosity = _mm_set1_pd(2.0 * AIR_VISCOSITY_CGS);
+  int i;
+
+  for (i = 0; i + 2 <= n; i += 2)
+  {
+    __m128d A = _mm_loadu_pd(area + i);
+    __m128d mask = _mm_cmplt_pd(A, minArea);
+    A = _mm_or_pd(_mm_and_pd(mask, minArea), _mm_andnot_pd(mask, A));
+    _mm_storeu_pd(area + i, A);
+
+    _mm_storeu_pd(S + i, _mm_setzero_pd());
+    _mm_storeu_pd(circ + i, _mm_mul_pd(two, _mm_sqrt_pd(_mm_mul_pd(A, pi))));
+
+    __m128d a = _mm_sqrt_pd(_mm_div_pd(A, pi));
+    mask = _mm_cmplt_pd(a, minRadius);
+    __m128d b = _mm_or_pd(_mm_and_pd(mask, _mm_div_pd(A, _mm_mul_pd(pi, minRadius))), _mm_andnot_pd(mask, a));
+    a = _mm_or_pd(_mm_and_pd(mask, minRadius), _mm_andnot_pd(mask, a));
+
+    __m128d len = _mm_loadu_pd(length + i);
+    _mm_storeu_pd(L + i, _mm_div_pd(_mm_mul_pd(halfDensity, len), A));
+    _mm_storeu_pd(C + i, _mm_div_pd(_mm_loadu_pd(volume + i), compliance));
+
+    __m128d aa = _mm_mul_pd(a, a);
+    __m128d bb = _mm_mul_pd(b, b);
+    __m128d num = _mm_mul_pd(_mm_mul_pd(viscosity, len), _mm_add_pd(aa, bb));
+    __m128d den = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(_mm_mul_pd(_mm_mul_pd(_mm_mul_pd(pi, a), a), a), b), b), b);
+    __m128d R = _mm_div_pd(num, den);
+    _mm_storeu_pd(R0 + i, R);
+    _mm_storeu_pd(R1 + i, R);
+  }
+
+  calcComponentsScalar(n - i, p, area + i, length + i, volume + i, L + i,
+    C + i, R0 + i, R1 + i, S + i, circ + i);
+}
+
+// ****************************************************************************
+
+static void calcWallCoefficientsSse2(int n, const TdsKernels::Parameters &p,
+  const double *circ, const double *length, const double *Mw,
+  const double *Bw, const double *Kw, const double *wallCurrent,
+  const double *wallCurrentRate, const double *wallCurrentRate2,
+  double *alpha, double *beta)
+{
+  const double theta1 = 1.0 - p.theta;
+  const __m128d minArea = _mm_set1_pd(p.minArea_cm2);
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d t2 = _mm_set1_pd(p.timeStep*p.timeStep*p.theta*p.theta);
+  const __m128d t1 = _mm_set1_pd(p.timeStep*p.theta);
+  const __m128d c1 = _mm_set1_pd(theta1/p.theta + 1.0);
+  const __m128d c2 = _mm_set1_pd(theta1/p.theta);
+  int i;
+
+  for (i = 0; i + 2 <= n; i += 2)
+  {
+    __m128d surface = _mm_mul_pd(_mm_loadu_pd(circ + i), _mm_loadu_pd(length + i));
+    __m128d mask = _mm_cmplt_pd(surface, minArea);
+    surface = _mm_or_pd(_mm_and_pd(mask, minArea), _mm_andnot_pd(mask, surface));
+
+    __m128d Rw = _mm_div_pd(_mm_loadu_pd(Bw + i), surface);
+    __m128d Lw = _mm_div_pd(_mm_loadu_pd(Mw + i), surface);
+    __m128d Cw = _mm_div_pd(surface, _mm_loadu_pd(Kw + i));
+
+    __m128d LwT2 = _mm_div_pd(Lw, t2);
+    __m128d RwT1 = _mm_div_pd(Rw, t1);
+    __m128d a = _mm_div_pd(one, _mm_add_pd(_mm_add_pd(LwT2, RwT1), _mm_div_pd(one, Cw)));
+
+    __m128d s = _mm_mul_pd(_mm_loadu_pd(wallCurrent + i), _mm_add_pd(LwT2, RwT1));
+    s = _mm_add_pd(s, _mm_mul_pd(_mm_loadu_pd(wallCurrentRate + i),
+      _mm_add_pd(_mm_div_pd(_mm_mul_pd(Lw, c1), t1), _mm_mul_pd(Rw, c2))));
+    s = _mm_add_pd(s, _mm_mul_pd(_mm_mul_pd(_mm_loadu_pd(wallCurrentRate2 + i), Lw), c2));
+
+    _mm_storeu_pd(alpha + i, a);
+    _mm_storeu_pd(beta + i, _mm_mul_pd(a, s));
+  }
+
+  calcWallCoefficientsScalar(n - i, p, circ + i, length + i, Mw + i, Bw + i,
+    Kw + i, wallCurrent + i, wallCurrentRate + i, wallCurrentRate2 + i,
+    alpha + i, beta + i);
+}
+
+// ****************************************************************************
+
+static void calcDESse2(int n, const TdsKernels::Parameters &p,
+  const double *C, const double *alpha, const double *beta,
+  const double *pressure, const double *pressureRate, const double *sourceAmp,
+  double *D, double *E)
+{
+  const __m128d t = _mm_set1_pd(p.timeStep*p.theta);
+  const __m128d t1 = _mm_set1_pd(p.timeStep*(1.0 - p.theta));
+  int i;
+
+  for (i = 0; i + 2 <= n; i += 2)
+  {
+    __m128d d = _mm_div_pd(t, _mm_add_pd(_mm_loadu_pd(C + i), _mm_loadu_pd(alpha + i)));
+    _mm_storeu_pd(E + i, d);
+    __m128d x = _mm_add_pd(_mm_loadu_pd(pressure + i), _mm_mul_pd(t1, _mm_loadu_pd(pressureRate + i)));
+    x = _mm_sub_pd(x, _mm_mul_pd(d, _mm_sub_pd(_mm_loadu_pd(beta + i), _mm_loadu_pd(sourceAmp + i))));
+    _mm_storeu_pd(D + i, x);
+  }
+
+  calcDEScalar(n - i, p, C + i, alpha + i, beta + i, pressure + i,
+    pressureRate + i, sourceAmp + i, D + i, E + i);
+}
+
+// ****************************************************************************
+
+static void updateStateSse2(int n, const TdsKernels::Parameters &p,
+  const double *netFlow, const double *D, const double *E,
+  const double *alpha, const double *beta, double *pressure,
+  double *pressureRate, double *wallCurrent, double *wallCurrentRate,
+  double *wallCurrentRate2)
+{
+  const __m128d t = _mm_set1_pd(p.timeStep*p.theta);
+  const __m128d c = _mm_set1_pd((1.0 - p.theta)/p.theta);
+  int i;
+
+  for (i = 0; i + 2 <= n; i += 2)
+  {
+    __m128d oldPressure = _mm_loadu_pd(pressure + i);
+    __m128d P = _mm_add_pd(_mm_loadu_pd(D + i), _mm_mul_pd(_mm_loadu_pd(E + i), _mm_loadu_pd(netFlow + i)));
+    __m128d Pr = _mm_sub_pd(_mm_div_pd(_mm_sub_pd(P, oldPressure), t), _mm_mul_pd(_mm_loadu_pd(pressureRate + i), c));
+    _mm_storeu_pd(pressure + i, P);
+    _mm_storeu_pd(pressureRate + i, Pr);
+
+    __m128d oldCurrent = _mm_loadu_pd(wallCurrent + i);
+    __m128d oldCurrentRate = _mm_loadu_pd(wallCurrentRate + i);
+    __m128d W = _mm_add_pd(_mm_mul_pd(Pr, _mm_loadu_pd(alpha + i)), _mm_loadu_pd(beta + i));
+    __m128d Wr = _mm_sub_pd(_mm_div_pd(_mm_sub_pd(W, oldCurrent), t), _mm_mul_pd(oldCurrentRate, c));
+    __m128d Wr2 = _mm_sub_pd(_mm_div_pd(_mm_sub_pd(Wr, oldCurrentRate), t), _mm_mul_pd(_mm_loadu_pd(wallCurrentRate2 + i), c));
+    _mm_storeu_pd(wallCurrent + i, W);
+    _mm_storeu_pd(wallCurrentRate + i, Wr);
+    _mm_storeu_pd(wallCurrentRate2 + i, Wr2);
+  }
+
+  updateStateScalar(n - i, p, netFlow + i, D + i, E + i, alpha + i, beta + i,
+    pressure + i, pressureRate + i, wallCurrent + i, wallCurrentRate + i,
+    wallCurrentRate2 + i);
+}
+
+// ****************************************************************************
+
+static void calcFourthRootsSse2(int n, const double *x, double *root)
+{
+  int i;
+
+  for (i = 0; i + 2 <= n; i += 2)
+  {
+    _mm_storeu_pd(root + i, _mm_sqrt_pd(_mm_sqrt_pd(_mm_loadu_pd(x + i))));
+  }
+
+  calcFourthRootsScalar(n - i, x + i, root + i);
+}
+
+
+// ****************************************************************************
+// AVX2 kernels (4 sections at a time). The same as the SSE2 kernels with
+// twice the width.
+// ****************************************************************************
+
+TARGET_AVX2 static void calcComponentsAvx2(int n, const TdsKernels::Parameters &p,
+  double *area, const double *length, const double *volume, double *L,
+  double *C, double *R0, double *R1, double *S, double *circ)
+{
+  const __m256d minArea = _mm256_set1_pd(p.minArea_cm2);
+  const __m256d minRadius = _mm256_set1_pd(MIN_RADIUS_CM);
+  const __m256d pi = _mm256_set1_pd(M_PI);
+  const __m256d two = _mm256_set1_pd(2.0);
+  const __m256d halfDensity = _mm256_set1_pd(AMBIENT_DENSITY_CGS * 0.5);
+  const __m256d compliance = _mm256_set1_pd(AMBIENT_DENSITY_CGS * SOUND_VELOCITY_CGS * SOUND_VELOCITY_CGS);
+  const __m256d viscosity = _mm256_set1_pd(2.0 * AIR_VISCOSITY_CGS);
+  int i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m256d A = _mm256_loadu_pd(area + i);
+    A = _mm256_blendv_pd(A, minArea, _mm256_cmp_pd(A, minArea, _CMP_LT_OQ));
+    _mm256_storeu_pd(area + i, A);
+
+    _mm256_storeu_pd(S + i, _mm256_setzero_pd());
+    _mm256_storeu_pd(circ + i, _mm256_mul_pd(two, _mm256_sqrt_pd(_mm256_mul_pd(A, pi))));
+
+    __m256d a = _mm256_sqrt_pd(_mm256_div_pd(A, pi));
+    __m256d mask = _mm256_cmp_pd(a, minRadius, _CMP_LT_OQ);
+    __m256d b = _mm256_blendv_pd(a, _mm256_div_pd(A, _mm256_mul_pd(pi, minRadius)), mask);
+    a = _mm256_blendv_pd(a, minRadius, mask);
+
+    __m256d len = _mm256_loadu_pd(length + i);
+    _mm256_storeu_pd(L + i, _mm256_div_pd(_mm256_mul_pd(halfDensity, len), A));
+    _mm256_storeu_pd(C + i, _mm256_div_pd(_mm256_loadu_pd(volume + i), compliance));
+
+    __m256d aa = _mm256_mul_pd(a, a);
+    __m256d bb = _mm256_mul_pd(b, b);
+    __m256d num = _mm256_mul_pd(_mm256_mul_pd(viscosity, len), _mm256_add_pd(aa, bb));
+    __m256d den = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(pi, a), a), a), b), b), b);
+    __m256d R = _mm256_div_pd(num, den);
+    _mm256_storeu_pd(R0 + i, R);
+    _mm256_storeu_pd(R1 + i, R);
+  }
+
+  // Avoid the penalty for mixing AVX and SSE code in the scalar code.
+  _mm256_zeroupper();
+
+  calcComponentsScalar(n - i, p, area + i, length + i, volume + i, L + i,
+    C + i, R0 + i, R1 + i, S + i, circ + i);
+}
+
+// ****************************************************************************
+
+TARGET_AVX2 static void calcWallCoefficientsAvx2(int n, const TdsKernels::Parameters &p,
+  const double *circ, const double *length, const double *Mw,
+  const double *Bw, const double *Kw, const double *wallCurrent,
+  const double *wallCurrentRate, const double *wallCurrentRate2,
+  double *alpha, double *beta)
+{
+  const double theta1 = 1.0 - p.theta;
+  const __m256d minArea = _mm256_set1_pd(p.minArea_cm2);
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d t2 = _mm256_set1_pd(p.timeStep*p.timeStep*p.theta*p.theta);
+  const __m256d t1 = _mm256_set1_pd(p.timeStep*p.theta);
+  const __m256d c1 = _mm256_set1_pd(theta1/p.theta + 1.0);
+  const __m256d c2 = _mm256_set1_pd(theta1/p.theta);
+  int i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m256d surface = _mm256_mul_pd(_mm256_loadu_pd(circ + i), _mm256_loadu_pd(length + i));
+    surface = _mm256_blendv_pd(surface, minArea, _mm256_cmp_pd(surface, minArea, _CMP_LT_OQ));
+
+    __m256d Rw = _mm256_div_pd(_mm256_loadu_pd(Bw + i), surface);
+    __m256d Lw = _mm256_div_pd(_mm256_loadu_pd(Mw + i), surface);
+    __m256d Cw = _mm256_div_pd(surface, _mm256_loadu_pd(Kw + i));
+
+    __m256d LwT2 = _mm256_div_pd(Lw, t2);
+    __m256d RwT1 = _mm256_div_pd(Rw, t1);
+    __m256d a = _mm256_div_pd(one, _mm256_add_pd(_mm256_add_pd(LwT2, RwT1), _mm256_div_pd(one, Cw)));
+
+    __m256d s = _mm256_mul_pd(_mm256_loadu_pd(wallCurrent + i), _mm256_add_pd(LwT2, RwT1));
+    s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_loadu_pd(wallCurrentRate + i),
+      _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(Lw, c1), t1), _mm256_mul_pd(Rw, c2))));
+    s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(wallCurrentRate2 + i), Lw), c2));
+
+    _mm256_storeu_pd(alpha + i, a);
+    _mm256_storeu_pd(beta + i, _mm256_mul_pd(a, s));
+  }
+
+  // Avoid the penalty for mixing AVX and SSE code in the scalar code.
+  _mm256_zeroupper();
+
+  calcWallCoefficientsScalar(n - i, p, circ + i, length + i, Mw + i, Bw + i,
+    Kw + i, wallCurrent + i, wallCurrentRate + i, wallCurrentRate2 + i,
+    alpha + i, beta + i);
+}
+
+// ****************************************************************************
+
+TARGET_AVX2 static void calcDEAvx2(int n, const TdsKernels::Parameters &p,
+  const double *C, const double *alpha, const double *beta,
+  const double *pressure, const double *pressureRate, const double *sourceAmp,
+  double *D, double *E)
+{
+  const __m256d t = _mm256_set1_pd(p.timeStep*p.theta);
+  const __m256d t1 = _mm256_set1_pd(p.timeStep*(1.0 - p.theta));
+  int i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m256d d = _mm256_div_pd(t, _mm256_add_pd(_mm256_loadu_pd(C + i), _mm256_loadu_pd(alpha + i)));
+    _mm256_storeu_pd(E + i, d);
+    __m256d x = _mm256_add_pd(_mm256_loadu_pd(pressure + i), _mm256_mul_pd(t1, _mm256_loadu_pd(pressureRate + i)));
+    x = _mm256_sub_pd(x, _mm256_mul_pd(d, _mm256_sub_pd(_mm256_loadu_pd(beta + i), _mm256_loadu_pd(sourceAmp + i))));
+    _mm256_storeu_pd(D + i, x);
+  }
+
+  // Avoid the penalty for mixing AVX and SSE code in the scalar code.
+  _mm256_zeroupper();
+
+  calcDEScalar(n - i, p, C + i, alpha + i, beta + i, pressure + i,
+    pressureRate + i, sourceAmp + i, D + i, E + i);
+}
+
+// ****************************************************************************
+
+TARGET_AVX2 static void updateStateAvx2(int n, const TdsKernels::Parameters &p,
+  const double *netFlow, const double *D, const double *E,
+  const double *alpha, const double *beta, double *pressure,
+  double *pressureRate, double *wallCurrent, double *wallCurrentRate,
+  double *wallCurrentRate2)
+{
+  const __m256d t = _mm256_set1_pd(p.timeStep*p.theta);
+  const __m256d c = _mm256_set1_pd((1.0 - p.theta)/p.theta);
+  int i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m256d oldPressure = _mm256_loadu_pd(pressure + i);
+    __m256d P = _mm256_add_pd(_mm256_loadu_pd(D + i), _mm256_mul_pd(_mm256_loadu_pd(E + i), _mm256_loadu_pd(netFlow + i)));
+    __m256d Pr = _mm256_sub_pd(_mm256_div_pd(_mm256_sub_pd(P, oldPressure), t), _mm256_mul_pd(_mm256_loadu_pd(pressureRate + i), c));
+    _mm256_storeu_pd(pressure + i, P);
+    _mm256_storeu_pd(pressureRate + i, Pr);
+
+    __m256d oldCurrent = _mm256_loadu_pd(wallCurrent + i);
+    __m256d oldCurrentRate = _mm256_loadu_pd(wallCurrentRate + i);
+    __m256d W = _mm256_add_pd(_mm256_mul_pd(Pr, _mm256_loadu_pd(alpha + i)), _mm256_loadu_pd(beta + i));
+    __m256d Wr = _mm256_sub_pd(_mm256_div_pd(_mm256_sub_pd(W, oldCurrent), t), _mm256_mul_pd(oldCurrentRate, c));
+    __m256d Wr2 = _mm256_sub_pd(_mm256_div_pd(_mm256_sub_pd(Wr, oldCurrentRate), t), _mm256_mul_pd(_mm256_loadu_pd(wallCurrentRate2 + i), c));
+    _mm256_storeu_pd(wallCurrent + i, W);
+    _mm256_storeu_pd(wallCurrentRate + i, Wr);
+    _mm256_storeu_pd(wallCurrentRate2 + i, Wr2);
+  }
+
+  // Avoid the penalty for mixing AVX and SSE code in the scalar code.
+  _mm256_zeroupper();
+
+  updateStateScalar(n - i, p, netFlow + i, D + i, E + i, alpha + i, beta + i,
+    pressure + i, pressureRate + i, wallCurrent + i, wallCurrentRate + i,
+    wallCurrentRate2 + i);
+}
+
+// ****************************************************************************
+
+TARGET_AVX2 static void calcFourthRootsAvx2(int n, const double *x, double *root)
+{
+  int i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    _mm256_storeu_pd(root + i, _mm256_sqrt_pd(_mm256_sqrt_pd(_mm256_loadu_pd(x + i))));
+  }
+
+  // Avoid the penalty for mixing AVX and SSE code in the scalar code.
+  _mm256_zeroupper();
+
+  calcFourthRootsScalar(n - i, x + i, root + i);
+}
+
+#endif
+
+
+// ****************************************************************************
+/// Returns true if the CPU (and the operating system) support AVX2.
+// ****************************************************************************
+
+static bool detectAvx2()
+{
+#if defined(TDS_KERNELS_X86_64) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+  {
+    return false;
+  }
+  // OSXSAVE and AVX, and the OS saves the YMM registers.
+  __cpuid(info, 1);
+  if (((info[2] & (1 << 27)) == 0) || ((info[2] & (1 << 28)) == 0))
+  {
+    return false;
+  }
+  if ((_xgetbv(0) & 6) != 6)
+  {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return ((info[1] & (1 << 5)) != 0);
+#elif defined(TDS_KERNELS_X86_64)
+  __builtin_cpu_init();
+  return (__builtin_cpu_supports("avx2") != 0);
+#else
+  return false;
+#endif
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+static TdsKernels::InstructionSet getBestInstructionSet()
+{
+  if (TdsKernels::isSupported(TdsKernels::AVX2))
+  {
+    return TdsKernels::AVX2;
+  }
+  if (TdsKernels::isSupported(TdsKernels::SSE2))
+  {
+    return TdsKernels::SSE2;
+  }
+  return TdsKernels::SCALAR;
+}
+
+
+// ****************************************************************************
+/// Returns the instruction set of the kernels that are currently used.
+// ****************************************************************************
+
+TdsKernels::InstructionSet TdsKernels::getInstructionSet()
+{
+  return instructionSet;
+}
+
+
+// ****************************************************************************
+/// Selects the instruction set of the kernels (mainly for benchmarks).
+/// If the given set is not supported, the best supported one below it is
+/// selected. As all versions give the same results, this may be called at
+/// any time, even while other threads run the kernels.
+/// Returns the selected instruction set.
+// ****************************************************************************
+
+TdsKernels::InstructionSet TdsKernels::setInstructionSet(InstructionSet set)
+{
+  while ((set > SCALAR) && (isSupported(set) == false))
+  {
+    set = (InstructionSet)(set - 1);
+  }
+  instructionSet = set;
+  return instructionSet;
+}
+
+
+// ****************************************************************************
+/// Returns true if the kernels for the given instruction set are compiled in
+/// and supported by the CPU.
+// ****************************************************************************
+
+bool TdsKernels::isSupported(InstructionSet set)
+{
+  static const bool hasAvx2 = detectAvx2();
+
+  switch (set)
+  {
+  case SCALAR: return true;
+#ifdef TDS_KERNELS_X86_64
+  case SSE2: return true;
+  case AVX2: return hasAvx2;
+#endif
+  default: return false;
+  }
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+const char *TdsKernels::getName(InstructionSet set)
+{
+  switch (set)
+  {
+  case SCALAR: return "scalar";
+  case SSE2: return "SSE2";
+  case AVX2: return "AVX2";
+  default: return "";
+  }
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+void TdsKernels::calcComponents(int n, const Parameters &p, double *area,
+  const double *length, const double *volume, double *L, double *C,
+  double *R0, double *R1, double *S, double *circ)
+{
+#ifdef TDS_KERNELS_X86_64
+  const InstructionSet set = instructionSet;
+  if (set == AVX2)
+  {
+    calcComponentsAvx2(n, p, area, length, volume, L, C, R0, R1, S, circ);
+    return;
+  }
+  if (set == SSE2)
+  {
+    calcComponentsSse2(n, p, area, length, volume, L, C, R0, R1, S, circ);
+    return;
+  }
+#endif
+  calcComponentsScalar(n, p, area, length, volume, L, C, R0, R1, S, circ);
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+void TdsKernels::calcWallCoefficients(int n, const Parameters &p,
+  const double *circ, const double *length, const double *Mw,
+  const double *Bw, const double *Kw, const double *wallCurrent,
+  const double *wallCurrentRate, const double *wallCurrentRate2,
+  double *alpha, double *beta)
+{
+#ifdef TDS_KERNELS_X86_64
+  const InstructionSet set = instructionSet;
+  if (set == AVX2)
+  {
+    calcWallCoefficientsAvx2(n, p, circ, length, Mw, Bw, Kw, wallCurrent,
+      wallCurrentRate, wallCurrentRate2, alpha, beta);
+    return;
+  }
+  if (set == SSE2)
+  {
+    calcWallCoefficientsSse2(n, p, circ, length, Mw, Bw, Kw, wallCurrent,
+      wallCurrentRate, wallCurrentRate2, alpha, beta);
+    return;
+  }
+#endif
+  calcWallCoefficientsScalar(n, p, circ, length, Mw, Bw, Kw, wallCurrent,
+    wallCurrentRate, wallCurrentRate2, alpha, beta);
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+void TdsKernels::calcDE(int n, const Parameters &p, const double *C,
+  const double *alpha, const double *beta, const double *pressure,
+  const double *pressureRate, const double *sourceAmp, double *D, double *E)
+{
+#ifdef TDS_KERNELS_X86_64
+  const InstructionSet set = instructionSet;
+  if (set == AVX2)
+  {
+    calcDEAvx2(n, p, C, alpha, beta, pressure, pressureRate, sourceAmp, D, E);
+    return;
+  }
+  if (set == SSE2)
+  {
+    calcDESse2(n, p, C, alpha, beta, pressure, pressureRate, sourceAmp, D, E);
+    return;
+  }
+#endif
+  calcDEScalar(n, p, C, alpha, beta, pressure, pressureRate, sourceAmp, D, E);
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+void TdsKernels::updateState(int n, const Parameters &p, const double *netFlow,
+  const double *D, const double *E, const double *alpha, const double *beta,
+  double *pressure, double *pressureRate, double *wallCurrent,
+  double *wallCurrentRate, double *wallCurrentRate2)
+{
+#ifdef TDS_KERNELS_X86_64
+  const InstructionSet set = instructionSet;
+  if (set == AVX2)
+  {
+    updateStateAvx2(n, p, netFlow, D, E, alpha, beta, pressure, pressureRate,
+      wallCurrent, wallCurrentRate, wallCurrentRate2);
+    return;
+  }
+  if (set == SSE2)
+  {
+    updateStateSse2(n, p, netFlow, D, E, alpha, beta, pressure, pressureRate,
+      wallCurrent, wallCurrentRate, wallCurrentRate2);
+    return;
+  }
+#endif
+  updateStateScalar(n, p, netFlow, D, E, alpha, beta, pressure, pressureRate,
+    wallCurrent, wallCurrentRate, wallCurrentRate2);
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+void TdsKernels::calcFourthRoots(int n, const double *x, double *root)
+{
+#ifdef TDS_KERNELS_X86_64
+  const InstructionSet set = instructionSet;
+  if (set == AVX2)
+  {
+    calcFourthRootsAvx2(n, x, root);
+    return;
+  }
+  if (set == SSE2)
+  {
+    calcFourthRootsSse2(n, x, root);
+    return;
+  }
+#endif
+  calcFourthRootsScalar(n, x, root);
+}
@@ -0,0 +1,80 @@
+#ifndef __TDS_KERNELS_H__
+#define __TDS_KERNELS_H__
+
+// ****************************************************************************
+/// The per-sample loops of TdsModel over the tube sections, written as
+/// kernels over the parallel arrays of TdsModel::SectionArrays. Each kernel
+/// has a scalar version and, on x86-64, SSE2 and AVX2 versions. The fastest
+/// version supported by the CPU is selected at runtime.
+///
+/// All versions evaluate exactly the same expressions in the same order
+/// (without fused multiply-add), so that they give bit-identical results.
+/// Special cases of individual sections (e.g., the sinus sections) are not
+/// handled here, but by the caller after the kernel.
+// ****************************************************************************
+
+class TdsKernels
+{
+  // **************************************************************************
+  // Public data.
+  // **************************************************************************
+
+public:
+  enum InstructionSet
+  {
+    SCALAR,
+    SSE2,
+    AVX2,
+    NUM_INSTRUCTION_SETS
+  };
+
+  /// Constant parameters of the kernels.
+  struct Parameters
+  {
+    double timeStep;
+    double theta;           ///< Weight of the new values in the integration
+    double minArea_cm2;
+  };
+
+  // **************************************************************************
+  // Public functions.
+  // **************************************************************************
+
+public:
+  static InstructionSet getInstructionSet();
+  static InstructionSet setInstructionSet(InstructionSet set);
+  static bool isSupported(InstructionSet set);
+  static const char *getName(InstructionSet set);
+
+  /// Limits the areas to the minimum area and calculates L, C, R, S and the
+  /// circumference of cylindrical tube sections.
+  static void calcComponents(int n, const Parameters &p, double *area,
+    const double *length, const double *volume, double *L, double *C,
+    double *R0, double *R1, double *S, double *circ);
+
+  /// Calculates alpha and beta for the wall vibration of tube sections with
+  /// the surface of a cylinder barrel.
+  static void calcWallCoefficients(int n, const Parameters &p,
+    const double *circ, const double *length, const double *Mw,
+    const double *Bw, const double *Kw, const double *wallCurrent,
+    const double *wallCurrentRate, const double *wallCurrentRate2,
+    double *alpha, double *beta);
+
+  /// Calculates D and E for the system of equations.
+  static void calcDE(int n, const Parameters &p, const double *C,
+    const double *alpha, const double *beta, const double *pressure,
+    const double *pressureRate, const double *sourceAmp, double *D, double *E);
+
+  /// Calculates the new pressures and wall currents and their derivatives
+  /// from the net flows into the sections.
+  static void updateState(int n, const Parameters &p, const double *netFlow,
+    const double *D, const double *E, const double *alpha, const double *beta,
+    double *pressure, double *pressureRate, double *wallCurrent,
+    double *wallCurrentRate, double *wallCurrentRate2);
+
+  /// Calculates the fourth roots of n values (for the limitation of the
+  /// speed of area changes).
+  static void calcFourthRoots(int n, const double *x, double *root);
+};
+
+#endif
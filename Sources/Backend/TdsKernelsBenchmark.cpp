@@ -0,0 +1,246 @@
+// ****************************************************************************
+// Micro-benchmark of the per-sample stages of TdsModel (see TdsKernels).
+// The kernels run on the section arrays of a TdsModel after a short voiced
+// simulation with JD2.speaker or another speaker, once for each instruction
+// set that the CPU supports. The results are in ns per call, which is the
+// cost per audio sample, because each kernel is called once per time step
+// (calcFourthRoots() twice). For comparison, the time of a whole time step
+// of TdsModel is printed, too.
+//
+// Usage: TdsKernelsBenchmark <speaker file> [numCalls]
+// ****************************************************************************
+
+#include "SpeakerModel.h"
+#include "TdsKernels.h"
+#include "TdsModel.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+static const int NUM_STAGES = 5;
+static const char *STAGE_NAMES[NUM_STAGES] =
+{
+  "calcComponents",
+  "calcWallCoefficients",
+  "calcDE",
+  "updateState",
+  "calcFourthRoots"
+};
+
+// The section state is restored after this number of calls of updateState(),
+// so that the values stay in a realistic range.
+static const int STATE_RESET_INTERVAL = 1000;
+
+// ****************************************************************************
+/// Returns the nanoseconds since start.
+// ****************************************************************************
+
+static double getElapsed_ns(chrono::steady_clock::time_point start)
+{
+  return (double)chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start).count();
+}
+
+
+// ****************************************************************************
+/// Runs a voiced simulation with the neutral vocal tract for numSteps time
+/// steps and returns the time per step in ns.
+// ****************************************************************************
+
+static double runModel(const SpeakerModel &speaker, TdsModel &model, int numSteps)
+{
+  unique_ptr<VocalTract> tract(speaker.createVocalTract());
+  unique_ptr<Glottis> glottis(speaker.createGlottis(speaker.selectedGlottis));
+  Tube tube;
+  double length_cm[Tube::NUM_GLOTTIS_SECTIONS];
+  double area_cm2[Tube::NUM_GLOTTIS_SECTIONS];
+  double pressure_dPa[4];
+  double mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s;
+  int i, k;
+
+  for (k = 0; k < (int)glottis->controlParam.size(); k++)
+  {
+    glottis->controlParam[k].x = glottis->controlParam[k].neutral;
+  }
+  glottis->controlParam[Glottis::PRESSURE].x = 8000.0;
+
+  tract->calculateAll();
+  tract->getTube(&tube);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for (i = 0; i < numSteps; i++)
+  {
+    glottis->calcGeometry();
+    glottis->getTubeData(length_cm, area_cm2);
+    tube.setGlottisGeometry(length_cm, area_cm2);
+
+    model.setTube(&tube, i > 0);
+    model.setFlowSource(0.0, -1);
+    model.setPressureSource(glottis->controlParam[Glottis::PRESSURE].x, Tube::FIRST_TRACHEA_SECTION);
+
+    pressure_dPa[0] = model.getSectionPressure(Tube::LAST_TRACHEA_SECTION);
+    pressure_dPa[1] = model.getSectionPressure(Tube::LOWER_GLOTTIS_SECTION);
+    pressure_dPa[2] = model.getSectionPressure(Tube::UPPER_GLOTTIS_SECTION);
+    pressure_dPa[3] = model.getSectionPressure(Tube::FIRST_PHARYNX_SECTION);
+    glottis->incTime(model.timeStep, pressure_dPa);
+
+    model.proceedTimeStep(mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s);
+  }
+
+  return getElapsed_ns(start) / numSteps;
+}
+
+
+// ****************************************************************************
+/// Calls the kernel of the given stage numCalls times on a copy of the
+/// section arrays and returns the time per call in ns.
+// ****************************************************************************
+
+static double runStage(int stage, const TdsModel::SectionArrays &initial,
+  TdsKernels::Parameters &p, int numCalls)
+{
+  const int N = Tube::NUM_SECTIONS;
+  unique_ptr<TdsModel::SectionArrays> s(new TdsModel::SectionArrays(initial));
+  double circ[N];
+  double sourceAmp[N];
+  double netFlow[N];
+  double root[N];
+  double elapsed_ns = 0.0;
+  int i;
+
+  for (i = 0; i < N; i++)
+  {
+    circ[i] = 2.0*sqrt(s->area[i] * M_PI);
+    sourceAmp[i] = 0.0;
+    // Small net flows that keep the pressures in a realistic range.
+    netFlow[i] = 1e-3 * sin((double)i);
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for (i = 0; i < numCalls; i++)
+  {
+    switch (stage)
+    {
+    case 0:
+      TdsKernels::calcComponents(N, p, s->area, s->length, s->volume,
+        s->L, s->C, s->R[0], s->R[1], s->S, circ);
+      break;
+    case 1:
+      TdsKernels::calcWallCoefficients(N, p, circ, s->length, s->Mw, s->Bw, s->Kw,
+        s->wallCurrent, s->wallCurrentRate, s->wallCurrentRate2, s->alpha, s->beta);
+      break;
+    case 2:
+      TdsKernels::calcDE(N, p, s->C, s->alpha, s->beta, s->pressure,
+        s->pressureRate, sourceAmp, s->D, s->E);
+      break;
+    case 3:
+      TdsKernels::updateState(N, p, netFlow, s->D, s->E, s->alpha, s->beta,
+        s->pressure, s->pressureRate, s->wallCurrent, s->wallCurrentRate,
+        s->wallCurrentRate2);
+      if ((i % STATE_RESET_INTERVAL) == STATE_RESET_INTERVAL - 1)
+      {
+        // The copy is not part of the measured time.
+        elapsed_ns += getElapsed_ns(start);
+        *s = initial;
+        start = chrono::steady_clock::now();
+      }
+      break;
+    default:
+      TdsKernels::calcFourthRoots(Tube::NUM_PHARYNX_MOUTH_SECTIONS,
+        &s->area[Tube::FIRST_PHARYNX_SECTION], root);
+      break;
+    }
+  }
+
+  elapsed_ns += getElapsed_ns(start);
+  return elapsed_ns / numCalls;
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s <speaker file> [numCalls]\n", argv[0]);
+    return 1;
+  }
+
+  int numCalls = (argc > 2) ? atoi(argv[2]) : 200000;
+  int stage, set;
+  double total_ns[TdsKernels::NUM_INSTRUCTION_SETS];
+
+  if (numCalls < 1) { numCalls = 1; }
+
+  shared_ptr<const SpeakerModel> speaker = SpeakerModel::load(argv[1]);
+  if (!speaker)
+  {
+    printf("Error: The speaker file could not be loaded.\n");
+    return 1;
+  }
+
+  TdsKernels::InstructionSet bestSet = TdsKernels::getInstructionSet();
+  unique_ptr<TdsModel> model(new TdsModel());
+  double step_ns = runModel(*speaker, *model, 20000);
+
+  TdsKernels::Parameters p;
+  p.timeStep = model->timeStep;
+  p.theta = TdsModel::THETA;
+  p.minArea_cm2 = TdsModel::MIN_AREA_CM2;
+
+  printf("%-22s", "ns per sample");
+  for (set = 0; set < TdsKernels::NUM_INSTRUCTION_SETS; set++)
+  {
+    total_ns[set] = 0.0;
+    if (TdsKernels::isSupported((TdsKernels::InstructionSet)set))
+    {
+      printf("%10s", TdsKernels::getName((TdsKernels::InstructionSet)set));
+    }
+  }
+  printf("\n");
+
+  for (stage = 0; stage < NUM_STAGES; stage++)
+  {
+    printf("%-22s", STAGE_NAMES[stage]);
+    for (set = 0; set < TdsKernels::NUM_INSTRUCTION_SETS; set++)
+    {
+      if (TdsKernels::isSupported((TdsKernels::InstructionSet)set))
+      {
+        TdsKernels::setInstructionSet((TdsKernels::InstructionSet)set);
+        double t_ns = runStage(stage, model->sections, p, numCalls);
+        // calcFourthRoots() is called twice per sample.
+        if (stage == NUM_STAGES - 1) { t_ns *= 2.0; }
+        total_ns[set] += t_ns;
+        printf("%10.1f", t_ns);
+      }
+    }
+    printf("\n");
+  }
+
+  printf("%-22s", "all stages");
+  for (set = 0; set < TdsKernels::NUM_INSTRUCTION_SETS; set++)
+  {
+    if (TdsKernels::isSupported((TdsKernels::InstructionSet)set))
+    {
+      printf("%10.1f", total_ns[set]);
+    }
+  }
+  printf("\n");
+
+  TdsKernels::setInstructionSet(bestSet);
+  printf("Whole time step with the glottis (%s): %.1f ns per sample\n",
+    TdsKernels::getName(bestSet), step_ns);
+
+  return 0;
+}
@@ -20,12 +20,14 @@
 // ****************************************************************************
 
 #include "TdsModel.h"
+#include "TdsKernels.h"
 #include <fstream>
 #include <iomanip>
 #include <cstdlib>
 #include <limits>
 #include <iostream>
 #include <random>
+#include <vector>
 
 // For theta = 0.505, the TDS bandwidths are about the same as those
 // of the FDS for frequencies up to 5 kHz. Above 5 kHz, the TDS resonance
@@ -41,6 +43,10 @@ const double TdsModel::MIN_AREA_CM2 = 0.01E-2; // = 0.01 mm^2;
 // Cutoff-freq. of the low-pass filter for the flow that induces friction
 const double TdsModel::NOISE_CUTOFF_FREQ = 500.0;    
 
+// Upper limit of the cutoff-freq. of the noise sources relative to the 
+// sampling rate.
+const double TdsModel::MAX_NOISE_CUTOFF_FREQ_RATIO = 0.45;
+
 // double max_velocity = 0.0;
 // double max_fullAmp = 0.0;
 // double max_targetkHzAmp = 0.0;
@@ -69,6 +75,7 @@ const double TdsModel::NOISE_CUTOFF_FREQ = 500.0;
 
 TdsModel::TdsModel()
 {
+  samplingRate = SAMPLING_RATE;
   constrictionBuffer = new Constriction[CONSTRICTION_BUFFER_SIZE];
   constrictionMonitorTubeSection = 0;
 
@@ -83,7 +90,7 @@ TdsModel::TdsModel()
   options.piriformFossa = true;
   options.innerLengthCorrections = false;
   options.transvelarCoupling = false;
-  options.solverType = CHOLESKY_FACTORIZATION; // CHOLESKY_FACTORIZATION | SOR_GAUSS_SEIDEL
+  options.solverType = CHOLESKY_FACTORIZATION; // CHOLESKY_FACTORIZATION | SOR_GAUSS_SEIDEL | TREE_ELIMINATION
 
   // ****************************************************************
 
@@ -92,6 +99,7 @@ TdsModel::TdsModel()
 
   initModel();
   resetMotion();
+  resetFactorizationStatistics();
 }
 
 // ****************************************************************************
@@ -113,7 +121,7 @@ void TdsModel::initModel()
   int i, j, k;
 
   SORIterations = 0;
-  timeStep = 1.0 / (double)SAMPLING_RATE;
+  timeStep = 1.0 / (double)samplingRate;
 
   // The network components of the static tube segments must be
   // initialized once at the beginning.
@@ -214,27 +222,9 @@ void TdsModel::initModel()
 
   // ****************************************************************
   // Init the matrix and the help structures for the Cholesky 
-  // factorization.
+  // factorization (symbolic factorization).
   // ****************************************************************
 
-  for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
-  {
-    numFilledRowValuesSymmetricEnvelope[i] = 0;
-    for (k = 0; k < MAX_CONCERNED_MATRIX_COLUMNS_SYMMETRIC_ENVELOPE; k++)
-    {
-      filledRowIndexSymmetricEnvelope[i][k] = 0;
-    }
-  }
-
-  for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
-  {
-    numFilledColumnValuesSymmetricEnvelope[i] = 0;
-    for (k = 0; k < MAX_CONCERNED_MATRIX_ROWS_SYMMETRIC_ENVELOPE; k++)
-    {
-      filledColumnIndexSymmetricEnvelope[i][k] = 0;
-    }
-  }
-
   // Fill the whole matrix with zeros.
 
   for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
@@ -245,18 +235,17 @@ void TdsModel::initModel()
     }
   }
 
-  // Fill the whole factorizationMatrix with zeros.
-
-  for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
+  for (i = 0; i < MAX_ENVELOPE_SIZE; i++)
   {
-    for (j = 0; j < NUM_BRANCH_CURRENTS; j++)
-    {
-      factorizationMatrix[i][j] = 0.0;
-    }
+    envelope[i] = 0.0;
+    envelopeMatrix[i] = 0.0;
   }
+  isFactorizationValid = false;
 
   // Set a 1 to all non-zero places in the matrix.
 
+  envelopeRowStart[0] = 0;
+
   for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
   {
     if (branchCurrent[i].sourceSection != -1)
@@ -275,26 +264,48 @@ void TdsModel::initModel()
       if (ts->currentOut[1] != -1) { matrix[i][ts->currentOut[1]] = 1.0; }
     }
 
-    // Keep in mind the columns elements with a number different from
-    // zero in one row in the lower left triangular matrix and the 
-    // columns elements between the first non zeros in one row and 
-    // the main diagonal (symmetric envelope format).
-    // The indices on the main diagonal are not kept in mind explicitly.
-
-    numFilledRowValuesSymmetricEnvelope[i] = 0;
-    int betweenNonZeros = 0;
+    // The envelope of row i in the lower left triangular matrix reaches
+    // from the first non-zero column to the main diagonal. The fill-in of
+    // the factorization stays within the envelope.
 
+    envelopeFirstColumn[i] = i;
     for (j = 0; j < i; j++)
     {
-      if ((matrix[i][j] != 0.0) || betweenNonZeros != 0)
+      if (matrix[i][j] != 0.0)
       {
-        betweenNonZeros = 1;
-        matrix[i][j] = 1;  // for the calculation of the envelpe column indices
+        envelopeFirstColumn[i] = j;
+        break;
+      }
+    }
 
-        if (numFilledRowValuesSymmetricEnvelope[i] < MAX_CONCERNED_MATRIX_COLUMNS_SYMMETRIC_ENVELOPE)
+    if ((i - envelopeFirstColumn[i] > MAX_CONCERNED_MATRIX_COLUMNS_SYMMETRIC_ENVELOPE) ||
+      (envelopeRowStart[i] + i - envelopeFirstColumn[i] + 1 > MAX_ENVELOPE_SIZE))
+    {
+      printf("Error: Attention: The max. number of used rows and columns has been "
+        "exceeded in prepareCholeskyFactorization().\n");
+      envelopeFirstColumn[i] = i;
+    }
+
+    envelopeRowStart[i + 1] = envelopeRowStart[i] + i - envelopeFirstColumn[i] + 1;
+  }
+
+  // Keep in mind the rows below the main diagonal whose envelope contains
+  // the column, and where their values are stored.
+
+  for (j = 0; j < NUM_BRANCH_CURRENTS; j++)
+  {
+    numFilledColumnValuesSymmetricEnvelope[j] = 0;
+
+    for (i = j + 1; i < NUM_BRANCH_CURRENTS; i++)
+    {
+      if (envelopeFirstColumn[i] <= j)
+      {
+        if (numFilledColumnValuesSymmetricEnvelope[j] < MAX_CONCERNED_MATRIX_ROWS_SYMMETRIC_ENVELOPE)
         {
-          filledRowIndexSymmetricEnvelope[i][numFilledRowValuesSymmetricEnvelope[i]] = j;
-          numFilledRowValuesSymmetricEnvelope[i]++;
+          k = numFilledColumnValuesSymmetricEnvelope[j];
+          filledColumnIndexSymmetricEnvelope[j][k] = i;
+          filledColumnPosSymmetricEnvelope[j][k] = envelopeRowStart[i] + j - envelopeFirstColumn[i];
+          numFilledColumnValuesSymmetricEnvelope[j]++;
         }
         else
         {
@@ -305,32 +316,151 @@ void TdsModel::initModel()
     }
   }
 
-  // Keep in mind the rows elements with a number different from zero
-  // in one column in the lower left triangular matrix.
-  // (symmetric envelope format)
-  // The indices on the main diagonal are not kept in mind explicitly.
+  // ****************************************************************
+  // Init the help structures for the tree elimination. The network
+  // of branch currents has the topology of a tree (with small loops
+  // at the junctions and the radiation impedances), so that there
+  // is an elimination order with (almost) no fill-in. It is found by
+  // greedily eliminating the current that causes the least fill-in,
+  // i.e., starting from the ends of the branches.
+  // ****************************************************************
 
-  for (j = 0; j < NUM_BRANCH_CURRENTS; j++)
-  {
-    numFilledColumnValuesSymmetricEnvelope[j] = 0;
+  vector<int> entryIndex(NUM_BRANCH_CURRENTS*NUM_BRANCH_CURRENTS, -1);
+  bool isEliminated[NUM_BRANCH_CURRENTS];
+  int neighbor[NUM_BRANCH_CURRENTS];
+  int numNeighbors;
+  int bestCurrent, bestFillIn, bestNumNeighbors, fillIn;
 
-    for (i = j + 1; i < NUM_BRANCH_CURRENTS; i++)
+  numTreeEntries = 0;
+  isTreeEliminationPossible = true;
+
+  for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
+  {
+    isEliminated[i] = false;
+    for (j = 0; j < i; j++)
     {
       if (matrix[i][j] != 0.0)
       {
+        if (numTreeEntries < MAX_TREE_ENTRIES)
+        {
+          treeEntryRow[numTreeEntries] = i;
+          treeEntryColumn[numTreeEntries] = j;
+          entryIndex[i*NUM_BRANCH_CURRENTS + j] = numTreeEntries;
+          entryIndex[j*NUM_BRANCH_CURRENTS + i] = numTreeEntries;
+          numTreeEntries++;
+        }
+        else
+        {
+          isTreeEliminationPossible = false;
+        }
+      }
+    }
+  }
 
-        if (numFilledColumnValuesSymmetricEnvelope[j] < MAX_CONCERNED_MATRIX_ROWS_SYMMETRIC_ENVELOPE)
+  for (k = 0; (k < NUM_BRANCH_CURRENTS) && (isTreeEliminationPossible); k++)
+  {
+    // Find the current with the least fill-in (and the fewest neighbors).
+
+    bestCurrent = -1;
+    bestFillIn = 0;
+    bestNumNeighbors = 0;
+
+    for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
+    {
+      if (isEliminated[i])
+      {
+        continue;
+      }
+
+      numNeighbors = 0;
+      for (j = 0; j < NUM_BRANCH_CURRENTS; j++)
+      {
+        if ((!isEliminated[j]) && (entryIndex[i*NUM_BRANCH_CURRENTS + j] != -1))
         {
-          filledColumnIndexSymmetricEnvelope[j][numFilledColumnValuesSymmetricEnvelope[j]] = i;
-          numFilledColumnValuesSymmetricEnvelope[j]++;
+          neighbor[numNeighbors++] = j;
+        }
+      }
+
+      fillIn = 0;
+      for (int a = 0; a < numNeighbors; a++)
+      {
+        for (int b = a + 1; b < numNeighbors; b++)
+        {
+          if (entryIndex[neighbor[a]*NUM_BRANCH_CURRENTS + neighbor[b]] == -1) { fillIn++; }
+        }
+      }
+
+      if ((bestCurrent == -1) || (fillIn < bestFillIn) ||
+        ((fillIn == bestFillIn) && (numNeighbors < bestNumNeighbors)))
+      {
+        bestCurrent = i;
+        bestFillIn = fillIn;
+        bestNumNeighbors = numNeighbors;
+      }
+    }
+
+    // Eliminate this current.
+
+    treeOrder[k] = bestCurrent;
+    numTreeNeighbors[k] = 0;
+
+    for (j = 0; j < NUM_BRANCH_CURRENTS; j++)
+    {
+      if ((!isEliminated[j]) && (entryIndex[bestCurrent*NUM_BRANCH_CURRENTS + j] != -1))
+      {
+        if (numTreeNeighbors[k] < MAX_TREE_NEIGHBORS)
+        {
+          treeNeighbor[k][numTreeNeighbors[k]] = j;
+          treeNeighborEntry[k][numTreeNeighbors[k]] = entryIndex[bestCurrent*NUM_BRANCH_CURRENTS + j];
+          numTreeNeighbors[k]++;
         }
         else
         {
-          printf("Error: Attention: The max. number of used rows and columns has been "
-            "exceeded in prepareCholeskyFactorization().\n");
+          isTreeEliminationPossible = false;
         }
       }
     }
+
+    // The values between the pairs of neighbors are updated (and 
+    // created as fill-in if necessary).
+
+    int u = 0;
+    for (int a = 0; (a < numTreeNeighbors[k]) && (isTreeEliminationPossible); a++)
+    {
+      for (int b = a + 1; (b < numTreeNeighbors[k]) && (isTreeEliminationPossible); b++)
+      {
+        int row = treeNeighbor[k][a];
+        int col = treeNeighbor[k][b];
+        if (entryIndex[row*NUM_BRANCH_CURRENTS + col] == -1)
+        {
+          if (numTreeEntries < MAX_TREE_ENTRIES)
+          {
+            treeEntryRow[numTreeEntries] = row;
+            treeEntryColumn[numTreeEntries] = col;
+            entryIndex[row*NUM_BRANCH_CURRENTS + col] = numTreeEntries;
+            entryIndex[col*NUM_BRANCH_CURRENTS + row] = numTreeEntries;
+            numTreeEntries++;
+          }
+          else
+          {
+            isTreeEliminationPossible = false;
+            break;
+          }
+        }
+        treeUpdateEntry[k][u++] = entryIndex[row*NUM_BRANCH_CURRENTS + col];
+      }
+    }
+
+    isEliminated[bestCurrent] = true;
+  }
+
+  // Without a complete elimination order, the tree elimination would 
+  // give wrong results.
+
+  if (isTreeEliminationPossible == false)
+  {
+    printf("Error: Attention: The max. number of neighbors or matrix values has been "
+      "exceeded in prepareTreeElimination(). The Cholesky factorization is used instead.\n");
   }
 
   // ****************************************************************
@@ -429,21 +559,21 @@ void TdsModel::resetMotion()
   {
     ts = &tubeSection[i];
 
-    ts->pressure         = 0.0;
-    ts->pressureRate     = 0.0;
-    ts->wallCurrent      = 0.0;
-    ts->wallCurrentRate  = 0.0;
-    ts->wallCurrentRate2 = 0.0;
+    sections.pressure[i]         = 0.0;
+    sections.pressureRate[i]     = 0.0;
+    sections.wallCurrent[i]      = 0.0;
+    sections.wallCurrentRate[i]  = 0.0;
+    sections.wallCurrentRate2[i] = 0.0;
     
     // Intermediate values ********************************
-    ts->L                = 0.0;
-    ts->C                = 0.0;
-    ts->R[0] = ts->R[1]  = 0.0;
-    ts->S                = 0.0;
-    ts->alpha            = 0.0;
-    ts->beta             = 0.0;
-    ts->D                = 0.0;
-    ts->E                = 0.0;
+    sections.L[i]                = 0.0;
+    sections.C[i]                = 0.0;
+    sections.R[0][i] = sections.R[1][i]  = 0.0;
+    sections.S[i]                = 0.0;
+    sections.alpha[i]            = 0.0;
+    sections.beta[i]             = 0.0;
+    sections.D[i]                = 0.0;
+    sections.E[i]                = 0.0;
 
     // Set the noise sources to 0 ***********************************
 
@@ -517,7 +647,7 @@ void TdsModel::resetMotion()
     flowVector[i] = 0.0; 
   }
 
-  transglottalPressureFilter.createChebyshev(50.0 / (double)SAMPLING_RATE, false, 4);
+  transglottalPressureFilter.createChebyshev(50.0 / (double)samplingRate, false, 4);
   transglottalPressureFilter.resetBuffers();
 
 
@@ -527,7 +657,9 @@ void TdsModel::resetMotion()
   // difference of the pressures P_below and P_above below and above the velum.
   // The filter coefficients were derived from a matched z-transform of the
   // analog circuit model for the velum according to Dang et al. (2016, JASA)
-  // for a sampling rate of 44100 Hz.
+  // for a sampling rate of 44100 Hz. For other sampling rates, the 
+  // same transform is applied to the poles and zeros of H1(s) and H2(s)
+  // (see createCouplingFilter()).
   // U_nose(s) = P_below(s)*H1(s) + P_above(s)*H2(s).
   // ****************************************************************
 
@@ -573,8 +705,38 @@ void TdsModel::resetMotion()
     -0.987047716233603
   };
   
+  // The common poles of H1(s) and H2(s) and their zeros in rad/s, as
+  // obtained from the coefficients above.
+  const ComplexValue POLES[COUPLING_FILTER_ORDER] =
+  {
+    ComplexValue(-130.6122450, 230.6345438),
+    ComplexValue(-130.6122450, -230.6345438),
+    ComplexValue(-156.8513119, 1124.946163),
+    ComplexValue(-156.8513119, -1124.946163)
+  };
+  const ComplexValue ZEROS1[2] =
+  {
+    ComplexValue(0.0, 0.0),
+    ComplexValue(-23245.00232, 0.0)
+  };
+  const ComplexValue ZEROS2[3] =
+  {
+    ComplexValue(0.0, 0.0),
+    ComplexValue(-143.7317653, 812.1084898),
+    ComplexValue(-143.7317653, -812.1084898)
+  };
+
   transvelarCouplingFilter1.setCoefficients(a1, b1, COUPLING_FILTER_ORDER);
   transvelarCouplingFilter2.setCoefficients(a2, b2, COUPLING_FILTER_ORDER);
+  glottalToneFilter.setCoefficients(a1, b1, COUPLING_FILTER_ORDER);
+
+  if (samplingRate != SAMPLING_RATE)
+  {
+    createCouplingFilter(transvelarCouplingFilter1, POLES, COUPLING_FILTER_ORDER, ZEROS1, 2);
+    createCouplingFilter(transvelarCouplingFilter2, POLES, COUPLING_FILTER_ORDER, ZEROS2, 3);
+    createCouplingFilter(glottalToneFilter, POLES, COUPLING_FILTER_ORDER, ZEROS1, 2);
+  }
+
   transvelarCouplingFilter1.resetBuffers();
   transvelarCouplingFilter2.resetBuffers();
 
@@ -585,7 +747,6 @@ void TdsModel::resetMotion()
   // Use the same filter here as for the transvelar coupling.
   // ****************************************************************
 
-  glottalToneFilter.setCoefficients(a1, b1, COUPLING_FILTER_ORDER);
   glottalToneFilter.resetBuffers();
 
   // ****************************************************************
@@ -599,6 +760,204 @@ void TdsModel::resetMotion()
 }
 
 
+// ****************************************************************************
+/// Sets the sampling rate of the simulation (by default SAMPLING_RATE) and
+/// reinitializes the model. All filters and time constants of the model are 
+/// derived from this rate. Returns false if the rate is out of range.
+// ****************************************************************************
+
+bool TdsModel::setSamplingRate(int samplingRate_Hz)
+{
+  if ((samplingRate_Hz < MIN_SAMPLING_RATE) || (samplingRate_Hz > MAX_SAMPLING_RATE))
+  {
+    std::cout << "ERROR: The sampling rate must be in the range from " 
+      << MIN_SAMPLING_RATE << " to " << MAX_SAMPLING_RATE << " Hz." << endl;
+    return false;
+  }
+
+  samplingRate = samplingRate_Hz;
+  initModel();
+  resetMotion();
+  return true;
+}
+
+
+// ****************************************************************************
+/// Saves the dynamic state of the simulation after the last time step, i.e.,
+/// all pressures, flows and their derivatives, the noise sources, the filter
+/// buffers, the random number generator and the sample position. Together 
+/// with restoreMotionState(), the simulation can be continued from this 
+/// point several times with different inputs.
+// ****************************************************************************
+
+void TdsModel::saveMotionState(MotionState &state)
+{
+  int i;
+
+  state.samplingRate = samplingRate;
+  state.position = position;
+
+  state.flowSourceAmp = flowSourceAmp;
+  state.flowSourceSection = flowSourceSection;
+  state.pressureSourceAmp = pressureSourceAmp;
+  state.pressureSourceSection = pressureSourceSection;
+
+  state.lipsDipoleSource = lipsDipoleSource;
+  for (i = 0; i < Tube::NUM_SECTIONS; i++)
+  {
+    state.tubeSection[i] = tubeSection[i];
+  }
+  state.sections = sections;
+  for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
+  {
+    state.branchCurrent[i] = branchCurrent[i];
+    state.solutionVector[i] = solutionVector[i];
+    state.flowVector[i] = flowVector[i];
+  }
+
+  state.glottalToneFilter = glottalToneFilter;
+  state.transglottalPressureFilter = transglottalPressureFilter;
+  state.glottalBernoulliFactor = glottalBernoulliFactor;
+  state.transvelarCouplingFilter1 = transvelarCouplingFilter1;
+  state.transvelarCouplingFilter2 = transvelarCouplingFilter2;
+
+  for (i = 0; i < MAX_CONSTRICTIONS; i++)
+  {
+    state.constriction[i] = constriction[i];
+  }
+  state.numConstrictions = numConstrictions;
+
+  state.doNetworkInitialization = doNetworkInitialization;
+  state.aspirationStrength_dB = aspirationStrength_dB;
+  state.teethPosition = teethPosition;
+  state.tongueTipSideElevation = tongueTipSideElevation;
+  state.randomNumberGenerator = randomNumberGenerator;
+}
+
+
+// ****************************************************************************
+/// Continues the simulation from a state saved with saveMotionState(), 
+/// possibly of another model of the same speaker. The following time steps
+/// give exactly the same results as those after saving the state.
+/// The Cholesky factor is kept: it is checked against the next matrix row by
+/// row anyway. Returns false if the state was saved at another sampling rate.
+// ****************************************************************************
+
+bool TdsModel::restoreMotionState(const MotionState &state)
+{
+  int i;
+
+  if (state.samplingRate != samplingRate)
+  {
+    return false;
+  }
+
+  position = state.position;
+
+  flowSourceAmp = state.flowSourceAmp;
+  flowSourceSection = state.flowSourceSection;
+  pressureSourceAmp = state.pressureSourceAmp;
+  pressureSourceSection = state.pressureSourceSection;
+
+  lipsDipoleSource = state.lipsDipoleSource;
+  for (i = 0; i < Tube::NUM_SECTIONS; i++)
+  {
+    tubeSection[i] = state.tubeSection[i];
+  }
+  sections = state.sections;
+  for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
+  {
+    branchCurrent[i] = state.branchCurrent[i];
+    solutionVector[i] = state.solutionVector[i];
+    flowVector[i] = state.flowVector[i];
+  }
+
+  glottalToneFilter = state.glottalToneFilter;
+  transglottalPressureFilter = state.transglottalPressureFilter;
+  glottalBernoulliFactor = state.glottalBernoulliFactor;
+  transvelarCouplingFilter1 = state.transvelarCouplingFilter1;
+  transvelarCouplingFilter2 = state.transvelarCouplingFilter2;
+
+  for (i = 0; i < MAX_CONSTRICTIONS; i++)
+  {
+    constriction[i] = state.constriction[i];
+  }
+  numConstrictions = state.numConstrictions;
+
+  doNetworkInitialization = state.doNetworkInitialization;
+  aspirationStrength_dB = state.aspirationStrength_dB;
+  teethPosition = state.teethPosition;
+  tongueTipSideElevation = state.tongueTipSideElevation;
+  randomNumberGenerator = state.randomNumberGenerator;
+
+  return true;
+}
+
+
+// ****************************************************************************
+/// Replaces the coefficients of the given filter, which are those for 
+/// SAMPLING_RATE, by the matched z-transform of the analog filter with the
+/// given poles and zeros (in rad/s) for the current sampling rate.
+/// The gain is chosen such that the magnitude at a low reference frequency 
+/// stays the same.
+// ****************************************************************************
+
+void TdsModel::createCouplingFilter(IirFilter &filter, const ComplexValue *poles, 
+  int numPoles, const ComplexValue *zeros, int numZeros)
+{
+  const double REFERENCE_FREQ_HZ = 100.0;
+  ComplexValue referenceResponse = 
+    filter.getFrequencyResponse(REFERENCE_FREQ_HZ / (double)SAMPLING_RATE);
+
+  // Expand the products of (1 - exp(s_k*T)*z^(-1)) into polynomials in z^(-1).
+  ComplexValue numerator[MAX_IIR_ORDER + 1];
+  ComplexValue denominator[MAX_IIR_ORDER + 1];
+  double A[MAX_IIR_ORDER + 1];
+  double B[MAX_IIR_ORDER + 1];
+  int order = max(numPoles, numZeros);
+  int i, k;
+
+  for (i = 0; i <= order; i++)
+  {
+    numerator[i] = 0.0;
+    denominator[i] = 0.0;
+  }
+  numerator[0] = 1.0;
+  denominator[0] = 1.0;
+
+  for (k = 0; k < numZeros; k++)
+  {
+    ComplexValue z = exp(zeros[k] * timeStep);
+    for (i = k + 1; i > 0; i--)
+    {
+      numerator[i] -= z * numerator[i - 1];
+    }
+  }
+
+  for (k = 0; k < numPoles; k++)
+  {
+    ComplexValue p = exp(poles[k] * timeStep);
+    for (i = k + 1; i > 0; i--)
+    {
+      denominator[i] -= p * denominator[i - 1];
+    }
+  }
+
+  // The imaginary parts cancel out for conjugate complex pairs of roots.
+  A[0] = numerator[0].real();
+  B[0] = 0.0;
+  for (i = 1; i <= order; i++)
+  {
+    A[i] = numerator[i].real();
+    B[i] = -denominator[i].real();
+  }
+
+  filter.setCoefficients(A, B, order);
+  filter.setGain(abs(referenceResponse) / 
+    abs(filter.getFrequencyResponse(REFERENCE_FREQ_HZ / (double)samplingRate)));
+}
+
+
 // ****************************************************************************
 // Save the data in the constriction buffer to a file.
 // ****************************************************************************
@@ -671,9 +1030,25 @@ void TdsModel::setTube(Tube *tube, bool filtering)
   int i;
   TubeSection *target = NULL;
   Tube::Section *source = NULL;
-  double oldArea_cm2 = 0.0;
   double newArea_cm2 = 0.0;
 
+  // The fourth roots of the old and new areas of the pharynx and mouth
+  // sections for the smoothing below, calculated for all sections at once.
+  const int N = Tube::NUM_PHARYNX_MOUTH_SECTIONS;
+  double newAreas_cm2[N];
+  double oldRoots[N];
+  double newRoots[N];
+
+  if (filtering)
+  {
+    for (i = 0; i < N; i++)
+    {
+      newAreas_cm2[i] = tube->pharynxMouthSection[i].area_cm2;
+    }
+    TdsKernels::calcFourthRoots(N, &sections.area[Tube::FIRST_PHARYNX_SECTION], oldRoots);
+    TdsKernels::calcFourthRoots(N, newAreas_cm2, newRoots);
+  }
+
   for (i = 0; i < Tube::NUM_SECTIONS; i++)
   {
     source = tube->section[i];
@@ -688,22 +1063,21 @@ void TdsModel::setTube(Tube *tube, bool filtering)
 
     if ((filtering) && (i >= Tube::FIRST_PHARYNX_SECTION) && (i <= Tube::LAST_MOUTH_SECTION))
     {
-      oldArea_cm2 = target->area;
       newArea_cm2 = source->area_cm2;
 
       // This is a CLOSING gesture.
-      if (newArea_cm2 < oldArea_cm2)
+      if (newArea_cm2 < sections.area[i])
       {
         // Make a nonlinear transformation of the areas so that 
         // changes at smaller areas are constraint stronger.
-        double oldValue = sqrt(sqrt(oldArea_cm2));
-        double newValue = sqrt(sqrt(newArea_cm2));
+        double oldValue = oldRoots[i - Tube::FIRST_PHARYNX_SECTION];
+        double newValue = newRoots[i - Tube::FIRST_PHARYNX_SECTION];
         
-        // This threshold depends on SAMPLING_RATE and is optimized
-        // for SAMPLING_RATE = 44100. It is adjusted such that 
-        // closures start to slow down when the areas become smaller 
-        // than about 25 mm^2.
-        const double THRESHOLD = -0.001;
+        // This threshold (per sample) was optimized for a sampling 
+        // rate of 44100 Hz and is scaled for other sampling rates. It 
+        // is adjusted such that closures start to slow down when the 
+        // areas become smaller than about 25 mm^2.
+        const double THRESHOLD = -0.001 * (double)SAMPLING_RATE / (double)samplingRate;
 
         if (newValue - oldValue < THRESHOLD)
         {
@@ -718,18 +1092,18 @@ void TdsModel::setTube(Tube *tube, bool filtering)
       {
         // Make a nonlinear transformation of the areas so that 
         // changes at smaller areas are constraint stronger.
-        double oldValue = sqrt(sqrt(oldArea_cm2));
-        double newValue = sqrt(sqrt(newArea_cm2));
+        double oldValue = oldRoots[i - Tube::FIRST_PHARYNX_SECTION];
+        double newValue = newRoots[i - Tube::FIRST_PHARYNX_SECTION];
 
-        // This threshold depends on SAMPLING_RATE and is optimized
-        // for SAMPLING_RATE = 44100. It may be different from that for
-        // the closing gesture!
+        // This threshold (per sample) was optimized for a sampling 
+        // rate of 44100 Hz and is scaled for other sampling rates. 
+        // It may be different from that for the closing gesture!
 
 //        const double THRESHOLD = 0.001;     // ORIGINAL: Like the closure...
         
         // Must be > 0.001 (as during opening), because otherwise
         // the burst will get too strong in /utu/, for example.
-        const double THRESHOLD = 0.002; // 0.001;
+        const double THRESHOLD = 0.002 * (double)SAMPLING_RATE / (double)samplingRate; // 0.001;
 
         if (newValue - oldValue > THRESHOLD)
         {
@@ -739,23 +1113,23 @@ void TdsModel::setTube(Tube *tube, bool filtering)
       }
 
       target->pos = source->pos_cm;
-      target->area = newArea_cm2;
-      target->length = source->length_cm;
-      target->volume = source->length_cm * newArea_cm2;
+      sections.area[i] = newArea_cm2;
+      sections.length[i] = source->length_cm;
+      sections.volume[i] = source->length_cm * newArea_cm2;
     }
     else
     {
       target->pos = source->pos_cm;
-      target->area = source->area_cm2;
-      target->length = source->length_cm;
-      target->volume = source->volume_cm3;
+      sections.area[i] = source->area_cm2;
+      sections.length[i] = source->length_cm;
+      sections.volume[i] = source->volume_cm3;
     }
 
     // **************************************************************
 
-    target->Mw = source->wallMass_cgs;
-    target->Bw = source->wallResistance_cgs;
-    target->Kw = source->wallStiffness_cgs;
+    sections.Mw[i] = source->wallMass_cgs;
+    sections.Bw[i] = source->wallResistance_cgs;
+    sections.Kw[i] = source->wallStiffness_cgs;
 
     // Tube sections with a small area should have a higher stiffness,
     // and for "closed" tube sections the stiffness should be very
@@ -764,15 +1138,15 @@ void TdsModel::setTube(Tube *tube, bool filtering)
     // even during complete closures. This may cause artifacts.
     
     const double CRITICAL_AREA_CM2 = 1.0;
-    if (target->area < CRITICAL_AREA_CM2)
+    if (sections.area[i] < CRITICAL_AREA_CM2)
     {
-      double a = target->area / CRITICAL_AREA_CM2;
+      double a = sections.area[i] / CRITICAL_AREA_CM2;
       // Maximal stiffness increase is by a factor of 100.
       if (a < 0.01)
       {
         a = 0.01;
       }
-      target->Kw /= a;
+      sections.Kw[i] /= a;
     }
 
     target->articulator = source->articulator;
@@ -804,13 +1178,13 @@ void TdsModel::getTube(Tube *tube)
     target = tube->section[i];
 
     target->pos_cm     = source->pos;
-    target->area_cm2   = source->area;
-    target->length_cm  = source->length;
-    target->volume_cm3 = source->volume;
+    target->area_cm2   = sections.area[i];
+    target->length_cm  = sections.length[i];
+    target->volume_cm3 = sections.volume[i];
 
-    target->wallMass_cgs       = source->Mw;
-    target->wallResistance_cgs = source->Bw;
-    target->wallStiffness_cgs  = source->Kw;
+    target->wallMass_cgs       = sections.Mw[i];
+    target->wallResistance_cgs = sections.Bw[i];
+    target->wallStiffness_cgs  = sections.Kw[i];
 
     target->articulator = source->articulator;
   }
@@ -869,8 +1243,6 @@ void TdsModel::setPressureSource(double pressure_dPa, int section)
 double TdsModel::proceedTimeStep(double& mouthFlow_cm3_s, double& nostrilFlow_cm3_s,
   double& skinFlow_cm3_s, const string &matrixFileName)
 {
-  TubeSection *ts = NULL;
-
   // cout << "---------------------------------------------------------------------------------------------------------------------------------------------------------" << endl;
   // cout << "Sample #" << getSampleIndex() << endl;
 
@@ -886,11 +1258,32 @@ double TdsModel::proceedTimeStep(double& mouthFlow_cm3_s, double& nostrilFlow_cm
     solveEquationsCholesky();
   }
   else
+  if (options.solverType == TREE_ELIMINATION)
+  {
+    // Solve the system of eqs. by elimination along the branches
+    solveEquationsTree();
+  }
+  else
   {
     // Default: Solve the system of eqs. with the SOR method.
     solveEquationsSor(matrixFileName);
   }
 
+  return finishTimeStep(mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s);
+}
+
+
+// ****************************************************************************
+/// Second part of proceedTimeStep() after the system of equations was solved:
+/// Updates the state of the model with the new flows and returns the 
+/// radiated flow.
+// ****************************************************************************
+
+double TdsModel::finishTimeStep(double& mouthFlow_cm3_s, double& nostrilFlow_cm3_s,
+  double& skinFlow_cm3_s)
+{
+  TubeSection *ts = NULL;
+
   // Recalculate all currents, pressures and their derivatives.
   updateVariables();
 
@@ -921,8 +1314,7 @@ double TdsModel::proceedTimeStep(double& mouthFlow_cm3_s, double& nostrilFlow_cm
 
   if (options.radiationFromSkin)
   {
-    ts = &tubeSection[Tube::FIRST_PHARYNX_SECTION];
-    skinFlow_cm3_s = glottalToneFilter.getOutputSample(ts->pressure);
+    skinFlow_cm3_s = glottalToneFilter.getOutputSample(sections.pressure[Tube::FIRST_PHARYNX_SECTION]);
   }
   
   // Increase the internal position counter to the next sample.
@@ -953,107 +1345,86 @@ void TdsModel::prepareTimeStep()
 {
   TubeSection *ts = NULL;
   int i;
-  double d;
   double Lw, Rw, Cw;
   double surface;
-  double a, b;
   double u;
-  double circ;
 
   // Calculate the values D and E and the components L, R, W, C for
   // all tube sections.
   
   // cout << "In prepareTimeStep: " << endl;
 
-  for (i=0; i < Tube::NUM_SECTIONS; i++)
-  {
-    ts = &tubeSection[i];
-    if (ts->area < MIN_AREA_CM2) 
-    { 
-      ts->area = MIN_AREA_CM2; 
-    }
+  TdsKernels::Parameters kernelParams;
+  kernelParams.timeStep = timeStep;
+  kernelParams.theta = THETA;
+  kernelParams.minArea_cm2 = MIN_AREA_CM2;
 
-    ts->S = 0.0;      // No pressure source at the inlet of the section，section入口处无压力
-    circ = 2.0*sqrt(ts->area*M_PI);
+  double circ[Tube::NUM_SECTIONS];
 
-    // **************************************************************
-    // Recalculate the components of the dynamic tube sections.
-    // **************************************************************
+  // **************************************************************
+  // Recalculate the components of the dynamic tube sections. All
+  // sections are first treated as normal tube segments.
+  // **************************************************************
 
-    // The Helmholtz-Resonators are special.
-    if ((i >= Tube::FIRST_SINUS_SECTION) && (i <= Tube::LAST_SINUS_SECTION))
-    {
-      ts->L    = AMBIENT_DENSITY_CGS*(ts->length / ts->area);
-      ts->C    = ts->volume / (AMBIENT_DENSITY_CGS*SOUND_VELOCITY_CGS*SOUND_VELOCITY_CGS);
-      ts->R[0] = (8.0*AIR_VISCOSITY_CGS * M_PI * ts->length) / (ts->area * ts->area);
-      ts->R[1] = ts->R[0];
-    }
-    // Normal tube segments.
-    else
-    {
-      // Assume a circular cross-section.
-      a = b = sqrt(ts->area / M_PI);      // Half-axes of the circle
+  TdsKernels::calcComponents(Tube::NUM_SECTIONS, kernelParams, sections.area,
+    sections.length, sections.volume, sections.L, sections.C, sections.R[0],
+    sections.R[1], sections.S, circ);
 
-      // If the radius of the circle becomes smaller than a threshold,
-      // then make the cross-section elliptical with the threshold
-      // being the length of the bigger half-axis.
-      // This will strongly increase the viscous resistance, esp.
-      // just before supraglottal or glottal closures and make it
-      // roughly equivalent to that of a rectangular slit.
-
-      double MIN_RADIUS_CM = 0.6;    // = 5 mm (corresponds to area of 1.1 cm^2)
-      if (a < MIN_RADIUS_CM)
-      {
-        a = MIN_RADIUS_CM;
-        b = ts->area / (M_PI*a);
-        
-        // if ( fabs(b) < min_b ) { min_b = fabs(b); }
-      }
-
-      ts->L    = (AMBIENT_DENSITY_CGS * 0.5 * ts->length) / ts->area;
-      ts->C    = ts->volume / (AMBIENT_DENSITY_CGS * SOUND_VELOCITY_CGS * SOUND_VELOCITY_CGS);
-      ts->R[0] = ((2.0 * AIR_VISCOSITY_CGS * ts->length) * (a * a + b * b)) / (M_PI*a*a*a*b*b*b);
-      ts->R[1] = ts->R[0];
-
-    }
+  // The Helmholtz-Resonators are special.
+  for (i = Tube::FIRST_SINUS_SECTION; i <= Tube::LAST_SINUS_SECTION; i++)
+  {
+    sections.L[i]    = AMBIENT_DENSITY_CGS*(sections.length[i] / sections.area[i]);
+    sections.C[i]    = sections.volume[i] / (AMBIENT_DENSITY_CGS*SOUND_VELOCITY_CGS*SOUND_VELOCITY_CGS);
+    sections.R[0][i] = (8.0*AIR_VISCOSITY_CGS * M_PI * sections.length[i]) / (sections.area[i] * sections.area[i]);
+    sections.R[1][i] = sections.R[0][i];
+  }
 
-    // **************************************************************
-    // The alpha and beta values for the incorporation of wall 
-    // vibration.
-    // **************************************************************
+  // **************************************************************
+  // The alpha and beta values for the incorporation of wall 
+  // vibration.
+  // **************************************************************
 
-    ts->alpha = 0.0;
-    ts->beta = 0.0;
+  if (options.softWalls)
+  {
+    TdsKernels::calcWallCoefficients(Tube::NUM_SECTIONS, kernelParams, circ,
+      sections.length, sections.Mw, sections.Bw, sections.Kw, sections.wallCurrent,
+      sections.wallCurrentRate, sections.wallCurrentRate2, sections.alpha, sections.beta);
 
-  	if ((options.softWalls) && (i != Tube::LOWER_GLOTTIS_SECTION) && (i != Tube::UPPER_GLOTTIS_SECTION))
-  	{
-      // What is the area of the wall ?
-      if ((i >= Tube::FIRST_SINUS_SECTION) && (i <= Tube::LAST_SINUS_SECTION))
-      {
-        surface = 4.0*M_PI*pow((3.0*ts->volume)/(4.0*M_PI), 2.0/3.0); // Surface of a sphere
-      }
-      else
-      {
-        surface = circ*ts->length;    // Surface of a cylinder barrel
-      }
+    // The wall of the Helmholtz-Resonators is the surface of a sphere.
+    for (i = Tube::FIRST_SINUS_SECTION; i <= Tube::LAST_SINUS_SECTION; i++)
+    {
+      surface = 4.0*M_PI*pow((3.0*sections.volume[i])/(4.0*M_PI), 2.0/3.0);
 
       if (surface < MIN_AREA_CM2)
       {
         surface = MIN_AREA_CM2;
       }
 
-      Rw = ts->Bw / surface;
-      Lw = ts->Mw / surface;
-      Cw = surface / ts->Kw;
+      Rw = sections.Bw[i] / surface;
+      Lw = sections.Mw[i] / surface;
+      Cw = surface / sections.Kw[i];
 
-      ts->alpha = 1.0 / (Lw / (timeStep*timeStep*THETA*THETA) + Rw / (timeStep*THETA) + 1.0/Cw);
-      ts->beta = ts->alpha*(
-        ts->wallCurrent*(Lw/(timeStep*timeStep*THETA*THETA) + Rw/(timeStep*THETA)) +
-        ts->wallCurrentRate*(Lw*(THETA1/THETA + 1.0)/(timeStep*THETA) + Rw*(THETA1/THETA)) +
-        ts->wallCurrentRate2*Lw*(THETA1/THETA)
+      sections.alpha[i] = 1.0 / (Lw / (timeStep*timeStep*THETA*THETA) + Rw / (timeStep*THETA) + 1.0/Cw);
+      sections.beta[i] = sections.alpha[i]*(
+        sections.wallCurrent[i]*(Lw/(timeStep*timeStep*THETA*THETA) + Rw/(timeStep*THETA)) +
+        sections.wallCurrentRate[i]*(Lw*(THETA1/THETA + 1.0)/(timeStep*THETA) + Rw*(THETA1/THETA)) +
+        sections.wallCurrentRate2[i]*Lw*(THETA1/THETA)
         );
-  	}
+    }
 
+    // No wall vibration at the glottis.
+    sections.alpha[Tube::LOWER_GLOTTIS_SECTION] = 0.0;
+    sections.beta[Tube::LOWER_GLOTTIS_SECTION] = 0.0;
+    sections.alpha[Tube::UPPER_GLOTTIS_SECTION] = 0.0;
+    sections.beta[Tube::UPPER_GLOTTIS_SECTION] = 0.0;
+  }
+  else
+  {
+    for (i = 0; i < Tube::NUM_SECTIONS; i++)
+    {
+      sections.alpha[i] = 0.0;
+      sections.beta[i] = 0.0;
+    }
   }
 
   // ****************************************************************
@@ -1088,13 +1459,13 @@ void TdsModel::prepareTimeStep()
 
           // Add Bernoulli resistance when the flow is from a wide into
           // a narrow section.
-          if (((tubeSection[i].area < tubeSection[i - 1].area) && (u > 0)) ||
-            ((tubeSection[i].area > tubeSection[i - 1].area) && (u < 0)))
+          if (((sections.area[i] < sections.area[i - 1]) && (u > 0)) ||
+            ((sections.area[i] > sections.area[i - 1]) && (u < 0)))
           {
             ts = &tubeSection[i - 1];
-            ts->R[1] -= u * 0.5 * AMBIENT_DENSITY_CGS / (ts->area * ts->area);
+            sections.R[1][i - 1] -= u * 0.5 * AMBIENT_DENSITY_CGS / (sections.area[i - 1] * sections.area[i - 1]);
             ts = &tubeSection[i];
-            ts->R[0] += u * 0.5 * AMBIENT_DENSITY_CGS / (ts->area * ts->area);
+            sections.R[0][i] += u * 0.5 * AMBIENT_DENSITY_CGS / (sections.area[i] * sections.area[i]);
           }  
         }
       }
@@ -1111,7 +1482,7 @@ void TdsModel::prepareTimeStep()
     // Set entrance of piriform fossae to the (very high) flow resistance
     // of the smallest possible area.
     ts = &tubeSection[Tube::FIRST_FOSSA_SECTION];
-    ts->R[0] = 8.0 * AIR_VISCOSITY_CGS * ts->length * M_PI / (MIN_AREA_CM2 * MIN_AREA_CM2);
+    sections.R[0][Tube::FIRST_FOSSA_SECTION] = 8.0 * AIR_VISCOSITY_CGS * sections.length[Tube::FIRST_FOSSA_SECTION] * M_PI / (MIN_AREA_CM2 * MIN_AREA_CM2);
   }
   
   // ****************************************************************
@@ -1126,13 +1497,13 @@ void TdsModel::prepareTimeStep()
 
   double k_ent = 1.0;
 
-  sourceArea = tubeSection[Tube::LAST_TRACHEA_SECTION].area;
-  targetArea = tubeSection[Tube::LOWER_GLOTTIS_SECTION].area;
+  sourceArea = sections.area[Tube::LAST_TRACHEA_SECTION];
+  targetArea = sections.area[Tube::LOWER_GLOTTIS_SECTION];
   u = getCurrentIn(Tube::LOWER_GLOTTIS_SECTION);
   
   if (u > 0.0)
   {
-    tubeSection[Tube::LOWER_GLOTTIS_SECTION].R[0] +=
+    sections.R[0][Tube::LOWER_GLOTTIS_SECTION] +=
       k_ent * 0.5 * AMBIENT_DENSITY_CGS * fabs(u) *
       (1.0 / (targetArea*targetArea) - 1.0 / (sourceArea*sourceArea));
   }
@@ -1140,13 +1511,13 @@ void TdsModel::prepareTimeStep()
   // Transition between the glottal sections:
   // Assume Bernoulli flow, as long as A_upper <= A_lower.
 
-  sourceArea = tubeSection[Tube::LOWER_GLOTTIS_SECTION].area;
-  targetArea = tubeSection[Tube::UPPER_GLOTTIS_SECTION].area;
+  sourceArea = sections.area[Tube::LOWER_GLOTTIS_SECTION];
+  targetArea = sections.area[Tube::UPPER_GLOTTIS_SECTION];
   u = getCurrentOut(Tube::LOWER_GLOTTIS_SECTION);
 
   if ((u > 0.0) && (targetArea < sourceArea))
   {
-    tubeSection[Tube::LOWER_GLOTTIS_SECTION].R[1] +=
+    sections.R[1][Tube::LOWER_GLOTTIS_SECTION] +=
       fabs(u) * 0.5 * AMBIENT_DENSITY_CGS * 
       (1.0 / (targetArea*targetArea) - 1.0 / (sourceArea*sourceArea));
   }
@@ -1174,8 +1545,8 @@ void TdsModel::prepareTimeStep()
   {
     // The extra flow is calculated from the filtered pressures 
     // below and above the velum.
-    double p1 = tubeSection[Tube::FIRST_MOUTH_SECTION + 2].pressure;
-    double p2 = tubeSection[Tube::FIRST_NOSE_SECTION + 2].pressure;
+    double p1 = sections.pressure[Tube::FIRST_MOUTH_SECTION + 2];
+    double p2 = sections.pressure[Tube::FIRST_NOSE_SECTION + 2];
 
     transvelarCouplingFlow = transvelarCouplingFilter1.getOutputSample(p1) + transvelarCouplingFilter2.getOutputSample(p2);
   }
@@ -1184,45 +1555,22 @@ void TdsModel::prepareTimeStep()
   // Calculate D and E for each tube section.
   // ****************************************************************
 
-  double sourceAmp;
+  double sourceAmp[Tube::NUM_SECTIONS];
 
   for (i=0; i < Tube::NUM_SECTIONS; i++)
   {
-    ts = &tubeSection[i];
-
-    sourceAmp = ts->monopoleSource.sample;
-
-    if (i == Tube::FIRST_NOSE_SECTION + 2) 
-    { 
-      sourceAmp += transvelarCouplingFlow; 
-    }
-
-    if (i == flowSourceSection) 
-    { 
-      sourceAmp += flowSourceAmp; 
-    }
-
-    d = timeStep*THETA / (ts->C + ts->alpha);
-    ts->E = d;
-    ts->D = ts->pressure + timeStep*THETA1*ts->pressureRate - 
-            d*(ts->beta - sourceAmp);
-    
-    /* R可能受u影响（即受magnitude影响），会变得很大。
-     * E比较正常
-     * D会很大，主要是受ts->pressure影响，而ts->pressure又受上一次的D和magnitude影响。
-     * D会影响solutionVector的初值
-     */
-    // cout << "  Tube Section #" << i << ":"
-    //   << "  pos=" << ts->pos << "  volume=" << ts->volume << "  area=" << ts->area << "  length=" << ts->length
-    //   << "  ts->R[0]=" << ts->R[0] << "  ts->R[1]=" << ts->R[1] << "  ts->E=" << ts->E << "  ts->D=" << ts->D 
-    //   << "  ts->currentOut[0]=" << ts->currentOut[0] << "  ts->currentOut[1]=" << ts->currentOut[1]
-    //   << endl;
+    sourceAmp[i] = tubeSection[i].monopoleSource.sample;
+  }
 
-    // if (fabs(ts->D) > max_D)  { max_D = fabs(ts->D); }
-    // if (fabs(ts->R[0]) > max_R)  { max_R = fabs(ts->R[0]); }
+  sourceAmp[Tube::FIRST_NOSE_SECTION + 2] += transvelarCouplingFlow;
 
-    // if (ts->R[0] > 100000000) { getchar(); }
+  if ((flowSourceSection >= 0) && (flowSourceSection < Tube::NUM_SECTIONS))
+  { 
+    sourceAmp[flowSourceSection] += flowSourceAmp; 
   }
+
+  TdsKernels::calcDE(Tube::NUM_SECTIONS, kernelParams, sections.C, sections.alpha,
+    sections.beta, sections.pressure, sections.pressureRate, sourceAmp, sections.D, sections.E);
 }
 
 
@@ -1302,9 +1650,9 @@ void TdsModel::calcNoiseSources()
   for (i = Tube::FIRST_PHARYNX_SECTION; i <= Tube::LAST_MOUTH_SECTION; i++)
   {
     if ((tubeSection[i].articulator == Tube::TONGUE) && 
-        (tubeSection[i].area < minTongueArea))
+        (sections.area[i] < minTongueArea))
     {
-      minTongueArea = tubeSection[i].area;
+      minTongueArea = sections.area[i];
       minTongueSection = i;
     }
   }
@@ -1325,11 +1673,11 @@ void TdsModel::calcNoiseSources()
     
     double maxArea = minTongueArea + MAX_DELTA_AREA; 
 
-    while ((tubeSection[ cons->firstSection ].area < maxArea) &&
+    while ((sections.area[cons->firstSection] < maxArea) &&
            (tubeSection[ cons->firstSection ].articulator == Tube::TONGUE) &&
            (cons->firstSection > Tube::FIRST_PHARYNX_SECTION)) { cons->firstSection--; }
   
-    while ((tubeSection[ cons->lastSection ].area < maxArea) &&
+    while ((sections.area[cons->lastSection] < maxArea) &&
            (tubeSection[ cons->lastSection ].articulator == Tube::TONGUE) &&
            (cons->lastSection < Tube::LAST_MOUTH_SECTION)) { cons->lastSection++; }
 
@@ -1338,13 +1686,13 @@ void TdsModel::calcNoiseSources()
 
     // Position and distance to an obstacle.
 
-    double jetPos = tubeSection[ cons->lastSection ].pos + tubeSection[ cons->lastSection ].length;
+    double jetPos = tubeSection[ cons->lastSection ].pos + sections.length[cons->lastSection];
 
     // The case for /s, S/
     if (teethPosition - jetPos < MAX_TEETH_DISTANCE)
     {
       cons->obstaclePos = teethPosition;
-      minTongueAreaForTeethSource = tubeSection[ cons->narrowestSection ].area;
+      minTongueAreaForTeethSource = sections.area[cons->narrowestSection];
     }
     else
     // The case for /x, ch/
@@ -1354,7 +1702,7 @@ void TdsModel::calcNoiseSources()
       // sources at each end of the section to approximate the
       // source distribution.
       cons->obstaclePos = tubeSection[ cons->lastSection + 1 ].pos + 
-        0.5*tubeSection[ cons->lastSection + 1 ].length;
+        0.5*sections.length[cons->lastSection + 1];
     }
   }
 
@@ -1372,10 +1720,10 @@ void TdsModel::calcNoiseSources()
     for (i = Tube::FIRST_PHARYNX_SECTION; i <= Tube::LAST_MOUTH_SECTION; i++)
     {
       if ((tubeSection[i].articulator == Tube::TONGUE) && 
-          (tubeSection[i].area < minTongueArea) && 
+          (sections.area[i] < minTongueArea) && 
           ((i < prevCons->firstSection) || (i > prevCons->lastSection)))
       {
-        minTongueArea = tubeSection[i].area;
+        minTongueArea = sections.area[i];
         minTongueSection = i;
       }
     }
@@ -1396,11 +1744,11 @@ void TdsModel::calcNoiseSources()
     
       double maxArea = minTongueArea + MAX_DELTA_AREA; 
 
-      while ((tubeSection[ cons->firstSection ].area < maxArea) &&
+      while ((sections.area[cons->firstSection] < maxArea) &&
              (tubeSection[ cons->firstSection ].articulator == Tube::TONGUE) &&
              (cons->firstSection > Tube::FIRST_PHARYNX_SECTION)) { cons->firstSection--; }
   
-      while ((tubeSection[ cons->lastSection ].area < maxArea) &&
+      while ((sections.area[cons->lastSection] < maxArea) &&
              (tubeSection[ cons->lastSection ].articulator == Tube::TONGUE) &&
              (cons->lastSection < Tube::LAST_MOUTH_SECTION)) { cons->lastSection++; }
 
@@ -1411,13 +1759,13 @@ void TdsModel::calcNoiseSources()
       {
         // Position and distance to an obstacle.
 
-        double jetPos = tubeSection[ cons->lastSection ].pos + tubeSection[ cons->lastSection ].length;
+        double jetPos = tubeSection[ cons->lastSection ].pos + sections.length[cons->lastSection];
 
         // The case for /s,S/
         if (teethPosition - jetPos < MAX_TEETH_DISTANCE)
         {
           cons->obstaclePos = teethPosition;
-          minTongueAreaForTeethSource = tubeSection[ cons->narrowestSection ].area;
+          minTongueAreaForTeethSource = sections.area[cons->narrowestSection];
         }
         else
         // The case for /x,ch/
@@ -1427,7 +1775,7 @@ void TdsModel::calcNoiseSources()
           // sources at each end of the section to approximate the
           // source distribution.
           cons->obstaclePos = tubeSection[ cons->lastSection + 1 ].pos + 
-            0.5*tubeSection[ cons->lastSection + 1 ].length;
+            0.5*sections.length[cons->lastSection + 1];
         }
       }
       else
@@ -1452,9 +1800,9 @@ void TdsModel::calcNoiseSources()
   for (i = Tube::FIRST_MOUTH_SECTION; i <= Tube::LAST_MOUTH_SECTION; i++)
   {
     if ((tubeSection[i].articulator == Tube::LOWER_LIP) && 
-        (tubeSection[i].area < minLipArea))
+        (sections.area[i] < minLipArea))
     {
-      minLipArea = tubeSection[i].area;
+      minLipArea = sections.area[i];
       minLipSection = i;
     }
   }
@@ -1478,23 +1826,23 @@ void TdsModel::calcNoiseSources()
     
     maxArea = minLipArea + MAX_DELTA_AREA; 
 
-    while ((tubeSection[ cons->firstSection ].area < maxArea) &&
+    while ((sections.area[cons->firstSection] < maxArea) &&
            (tubeSection[ cons->firstSection ].articulator == Tube::LOWER_LIP) &&
            (cons->firstSection > Tube::FIRST_MOUTH_SECTION)) { cons->firstSection--; }
   
-    while ((tubeSection[ cons->lastSection ].area < maxArea) &&
+    while ((sections.area[cons->lastSection] < maxArea) &&
            (tubeSection[ cons->lastSection ].articulator == Tube::LOWER_LIP) &&
            (cons->lastSection < Tube::LAST_MOUTH_SECTION)) { cons->lastSection++; }
 
     cons->firstSection++;
-    if (tubeSection[cons->lastSection].area >= maxArea)
+    if (sections.area[cons->lastSection] >= maxArea)
     {
       cons->lastSection--;
     }
 
     // Put the noise source in the middle of the constriction.
     // This sounds better compared to a source at the end of the constriction.
-    cons->obstaclePos = 0.5 * (tubeSection[cons->firstSection].pos + tubeSection[cons->lastSection].pos + tubeSection[cons->lastSection].length);
+    cons->obstaclePos = 0.5 * (tubeSection[cons->firstSection].pos + tubeSection[cons->lastSection].pos + sections.length[cons->lastSection]);
   }
 
     
@@ -1517,7 +1865,7 @@ void TdsModel::calcNoiseSources()
     // ************************************************************
 
     ts = &tubeSection[cons->narrowestSection];
-    cons->area = ts->area;
+    cons->area = sections.area[cons->narrowestSection];
 
     if (cons->area < MIN_AREA_CM2)
     {
@@ -1579,9 +1927,9 @@ void TdsModel::calcNoiseSources()
       for (i = Tube::FIRST_MOUTH_SECTION; i <= Tube::LAST_MOUTH_SECTION; i++)
       {
         if ((teethPosition >= tubeSection[i].pos) &&
-          (teethPosition <= tubeSection[i].pos + tubeSection[i].length))
+          (teethPosition <= tubeSection[i].pos + sections.length[i]))
         {
-          areaAtTeeth_cm2 = tubeSection[i].area;
+          areaAtTeeth_cm2 = sections.area[i];
         }
       }
 
@@ -1713,9 +2061,9 @@ void TdsModel::calcNoiseSources()
     // If the obstaclePos is in front of the mouth of the vocal tract
     // then move it at the very lip end.
 
-    if (cons->obstaclePos >= tubeSection[Tube::LAST_MOUTH_SECTION].pos + tubeSection[Tube::LAST_MOUTH_SECTION].length)
+    if (cons->obstaclePos >= tubeSection[Tube::LAST_MOUTH_SECTION].pos + sections.length[Tube::LAST_MOUTH_SECTION])
     {
-      cons->obstaclePos = tubeSection[Tube::LAST_MOUTH_SECTION].pos + 0.99 * tubeSection[Tube::LAST_MOUTH_SECTION].length;
+      cons->obstaclePos = tubeSection[Tube::LAST_MOUTH_SECTION].pos + 0.99 * sections.length[Tube::LAST_MOUTH_SECTION];
     }
 
     // Determine the obstacle section.
@@ -1725,7 +2073,7 @@ void TdsModel::calcNoiseSources()
     for (i = Tube::FIRST_PHARYNX_SECTION; (i <= Tube::LAST_MOUTH_SECTION) && (cons->obstacleSection == -1); i++)
     {
       if ((tubeSection[i].pos <= cons->obstaclePos) &&
-        (tubeSection[i].pos + tubeSection[i].length >= cons->obstaclePos))
+        (tubeSection[i].pos + sections.length[i] >= cons->obstaclePos))
       {
         cons->obstacleSection = i;
       }
@@ -1751,7 +2099,7 @@ void TdsModel::calcNoiseSources()
 
       // Factors between 0 and 1 for the contributions of the two sources.
       double downstreamFactor = (cons->obstaclePos - tubeSection[cons->obstacleSection].pos) /
-        tubeSection[cons->obstacleSection].length;
+        sections.length[cons->obstacleSection];
       double upstreamFactor = 1.0 - downstreamFactor;
 
       upstreamSource->targetAmp1kHz = upstreamFactor * cons->fullAmp;
@@ -1862,7 +2210,7 @@ void TdsModel::calcNoiseSample(NoiseSource *s, double ampThreshold, bool printFl
   {
     // First-order filter goes up to 63 % of the target value within 
     // the time constant.
-    const double TIME_CONSTANT_SAMPLES = 0.003 * (double)SAMPLING_RATE;   // 3 ms
+    const double TIME_CONSTANT_SAMPLES = 0.003 * (double)samplingRate;   // 3 ms
     const double F = exp(-1.0 / TIME_CONSTANT_SAMPLES);
 
     // Filter sqrt(amp) instead of amp, which delays even better.
@@ -1904,15 +2252,23 @@ void TdsModel::calcNoiseSample(NoiseSource *s, double ampThreshold, bool printFl
   // Setup the IIR-filter to get the filter coefficients.
   IirFilter filter;
 
+  // The cutoff frequency must stay below the Nyquist frequency, which
+  // matters only for low sampling rates.
+  double cutoffFreqRatio = s->cutoffFreq * timeStep;
+  if (cutoffFreqRatio > MAX_NOISE_CUTOFF_FREQ_RATIO)
+  {
+    cutoffFreqRatio = MAX_NOISE_CUTOFF_FREQ_RATIO;
+  }
+
   if (s->isFirstOrder)
   {
-    filter.createSinglePoleLowpass(s->cutoffFreq*timeStep);
+    filter.createSinglePoleLowpass(cutoffFreqRatio);
   }
   else
   {
     // Always assume a critically damped 2nd order low-pass filter.
     const double Q = 1.0 / sqrt(2.0);
-    filter.createSecondOrderLowpass(s->cutoffFreq * timeStep, Q);
+    filter.createSecondOrderLowpass(cutoffFreqRatio, Q);
   }
 
   // ****************************************************************
@@ -1932,6 +2288,10 @@ void TdsModel::calcNoiseSample(NoiseSource *s, double ampThreshold, bool printFl
   // Multiplication with factor is necessary due to the radiation
   // characteristics.
   filterGain *= factor * sqrt(factor);
+  // The white noise below has a constant variance, i.e., its spectral 
+  // density is inversely proportional to the sampling rate. Compensate
+  // for that relative to SAMPLING_RATE.
+  filterGain *= sqrt((double)samplingRate / (double)SAMPLING_RATE);
 
   // ****************************************************************
   // Insert a new random number into the input buffer and
@@ -1982,8 +2342,7 @@ double TdsModel::getSectionPressure(int sectionIndex)
     return 0.0;
   }
 
-  TubeSection *ts = &tubeSection[sectionIndex];
-  return ts->pressure;
+  return sections.pressure[sectionIndex];
 }
 
 
@@ -2122,13 +2481,13 @@ void TdsModel::calcMatrix()
       double uR_rate = branchCurrent[resistanceCurrent].magnitudeRate;
       double uL_rate = branchCurrent[inductivityCurrent].magnitudeRate;
 
-      double L_A = sourceTs->L;
-      double R_A = sourceTs->R[1];
+      double L_A = sections.L[bc->sourceSection];
+      double R_A = sections.R[1][bc->sourceSection];
       double S   = -lipsDipoleSource.sample;    // Spannungsquelle am Ende des Rohrabschnitts
 
       // if (fabs(S) > max_S) { max_S = fabs(S); }
 
-      double radiationArea = sourceTs->area;
+      double radiationArea = sections.area[bc->sourceSection];
 
       // ************************************************************
       // Current through the radiation resistor.
@@ -2166,13 +2525,13 @@ void TdsModel::calcMatrix()
       }
 
       // Inflowing currents
-      if (sourceTs->currentIn != -1) { matrix[i][sourceTs->currentIn] = sourceTs->E; }
+      if (sourceTs->currentIn != -1) { matrix[i][sourceTs->currentIn] = sections.E[bc->sourceSection]; }
         
       // Branch currents through the inductivity and the resistance
-      matrix[i][resistanceCurrent]  = -sourceTs->E - F;
-      matrix[i][inductivityCurrent] = -sourceTs->E - G;
+      matrix[i][resistanceCurrent]  = -sections.E[bc->sourceSection] - F;
+      matrix[i][inductivityCurrent] = -sections.E[bc->sourceSection] - G;
 
-      solutionVector[i] = H - sourceTs->D;
+      solutionVector[i] = H - sections.D[bc->sourceSection];
     }
 
     else
@@ -2182,15 +2541,15 @@ void TdsModel::calcMatrix()
     {
       // Inductivities, resistances, ...
 
-      double L_B = targetTs->L;
-      double R_B = targetTs->R[0];
+      double L_B = sections.L[bc->targetSection];
+      double R_B = sections.R[0][bc->targetSection];
 
       double L_A = 0.0;
       double R_A = 0.0;
       if (sourceTs != NULL)
       {
-        L_A = sourceTs->L;
-        R_A = sourceTs->R[1];
+        L_A = sections.L[bc->sourceSection];
+        R_A = sections.R[1][bc->sourceSection];
       }
 
       double L_AB = L_A + L_B;
@@ -2210,7 +2569,7 @@ void TdsModel::calcMatrix()
 
       // Strength of an additional pressure source between both sections
       
-      double S = targetTs->S;
+      double S = sections.S[bc->targetSection];
       S-= targetTs->dipoleSource.sample;      
       if (bc->targetSection == pressureSourceSection) 
       { 
@@ -2238,23 +2597,23 @@ void TdsModel::calcMatrix()
         H = - (1.0/(timeStep*THETA))*(L_AB*uB + L_A*uD)
             - (THETA1/THETA)*(L_AB*uB_rate + L_A*uD_rate) + S;
 
-        matrix[i][branchingOffCurrent] = -sourceTs->E - G;    // the parallel current.
+        matrix[i][branchingOffCurrent] = -sections.E[bc->sourceSection] - G;    // the parallel current.
 
         // In A inflowing currents
         if (sourceTs != NULL)
         {
-          if (sourceTs->currentIn != -1) { matrix[i][sourceTs->currentIn] = sourceTs->E; }
+          if (sourceTs->currentIn != -1) { matrix[i][sourceTs->currentIn] = sections.E[bc->sourceSection]; }
         }
 
         // This current
-        matrix[i][i] = -targetTs->E - sourceTs->E - F;
+        matrix[i][i] = -sections.E[bc->targetSection] - sections.E[bc->sourceSection] - F;
 
         // From B outflowing currents
-        if (targetTs->currentOut[0] != -1) { matrix[i][targetTs->currentOut[0]] = targetTs->E; }
-        if (targetTs->currentOut[1] != -1) { matrix[i][targetTs->currentOut[1]] = targetTs->E; }
+        if (targetTs->currentOut[0] != -1) { matrix[i][targetTs->currentOut[0]] = sections.E[bc->targetSection]; }
+        if (targetTs->currentOut[1] != -1) { matrix[i][targetTs->currentOut[1]] = sections.E[bc->targetSection]; }
 
         // Solution value
-        solutionVector[i] = H + targetTs->D - sourceTs->D;
+        solutionVector[i] = H + sections.D[bc->targetSection] - sections.D[bc->sourceSection];
 
         // uB和uD就是出现了branching off，即sourceTs会有两个currentOut
         // u本质上就是bc.mag，用来更新H，而H和D用于更新solutionVector
@@ -2281,7 +2640,7 @@ void TdsModel::calcMatrix()
         if ((options.innerLengthCorrections) && (bc->sourceSection >= Tube::FIRST_PHARYNX_SECTION) &&
           (bc->targetSection <= Tube::LAST_MOUTH_SECTION))
         {
-          L_AB+= getJunctionInductance(tubeSection[bc->sourceSection].area, tubeSection[bc->targetSection].area);
+          L_AB+= getJunctionInductance(sections.area[bc->sourceSection], sections.area[bc->targetSection]);
         }
 
         G = L_AB / (timeStep*THETA) + R_AB;
@@ -2290,20 +2649,20 @@ void TdsModel::calcMatrix()
         // In A inflowing currents
         if (sourceTs != NULL)
         {
-          if (sourceTs->currentIn != -1) { matrix[i][sourceTs->currentIn] = sourceTs->E; }
+          if (sourceTs->currentIn != -1) { matrix[i][sourceTs->currentIn] = sections.E[bc->sourceSection]; }
         }
 
         // This current
-        matrix[i][i] = -targetTs->E - G;
-        if (sourceTs != NULL) { matrix[i][i]-= sourceTs->E; }
+        matrix[i][i] = -sections.E[bc->targetSection] - G;
+        if (sourceTs != NULL) { matrix[i][i]-= sections.E[bc->sourceSection]; }
 
         // From B outflowing currents
-        if (targetTs->currentOut[0] != -1) { matrix[i][targetTs->currentOut[0]] = targetTs->E; }
-        if (targetTs->currentOut[1] != -1) { matrix[i][targetTs->currentOut[1]] = targetTs->E; }
+        if (targetTs->currentOut[0] != -1) { matrix[i][targetTs->currentOut[0]] = sections.E[bc->targetSection]; }
+        if (targetTs->currentOut[1] != -1) { matrix[i][targetTs->currentOut[1]] = sections.E[bc->targetSection]; }
 
         // Solution value
-        solutionVector[i] = H + targetTs->D;
-        if (sourceTs != NULL) { solutionVector[i]-= sourceTs->D; }
+        solutionVector[i] = H + sections.D[bc->targetSection];
+        if (sourceTs != NULL) { solutionVector[i]-= sections.D[bc->sourceSection]; }
         
         // cout << "  Branch Current #" << i << ":"
         //   << "  branchingOffCurrent=" << branchingOffCurrent 
@@ -2333,10 +2692,7 @@ void TdsModel::updateVariables()
   TubeSection *ts = NULL;
   BranchCurrent *bc = NULL;
 
-  double oldPressure;
   double oldCurrent;
-  double oldCurrentRate;
-  double netFlow;
 
   // ****************************************************************
   // The new currents and their derivatives
@@ -2349,7 +2705,6 @@ void TdsModel::updateVariables()
   {
     bc = &branchCurrent[i];
     oldCurrent = bc->magnitude;
-    oldCurrentRate = bc->magnitudeRate;
 
     bc->magnitude = flowVector[i];
 
@@ -2369,33 +2724,22 @@ void TdsModel::updateVariables()
   // ****************************************************************
   // Attention tubeSection
   // pressure
+  double netFlow[Tube::NUM_SECTIONS];
+
   for (i=0; i < Tube::NUM_SECTIONS; i++)
   {
     ts = &tubeSection[i];
-
-    netFlow = getCurrentIn(ts) - getCurrentOut(ts);
-
-    oldPressure = ts->pressure;
-    ts->pressure = ts->D + ts->E*netFlow;
-
-    // if (fabs(ts->pressure) > max_pressure) { max_pressure = fabs(ts->pressure); }
-
-    ts->pressureRate = (ts->pressure - oldPressure)/(timeStep*THETA) - ts->pressureRate*(THETA1/THETA);
-
-    // cout << "  Tube Section #" << i << ":"
-    //   << "  ts_old->pressure=" << oldPressure << "  ts_new->pressure=" << ts->pressure << "  netFlow=" << netFlow
-    //   << endl;
-
-    // The current "into the wall".
-
-    oldCurrent = ts->wallCurrent;
-    oldCurrentRate = ts->wallCurrentRate;
-    
-    ts->wallCurrent = ts->pressureRate*ts->alpha + ts->beta;
-    ts->wallCurrentRate  = (ts->wallCurrent - oldCurrent)/(timeStep*THETA) - oldCurrentRate*(THETA1/THETA);
-    ts->wallCurrentRate2 = (ts->wallCurrentRate - oldCurrentRate)/(timeStep*THETA) - ts->wallCurrentRate2*(THETA1/THETA);
+    netFlow[i] = getCurrentIn(ts) - getCurrentOut(ts);
   }
 
+  TdsKernels::Parameters kernelParams;
+  kernelParams.timeStep = timeStep;
+  kernelParams.theta = THETA;
+  kernelParams.minArea_cm2 = MIN_AREA_CM2;
+
+  TdsKernels::updateState(Tube::NUM_SECTIONS, kernelParams, netFlow, sections.D,
+    sections.E, sections.alpha, sections.beta, sections.pressure, sections.pressureRate,
+    sections.wallCurrent, sections.wallCurrentRate, sections.wallCurrentRate2);
 }
 
 
@@ -2435,7 +2779,7 @@ void TdsModel::solveEquationsSor(const string &matrixFileName)
   {
     ts = &tubeSection[i];
     
-    if (ts->area <= 1.01*MIN_AREA_CM2)
+    if (sections.area[i] <= 1.01*MIN_AREA_CM2)
     {
       if (ts->currentIn != -1)     { isActive[ts->currentIn] = false; }
       if (ts->currentOut[0] != -1) { isActive[ts->currentOut[0]] = false; }
@@ -2532,20 +2876,49 @@ void TdsModel::solveEquationsSor(const string &matrixFileName)
 
 void TdsModel::solveEquationsCholesky()
 {
-  int k, i, j, u, v;
+  int k, i, j, u;
+  int first, start;
+  int firstChangedRow;
+  double *A;        // Row i of the matrix
+  double *L;        // Row i of the factor
+  double *M;        // Row k of the factor
+  double d;
 
   // ****************************************************************
-  // Negate the whole matrix and the right-hand side vector.
+  // Copy the negated envelope of the matrix and negate the right-hand
+  // side vector. Row i of the factor only depends on the rows 0...i 
+  // of the matrix. Hence, when the matrix is unchanged up to some
+  // row, the factor is still valid up to this row.
   // ****************************************************************
 
+  firstChangedRow = isFactorizationValid ? NUM_BRANCH_CURRENTS : 0;
+
   for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
   {
-    factorizationMatrix[i][i] = -matrix[i][i];
-    // calculate row i without main diagonal elements
-    for (v = 0; v < numFilledRowValuesSymmetricEnvelope[i]; v++)
+    first = envelopeFirstColumn[i];
+    A = &envelopeMatrix[envelopeRowStart[i]] - first;
+    L = &envelope[envelopeRowStart[i]] - first;
+
+    if (i < firstChangedRow)
+    {
+      for (j = first; j <= i; j++)
+      {
+        if (A[j] != -matrix[i][j])
+        {
+          firstChangedRow = i;
+          break;
+        }
+      }
+    }
+
+    if (i >= firstChangedRow)
     {
-      j = filledRowIndexSymmetricEnvelope[i][v];
-      factorizationMatrix[i][j] = -matrix[i][j];
+      for (j = first; j <= i; j++)
+      {
+        d = -matrix[i][j];
+        A[j] = d;
+        L[j] = d;
+      }
     }
   }
 
@@ -2554,71 +2927,194 @@ void TdsModel::solveEquationsCholesky()
     solutionVector[i] = -solutionVector[i];
   }
 
+  if (firstChangedRow == 0)
+  {
+    factorizationStatistics.numFullFactorizations++;
+  }
+  else
+  if (firstChangedRow < NUM_BRANCH_CURRENTS)
+  {
+    factorizationStatistics.numPartialFactorizations++;
+  }
+  else
+  {
+    factorizationStatistics.numReusedFactorizations++;
+  }
+  factorizationStatistics.numFactorizedRows += NUM_BRANCH_CURRENTS - firstChangedRow;
+
   // ****************************************************************
-  // Cholesky factorization
+  // Cholesky factorization, row by row from the first changed row on.
+  // Row i only depends on the rows above it, and the dot products run
+  // over the overlap of the (contiguous) envelopes of both rows.
   // ****************************************************************
 
-  for (k = 0; k < NUM_BRANCH_CURRENTS; k++)
+  for (i = firstChangedRow; i < NUM_BRANCH_CURRENTS; i++)
   {
-    for (v = 0; v < numFilledRowValuesSymmetricEnvelope[k]; v++)
-    {
-      j = filledRowIndexSymmetricEnvelope[k][v];
-      factorizationMatrix[k][k] -= factorizationMatrix[k][j] * factorizationMatrix[k][j];
-    }
-
-    if (factorizationMatrix[k][k] < 0) printf("Error: Cholesky factorization: Matrix is not positive definite!\n");
-    factorizationMatrix[k][k] = sqrt(factorizationMatrix[k][k]);
+    first = envelopeFirstColumn[i];
+    L = &envelope[envelopeRowStart[i]] - first;
 
-    // calculate column k without main diagonal elements
-    for (u = 0; u < numFilledColumnValuesSymmetricEnvelope[k]; u++)
+    for (k = first; k < i; k++)
     {
-      i = filledColumnIndexSymmetricEnvelope[k][u];
+      M = &envelope[envelopeRowStart[k]] - envelopeFirstColumn[k];
+      start = (first > envelopeFirstColumn[k]) ? first : envelopeFirstColumn[k];
 
-      // calculate row k without main diagonal elements
-      for (v = 0; v < numFilledRowValuesSymmetricEnvelope[k]; v++)
+      d = L[k];
+      for (j = start; j < k; j++)
       {
-        j = filledRowIndexSymmetricEnvelope[k][v];
-        factorizationMatrix[i][k] -= factorizationMatrix[i][j] * factorizationMatrix[k][j];
+        d -= L[j] * M[j];
       }
+      L[k] = d / M[k];
+    }
 
-      factorizationMatrix[i][k] = factorizationMatrix[i][k] / factorizationMatrix[k][k];
+    d = L[i];
+    for (j = first; j < i; j++)
+    {
+      d -= L[j] * L[j];
     }
 
+    if (d < 0) printf("Error: Cholesky factorization: Matrix is not positive definite!\n");
+    L[i] = sqrt(d);
   }
 
+  isFactorizationValid = true;
+
   // ****************************************************************
   // forward substitution
   // ****************************************************************
 
   for (k = 0; k < NUM_BRANCH_CURRENTS; k++)
   {
-    for (v = 0; v < numFilledRowValuesSymmetricEnvelope[k]; v++)
+    first = envelopeFirstColumn[k];
+    M = &envelope[envelopeRowStart[k]] - first;
+
+    d = solutionVector[k];
+    for (j = first; j < k; j++)
     {
-      j = filledRowIndexSymmetricEnvelope[k][v];
-      solutionVector[k] -= factorizationMatrix[k][j] * solutionVector[j];
+      d -= M[j] * solutionVector[j];
     }
-    solutionVector[k] /= factorizationMatrix[k][k];
+    solutionVector[k] = d / M[k];
   }
 
   // ****************************************************************
   // backward substitution
   // ****************************************************************
 
-  // cout << "In solveEquationsCholesky:  " << endl;
   for (k = NUM_BRANCH_CURRENTS - 1; k >= 0; --k)
   {
+    d = solutionVector[k];
     for (u = 0; u < numFilledColumnValuesSymmetricEnvelope[k]; u++)
     {
-      i = filledColumnIndexSymmetricEnvelope[k][u];
-      solutionVector[k] -= factorizationMatrix[i][k] * flowVector[i];
+      d -= envelope[filledColumnPosSymmetricEnvelope[k][u]] * flowVector[filledColumnIndexSymmetricEnvelope[k][u]];
     }
-    flowVector[k] = solutionVector[k] / factorizationMatrix[k][k];
+    solutionVector[k] = d;
+    flowVector[k] = d / envelope[envelopeRowStart[k + 1] - 1];
+  }
+}
 
-    // cout << "  Branch Current #" << k << ":"
-    //   << "  flowVector=" << flowVector[k] << "  solutionVector=" << solutionVector[k] << "  factorizationMatrix=" << factorizationMatrix[k][k]
-    //   << endl;
-    // if (fabs(solutionVector[k]) > max_solutionV) { max_solutionV = fabs(solutionVector[k]); }
+
+// ****************************************************************************
+/// Solve the linear system of equations by the elimination of the currents 
+/// along the tree structure of the network (an LDL^T factorization in the
+/// order prepared in initModel()). The effort is linear in the number of
+/// branch currents. Networks that do not fit into the structures of the 
+/// tree elimination are solved by the Cholesky factorization.
+// ****************************************************************************
+
+void TdsModel::solveEquationsTree()
+{
+  int i, k, a, b, u;
+  int n;
+  int p;
+  double w[MAX_TREE_NEIGHBORS];
+  double y, x, invD;
+
+  if (isTreeEliminationPossible == false)
+  {
+    solveEquationsCholesky();
+    return;
+  }
+
+  // ****************************************************************
+  // Copy the values of the matrix (fill-in places are zero in the
+  // matrix).
+  // ****************************************************************
+
+  for (i = 0; i < NUM_BRANCH_CURRENTS; i++)
+  {
+    treeDiagonal[i] = matrix[i][i];
+  }
+
+  for (i = 0; i < numTreeEntries; i++)
+  {
+    treeEntry[i] = matrix[treeEntryRow[i]][treeEntryColumn[i]];
+  }
+
+  // ****************************************************************
+  // Factorization and forward substitution. Each elimination step
+  // only updates the few remaining neighbors of the current.
+  // ****************************************************************
+
+  for (k = 0; k < NUM_BRANCH_CURRENTS; k++)
+  {
+    p = treeOrder[k];
+    n = numTreeNeighbors[k];
+
+    if (treeDiagonal[p] == 0.0) printf("Error: Tree elimination: Zero pivot!\n");
+    invD = 1.0 / treeDiagonal[p];
+    y = solutionVector[p];
+
+    for (a = 0; a < n; a++)
+    {
+      w[a] = treeEntry[treeNeighborEntry[k][a]];
+    }
+
+    u = 0;
+    for (a = 0; a < n; a++)
+    {
+      double l = w[a] * invD;
+      treeDiagonal[treeNeighbor[k][a]] -= w[a] * l;
+      solutionVector[treeNeighbor[k][a]] -= l * y;
+      for (b = a + 1; b < n; b++)
+      {
+        treeEntry[treeUpdateEntry[k][u++]] -= l * w[b];
+      }
+      treeEntry[treeNeighborEntry[k][a]] = l;
+    }
+
+    treeDiagonal[p] = invD;
   }
+
+  // ****************************************************************
+  // Backward substitution.
+  // ****************************************************************
+
+  for (k = NUM_BRANCH_CURRENTS - 1; k >= 0; --k)
+  {
+    p = treeOrder[k];
+    n = numTreeNeighbors[k];
+
+    x = solutionVector[p] * treeDiagonal[p];
+    for (a = 0; a < n; a++)
+    {
+      x -= treeEntry[treeNeighborEntry[k][a]] * flowVector[treeNeighbor[k][a]];
+    }
+    flowVector[p] = x;
+  }
+}
+
+
+// ****************************************************************************
+/// Resets the counters of how the Cholesky factorizations were obtained.
+/// They are not reset by resetMotion(), so that they sum up over multiple
+/// syntheses.
+// ****************************************************************************
+
+void TdsModel::resetFactorizationStatistics()
+{
+  factorizationStatistics.numFullFactorizations = 0;
+  factorizationStatistics.numPartialFactorizations = 0;
+  factorizationStatistics.numReusedFactorizations = 0;
+  factorizationStatistics.numFactorizedRows = 0;
 }
 
 
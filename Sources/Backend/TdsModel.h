@@ -35,6 +35,7 @@
 #include "Constants.h"
 #include "TimeFunction.h"
 
+template<int K> class TdsModelBatch;
 
 // ****************************************************************************
 /// Class for the simulation of vocal tract acoustics in the time domain on the
@@ -44,6 +45,9 @@
 
 class TdsModel
 {
+  // Runs the time steps of several models in lockstep.
+  template<int K> friend class TdsModelBatch;
+
 public:
 
   // ************************************************************************
@@ -66,6 +70,12 @@ public:
   static const int MAX_CONCERNED_MATRIX_COLUMNS_SYMMETRIC_ENVELOPE = 57;
   // Max. number of non-zero places per	column in the matrix when it is saved in symmetric envelope structure (for cholesky factorization)
   static const int MAX_CONCERNED_MATRIX_ROWS_SYMMETRIC_ENVELOPE = 10;
+  // Max. number of values in the packed envelope of the lower triangular matrix (incl. the main diagonal)
+  static const int MAX_ENVELOPE_SIZE = 8*NUM_BRANCH_CURRENTS;
+  // Max. number of not yet eliminated neighbors of a current in the tree elimination
+  static const int MAX_TREE_NEIGHBORS = 4;
+  // Max. number of off-diagonal values (incl. fill-in) in the tree elimination
+  static const int MAX_TREE_ENTRIES = 4*NUM_BRANCH_CURRENTS;
 
   // Max. number of non-zero places per row in the symmetric saved matrix
   static const int MAX_CONCERNED_MATRIX_COLUMNS_SYMMETRIC = 3;
@@ -78,6 +88,7 @@ public:
 
   static const double MIN_AREA_CM2;
   static const double NOISE_CUTOFF_FREQ;
+  static const double MAX_NOISE_CUTOFF_FREQ_RATIO;
   static const double GENERAL_CUTOFF;
 
 
@@ -89,6 +100,7 @@ public:
   {
     SOR_GAUSS_SEIDEL,
     CHOLESKY_FACTORIZATION,
+    TREE_ELIMINATION,
     NUM_SOLVER_TYPES
   };
 
@@ -141,6 +153,22 @@ public:
   };
 
 
+  // ************************************************************************
+  /// Counters for how the Cholesky factorization was obtained in the time
+  /// steps: computed from scratch, recomputed from the first changed row of
+  /// the matrix on (the rows above are still valid), or reused completely
+  /// because the matrix did not change. They count from the construction
+  /// or the last call of resetFactorizationStatistics() on.
+  // ************************************************************************
+
+  struct FactorizationStatistics
+  {
+    long long numFullFactorizations;
+    long long numPartialFactorizations;
+    long long numReusedFactorizations;
+    long long numFactorizedRows;        ///< Total number of recomputed rows
+  };
+
   // ************************************************************************
   /// Structure for one individual branch current in the electrical
   /// network. The identity of a branch current is defined by the
@@ -159,7 +187,9 @@ public:
   };
 
   // ************************************************************************
-  /// An individual short homogeneous tube section.
+  /// An individual short homogeneous tube section. Only the rarely used
+  /// data (position, noise sources, topology) are kept here. The values 
+  /// that are needed in every time step are in SectionArrays.
   // ************************************************************************
 
   struct TubeSection
@@ -167,49 +197,100 @@ public:
 //    bool isDynamic;        ///< Can the network components R, C, L, ... change ?
 
     double pos;
-    double area;
-    double length;
-    double volume;
     Tube::Articulator articulator;
 
     NoiseSource monopoleSource; ///< Is created in the center of the tube section
     NoiseSource dipoleSource;   ///< Is created at the entrance of the tube section
 
-    double pressure;
-    double pressureRate;
-
     /// \name Indices of the inflowing and outflowing currents
     /// @{
     int currentIn;
     int currentOut[2];
     /// @}
+  };
+
+  // ************************************************************************
+  /// The geometry, network components and state of all tube sections in
+  /// parallel arrays (structure of arrays), indexed by the tube section.
+  /// This way, the loops over the sections in every time step run over
+  /// contiguous memory.
+  // ************************************************************************
+
+  struct SectionArrays
+  {
+    double area[Tube::NUM_SECTIONS];
+    double length[Tube::NUM_SECTIONS];
+    double volume[Tube::NUM_SECTIONS];
+
+    double pressure[Tube::NUM_SECTIONS];
+    double pressureRate[Tube::NUM_SECTIONS];
 
     /// \name Wall properties
     /// @{
-    double Mw;    ///< Mass per unit-area
-    double Bw;    ///< Resistance per unit-area
-    double Kw;    ///< Stiffness per unit-area
+    double Mw[Tube::NUM_SECTIONS];    ///< Mass per unit-area
+    double Bw[Tube::NUM_SECTIONS];    ///< Resistance per unit-area
+    double Kw[Tube::NUM_SECTIONS];    ///< Stiffness per unit-area
     /// @}
 
     /// \name Wall currents
     /// @{
-    double wallCurrent;       ///< Current flow "into" the walls
-    double wallCurrentRate;   ///< 1st derivative of the wall-flow
-    double wallCurrentRate2;  ///< 2nd derivative of the wall-flow
+    double wallCurrent[Tube::NUM_SECTIONS];       ///< Current flow "into" the walls
+    double wallCurrentRate[Tube::NUM_SECTIONS];   ///< 1st derivative of the wall-flow
+    double wallCurrentRate2[Tube::NUM_SECTIONS];  ///< 2nd derivative of the wall-flow
     /// @}
 
-    double L;        ///< Inductivity
-    double C;        ///< Capacity
-    double R[2];     ///< Ohm's resistance left and right
-    double S;        ///< Pressure source at the inlet of the section (A constant in the pressure-difference eq.)
+    double L[Tube::NUM_SECTIONS];        ///< Inductivity
+    double C[Tube::NUM_SECTIONS];        ///< Capacity
+    double R[2][Tube::NUM_SECTIONS];     ///< Ohm's resistance left and right
+    double S[Tube::NUM_SECTIONS];        ///< Pressure source at the inlet of the section (A constant in the pressure-difference eq.)
 
     // For the wall vibration
-    double alpha;
-    double beta;
+    double alpha[Tube::NUM_SECTIONS];
+    double beta[Tube::NUM_SECTIONS];
 
     // Temporary values
-    double D;  // pressure
-    double E;  // 
+    double D[Tube::NUM_SECTIONS];  // pressure
+    double E[Tube::NUM_SECTIONS];  // 
+  };
+
+  // ************************************************************************
+  /// The complete dynamic state of the simulation (see saveMotionState()).
+  /// The network topology, the options and the monitored constriction data
+  /// are not part of it. The structure is large and should be allocated on 
+  /// the heap.
+  // ************************************************************************
+
+  struct MotionState
+  {
+    int samplingRate;
+    int position;
+
+    double flowSourceAmp;
+    int    flowSourceSection;
+    double pressureSourceAmp;
+    int    pressureSourceSection;
+
+    NoiseSource lipsDipoleSource;
+    TubeSection tubeSection[Tube::NUM_SECTIONS];
+    SectionArrays sections;
+    BranchCurrent branchCurrent[NUM_BRANCH_CURRENTS];
+    double solutionVector[NUM_BRANCH_CURRENTS];
+    double flowVector[NUM_BRANCH_CURRENTS];
+
+    IirFilter glottalToneFilter;
+    IirFilter transglottalPressureFilter;
+    double glottalBernoulliFactor;
+    IirFilter transvelarCouplingFilter1;
+    IirFilter transvelarCouplingFilter2;
+
+    Constriction constriction[MAX_CONSTRICTIONS];
+    int numConstrictions;
+
+    bool doNetworkInitialization;
+    double aspirationStrength_dB;
+    double teethPosition;
+    double tongueTipSideElevation;
+    std::mt19937 randomNumberGenerator;
   };
 
   // ************************************************************************
@@ -224,25 +305,57 @@ public:
   NoiseSource lipsDipoleSource;   ///< Last noise source at the mouth opening
 
   TubeSection tubeSection[Tube::NUM_SECTIONS];
+  SectionArrays sections;
   BranchCurrent branchCurrent[NUM_BRANCH_CURRENTS];
 
   // Help variables to effectively solve the system of eqs. with Gauss-Seidel
   int numFilledRowValues[NUM_BRANCH_CURRENTS];
   int filledRowIndex[NUM_BRANCH_CURRENTS][MAX_CONCERNED_MATRIX_COLUMNS];
 
-  // Help variables to effectively solve the system of eqs. with cholesky factorization
-  int numFilledRowValuesSymmetricEnvelope[NUM_BRANCH_CURRENTS];
-  int filledRowIndexSymmetricEnvelope[NUM_BRANCH_CURRENTS][MAX_CONCERNED_MATRIX_COLUMNS_SYMMETRIC_ENVELOPE];
+  // Help variables to effectively solve the system of eqs. with cholesky factorization.
+  // The lower triangular part of the matrix and its factorization are stored row 
+  // by row in the packed skyline (envelope) format: row i holds the columns 
+  // envelopeFirstColumn[i] ... i (the last one is the main diagonal) and starts
+  // at envelope[envelopeRowStart[i]].
+  int envelopeFirstColumn[NUM_BRANCH_CURRENTS];
+  int envelopeRowStart[NUM_BRANCH_CURRENTS + 1];
+  // The rows below the main diagonal whose envelope contains the column, and
+  // the positions of these values in envelope[].
   int numFilledColumnValuesSymmetricEnvelope[NUM_BRANCH_CURRENTS];
   int filledColumnIndexSymmetricEnvelope[NUM_BRANCH_CURRENTS][MAX_CONCERNED_MATRIX_ROWS_SYMMETRIC_ENVELOPE];
+  int filledColumnPosSymmetricEnvelope[NUM_BRANCH_CURRENTS][MAX_CONCERNED_MATRIX_ROWS_SYMMETRIC_ENVELOPE];
+
+  // Help variables for the tree elimination (LDL^T factorization in an order
+  // that eliminates the currents from the ends of the branches towards the 
+  // junctions). Step k eliminates the current treeOrder[k]; its not yet 
+  // eliminated neighbors are treeNeighbor[k][...], coupled by the 
+  // off-diagonal values treeEntry[treeNeighborEntry[k][...]]. 
+  // treeUpdateEntry[k][...] are the values between pairs of these neighbors
+  // (in the order (0,1), (0,2), (1,2), ...).
+  int treeOrder[NUM_BRANCH_CURRENTS];
+  int numTreeNeighbors[NUM_BRANCH_CURRENTS];
+  int treeNeighbor[NUM_BRANCH_CURRENTS][MAX_TREE_NEIGHBORS];
+  int treeNeighborEntry[NUM_BRANCH_CURRENTS][MAX_TREE_NEIGHBORS];
+  int treeUpdateEntry[NUM_BRANCH_CURRENTS][MAX_TREE_NEIGHBORS*(MAX_TREE_NEIGHBORS - 1) / 2];
+  int numTreeEntries;
+  int treeEntryRow[MAX_TREE_ENTRIES];
+  int treeEntryColumn[MAX_TREE_ENTRIES];
+  // False when the network did not fit into the structures above, so that
+  // solveEquationsTree() uses the Cholesky factorization instead.
+  bool isTreeEliminationPossible;
 
   bool doNetworkInitialization;
-  double  timeStep;
+  double  timeStep;     ///< = 1 / samplingRate
   /// Aspiration strength from -40 dB to 0 dB.
   double aspirationStrength_dB;
 
   double matrix[NUM_BRANCH_CURRENTS][NUM_BRANCH_CURRENTS];
-  double factorizationMatrix[NUM_BRANCH_CURRENTS][NUM_BRANCH_CURRENTS];
+  double envelope[MAX_ENVELOPE_SIZE];   ///< Packed Cholesky factor (see envelopeRowStart)
+  double envelopeMatrix[MAX_ENVELOPE_SIZE];   ///< Packed (negated) matrix of the factor in envelope[]
+  bool isFactorizationValid;                  ///< Do envelope[] and envelopeMatrix[] belong together?
+  FactorizationStatistics factorizationStatistics;
+  double treeDiagonal[NUM_BRANCH_CURRENTS];   ///< D of the tree elimination
+  double treeEntry[MAX_TREE_ENTRIES];         ///< Off-diagonal values / factor L of the tree elimination
   double solutionVector[NUM_BRANCH_CURRENTS];
   double flowVector[NUM_BRANCH_CURRENTS];
 
@@ -266,6 +379,10 @@ public:
   Options options;
 
 
+  /// Limits of the sampling rate that can be set with setSamplingRate().
+  static const int MIN_SAMPLING_RATE = 8000;
+  static const int MAX_SAMPLING_RATE = 96000;
+
   // ************************************************************************
   // Public methods of the class
   // ************************************************************************
@@ -276,6 +393,10 @@ public:
 
   void initModel();
   void resetMotion();
+  bool setSamplingRate(int samplingRate_Hz);
+  int getSamplingRate() { return samplingRate; }
+  void saveMotionState(MotionState &state);
+  bool restoreMotionState(const MotionState &state);
   bool saveConstrictionBuffer(std::string fileName);
 
   // **************************************************************
@@ -294,6 +415,9 @@ public:
 
   void solveEquationsSor(const string &matrixFileName = "");
   void solveEquationsCholesky();
+  void solveEquationsTree();
+  void resetFactorizationStatistics();
+  FactorizationStatistics getFactorizationStatistics() { return factorizationStatistics; }
   int getSampleIndex() { return position; }
   void getSectionFlow(int sectionIndex, double &inflow, double &outflow);
   double getSectionPressure(int sectionIndex);
@@ -304,6 +428,7 @@ public:
 
 private:
   int position;         ///< Internal counter for the sampling position
+  int samplingRate;     ///< Sampling rate of the simulation in Hz
   double teethPosition; ///< Position of the teeth (from the glottis)
   // Elevation of the tongue tip side (corresponding to TS3 of the vocal tract model)
   double tongueTipSideElevation;
@@ -315,12 +440,17 @@ private:
 
 private:
   void prepareTimeStep();
+  double finishTimeStep(double &mouthFlow_cm3_s, double &nostrilFlow_cm3_s,
+    double &skinFlow_cm3_s);
 
   double getJunctionInductance(double A1_cm2, double A2_cm2);
 
   void calcMatrix();
   void updateVariables();
   
+  void createCouplingFilter(IirFilter &filter, const ComplexValue *poles, 
+    int numPoles, const ComplexValue *zeros, int numZeros);
+
   void resetConstriction(Constriction *c);
   void calcNoiseSources();
   void calcNoiseSample(NoiseSource *s, double ampThreshold, bool printFlag=false);
@@ -0,0 +1,358 @@
+#ifndef __TDS_MODEL_BATCH_H__
+#define __TDS_MODEL_BATCH_H__
+
+#include "TdsModel.h"
+#include <cstdio>
+#include <cmath>
+
+// ****************************************************************************
+/// Runs the time steps of K TdsModel objects (the lanes) in lockstep, e.g.,
+/// for the synthesis of K independent utterances on one core.
+/// All models have the same network topology, so that their systems of
+/// equations are solved together by one Cholesky factorization whose
+/// innermost loops run over the lanes. The compiler maps these loops to SIMD
+/// instructions, so that K = 2 (SSE2), 4 (AVX2) or 8 (AVX-512) lanes cost
+/// about as much as a single model for the solution, depending on the
+/// instruction set enabled for the build.
+///
+/// Everything else (network components, constrictions, noise sources,
+/// lanes with another solver type) is calculated by the individual models.
+/// Each lane gives exactly the same result as its model on its own.
+/// The models are *not* owned by this class, but just used.
+// ****************************************************************************
+
+template<int K> class TdsModelBatch
+{
+  // **************************************************************************
+  // Public data.
+  // **************************************************************************
+
+public:
+  static const int NUM_LANES = K;
+
+  /// Counters of the (partial) factorizations of the combined system.
+  TdsModel::FactorizationStatistics factorizationStatistics;
+
+  // **************************************************************************
+  // Public functions.
+  // **************************************************************************
+
+public:
+  TdsModelBatch();
+
+  void setLane(int lane, TdsModel *model);
+  TdsModel *getLane(int lane) { return model[lane]; }
+  void proceedTimeStep(const bool *isActive, double *radiatedFlow_cm3_s);
+
+  // **************************************************************************
+  // Private data.
+  // **************************************************************************
+
+private:
+  static const int N = TdsModel::NUM_BRANCH_CURRENTS;
+
+  TdsModel *model[K];
+
+  // The same as the data of the Cholesky factorization in TdsModel, but with
+  // one value per lane.
+  double envelope[TdsModel::MAX_ENVELOPE_SIZE][K];
+  double envelopeMatrix[TdsModel::MAX_ENVELOPE_SIZE][K];
+  double solutionVector[N][K];
+  double flowVector[N][K];
+  bool isFactorizationValid;
+
+  // **************************************************************************
+  // Private functions.
+  // **************************************************************************
+
+private:
+  void solveEquationsCholesky(const bool *isSolved);
+};
+
+
+// ****************************************************************************
+/// Constructor. All lanes must be set with setLane() before the first time
+/// step.
+// ****************************************************************************
+
+template<int K> TdsModelBatch<K>::TdsModelBatch()
+{
+  int l;
+  for (l = 0; l < K; l++)
+  {
+    model[l] = NULL;
+  }
+
+  factorizationStatistics.numFullFactorizations = 0;
+  factorizationStatistics.numPartialFactorizations = 0;
+  factorizationStatistics.numReusedFactorizations = 0;
+  factorizationStatistics.numFactorizedRows = 0;
+
+  isFactorizationValid = false;
+}
+
+
+// ****************************************************************************
+/// Sets the model of the given lane.
+// ****************************************************************************
+
+template<int K> void TdsModelBatch<K>::setLane(int lane, TdsModel *model)
+{
+  this->model[lane] = model;
+  isFactorizationValid = false;
+}
+
+
+// ****************************************************************************
+/// Performs the next time step of the models of all lanes where isActive is
+/// true, exactly as TdsModel::proceedTimeStep() does, and returns their
+/// radiated flows (0 for inactive lanes). The models of inactive lanes are
+/// not changed.
+// ****************************************************************************
+
+template<int K> void TdsModelBatch<K>::proceedTimeStep(const bool *isActive,
+  double *radiatedFlow_cm3_s)
+{
+  int l;
+  bool isSolved[K];
+  double mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s;
+
+  for (l = 0; l < K; l++)
+  {
+    isSolved[l] = false;
+    if (isActive[l])
+    {
+      model[l]->prepareTimeStep();
+      model[l]->calcMatrix();
+      isSolved[l] = (model[l]->options.solverType == TdsModel::CHOLESKY_FACTORIZATION);
+    }
+  }
+
+  solveEquationsCholesky(isSolved);
+
+  for (l = 0; l < K; l++)
+  {
+    radiatedFlow_cm3_s[l] = 0.0;
+    if (isActive[l])
+    {
+      if (isSolved[l] == false)
+      {
+        if (model[l]->options.solverType == TdsModel::TREE_ELIMINATION)
+        {
+          model[l]->solveEquationsTree();
+        }
+        else
+        {
+          model[l]->solveEquationsSor();
+        }
+      }
+
+      radiatedFlow_cm3_s[l] =
+        model[l]->finishTimeStep(mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s);
+    }
+  }
+}
+
+
+// ****************************************************************************
+/// Solves the systems of equations of all lanes with the same steps as
+/// TdsModel::solveEquationsCholesky() and writes the solution into the models
+/// where isSolved is true. The other lanes take the system of the first lane
+/// where isSolved is true, because their own matrices may not have been 
+/// calculated at all (e.g., for lanes without a job that never made a time
+/// step). So they are always positive definite and do not cause additional
+/// rows to be factorized.
+// ****************************************************************************
+
+template<int K> void TdsModelBatch<K>::solveEquationsCholesky(const bool *isSolved)
+{
+  int k, i, j, u, l;
+  int first, start;
+  int firstChangedRow;
+  double (*A)[K];   // Row i of the matrix
+  double (*L)[K];   // Row i of the factor
+  double (*M)[K];   // Row k of the factor
+  double d[K];
+  const double (*matrix[K])[N];
+  const double *rightSide[K];
+
+  // The envelope structure is the same for all models.
+  const TdsModel *m = model[0];
+
+  // Find the first lane to solve.
+  int solvedLane = -1;
+  for (l = K - 1; l >= 0; l--)
+  {
+    if (isSolved[l])
+    {
+      solvedLane = l;
+    }
+  }
+  if (solvedLane == -1)
+  {
+    return;
+  }
+
+  for (l = 0; l < K; l++)
+  {
+    const TdsModel *source = isSolved[l] ? model[l] : model[solvedLane];
+    matrix[l] = source->matrix;
+    rightSide[l] = source->solutionVector;
+  }
+
+  // ****************************************************************
+  // Copy the negated envelopes of the matrices and negate the
+  // right-hand side vectors. The factorization is repeated from the
+  // first row that changed in any lane.
+  // ****************************************************************
+
+  firstChangedRow = isFactorizationValid ? N : 0;
+
+  for (i = 0; i < N; i++)
+  {
+    first = m->envelopeFirstColumn[i];
+    A = &envelopeMatrix[m->envelopeRowStart[i]] - first;
+    L = &envelope[m->envelopeRowStart[i]] - first;
+
+    if (i < firstChangedRow)
+    {
+      for (j = first; (j <= i) && (firstChangedRow > i); j++)
+      {
+        for (l = 0; l < K; l++)
+        {
+          if (A[j][l] != -matrix[l][i][j])
+          {
+            firstChangedRow = i;
+          }
+        }
+      }
+    }
+
+    if (i >= firstChangedRow)
+    {
+      for (j = first; j <= i; j++)
+      {
+        for (l = 0; l < K; l++)
+        {
+          A[j][l] = -matrix[l][i][j];
+          L[j][l] = A[j][l];
+        }
+      }
+    }
+  }
+
+  for (i = 0; i < N; i++)
+  {
+    for (l = 0; l < K; l++)
+    {
+      solutionVector[i][l] = -rightSide[l][i];
+    }
+  }
+
+  if (firstChangedRow == 0)
+  {
+    factorizationStatistics.numFullFactorizations++;
+  }
+  else
+  if (firstChangedRow < N)
+  {
+    factorizationStatistics.numPartialFactorizations++;
+  }
+  else
+  {
+    factorizationStatistics.numReusedFactorizations++;
+  }
+  factorizationStatistics.numFactorizedRows += N - firstChangedRow;
+
+  // ****************************************************************
+  // Cholesky factorization, row by row from the first changed row on.
+  // ****************************************************************
+
+  for (i = firstChangedRow; i < N; i++)
+  {
+    first = m->envelopeFirstColumn[i];
+    L = &envelope[m->envelopeRowStart[i]] - first;
+
+    for (k = first; k < i; k++)
+    {
+      M = &envelope[m->envelopeRowStart[k]] - m->envelopeFirstColumn[k];
+      start = (first > m->envelopeFirstColumn[k]) ? first : m->envelopeFirstColumn[k];
+
+      for (l = 0; l < K; l++) { d[l] = L[k][l]; }
+      for (j = start; j < k; j++)
+      {
+        for (l = 0; l < K; l++) { d[l] -= L[j][l] * M[j][l]; }
+      }
+      for (l = 0; l < K; l++) { L[k][l] = d[l] / M[k][l]; }
+    }
+
+    for (l = 0; l < K; l++) { d[l] = L[i][l]; }
+    for (j = first; j < i; j++)
+    {
+      for (l = 0; l < K; l++) { d[l] -= L[j][l] * L[j][l]; }
+    }
+
+    for (l = 0; l < K; l++)
+    {
+      if ((d[l] < 0) && (isSolved[l])) printf("Error: Cholesky factorization: Matrix is not positive definite!\n");
+      L[i][l] = sqrt(d[l]);
+    }
+  }
+
+  isFactorizationValid = true;
+
+  // ****************************************************************
+  // forward substitution
+  // ****************************************************************
+
+  for (k = 0; k < N; k++)
+  {
+    first = m->envelopeFirstColumn[k];
+    M = &envelope[m->envelopeRowStart[k]] - first;
+
+    for (l = 0; l < K; l++) { d[l] = solutionVector[k][l]; }
+    for (j = first; j < k; j++)
+    {
+      for (l = 0; l < K; l++) { d[l] -= M[j][l] * solutionVector[j][l]; }
+    }
+    for (l = 0; l < K; l++) { solutionVector[k][l] = d[l] / M[k][l]; }
+  }
+
+  // ****************************************************************
+  // backward substitution
+  // ****************************************************************
+
+  for (k = N - 1; k >= 0; --k)
+  {
+    for (l = 0; l < K; l++) { d[l] = solutionVector[k][l]; }
+    for (u = 0; u < m->numFilledColumnValuesSymmetricEnvelope[k]; u++)
+    {
+      double *e = envelope[m->filledColumnPosSymmetricEnvelope[k][u]];
+      double *f = flowVector[m->filledColumnIndexSymmetricEnvelope[k][u]];
+      for (l = 0; l < K; l++) { d[l] -= e[l] * f[l]; }
+    }
+    for (l = 0; l < K; l++)
+    {
+      solutionVector[k][l] = d[l];
+      flowVector[k][l] = d[l] / envelope[m->envelopeRowStart[k + 1] - 1][l];
+    }
+  }
+
+  // ****************************************************************
+  // Write the solutions into the models.
+  // ****************************************************************
+
+  for (l = 0; l < K; l++)
+  {
+    if (isSolved[l])
+    {
+      for (i = 0; i < N; i++)
+      {
+        model[l]->solutionVector[i] = solutionVector[i][l];
+        model[l]->flowVector[i] = flowVector[i][l];
+      }
+    }
+  }
+}
+
+#endif
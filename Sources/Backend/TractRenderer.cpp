@@ -0,0 +1,1547 @@
+#include "TractRenderer.h"
+
+#include <cmath>
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+using namespace std;
+
+// ****************************************************************************
+// Helpers for the 4x4 transformation matrices, which are stored column by
+// column like in OpenGL.
+// ****************************************************************************
+
+namespace
+{
+  void loadIdentity(double *m)
+  {
+    int i;
+    for (i = 0; i < 16; i++) { m[i] = 0.0; }
+    m[0] = m[5] = m[10] = m[15] = 1.0;
+  }
+
+  // m = m*b
+  void multiply(double *m, const double *b)
+  {
+    double a[16];
+    int row, col, k;
+
+    for (k = 0; k < 16; k++) { a[k] = m[k]; }
+
+    for (col = 0; col < 4; col++)
+    {
+      for (row = 0; row < 4; row++)
+      {
+        m[col*4 + row] = 0.0;
+        for (k = 0; k < 4; k++)
+        {
+          m[col*4 + row] += a[k*4 + row] * b[col*4 + k];
+        }
+      }
+    }
+  }
+
+  // Like glTranslated().
+  void translate(double *m, double x, double y, double z)
+  {
+    double t[16];
+    loadIdentity(t);
+    t[12] = x;
+    t[13] = y;
+    t[14] = z;
+    multiply(m, t);
+  }
+
+  // Like glRotated() for a unit axis.
+  void rotate(double *m, double angle_deg, double x, double y, double z)
+  {
+    double r[16];
+    double c = cos(angle_deg*M_PI / 180.0);
+    double s = sin(angle_deg*M_PI / 180.0);
+
+    loadIdentity(r);
+    r[0] = x*x*(1.0 - c) + c;
+    r[1] = y*x*(1.0 - c) + z*s;
+    r[2] = x*z*(1.0 - c) - y*s;
+    r[4] = x*y*(1.0 - c) - z*s;
+    r[5] = y*y*(1.0 - c) + c;
+    r[6] = y*z*(1.0 - c) + x*s;
+    r[8] = x*z*(1.0 - c) + y*s;
+    r[9] = y*z*(1.0 - c) - x*s;
+    r[10] = z*z*(1.0 - c) + c;
+    multiply(m, r);
+  }
+
+  // Like glFrustum().
+  void setFrustum(double *m, double left, double right, double bottom, double top,
+    double nearPlane, double farPlane)
+  {
+    loadIdentity(m);
+    m[0] = 2.0*nearPlane / (right - left);
+    m[5] = 2.0*nearPlane / (top - bottom);
+    m[8] = (right + left) / (right - left);
+    m[9] = (top + bottom) / (top - bottom);
+    m[10] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+    m[11] = -1.0;
+    m[14] = -2.0*farPlane*nearPlane / (farPlane - nearPlane);
+    m[15] = 0.0;
+  }
+
+  // Like glOrtho().
+  void setOrtho(double *m, double left, double right, double bottom, double top,
+    double nearPlane, double farPlane)
+  {
+    loadIdentity(m);
+    m[0] = 2.0 / (right - left);
+    m[5] = 2.0 / (top - bottom);
+    m[10] = -2.0 / (farPlane - nearPlane);
+    m[12] = -(right + left) / (right - left);
+    m[13] = -(top + bottom) / (top - bottom);
+    m[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+  }
+
+  void setMaterial(float *dest, float r, float g, float b, float a)
+  {
+    dest[0] = r;
+    dest[1] = g;
+    dest[2] = b;
+    dest[3] = a;
+  }
+}
+
+
+const double TractViewOptions::DEFAULT_DISTANCE = 17.0;
+const double TractViewOptions::DEFAULT_X_TRANSLATION = -1.5;
+const double TractViewOptions::DEFAULT_Y_TRANSLATION = 2.5;
+
+// ****************************************************************************
+/// Constructor with the default view of VocalTractPicture.
+// ****************************************************************************
+
+TractViewOptions::TractViewOptions()
+{
+  renderMode = RM_3DSOLID;
+  distance_cm = DEFAULT_DISTANCE;
+  yRotation_deg = 0.0;
+  zRotation_deg = 0.0;
+  cutPlanePos_cm = 10.4;
+  showControlPoints = true;
+  showCenterLine = false;
+  showEmaPoints = false;
+  renderBothSides = true;
+}
+
+
+// ****************************************************************************
+/// Constructor.
+// ****************************************************************************
+
+TractRenderer::TractRenderer(int width, int height)
+{
+  this->width = 0;
+  this->height = 0;
+  setSize(width, height);
+
+  loadIdentity(modelViewMatrix);
+  loadIdentity(projectionMatrix);
+}
+
+
+// ****************************************************************************
+/// Sets the size of the image in pixels.
+// ****************************************************************************
+
+void TractRenderer::setSize(int width, int height)
+{
+  if (width < 1) { width = 1; }
+  if (height < 1) { height = 1; }
+
+  this->width = width;
+  this->height = height;
+  colorBuffer.resize(width*height*3);
+  depthBuffer.resize(width*height);
+}
+
+
+// ****************************************************************************
+/// Renders the given vocal tract with the given view options (render mode,
+/// viewing distance and angles, control points etc.) into the frame buffer.
+// ****************************************************************************
+
+void TractRenderer::render(VocalTract *tract, const TractViewOptions &options)
+{
+  TractViewOptions::RenderMode renderMode = options.renderMode;
+
+  // ****************************************************************
+  // Clear the background.
+  // ****************************************************************
+
+  if (renderMode == TractViewOptions::RM_3DSOLID)
+  {
+    clear(0.4f, 0.4f, 1.0f);
+  }
+  else
+  if (renderMode == TractViewOptions::RM_3DWIRE)
+  {
+    clear(0.0f, 0.0f, 0.0f);
+  }
+  else
+  {
+    clear(1.0f, 1.0f, 1.0f);
+  }
+
+  // The 2D region of VocalTractPicture::get2DRegion() adapted to the size 
+  // of this image.
+  double left_cm = -4.0;
+  double right_cm = 7.5;
+  double bottom_cm = -9.0;
+  double top_cm = bottom_cm + (double)height*(right_cm - left_cm) / (double)width;
+
+  currentColor[0] = currentColor[1] = currentColor[2] = 0.0f;
+  lineWidth = 1.0;
+  lineStipple = 0xFFFF;
+  depthTest = true;
+  depthWrite = true;
+  fog = false;
+
+  // ****************************************************************
+  // Set the transformation matrices (see
+  // VocalTractPicture::setProjectionMatrix3D() etc.).
+  // ****************************************************************
+
+  if ((renderMode == TractViewOptions::RM_2D) || (renderMode == TractViewOptions::RM_NONE))
+  {
+    setOrtho(projectionMatrix, left_cm, right_cm, bottom_cm, top_cm, -1000.0, 1000.0);
+    loadIdentity(modelViewMatrix);
+
+    renderAxes(left_cm, right_cm, bottom_cm, top_cm);
+  }
+  else
+  {
+    const double NEAR_PLANE = 5.0;
+    double top = tan(0.5*40.0*M_PI / 180.0)*NEAR_PLANE;
+    double right = top*(double)width / (double)height;
+    setFrustum(projectionMatrix, -right, right, -top, top, NEAR_PLANE, 100.0);
+
+    loadIdentity(modelViewMatrix);
+    translate(modelViewMatrix, 0.0, 0.0, -options.distance_cm);
+    rotate(modelViewMatrix, options.yRotation_deg, 0.0, 1.0, 0.0);
+    rotate(modelViewMatrix, options.zRotation_deg, 0.0, 0.0, 1.0);
+    translate(modelViewMatrix, TractViewOptions::DEFAULT_X_TRANSLATION,
+      TractViewOptions::DEFAULT_Y_TRANSLATION, 0.0);
+  }
+
+  // ****************************************************************
+  // Do the actual rendering.
+  // ****************************************************************
+
+  if (renderMode == TractViewOptions::RM_3DSOLID)
+  {
+    renderSolid(tract, options);
+  }
+  else
+  if (renderMode == TractViewOptions::RM_3DWIRE)
+  {
+    renderWireFrame(tract, options);
+  }
+  else
+  if (renderMode == TractViewOptions::RM_2D)
+  {
+    render2D(tract);
+  }
+
+  if ((options.showControlPoints) && (renderMode != TractViewOptions::RM_NONE))
+  {
+    renderControlPoints(tract, options);
+  }
+
+  if ((options.showEmaPoints) && (renderMode != TractViewOptions::RM_NONE))
+  {
+    renderEmaPoints(tract);
+  }
+}
+
+
+// ****************************************************************************
+/// Copies the rendered image into rgb as 8 bit RGB triples, starting with the
+/// top row. rgb must hold width*height*3 bytes.
+// ****************************************************************************
+
+void TractRenderer::getImage(unsigned char *rgb)
+{
+  int x, y, k;
+  const float *src;
+  float c;
+
+  for (y = 0; y < height; y++)
+  {
+    src = &colorBuffer[(height - 1 - y)*width*3];
+    for (x = 0; x < width*3; x++)
+    {
+      c = src[x];
+      k = (int)(c*255.0f + 0.5f);
+      if (k < 0) { k = 0; }
+      if (k > 255) { k = 255; }
+      *rgb++ = (unsigned char)k;
+    }
+  }
+}
+
+
+// ****************************************************************************
+/// Fills the image with the given color and resets the depth buffer.
+// ****************************************************************************
+
+void TractRenderer::clear(float r, float g, float b)
+{
+  int i;
+  int numPixels = width*height;
+  float *p = &colorBuffer[0];
+
+  for (i = 0; i < numPixels; i++)
+  {
+    *p++ = r;
+    *p++ = g;
+    *p++ = b;
+  }
+  fill(depthBuffer.begin(), depthBuffer.end(), 1.0f);
+}
+
+
+// ****************************************************************************
+/// Transforms the given point from object to window coordinates.
+// ****************************************************************************
+
+TractRenderer::Fragment TractRenderer::transform(const Point3D &P)
+{
+  Fragment f;
+  const double *m = modelViewMatrix;
+  double ex, ey, ez, ew;
+  double cx, cy, cz, cw;
+
+  ex = m[0]*P.x + m[4]*P.y + m[8]*P.z + m[12];
+  ey = m[1]*P.x + m[5]*P.y + m[9]*P.z + m[13];
+  ez = m[2]*P.x + m[6]*P.y + m[10]*P.z + m[14];
+  ew = m[3]*P.x + m[7]*P.y + m[11]*P.z + m[15];
+
+  m = projectionMatrix;
+  cx = m[0]*ex + m[4]*ey + m[8]*ez + m[12]*ew;
+  cy = m[1]*ex + m[5]*ey + m[9]*ez + m[13]*ew;
+  cz = m[2]*ex + m[6]*ey + m[10]*ez + m[14]*ew;
+  cw = m[3]*ex + m[7]*ey + m[11]*ez + m[15]*ew;
+
+  f.visible = (cw > 0.0);
+  if (f.visible == false)
+  {
+    cw = 1.0;
+  }
+
+  f.x = (cx / cw + 1.0)*0.5*width;
+  f.y = (cy / cw + 1.0)*0.5*height;
+  f.z = (cz / cw + 1.0)*0.5;
+  f.eyeZ = ez / ew;
+
+  f.color[0] = currentColor[0];
+  f.color[1] = currentColor[1];
+  f.color[2] = currentColor[2];
+  f.color[3] = 1.0f;
+
+  return f;
+}
+
+
+// ****************************************************************************
+/// Calculates the color of a vertex with the given normal (in eye
+/// coordinates) like the OpenGL fixed-function lighting with the light
+/// source of VocalTractPicture::setLights().
+// ****************************************************************************
+
+void TractRenderer::lightVertex(const Point3D &normal, const Material &material, float *color)
+{
+  const double GLOBAL_AMBIENT = 0.2;
+  const double LIGHT_AMBIENT = 0.4;
+  const double LIGHT_DIFFUSE = 0.8;
+  const double LIGHT_SPECULAR = 0.3;
+
+  // Directional light and the half vector for a viewer at infinity.
+  static const Point3D L = Point3D(0.5, 0.0, 1.0) / sqrt(1.25);
+  static const Point3D H = (L + Point3D(0.0, 0.0, 1.0)) / (L + Point3D(0.0, 0.0, 1.0)).magnitude();
+
+  double nDotL = scalarProduct(normal, L);
+  double nDotH = scalarProduct(normal, H);
+  double specular = 0.0;
+  double c;
+  int i;
+
+  if (nDotL < 0.0) { nDotL = 0.0; }
+  if ((nDotL > 0.0) && (nDotH > 0.0))
+  {
+    specular = LIGHT_SPECULAR*pow(nDotH, (double)material.shininess);
+  }
+
+  for (i = 0; i < 3; i++)
+  {
+    c = (GLOBAL_AMBIENT + LIGHT_AMBIENT)*material.ambient[i] +
+      LIGHT_DIFFUSE*nDotL*material.diffuse[i] + specular*material.specular[i];
+    if (c > 1.0) { c = 1.0; }
+    color[i] = (float)c;
+  }
+  color[3] = material.diffuse[3];
+}
+
+
+// ****************************************************************************
+/// Draws a lit triangle with the given vertices and corner normals. As with
+/// two-sided lighting in OpenGL, the back material and the reversed normals
+/// are used when the back side of the triangle faces the viewer.
+// ****************************************************************************
+
+void TractRenderer::drawTriangle(const Point3D *V, const Point3D *N, const Material &front,
+  const Material &back, bool blend)
+{
+  Fragment f[3];
+  const double *m = modelViewMatrix;
+  Point3D n;
+  int k;
+
+  for (k = 0; k < 3; k++)
+  {
+    f[k] = transform(V[k]);
+    if (f[k].visible == false)
+    {
+      return;
+    }
+  }
+
+  // Counter-clockwise triangles in the window are front-facing.
+  bool isFront =
+    ((f[1].x - f[0].x)*(f[2].y - f[0].y) - (f[2].x - f[0].x)*(f[1].y - f[0].y) > 0.0);
+
+  for (k = 0; k < 3; k++)
+  {
+    n.x = m[0]*N[k].x + m[4]*N[k].y + m[8]*N[k].z;
+    n.y = m[1]*N[k].x + m[5]*N[k].y + m[9]*N[k].z;
+    n.z = m[2]*N[k].x + m[6]*N[k].y + m[10]*N[k].z;
+
+    if (isFront)
+    {
+      lightVertex(n, front, f[k].color);
+    }
+    else
+    {
+      lightVertex(-n, back, f[k].color);
+    }
+  }
+
+  fillTriangle(f, blend);
+}
+
+
+// ****************************************************************************
+/// Rasterizes a triangle in window coordinates with Gouraud shading. The
+/// pixel centers inside the triangle are filled.
+// ****************************************************************************
+
+void TractRenderer::fillTriangle(const Fragment *v, bool blend)
+{
+  double area = (v[1].x - v[0].x)*(v[2].y - v[0].y) - (v[2].x - v[0].x)*(v[1].y - v[0].y);
+  if (area == 0.0)
+  {
+    return;
+  }
+
+  int minX = (int)floor(min(v[0].x, min(v[1].x, v[2].x)));
+  int maxX = (int)ceil(max(v[0].x, max(v[1].x, v[2].x)));
+  int minY = (int)floor(min(v[0].y, min(v[1].y, v[2].y)));
+  int maxY = (int)ceil(max(v[0].y, max(v[1].y, v[2].y)));
+
+  if (minX < 0) { minX = 0; }
+  if (minY < 0) { minY = 0; }
+  if (maxX > width - 1) { maxX = width - 1; }
+  if (maxY > height - 1) { maxY = height - 1; }
+
+  int x, y, i, index;
+  double px, py, w0, w1, w2, z;
+  float color[4];
+
+  for (y = minY; y <= maxY; y++)
+  {
+    py = y + 0.5;
+    for (x = minX; x <= maxX; x++)
+    {
+      px = x + 0.5;
+
+      // Barycentric coordinates from the edge functions.
+      w0 = ((v[2].x - v[1].x)*(py - v[1].y) - (v[2].y - v[1].y)*(px - v[1].x)) / area;
+      w1 = ((v[0].x - v[2].x)*(py - v[2].y) - (v[0].y - v[2].y)*(px - v[2].x)) / area;
+      w2 = 1.0 - w0 - w1;
+      if ((w0 < 0.0) || (w1 < 0.0) || (w2 < 0.0))
+      {
+        continue;
+      }
+
+      z = w0*v[0].z + w1*v[1].z + w2*v[2].z;
+      if ((z < 0.0) || (z > 1.0))
+      {
+        continue;
+      }
+
+      index = y*width + x;
+      if ((depthTest) && (z > depthBuffer[index]))
+      {
+        continue;
+      }
+
+      for (i = 0; i < 4; i++)
+      {
+        color[i] = (float)(w0*v[0].color[i] + w1*v[1].color[i] + w2*v[2].color[i]);
+      }
+
+      blendPixel(index, color, blend ? color[3] : 1.0f);
+
+      if (depthWrite)
+      {
+        depthBuffer[index] = (float)z;
+      }
+    }
+  }
+}
+
+
+// ****************************************************************************
+/// Draws connected lines through the given points in the current color,
+/// width and stipple pattern (like GL_LINE_STRIP).
+// ****************************************************************************
+
+void TractRenderer::drawLineStrip(const Point3D *P, int numPoints)
+{
+  double stippleCounter = 0.0;
+  int i;
+
+  if (numPoints < 2)
+  {
+    return;
+  }
+
+  Fragment a = transform(P[0]);
+  Fragment b;
+
+  for (i = 1; i < numPoints; i++)
+  {
+    b = transform(P[i]);
+    if ((a.visible) && (b.visible))
+    {
+      drawSegment(a, b, stippleCounter);
+    }
+    a = b;
+  }
+}
+
+
+// ****************************************************************************
+/// Draws a single line (like a pair of vertices in GL_LINES).
+// ****************************************************************************
+
+void TractRenderer::drawLine(const Point3D &P0, const Point3D &P1)
+{
+  Point3D P[2] = { P0, P1 };
+  drawLineStrip(P, 2);
+}
+
+
+// ****************************************************************************
+/// Draws an anti-aliased line segment in window coordinates. The stipple
+/// counter is the length of the line strip drawn so far in pixels.
+// ****************************************************************************
+
+void TractRenderer::drawSegment(const Fragment &a, const Fragment &b, double &stippleCounter)
+{
+  double dx = b.x - a.x;
+  double dy = b.y - a.y;
+  double lengthSquared = dx*dx + dy*dy;
+  double length = sqrt(lengthSquared);
+  double radius = 0.5*lineWidth;
+  float colorA[3], colorB[3], color[3];
+  double fogFactor;
+  int i;
+
+  // Apply the linear fog (black fog color) to the end point colors.
+  for (i = 0; i < 3; i++)
+  {
+    colorA[i] = a.color[i];
+    colorB[i] = b.color[i];
+  }
+  if (fog)
+  {
+    fogFactor = (fogEnd + a.eyeZ) / (fogEnd - fogStart);
+    fogFactor = max(0.0, min(1.0, fogFactor));
+    for (i = 0; i < 3; i++) { colorA[i] *= (float)fogFactor; }
+
+    fogFactor = (fogEnd + b.eyeZ) / (fogEnd - fogStart);
+    fogFactor = max(0.0, min(1.0, fogFactor));
+    for (i = 0; i < 3; i++) { colorB[i] *= (float)fogFactor; }
+  }
+
+  int minX = (int)floor(min(a.x, b.x) - radius - 1.0);
+  int maxX = (int)ceil(max(a.x, b.x) + radius + 1.0);
+  int minY = (int)floor(min(a.y, b.y) - radius - 1.0);
+  int maxY = (int)ceil(max(a.y, b.y) + radius + 1.0);
+
+  if (minX < 0) { minX = 0; }
+  if (minY < 0) { minY = 0; }
+  if (maxX > width - 1) { maxX = width - 1; }
+  if (maxY > height - 1) { maxY = height - 1; }
+
+  int x, y, index, bit;
+  double px, py, t, qx, qy, distance, coverage, z;
+
+  for (y = minY; y <= maxY; y++)
+  {
+    py = y + 0.5;
+    for (x = minX; x <= maxX; x++)
+    {
+      px = x + 0.5;
+
+      // Closest point on the segment.
+      t = 0.0;
+      if (lengthSquared > 0.0)
+      {
+        t = ((px - a.x)*dx + (py - a.y)*dy) / lengthSquared;
+        if (t < 0.0) { t = 0.0; }
+        if (t > 1.0) { t = 1.0; }
+      }
+      qx = a.x + t*dx - px;
+      qy = a.y + t*dy - py;
+      distance = sqrt(qx*qx + qy*qy);
+
+      coverage = radius + 0.5 - distance;
+      if (coverage <= 0.0)
+      {
+        continue;
+      }
+      if (coverage > 1.0) { coverage = 1.0; }
+
+      if (lineStipple != 0xFFFF)
+      {
+        bit = (int)(stippleCounter + t*length) & 15;
+        if (((lineStipple >> bit) & 1) == 0)
+        {
+          continue;
+        }
+      }
+
+      z = a.z + t*(b.z - a.z);
+      if ((z < 0.0) || (z > 1.0))
+      {
+        continue;
+      }
+
+      index = y*width + x;
+      if ((depthTest) && (z > depthBuffer[index]))
+      {
+        continue;
+      }
+
+      for (i = 0; i < 3; i++)
+      {
+        color[i] = (float)(colorA[i] + t*(colorB[i] - colorA[i]));
+      }
+      blendPixel(index, color, (float)coverage);
+
+      if (depthWrite)
+      {
+        depthBuffer[index] = (float)z;
+      }
+    }
+  }
+
+  stippleCounter += length;
+}
+
+
+// ****************************************************************************
+/// Draws a round, anti-aliased point with the given diameter in pixels in
+/// the current color (without depth test).
+// ****************************************************************************
+
+void TractRenderer::drawPoint(const Point3D &P, double size)
+{
+  Fragment f = transform(P);
+  if (f.visible == false)
+  {
+    return;
+  }
+
+  double radius = 0.5*size;
+  int minX = max(0, (int)floor(f.x - radius - 1.0));
+  int maxX = min(width - 1, (int)ceil(f.x + radius + 1.0));
+  int minY = max(0, (int)floor(f.y - radius - 1.0));
+  int maxY = min(height - 1, (int)ceil(f.y + radius + 1.0));
+
+  int x, y;
+  double dx, dy, coverage;
+
+  for (y = minY; y <= maxY; y++)
+  {
+    for (x = minX; x <= maxX; x++)
+    {
+      dx = x + 0.5 - f.x;
+      dy = y + 0.5 - f.y;
+      coverage = radius + 0.5 - sqrt(dx*dx + dy*dy);
+      if (coverage > 0.0)
+      {
+        blendPixel(y*width + x, currentColor, (float)min(1.0, coverage));
+      }
+    }
+  }
+}
+
+
+// ****************************************************************************
+/// Blends the given color into the pixel with the given index.
+// ****************************************************************************
+
+void TractRenderer::blendPixel(int index, const float *color, float alpha)
+{
+  float *dest = &colorBuffer[index*3];
+  dest[0] = alpha*color[0] + (1.0f - alpha)*dest[0];
+  dest[1] = alpha*color[1] + (1.0f - alpha)*dest[1];
+  dest[2] = alpha*color[2] + (1.0f - alpha)*dest[2];
+}
+
+
+// ****************************************************************************
+/// Paints the coordinate axes of the 2D view.
+// ****************************************************************************
+
+void TractRenderer::renderAxes(double left_cm, double right_cm, double bottom_cm, double top_cm)
+{
+  int i;
+
+  lineWidth = 1.8;
+  currentColor[0] = currentColor[1] = currentColor[2] = 0.0f;
+
+  drawLine(Point3D((int)left_cm, (int)bottom_cm, 0.0), Point3D((int)right_cm + 1, (int)bottom_cm, 0.0));
+  drawLine(Point3D((int)left_cm, (int)top_cm + 1, 0.0), Point3D((int)left_cm, (int)bottom_cm, 0.0));
+
+  for (i = (int)left_cm; i <= (int)right_cm + 1; i++)
+  {
+    drawLine(Point3D(i, (int)bottom_cm + 0.25, 0.0), Point3D(i, (int)bottom_cm, 0.0));
+  }
+
+  for (i = (int)bottom_cm; i <= (int)top_cm + 1; i++)
+  {
+    drawLine(Point3D((int)left_cm, i, 0.0), Point3D((int)left_cm + 0.25, i, 0.0));
+  }
+}
+
+
+// ****************************************************************************
+/// Renders the vocal tract with filled surfaces like
+/// VocalTractPicture::renderSolid(): the opaque tongue first, and then the
+/// triangles of all transparent surfaces from back to front.
+// ****************************************************************************
+
+void TractRenderer::renderSolid(VocalTract *tract, const TractViewOptions &options)
+{
+  Point3D V[3], N[3];
+  Point3D P;
+  int i, k;
+
+  // ****************************************************************
+  // Material properties.
+  // ****************************************************************
+
+  const float transTeeth = 0.5f;
+  const float transLip = 0.6f;
+  const float transCover = 0.4f;
+
+  Material teeth;
+  setMaterial(teeth.ambient, 1.0f, 1.0f, 1.0f, 0.2f);
+  setMaterial(teeth.diffuse, 0.9f, 0.9f, 0.9f, transTeeth);
+  setMaterial(teeth.specular, 1.0f, 1.0f, 1.0f, transTeeth);
+  teeth.shininess = 50.0f;
+
+  Material frontLip, backLip;
+  setMaterial(frontLip.ambient, 1.0f, 0.5f, 0.5f, transLip);
+  setMaterial(frontLip.diffuse, 1.0f, 0.5f, 0.5f, transLip);
+  setMaterial(frontLip.specular, 1.0f, 1.0f, 1.0f, transLip);
+  frontLip.shininess = 50.0f;
+  backLip = frontLip;
+  setMaterial(backLip.ambient, 1.0f, 0.7f, 0.7f, transLip);
+  setMaterial(backLip.diffuse, 1.0f, 0.7f, 0.7f, transLip);
+
+  Material tongueMaterial;
+  setMaterial(tongueMaterial.ambient, 1.0f, 0.5f, 0.5f, 1.0f);
+  setMaterial(tongueMaterial.diffuse, 1.0f, 0.5f, 0.5f, 1.0f);
+  setMaterial(tongueMaterial.specular, 1.0f, 1.0f, 1.0f, 1.0f);
+  tongueMaterial.shininess = 50.0f;
+
+  Material cover;
+  setMaterial(cover.ambient, 0.5f, 0.5f, 0.5f, 1.0f);
+  setMaterial(cover.diffuse, 0.8f, 0.8f, 0.8f, transCover);
+  setMaterial(cover.specular, 1.0f, 1.0f, 1.0f, transCover);
+  cover.shininess = 50.0f;
+
+  // ****************************************************************
+  // Render the tongue two-sided without transparency.
+  // ****************************************************************
+
+  Surface *tongue = &tract->surface[VocalTract::TONGUE];
+
+  depthWrite = true;
+  tongue->calculateNormals();
+
+  for (i = 0; i < tongue->numTriangles; i++)
+  {
+    for (k = 0; k < 3; k++)
+    {
+      N[k] = tongue->triangle[i].cornerNormal[k];
+      V[k] = tongue->vertex[tongue->triangle[i].vertex[k]].coord;
+    }
+    drawTriangle(V, N, tongueMaterial, tongueMaterial, false);
+  }
+
+  // ****************************************************************
+  // Create an array with all transparent surfaces.
+  // ****************************************************************
+
+  const int NUM_TRANSPARENT_SURFACES = 10;
+  enum {
+    UPPER_TEETH = 0, LOWER_TEETH = 1, UPPER_LIP = 2, LOWER_LIP = 3,
+    UPPER_COVER = 4, LOWER_COVER = 5, LEFT_COVER = 6, RIGHT_COVER = 7,
+    EPIGLOTTIS = 8, UVULA = 9
+  };
+  Surface *transSurface[NUM_TRANSPARENT_SURFACES];
+
+  if (options.renderBothSides)
+  {
+    transSurface[UPPER_TEETH] = &tract->surface[VocalTract::UPPER_TEETH_TWOSIDE];
+    transSurface[LOWER_TEETH] = &tract->surface[VocalTract::LOWER_TEETH_TWOSIDE];
+    transSurface[UPPER_LIP]   = &tract->surface[VocalTract::UPPER_LIP_TWOSIDE];
+    transSurface[LOWER_LIP]   = &tract->surface[VocalTract::LOWER_LIP_TWOSIDE];
+    transSurface[UPPER_COVER] = &tract->surface[VocalTract::UPPER_COVER_TWOSIDE];
+    transSurface[LOWER_COVER] = &tract->surface[VocalTract::LOWER_COVER_TWOSIDE];
+    transSurface[LEFT_COVER]  = &tract->surface[VocalTract::LEFT_COVER];
+    transSurface[RIGHT_COVER] = &tract->surface[VocalTract::RIGHT_COVER];
+    transSurface[EPIGLOTTIS]  = &tract->surface[VocalTract::EPIGLOTTIS_TWOSIDE];
+    transSurface[UVULA]       = &tract->surface[VocalTract::UVULA_TWOSIDE];
+  }
+  else
+  {
+    transSurface[UPPER_TEETH] = &tract->surface[VocalTract::UPPER_TEETH];
+    transSurface[LOWER_TEETH] = &tract->surface[VocalTract::LOWER_TEETH];
+    transSurface[UPPER_LIP]   = &tract->surface[VocalTract::UPPER_LIP];
+    transSurface[LOWER_LIP]   = &tract->surface[VocalTract::LOWER_LIP];
+    transSurface[UPPER_COVER] = &tract->surface[VocalTract::UPPER_COVER];
+    transSurface[LOWER_COVER] = &tract->surface[VocalTract::LOWER_COVER];
+    transSurface[LEFT_COVER]  = &tract->surface[VocalTract::LEFT_COVER];
+    transSurface[RIGHT_COVER] = NULL;
+    transSurface[EPIGLOTTIS]  = &tract->surface[VocalTract::EPIGLOTTIS];
+    transSurface[UVULA]       = &tract->surface[VocalTract::UVULA];
+  }
+
+  // ****************************************************************
+  // Calculate the order of the triangles within each surface and the
+  // plane normals.
+  // ****************************************************************
+
+  for (i = 0; i < NUM_TRANSPARENT_SURFACES; i++)
+  {
+    if (transSurface[i] != NULL)
+    {
+      transSurface[i]->calculateNormals();
+      transSurface[i]->calculatePaintSequence(modelViewMatrix);
+    }
+  }
+
+  // ****************************************************************
+  // Adjust some normals in order to avoid sharp edges.
+  // ****************************************************************
+
+  // Normals at the interface between the upper and lower cover.
+
+  int numRibs = VocalTract::NUM_LARYNX_RIBS + VocalTract::NUM_PHARYNX_RIBS;
+  Surface *upperCover = transSurface[UPPER_COVER];
+  Surface *lowerCover = transSurface[LOWER_COVER];
+
+  for (i = 0; i < numRibs; i++)
+  {
+    P = upperCover->getNormal(i, 0) + lowerCover->getNormal(i, 0);
+    P.normalize();
+    upperCover->setNormal(i, 0, P);
+    lowerCover->setNormal(i, 0, P);
+
+    if (options.renderBothSides)
+    {
+      P = upperCover->getNormal(i, upperCover->numRibPoints - 1) +
+        lowerCover->getNormal(i, lowerCover->numRibPoints - 1);
+      P.normalize();
+      upperCover->setNormal(i, upperCover->numRibPoints - 1, P);
+      lowerCover->setNormal(i, lowerCover->numRibPoints - 1, P);
+    }
+  }
+
+  // Normals at the edge of the filling surfaces.
+
+  Surface *leftCover = transSurface[LEFT_COVER];
+  Surface *rightCover = transSurface[RIGHT_COVER];
+
+  int firstRib = VocalTract::NUM_LARYNX_RIBS + VocalTract::NUM_PHARYNX_RIBS - 1;
+  int lastRib = VocalTract::NUM_LARYNX_RIBS + VocalTract::NUM_PHARYNX_RIBS + VocalTract::NUM_VELUM_RIBS - 1;
+
+  if (leftCover != NULL)
+  {
+    P = upperCover->getNormal(firstRib, 0);
+    for (i = firstRib; i <= lastRib; i++) { upperCover->setNormal(i, 0, P); }
+    leftCover->setNormal(0, 0, P);
+    leftCover->setNormal(0, 1, P);
+    leftCover->setNormal(0, 2, P);
+    leftCover->setNormal(0, 3, P);
+
+    leftCover->setNormal(1, 0, P);
+    leftCover->setNormal(1, 1, P);
+
+    P = lowerCover->getNormal(VocalTract::NUM_LARYNX_RIBS + VocalTract::NUM_THROAT_RIBS, 0);
+    leftCover->setNormal(1, 2, P);
+    leftCover->setNormal(1, 3, P);
+  }
+
+  if (rightCover != NULL)
+  {
+    P = upperCover->getNormal(firstRib, upperCover->numRibPoints - 1);
+    for (i = firstRib; i <= lastRib; i++) { upperCover->setNormal(i, upperCover->numRibPoints - 1, P); }
+    rightCover->setNormal(0, 0, P);
+    rightCover->setNormal(0, 1, P);
+    rightCover->setNormal(0, 2, P);
+    rightCover->setNormal(0, 3, P);
+
+    rightCover->setNormal(1, 0, P);
+    rightCover->setNormal(1, 1, P);
+
+    P = lowerCover->getNormal(VocalTract::NUM_LARYNX_RIBS + VocalTract::NUM_THROAT_RIBS, lowerCover->numRibPoints - 1);
+    rightCover->setNormal(1, 2, P);
+    rightCover->setNormal(1, 3, P);
+  }
+
+  // Beginning and end of the uvula and epiglottis ribs.
+
+  if (options.renderBothSides)
+  {
+    Surface *s[2] = { transSurface[UVULA], transSurface[EPIGLOTTIS] };
+    for (k = 0; k < 2; k++)
+    {
+      for (i = 0; i < s[k]->numRibs; i++)
+      {
+        P = s[k]->getNormal(i, 0) + s[k]->getNormal(i, s[k]->numRibPoints - 1);
+        P.normalize();
+        s[k]->setNormal(i, 0, P);
+        s[k]->setNormal(i, s[k]->numRibPoints - 1, P);
+      }
+    }
+  }
+
+  // ****************************************************************
+  // Draw the transparent surfaces merging the individually sorted
+  // triangle sequences.
+  // ****************************************************************
+
+  int nextIndex[NUM_TRANSPARENT_SURFACES];
+  int numTriangles[NUM_TRANSPARENT_SURFACES];
+  int winningSurface;
+  double z, minZ;
+  Surface *s;
+  bool drawIt;
+  int numLipTriangles = (transSurface[UPPER_LIP]->numRibPoints - 1) * 2;
+
+  for (i = 0; i < NUM_TRANSPARENT_SURFACES; i++)
+  {
+    nextIndex[i] = 0;
+    numTriangles[i] = (transSurface[i] != NULL) ? transSurface[i]->numTriangles : 0;
+  }
+
+  depthWrite = false;
+
+  while (true)
+  {
+    // Choose the surface with the most distant next triangle.
+
+    winningSurface = -1;
+    minZ = 100000000.0;
+
+    for (i = 0; i < NUM_TRANSPARENT_SURFACES; i++)
+    {
+      if (nextIndex[i] < numTriangles[i])
+      {
+        z = transSurface[i]->triangle[transSurface[i]->sequence[nextIndex[i]]].distance;
+        if ((z < minZ) || (winningSurface == -1))
+        {
+          winningSurface = i;
+          minZ = z;
+        }
+      }
+    }
+
+    if (winningSurface == -1)
+    {
+      break;
+    }
+
+    s = transSurface[winningSurface];
+    i = s->sequence[nextIndex[winningSurface]];
+    nextIndex[winningSurface]++;
+
+    // Some triangles of the filling surfaces and the lips are not drawn.
+
+    drawIt = true;
+    if (((winningSurface == RIGHT_COVER) || (winningSurface == LEFT_COVER)) && (i > 5))
+    {
+      drawIt = false;
+    }
+    if (((winningSurface == UPPER_LIP) || (winningSurface == LOWER_LIP)) &&
+      ((i % numLipTriangles) < 2))
+    {
+      drawIt = false;
+    }
+
+    if (drawIt)
+    {
+      for (k = 0; k < 3; k++)
+      {
+        N[k] = s->triangle[i].cornerNormal[k];
+        V[k] = s->vertex[s->triangle[i].vertex[k]].coord;
+      }
+
+      if ((winningSurface == UPPER_TEETH) || (winningSurface == LOWER_TEETH))
+      {
+        drawTriangle(V, N, teeth, teeth, true);
+      }
+      else
+      if ((winningSurface == UPPER_LIP) || (winningSurface == LOWER_LIP))
+      {
+        drawTriangle(V, N, frontLip, backLip, true);
+      }
+      else
+      {
+        drawTriangle(V, N, cover, cover, true);
+      }
+    }
+  }
+
+  depthWrite = true;
+}
+
+
+// ****************************************************************************
+/// Renders the 2D contour lines of the model like
+/// VocalTractPicture::render2D().
+// ****************************************************************************
+
+void TractRenderer::render2D(VocalTract *tract)
+{
+  int i, k;
+  Surface *s = NULL;
+  int rib, ribPoint;
+  Point3D P, Q, R;
+  vector<Point3D> strip;
+
+  depthTest = false;
+  lineWidth = 1.8;
+  currentColor[0] = currentColor[1] = currentColor[2] = 0.0f;
+
+  // ****************************************************************
+  // Upper cover with the uvula.
+  // ****************************************************************
+
+  s = &tract->surface[VocalTract::UPPER_COVER];
+  ribPoint = s->numRibPoints - 1;
+  for (i = 0; i <= VocalTract::NUM_LARYNX_RIBS + VocalTract::NUM_PHARYNX_RIBS; i++)
+  {
+    strip.push_back(s->getVertex(i, ribPoint));
+  }
+
+  s = &tract->surface[VocalTract::UVULA];
+  ribPoint = s->numRibPoints - 1;
+  for (i = 0; i < s->numRibs; i++)
+  {
+    Q = s->getVertex(i, ribPoint);
+    strip.push_back(Point3D(Q.x, Q.y, 0.0));
+  }
+  for (i = s->numRibs - 1; i >= 0; i--)
+  {
+    Q = s->getVertex(i, 0);
+    strip.push_back(Point3D(Q.x, Q.y, 0.0));
+  }
+
+  s = &tract->surface[VocalTract::UPPER_COVER];
+  ribPoint = s->numRibPoints - 1;
+  for (i = VocalTract::NUM_LARYNX_RIBS + VocalTract::NUM_PHARYNX_RIBS + 1; i < s->numRibs; i++)
+  {
+    strip.push_back(s->getVertex(i, ribPoint));
+  }
+  drawLineStrip(&strip[0], (int)strip.size());
+
+  // ****************************************************************
+  // Lower cover with the epiglottis.
+  // ****************************************************************
+
+  strip.clear();
+  s = &tract->surface[VocalTract::LOWER_COVER];
+  ribPoint = s->numRibPoints - 1;
+  for (i = 0; i < VocalTract::NUM_LARYNX_RIBS - 1; i++)
+  {
+    strip.push_back(s->getVertex(i, ribPoint));
+  }
+
+  s = &tract->surface[VocalTract::EPIGLOTTIS];
+  ribPoint = s->numRibPoints - 1;
+  for (i = 0; i < s->numRibs; i++)
+  {
+    Q = s->getVertex(i, ribPoint);
+    strip.push_back(Point3D(Q.x, Q.y, 0.0));
+  }
+  for (i = s->numRibs - 1; i >= 0; i--)
+  {
+    Q = s->getVertex(i, 0);
+    strip.push_back(Point3D(Q.x, Q.y, 0.0));
+  }
+
+  s = &tract->surface[VocalTract::LOWER_COVER];
+  ribPoint = s->numRibPoints - 1;
+  for (i = VocalTract::NUM_LARYNX_RIBS - 1; i < s->numRibs; i++)
+  {
+    strip.push_back(s->getVertex(i, ribPoint));
+  }
+  drawLineStrip(&strip[0], (int)strip.size());
+
+  // ****************************************************************
+  // Tongue side 1 cm off the midsagittal plane.
+  // ****************************************************************
+
+  const double EPSILON = 0.000001;
+  const double z0 = -1.0;
+  double d;
+  bool ok;
+
+  currentColor[0] = currentColor[1] = currentColor[2] = 0.8f;
+  s = &tract->surface[VocalTract::TONGUE];
+  ribPoint = s->numRibPoints / 2;
+
+  strip.clear();
+  for (i = 0; i < s->numRibs; i++)
+  {
+    ok = false;
+    for (k = 0; k < ribPoint; k++)
+    {
+      Q = s->getVertex(i, k);
+      R = s->getVertex(i, k + 1);
+      if ((Q.z <= z0) && (R.z >= z0))
+      {
+        d = R.z - Q.z;
+        if (d < EPSILON) { d = EPSILON; }
+        P = Q + (R - Q)*(z0 - Q.z) / d;
+        ok = true;
+      }
+    }
+    if (ok == false) { P = s->getVertex(i, 0); }
+    strip.push_back(Point3D(P.x, P.y, 0.0));
+  }
+  drawLineStrip(&strip[0], (int)strip.size());
+
+  // Tongue in the midsagittal plane.
+
+  currentColor[0] = currentColor[1] = currentColor[2] = 0.0f;
+
+  strip.clear();
+  for (i = 0; i < s->numRibs; i++)
+  {
+    strip.push_back(s->getVertex(i, ribPoint));
+  }
+  drawLineStrip(&strip[0], (int)strip.size());
+
+  // The tongue circle as dashed line.
+
+  double mx = tract->param[VocalTract::TCX].limitedX;
+  double my = tract->param[VocalTract::TCY].limitedX;
+  double rx = tract->anatomy.tongueCenterRadiusX_cm;
+  double ry = tract->anatomy.tongueCenterRadiusY_cm;
+  const int N = 32;
+  double angle_rad;
+
+  strip.clear();
+  for (i = 0; i < N; i++)
+  {
+    angle_rad = 2.0*M_PI*(double)i / (double)(N - 1);
+    strip.push_back(Point3D(mx + rx*cos(angle_rad), my + ry*sin(angle_rad), 0.0));
+  }
+  lineStipple = 0x00FF;
+  drawLineStrip(&strip[0], (int)strip.size());
+  lineStipple = 0xFFFF;
+
+  // ****************************************************************
+  // Upper and lower teeth.
+  // ****************************************************************
+
+  int surfaceIndex[2] = { VocalTract::UPPER_TEETH, VocalTract::LOWER_TEETH };
+  int numOmittedRibs[2] = { 4, 7 };   // For the outer edge
+
+  for (k = 0; k < 2; k++)
+  {
+    s = &tract->surface[surfaceIndex[k]];
+
+    // Inner edge.
+    strip.clear();
+    for (i = 0; i < s->numRibs; i++)
+    {
+      Q = s->getVertex(i, 0);
+      strip.push_back(Point3D(Q.x, Q.y, 0.0));
+    }
+    drawLineStrip(&strip[0], (int)strip.size());
+
+    // Outer edge.
+    strip.clear();
+    for (i = 0; i < s->numRibs - numOmittedRibs[k]; i++)
+    {
+      Q = s->getVertex(i, 2);
+      strip.push_back(Point3D(Q.x, Q.y, 0.0));
+    }
+    drawLineStrip(&strip[0], (int)strip.size());
+
+    // The most posterior rib.
+    Q = s->getVertex(0, 0);
+    R = s->getVertex(0, 1);
+    drawLine(Point3D(Q.x, Q.y, 0.0), Point3D(R.x, R.y, 0.0));
+
+    // The most anterior rib.
+    rib = s->numRibs - 2;
+    strip.clear();
+    for (i = 0; i < s->numRibPoints; i++)
+    {
+      Q = s->getVertex(rib, i);
+      strip.push_back(Point3D(Q.x, Q.y, 0.0));
+    }
+    drawLineStrip(&strip[0], (int)strip.size());
+  }
+
+  // ****************************************************************
+  // Midsagittal contours of the upper and lower lip.
+  // ****************************************************************
+
+  int lipIndex[2] = { VocalTract::UPPER_LIP, VocalTract::LOWER_LIP };
+
+  for (k = 0; k < 2; k++)
+  {
+    s = &tract->surface[lipIndex[k]];
+    rib = s->numRibs - 1;
+
+    strip.clear();
+    for (i = 0; i < s->numRibPoints; i++)
+    {
+      Q = s->getVertex(rib, i);
+      strip.push_back(Point3D(Q.x, Q.y, 0.0));
+    }
+    drawLineStrip(&strip[0], (int)strip.size());
+  }
+
+  // ****************************************************************
+  // Lower end of the tooth roots of the lower incisors.
+  // ****************************************************************
+
+  s = &tract->surface[VocalTract::LOWER_TEETH];
+  rib = s->numRibs - 2;
+
+  P = s->getVertex(rib, 0);
+  Q = s->getVertex(rib, 3);
+  P = P - (Q - P);
+
+  lineStipple = 0x0F0F;
+  drawLine(Point3D(P.x, P.y - tract->anatomy.toothRootLength_cm, 0.0),
+    Point3D(Q.x, Q.y - tract->anatomy.toothRootLength_cm, 0.0));
+  lineStipple = 0xFFFF;
+
+  depthTest = true;
+}
+
+
+// ****************************************************************************
+/// Renders the model as wire frame with depth fog like
+/// VocalTractPicture::renderWireFrame().
+// ****************************************************************************
+
+void TractRenderer::renderWireFrame(VocalTract *tract, const TractViewOptions &options)
+{
+  const int NUM_SURFACES = 9;
+  int i, k, n;
+  Surface *surface[NUM_SURFACES];
+  Surface *s;
+  vector<Point3D> strip;
+
+  if (options.renderBothSides)
+  {
+    surface[0] = &tract->surface[VocalTract::UPPER_TEETH_TWOSIDE];
+    surface[1] = &tract->surface[VocalTract::LOWER_TEETH_TWOSIDE];
+    surface[2] = &tract->surface[VocalTract::UPPER_COVER_TWOSIDE];
+    surface[3] = &tract->surface[VocalTract::LOWER_COVER_TWOSIDE];
+    surface[4] = &tract->surface[VocalTract::EPIGLOTTIS_TWOSIDE];
+    surface[5] = &tract->surface[VocalTract::UVULA_TWOSIDE];
+    surface[6] = &tract->surface[VocalTract::UPPER_LIP_TWOSIDE];
+    surface[7] = &tract->surface[VocalTract::LOWER_LIP_TWOSIDE];
+    surface[8] = &tract->surface[VocalTract::TONGUE];
+  }
+  else
+  {
+    surface[0] = &tract->surface[VocalTract::UPPER_TEETH];
+    surface[1] = &tract->surface[VocalTract::LOWER_TEETH];
+    surface[2] = &tract->surface[VocalTract::UPPER_COVER];
+    surface[3] = &tract->surface[VocalTract::LOWER_COVER];
+    surface[4] = &tract->surface[VocalTract::EPIGLOTTIS];
+    surface[5] = &tract->surface[VocalTract::UVULA];
+    surface[6] = &tract->surface[VocalTract::UPPER_LIP];
+    surface[7] = &tract->surface[VocalTract::LOWER_LIP];
+    surface[8] = &tract->surface[VocalTract::TONGUE];
+  }
+
+  // ****************************************************************
+  // The fog range follows the min. and max. eye z-coord. of the model.
+  // ****************************************************************
+
+  const double *m = modelViewMatrix;
+  double zMin = 1000000.0;
+  double zMax = -1000000.0;
+  double z;
+
+  for (k = 0; k < NUM_SURFACES; k++)
+  {
+    s = surface[k];
+    for (i = 0; i < s->numVertices; i++)
+    {
+      const Point3D &P = s->vertex[i].coord;
+      z = m[2]*P.x + m[6]*P.y + m[10]*P.z + m[14];
+      if (z < zMin) { zMin = z; }
+      if (z > zMax) { zMax = z; }
+    }
+  }
+
+  fog = true;
+  fogStart = -zMax;
+  fogEnd = -zMin + 0.5*(zMax - zMin);
+  lineWidth = 1.8;
+  depthWrite = true;
+
+  // ****************************************************************
+  // The ribs and the lines across them.
+  // ****************************************************************
+
+  for (n = 0; n < NUM_SURFACES; n++)
+  {
+    s = surface[n];
+
+    if (n == 0)
+    {
+      currentColor[0] = 1.0f; currentColor[1] = 1.0f; currentColor[2] = 1.0f;
+    }
+    else
+    if (n == 2)
+    {
+      currentColor[0] = 1.0f; currentColor[1] = 0.8f; currentColor[2] = 0.1f;
+    }
+    else
+    if ((n == 6) || (n == 8))
+    {
+      currentColor[0] = 1.0f; currentColor[1] = 0.3f; currentColor[2] = 0.15f;
+    }
+
+    for (i = 0; i < s->numRibs; i++)
+    {
+      strip.clear();
+      for (k = 0; k < s->numRibPoints; k++)
+      {
+        strip.push_back(s->getVertex(i, k));
+      }
+      drawLineStrip(&strip[0], (int)strip.size());
+    }
+
+    for (i = 0; i < s->numRibPoints; i++)
+    {
+      strip.clear();
+      for (k = 0; k < s->numRibs; k++)
+      {
+        strip.push_back(s->getVertex(k, i));
+      }
+      drawLineStrip(&strip[0], (int)strip.size());
+    }
+  }
+
+  fog = false;
+  lineWidth = 1.0;
+}
+
+
+// ****************************************************************************
+/// Draws the control points at their set positions and, for the tongue body
+/// and tip, also at their limited positions.
+// ****************************************************************************
+
+void TractRenderer::renderControlPoints(VocalTract *tract, const TractViewOptions &options)
+{
+  const double POINT_SIZE = 8.0;
+  int i;
+
+  depthTest = false;
+
+  Point3D setTongueBody = getControlPoint(tract, CP_TONGUE_CENTER, options);
+  Point3D setTongueTip = getControlPoint(tract, CP_TONGUE_TIP, options);
+  Point3D limitedTongueBody(tract->param[VocalTract::TCX].limitedX, tract->param[VocalTract::TCY].limitedX, 0.0);
+  Point3D limitedTongueTip(tract->param[VocalTract::TTX].limitedX, tract->param[VocalTract::TTY].limitedX, 0.0);
+
+  // A dotted line connects the limited and set positions.
+
+  currentColor[0] = 1.0f; currentColor[1] = 0.8f; currentColor[2] = 0.0f;
+  lineStipple = 0x00FF;
+  drawLine(limitedTongueBody, setTongueBody);
+  drawLine(limitedTongueTip, setTongueTip);
+  lineStipple = 0xFFFF;
+
+  // The limited positions of the tongue tip and body.
+
+  currentColor[0] = 1.0f; currentColor[1] = 0.2f; currentColor[2] = 0.0f;
+  drawPoint(limitedTongueBody, POINT_SIZE);
+  drawPoint(limitedTongueTip, POINT_SIZE);
+
+  // All control points at their set positions.
+
+  currentColor[0] = 1.0f; currentColor[1] = 0.8f; currentColor[2] = 0.0f;
+
+  for (i = 0; i < NUM_CONTROL_POINTS; i++)
+  {
+    if ((i == CP_CUT_PLANE) && (options.showCenterLine == false))
+    {
+      continue;
+    }
+    if ((i == CP_TONGUE_BACK) && (tract->anatomy.automaticTongueRootCalc))
+    {
+      continue;
+    }
+    drawPoint(getControlPoint(tract, i, options), POINT_SIZE);
+  }
+
+  depthTest = true;
+}
+
+
+// ****************************************************************************
+/// Returns the position of the given control point for the current 
+/// parameters of the vocal tract, like 
+/// VocalTractPicture::parameterToControlPoint().
+// ****************************************************************************
+
+Point3D TractRenderer::getControlPoint(VocalTract *tract, int index, 
+  const TractViewOptions &options)
+{
+  VocalTract::Param *p;
+  Point3D onset, corner, F0, F1;
+  double yClose;
+  double t;
+  double x = 0.0;
+  double y = 0.0;
+  double z = 0.0;
+
+  switch (index)
+  {
+    // Velic opening along the horizontal axis and velum shape along the
+    // vertical axis.
+    case CP_VELUM:
+    {
+      const double X_LEFT = -2.5;
+      const double X_RIGHT = -1.5;
+      const double Y_TOP = 1.0;
+      const double Y_BOTTOM = 0.0;
+
+      p = &tract->param[VocalTract::VO];
+      t = (p->x - p->min) / (p->max - p->min);
+      x = X_LEFT + t*(X_RIGHT - X_LEFT);
+
+      p = &tract->param[VocalTract::VS];
+      t = (p->x - p->min) / (p->max - p->min);
+      y = Y_TOP + t*(Y_BOTTOM - Y_TOP);
+    }
+    break;
+
+    case CP_JAW:
+      tract->surface[VocalTract::LOWER_COVER].getVertex(
+        VocalTract::NUM_LARYNX_RIBS + VocalTract::NUM_THROAT_RIBS, 0, x, y, z);
+      break;
+
+    case CP_HYOID:
+      tract->surface[VocalTract::LOWER_COVER].getVertex(
+        VocalTract::NUM_LARYNX_RIBS - 1, VocalTract::NUM_LOWER_COVER_POINTS - 1, x, y, z);
+      break;
+
+    case CP_LIP_CORNER:
+      tract->getImportantLipPoints(onset, corner, F0, F1, yClose);
+      x = corner.x;
+      y = corner.y;
+      z = corner.z;
+      break;
+
+    case CP_LIP_DISTANCE:
+      tract->getImportantLipPoints(onset, corner, F0, F1, yClose);
+      x = F0.x;
+      y = yClose + 0.5*tract->param[VocalTract::LD].x;
+      break;
+
+    case CP_TONGUE_CENTER:
+      x = tract->param[VocalTract::TCX].x;
+      y = tract->param[VocalTract::TCY].x;
+      break;
+
+    case CP_TONGUE_TIP:
+      x = tract->param[VocalTract::TTX].x;
+      y = tract->param[VocalTract::TTY].x;
+      break;
+
+    case CP_TONGUE_BLADE:
+      x = tract->param[VocalTract::TBX].x;
+      y = tract->param[VocalTract::TBY].x;
+      break;
+
+    case CP_TONGUE_BACK:
+      x = tract->param[VocalTract::TRX].x;
+      y = tract->param[VocalTract::TRY].x;
+      break;
+
+    case CP_CUT_PLANE:
+    {
+      Point2D P, v;
+      tract->getCutVector(options.cutPlanePos_cm, P, v);
+      x = P.x;
+      y = P.y;
+    }
+    break;
+
+    default:
+      break;
+  }
+
+  return Point3D(x, y, z);
+}
+
+
+// ****************************************************************************
+/// Draws the EMA points.
+// ****************************************************************************
+
+void TractRenderer::renderEmaPoints(VocalTract *tract)
+{
+  int i;
+
+  currentColor[0] = 1.0f; currentColor[1] = 0.2f; currentColor[2] = 0.0f;
+
+  for (i = 0; i < (int)tract->emaPoints.size(); i++)
+  {
+    drawPoint(tract->getEmaPointCoord(i), 8.0);
+  }
+}
@@ -0,0 +1,150 @@
+#ifndef __TRACT_RENDERER_H__
+#define __TRACT_RENDERER_H__
+
+#include <vector>
+
+#include "VocalTract.h"
+
+using namespace std;
+
+// ****************************************************************************
+/// The view options of the TractRenderer. They have the same meaning and
+/// default values as the corresponding members of VocalTractPicture, but no
+/// dependency on OpenGL.
+// ****************************************************************************
+
+struct TractViewOptions
+{
+  static const double DEFAULT_DISTANCE;
+  static const double DEFAULT_X_TRANSLATION;
+  static const double DEFAULT_Y_TRANSLATION;
+
+  enum RenderMode
+  {
+    RM_NONE, RM_3DSOLID, RM_3DWIRE, RM_2D
+  };
+
+  RenderMode renderMode;
+  double distance_cm;
+  double yRotation_deg;
+  double zRotation_deg;
+  double cutPlanePos_cm;      ///< Position of the cutting plane on the center line.
+  bool showControlPoints;
+  bool showCenterLine;        ///< Shows the control point of the cutting plane.
+  bool showEmaPoints;
+  bool renderBothSides;
+
+  TractViewOptions();
+};
+
+
+// ****************************************************************************
+/// A software renderer for the views of VocalTractPicture that needs no
+/// OpenGL context or display. It reproduces the 3D solid, 3D wire frame and
+/// 2D contour views (with the coordinate axes, control points and EMA points)
+/// with the given view options, i.e., the same transformations, lighting,
+/// materials and transparency order as VocalTractPicture::display().
+/// The frame buffer is allocated once and reused for all frames.
+// ****************************************************************************
+
+class TractRenderer
+{
+  // **************************************************************************
+  // Public functions.
+  // **************************************************************************
+
+public:
+  TractRenderer(int width = 400, int height = 400);
+
+  void setSize(int width, int height);
+  int getWidth() { return width; }
+  int getHeight() { return height; }
+
+  void render(VocalTract *tract, const TractViewOptions &options);
+  void getImage(unsigned char *rgb);
+
+  // **************************************************************************
+  // Private data.
+  // **************************************************************************
+
+private:
+  /// The control points (in the order of VocalTractPicture::ControlPoints).
+  enum ControlPoint
+  {
+    CP_VELUM,
+    CP_HYOID,
+    CP_JAW,
+    CP_LIP_CORNER,
+    CP_LIP_DISTANCE,
+    CP_TONGUE_CENTER,
+    CP_TONGUE_TIP,
+    CP_TONGUE_BLADE,
+    CP_TONGUE_BACK,
+    CP_CUT_PLANE,
+    NUM_CONTROL_POINTS
+  };
+
+  /// A vertex in window coordinates with its color.
+  struct Fragment
+  {
+    double x, y, z;     ///< Window coordinates; z is the depth (0..1).
+    double eyeZ;        ///< z in eye coordinates (for the fog).
+    float color[4];
+    bool visible;       ///< false if the point is behind the eye.
+  };
+
+  /// The fixed-function material parameters of a surface.
+  struct Material
+  {
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+    float shininess;
+  };
+
+  int width;
+  int height;
+  vector<float> colorBuffer;    ///< RGB, rows from bottom to top (like OpenGL).
+  vector<float> depthBuffer;
+
+  double modelViewMatrix[16];
+  double projectionMatrix[16];
+
+  // The current drawing state (like the OpenGL state).
+  float currentColor[3];
+  double lineWidth;
+  unsigned short lineStipple;   ///< 0xFFFF for solid lines.
+  bool depthTest;
+  bool depthWrite;
+  bool fog;
+  double fogStart;
+  double fogEnd;
+
+  // **************************************************************************
+  // Private functions.
+  // **************************************************************************
+
+private:
+  void clear(float r, float g, float b);
+  Fragment transform(const Point3D &P);
+  void lightVertex(const Point3D &normal, const Material &material, float *color);
+
+  void drawTriangle(const Point3D *V, const Point3D *N, const Material &front,
+    const Material &back, bool blend);
+  void fillTriangle(const Fragment *v, bool blend);
+  void drawLineStrip(const Point3D *P, int numPoints);
+  void drawLine(const Point3D &P0, const Point3D &P1);
+  void drawSegment(const Fragment &a, const Fragment &b, double &stippleCounter);
+  void drawPoint(const Point3D &P, double size);
+  void blendPixel(int index, const float *color, float alpha);
+
+  void renderAxes(double left_cm, double right_cm, double bottom_cm, double top_cm);
+  void renderSolid(VocalTract *tract, const TractViewOptions &options);
+  void render2D(VocalTract *tract);
+  void renderWireFrame(VocalTract *tract, const TractViewOptions &options);
+  void renderControlPoints(VocalTract *tract, const TractViewOptions &options);
+  Point3D getControlPoint(VocalTract *tract, int index, const TractViewOptions &options);
+  void renderEmaPoints(VocalTract *tract);
+};
+
+#endif
@@ -95,6 +95,10 @@ Tube::Tube()
   piriformFossaLength_cm = 0.0;
   piriformFossaVolume_cm3 = 0.0;
 
+  leftTube = NULL;
+  rightTube = NULL;
+  interpolateStaticParts = false;
+
   // Init the static parts.
   staticPartsInitialized = false;
 
@@ -471,79 +475,116 @@ void Tube::setAspirationStrength(const double aspirationStrength_dB)
 /// current tube.
 /// The parameter ratio = [0, 1] determines the contribution of rightTube,
 /// i.e., thisTube = (1.0-ratio)*leftTube + ratio*rightTube.
+/// To interpolate between the same tubes for many ratios, call 
+/// prepareInterpolation() once and then interpolate(ratio).
 // ****************************************************************************
 
 void Tube::interpolate(const Tube *leftTube, const Tube *rightTube, const double ratio)
+{
+  prepareInterpolation(leftTube, rightTube);
+  interpolate(ratio);
+}
+
+
+// ****************************************************************************
+/// Prepares the interpolation between leftTube and rightTube with 
+/// interpolate(ratio). Both tubes must stay unchanged and valid as long as
+/// interpolate(ratio) is called.
+/// The static parts (subglottal system, nasal cavity and piriform fossae)
+/// are set here once if they have the same dimensions in both tubes (the
+/// normal case). Only when their dimensions differ, they are interpolated 
+/// for every ratio.
+// ****************************************************************************
+
+void Tube::prepareInterpolation(const Tube *leftTube, const Tube *rightTube)
+{
+  this->leftTube = leftTube;
+  this->rightTube = rightTube;
+
+  interpolateStaticParts =
+    (leftTube->subglottalCavityLength_cm != rightTube->subglottalCavityLength_cm) ||
+    (leftTube->nasalCavityLength_cm != rightTube->nasalCavityLength_cm) ||
+    (leftTube->piriformFossaLength_cm != rightTube->piriformFossaLength_cm) ||
+    (leftTube->piriformFossaVolume_cm3 != rightTube->piriformFossaVolume_cm3);
+
+  if (interpolateStaticParts == false)
+  {
+    // These functions return immediately if the dimensions did not change.
+    initSubglottalCavity(leftTube->subglottalCavityLength_cm);
+    initNasalCavity(leftTube->nasalCavityLength_cm);
+    initPiriformFossa(leftTube->piriformFossaLength_cm, leftTube->piriformFossaVolume_cm3);
+  }
+}
+
+
+// ****************************************************************************
+/// Interpolates linearly between the two tubes passed to 
+/// prepareInterpolation(), i.e., thisTube = (1.0-ratio)*leftTube + 
+/// ratio*rightTube. Only the sections that change during speaking are 
+/// recalculated.
+// ****************************************************************************
+
+void Tube::interpolate(const double ratio)
 {
   int i;
-  double length_cm[NUM_PHARYNX_MOUTH_SECTIONS];
-  double area_cm2[NUM_PHARYNX_MOUTH_SECTIONS];
-  Articulator articulator[NUM_PHARYNX_MOUTH_SECTIONS];
+  Section *ts = NULL;
+  const Section *left = NULL;
+  const Section *right = NULL;
 
   double ratio1 = 1.0 - ratio;
 
+  // Interpolate the pharynx and mouth sections (their positions are set
+  // by calcPositions() below).
+
   for (i=0; i < NUM_PHARYNX_MOUTH_SECTIONS; i++)
   {
-    area_cm2[i]  = ratio1*leftTube->pharynxMouthSection[i].area_cm2 + ratio*rightTube->pharynxMouthSection[i].area_cm2;
-    length_cm[i] = ratio1*leftTube->pharynxMouthSection[i].length_cm + ratio*rightTube->pharynxMouthSection[i].length_cm;
+    ts = &pharynxMouthSection[i];
+    left = &leftTube->pharynxMouthSection[i];
+    right = &rightTube->pharynxMouthSection[i];
+
+    ts->length_cm  = ratio1*left->length_cm + ratio*right->length_cm;
+    ts->area_cm2   = ratio1*left->area_cm2 + ratio*right->area_cm2;
+    if (ts->area_cm2 < MIN_AREA_CM2) { ts->area_cm2 = MIN_AREA_CM2; }
+    ts->volume_cm3 = ts->area_cm2 * ts->length_cm;
 
     if (ratio < 0.5)
     {
-      articulator[i] = leftTube->pharynxMouthSection[i].articulator;
+      ts->articulator = left->articulator;
     }
     else
     {
-      articulator[i] = rightTube->pharynxMouthSection[i].articulator;
+      ts->articulator = right->articulator;
     }
   }
 
   // Interpolate the teeth position and the tongue tip side elevation.
 
-  double incisorPos_cm = ratio1*leftTube->teethPosition_cm + ratio*rightTube->teethPosition_cm;
-  double tongueTipSideElevation = ratio1 * leftTube->tongueTipSideElevation + ratio * rightTube->tongueTipSideElevation;
-
-  // Set the dimensions of the main vocal tract.
+  teethPosition_cm = ratio1*leftTube->teethPosition_cm + ratio*rightTube->teethPosition_cm;
+  tongueTipSideElevation = ratio1*leftTube->tongueTipSideElevation + ratio*rightTube->tongueTipSideElevation;
 
-  this->setPharynxMouthGeometry(length_cm, area_cm2, articulator, incisorPos_cm, tongueTipSideElevation);
+  calcPositions();
 
   // Interpolate the velum area.
 
   double leftOpening_cm2 = leftTube->getVelumOpening_cm2();
   double rightOpening_cm2 = rightTube->getVelumOpening_cm2();
   
-  this->setVelumOpening( ratio1*leftOpening_cm2 + ratio*rightOpening_cm2 );
+  setVelumOpening( ratio1*leftOpening_cm2 + ratio*rightOpening_cm2 );
 
   // Interpolate the aspiration strength.
 
-  double leftAspirationStrength_dB = leftTube->aspirationStrength_dB;
-  double rightAspirationStrength_dB = rightTube->aspirationStrength_dB;
-
-  this->aspirationStrength_dB = ratio1*leftAspirationStrength_dB + ratio*rightAspirationStrength_dB;
+  aspirationStrength_dB = ratio1*leftTube->aspirationStrength_dB + ratio*rightTube->aspirationStrength_dB;
 
   // Interpolate the length of the subglottal system, the nasal cavity,
-  // and the piriform fossae.
-
-  double leftSubglottalCavityLength_cm, rightSubglottalCavityLength_cm;
-  double leftNasalCavityLength_cm, rightNasalCavityLength_cm;
-  double leftPiriformFossaLength_cm, rightPiriformFossaLength_cm;
-  double leftPiriformFossaVolume_cm3, rightPiriformFossaVolume_cm3;
-
-  leftTube->getStaticTubeDimensions(
-    leftSubglottalCavityLength_cm,
-    leftNasalCavityLength_cm, 
-    leftPiriformFossaLength_cm,
-    leftPiriformFossaVolume_cm3);
-
-  rightTube->getStaticTubeDimensions(
-    rightSubglottalCavityLength_cm,
-    rightNasalCavityLength_cm,
-    rightPiriformFossaLength_cm,
-    rightPiriformFossaVolume_cm3);
-
-  this->initSubglottalCavity(ratio1*leftSubglottalCavityLength_cm + ratio*rightSubglottalCavityLength_cm);
-  this->initNasalCavity(ratio1*leftNasalCavityLength_cm + ratio*rightNasalCavityLength_cm);
-  this->initPiriformFossa(ratio1*leftPiriformFossaLength_cm + ratio*rightPiriformFossaLength_cm,
-    ratio1*leftPiriformFossaVolume_cm3 + ratio*rightPiriformFossaVolume_cm3);
+  // and the piriform fossae, if they differ.
+
+  if (interpolateStaticParts)
+  {
+    initSubglottalCavity(ratio1*leftTube->subglottalCavityLength_cm + ratio*rightTube->subglottalCavityLength_cm);
+    initNasalCavity(ratio1*leftTube->nasalCavityLength_cm + ratio*rightTube->nasalCavityLength_cm);
+    initPiriformFossa(ratio1*leftTube->piriformFossaLength_cm + ratio*rightTube->piriformFossaLength_cm,
+      ratio1*leftTube->piriformFossaVolume_cm3 + ratio*rightTube->piriformFossaVolume_cm3);
+  }
 }
 
 
@@ -760,6 +801,12 @@ void Tube::operator=(const Tube &t)
   this->teethPosition_cm = t.teethPosition_cm;
   this->aspirationStrength_dB = t.aspirationStrength_dB;
   this->tongueTipSideElevation = t.tongueTipSideElevation;
+
+  // The dimensions of the static parts belong to their sections.
+  this->subglottalCavityLength_cm = t.subglottalCavityLength_cm;
+  this->nasalCavityLength_cm = t.nasalCavityLength_cm;
+  this->piriformFossaLength_cm = t.piriformFossaLength_cm;
+  this->piriformFossaVolume_cm3 = t.piriformFossaVolume_cm3;
 }
 
 // ****************************************************************************
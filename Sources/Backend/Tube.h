@@ -154,6 +154,8 @@ public:
   void setAspirationStrength(const double aspirationStrength_dB);
 
   void interpolate(const Tube *leftTube, const Tube *rightTube, const double ratio);
+  void prepareInterpolation(const Tube *leftTube, const Tube *rightTube);
+  void interpolate(const double ratio);
 
   double getVelumOpening_cm2() const;
 
@@ -179,6 +181,11 @@ private:
   double piriformFossaLength_cm;
   double piriformFossaVolume_cm3;
 
+  // The two tubes of the interpolation set up by prepareInterpolation().
+  const Tube *leftTube;
+  const Tube *rightTube;
+  bool interpolateStaticParts;
+
   // **************************************************************************
   // Private functions.
   // **************************************************************************
@@ -0,0 +1,170 @@
+// ****************************************************************************
+// Micro-benchmark of the per-sample tube path of Synthesizer::prepareSample():
+// the interpolation of the tube between two frames, the glottis geometry and
+// TdsModel::setTube(). The tubes of a sequence of random vocal tract shapes
+// are interpolated in three ways:
+// - per sample with Tube::interpolate(left, right, ratio), where the static
+//   parts (subglottal system, nasal cavity, piriform fossae) differ between
+//   the two tubes, so that they are rebuilt in every sample (this was the
+//   case in the synthesizer when Tube::operator=() did not copy them),
+// - per sample with Tube::interpolate(left, right, ratio) and the same
+//   static parts,
+// - with Tube::prepareInterpolation() once per frame and
+//   Tube::interpolate(ratio) per sample, as the synthesizer does now.
+// The results are in ns per sample (the fastest of several runs).
+//
+// Usage: TubePathBenchmark <speaker file> [numRepetitions]
+// ****************************************************************************
+
+#include "SpeakerModel.h"
+#include "TdsModel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+static const int NUM_SHAPES = 40;
+static const int FRAME_STEP_SAMPLES = 110;
+// The fastest of this number of runs is reported for each mode.
+static const int NUM_TRIALS = 7;
+
+enum InterpolationMode
+{
+  PER_SAMPLE_CHANGING_STATIC_PARTS,
+  PER_SAMPLE,
+  PER_FRAME,
+  NUM_MODES
+};
+
+static const char *MODE_NAMES[NUM_MODES] =
+{
+  "interpolate(left, right, ratio), static parts differ",
+  "interpolate(left, right, ratio)",
+  "prepareInterpolation() + interpolate(ratio)"
+};
+
+
+// ****************************************************************************
+/// Runs the tube path over all frames numRepetitions times and returns the
+/// time per sample in ns.
+// ****************************************************************************
+
+static double runTubePath(InterpolationMode mode, const vector<Tube*> &frames,
+  TdsModel &model, int numRepetitions)
+{
+  Tube prevTube;
+  Tube tube;
+  double length_cm[Tube::NUM_GLOTTIS_SECTIONS] = { 0.3, 0.3 };
+  double area_cm2[Tube::NUM_GLOTTIS_SECTIONS] = { 0.1, 0.05 };
+  double ratio;
+  int i, k, rep;
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for (rep = 0; rep < numRepetitions; rep++)
+  {
+    prevTube = *frames[0];
+
+    for (k = 1; k < (int)frames.size(); k++)
+    {
+      if (mode == PER_SAMPLE_CHANGING_STATIC_PARTS)
+      {
+        // The default dimensions of the piriform fossae.
+        prevTube.initPiriformFossa(3.0, 2.0);
+      }
+      if (mode == PER_FRAME)
+      {
+        tube.prepareInterpolation(&prevTube, frames[k]);
+      }
+
+      for (i = 0; i < FRAME_STEP_SAMPLES; i++)
+      {
+        ratio = (double)i / (double)FRAME_STEP_SAMPLES;
+        if (mode == PER_FRAME)
+        {
+          tube.interpolate(ratio);
+        }
+        else
+        {
+          tube.interpolate(&prevTube, frames[k], ratio);
+        }
+
+        tube.setGlottisGeometry(length_cm, area_cm2);
+        model.setTube(&tube, true);
+      }
+
+      prevTube = *frames[k];
+    }
+  }
+
+  double elapsed_ns = (double)chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start).count();
+
+  return elapsed_ns / ((double)numRepetitions * (frames.size() - 1) * FRAME_STEP_SAMPLES);
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s <speaker file> [numRepetitions]\n", argv[0]);
+    return 1;
+  }
+
+  int numRepetitions = (argc > 2) ? atoi(argv[2]) : 50;
+  if (numRepetitions < 1) { numRepetitions = 1; }
+
+  shared_ptr<const SpeakerModel> speaker = SpeakerModel::load(argv[1]);
+  if (!speaker)
+  {
+    printf("Error: The speaker file could not be loaded.\n");
+    return 1;
+  }
+
+  unique_ptr<VocalTract> tract(speaker->createVocalTract());
+  unique_ptr<TdsModel> model(new TdsModel());
+  vector<Tube*> frames(NUM_SHAPES);
+  double min, max, t_ns, best_ns;
+  int i, k, trial;
+
+  // Random vocal tract shapes in the middle part of the parameter ranges.
+  srand(1);
+  for (i = 0; i < NUM_SHAPES; i++)
+  {
+    for (k = 0; k < VocalTract::NUM_PARAMS; k++)
+    {
+      min = tract->param[k].min;
+      max = tract->param[k].max;
+      tract->param[k].x = min + (0.25 + 0.5 * rand() / (double)RAND_MAX) * (max - min);
+    }
+    tract->calculateAll();
+    frames[i] = new Tube();
+    tract->getTube(frames[i]);
+  }
+
+  for (i = 0; i < NUM_MODES; i++)
+  {
+    best_ns = 0.0;
+    for (trial = 0; trial < NUM_TRIALS; trial++)
+    {
+      t_ns = runTubePath((InterpolationMode)i, frames, *model, numRepetitions);
+      if ((trial == 0) || (t_ns < best_ns)) { best_ns = t_ns; }
+    }
+    printf("%-55s %8.1f ns per sample\n", MODE_NAMES[i], best_ns);
+  }
+
+  for (i = 0; i < NUM_SHAPES; i++)
+  {
+    delete frames[i];
+  }
+
+  return 0;
+}
@@ -164,11 +164,63 @@ void TwoMassModel::resetMotion()
 
   pos = 0;
 
-  supraglottalPressureFilter.createChebyshev(25.0/(double)SAMPLING_RATE, false, 4);
+  supraglottalPressureFilter.createChebyshev(25.0/(double)samplingRate, false, 4);
   supraglottalPressureFilter.resetBuffers();
 }
 
 
+// ****************************************************************************
+/// Saves the dynamic state of the simulation (see Glottis::saveMotionState()):
+/// the buffered displacements of the masses, the position and the pressure
+/// filter.
+// ****************************************************************************
+
+void TwoMassModel::saveMotionState(MotionState &state)
+{
+  int i, k;
+
+  Glottis::saveMotionState(state);
+
+  for (i = 0; i < 2; i++)
+  {
+    for (k = 0; k < BUFFER_LENGTH; k++)
+    {
+      state.value.push_back(relativeDisplacementBuffer[i][k]);
+    }
+  }
+  state.value.push_back((double)pos);
+  state.filter = supraglottalPressureFilter;
+}
+
+
+// ****************************************************************************
+/// Continues the simulation from a state saved with saveMotionState().
+// ****************************************************************************
+
+bool TwoMassModel::restoreMotionState(const MotionState &state)
+{
+  int i, k;
+
+  if (((int)state.value.size() != 2*BUFFER_LENGTH + 1) || 
+    (Glottis::restoreMotionState(state) == false))
+  {
+    return false;
+  }
+
+  for (i = 0; i < 2; i++)
+  {
+    for (k = 0; k < BUFFER_LENGTH; k++)
+    {
+      relativeDisplacementBuffer[i][k] = state.value[i*BUFFER_LENGTH + k];
+    }
+  }
+  pos = (int)state.value[2*BUFFER_LENGTH];
+  supraglottalPressureFilter = state.filter;
+
+  return true;
+}
+
+
 // ****************************************************************************
 /// Performs a time step of the digital simulation.
 /// Requires four pressure values: subglottal, lower glottis, upper glottis, 
@@ -1,30 +1,479 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/complex.h>
+#include <pybind11/numpy.h>
 namespace py = pybind11;
 
 #include "VocalTractLabApi.h"
 
+typedef py::array_t<double, py::array::c_style | py::array::forcecast> DoubleArray;
+
+// NumPy variant of synth_audio: C-contiguous float64 input is used in place
+// (other dtypes/layouts are converted once), the waveform is written straight
+// into the returned array and the GIL is released during the synthesis.
+// Only ndarrays are accepted here, so that lists always go to the list
+// variant (and get a list back), whatever the types of their elements.
+static py::array_t<double> synthAudioArray(VocalTractLab &vtl, py::array tractParamArray,
+    py::array glottisParamArray, int numFrames, int frameStep_samples)
+{
+    DoubleArray tractParams = py::cast<DoubleArray>(tractParamArray);
+    DoubleArray glottisParams = py::cast<DoubleArray>(glottisParamArray);
+
+    if (numFrames < 2)
+    {
+        return py::array_t<double>(0);
+    }
+    if (tractParams.size() < numFrames * VocalTract::NUM_PARAMS)
+    {
+        throw py::value_error("tractParams holds fewer than numFrames frames.");
+    }
+    if (glottisParams.size() < numFrames * vtl.vtlGetNumGlottisParams())
+    {
+        throw py::value_error("glottisParams holds fewer than numFrames frames.");
+    }
+
+    py::array_t<double> audio((size_t)(numFrames - 1) * frameStep_samples);
+    double *tract = const_cast<double*>(tractParams.data());
+    double *glottis = const_cast<double*>(glottisParams.data());
+    double *out = audio.mutable_data();
+    {
+        py::gil_scoped_release release;
+        vtl.vtlSynthAudio(tract, glottis, numFrames, frameStep_samples, out);
+    }
+    return audio;
+}
+
+// NumPy variant of tract2ema: returns a (numFrames, 2*numEmaPoints) array
+// that is filled with the GIL released, using up to numThreads threads.
+// As for synth_audio, only ndarrays are accepted here, so that lists always
+// go to the list variant (and get a list back).
+static py::array_t<double> tract2EmaArray(VocalTractLab &vtl, py::array tractParamArray,
+    int numFrames, int numThreads)
+{
+    DoubleArray tractParams = py::cast<DoubleArray>(tractParamArray);
+
+    if (numFrames < 0)
+    {
+        numFrames = 0;
+    }
+    if (tractParams.size() < numFrames * VocalTract::NUM_PARAMS)
+    {
+        throw py::value_error("tractParams holds fewer than numFrames frames.");
+    }
+
+    py::array_t<double> ema({ (size_t)numFrames, (size_t)(2 * vtl.vtlGetNumEmaPoints()) });
+    double *tract = const_cast<double*>(tractParams.data());
+    double *out = ema.mutable_data();
+    {
+        py::gil_scoped_release release;
+        vtl.vtlTract2EMA(tract, numFrames, out, numThreads);
+    }
+    return ema;
+}
+
+// Area functions of numFrames frames of tract parameters without acoustic
+// simulation. Returns a dict of arrays (one row per frame), filled with the
+// GIL released, using up to numThreads threads.
+static py::dict tractToTubeArray(VocalTractLab &vtl, DoubleArray tractParams,
+    int numFrames, int numThreads)
+{
+    const size_t N = Tube::NUM_PHARYNX_MOUTH_SECTIONS;
+
+    if (numFrames < 0)
+    {
+        numFrames = 0;
+    }
+    if (tractParams.size() < numFrames * VocalTract::NUM_PARAMS)
+    {
+        throw py::value_error("tractParams holds fewer than numFrames frames.");
+    }
+
+    py::array_t<double> length({ (size_t)numFrames, N });
+    py::array_t<double> area({ (size_t)numFrames, N });
+    py::array_t<int> articulator({ (size_t)numFrames, N });
+    py::array_t<double> incisorPos((size_t)numFrames);
+    py::array_t<double> tongueTipSideElevation((size_t)numFrames);
+    py::array_t<double> velumOpening((size_t)numFrames);
+
+    double *tract = const_cast<double*>(tractParams.data());
+    double *lengthData = length.mutable_data();
+    double *areaData = area.mutable_data();
+    int *articulatorData = articulator.mutable_data();
+    double *incisorPosData = incisorPos.mutable_data();
+    double *elevationData = tongueTipSideElevation.mutable_data();
+    double *velumData = velumOpening.mutable_data();
+    {
+        py::gil_scoped_release release;
+        vtl.vtlTractToTube(tract, numFrames, lengthData, areaData, articulatorData,
+            incisorPosData, elevationData, velumData, numThreads);
+    }
+
+    py::dict result;
+    result["tube_length_cm"] = length;
+    result["tube_area_cm2"] = area;
+    result["tube_articulator"] = articulator;
+    result["incisor_pos_cm"] = incisorPos;
+    result["tongue_tip_side_elevation"] = tongueTipSideElevation;
+    result["velum_opening_cm2"] = velumOpening;
+    return result;
+}
+
+// Formants of numFrames frames of tract parameters. Returns a dict with the
+// frequencies and bandwidths in Hz (one row per frame, missing formants are
+// zero) and the number of formants found per frame.
+static py::dict getFormantsArray(VocalTractLab &vtl, DoubleArray tractParams,
+    int numFrames, int numFormants, int numThreads)
+{
+    if (numFrames < 0)
+    {
+        numFrames = 0;
+    }
+    if (tractParams.size() < numFrames * VocalTract::NUM_PARAMS)
+    {
+        throw py::value_error("tractParams holds fewer than numFrames frames.");
+    }
+    if (numFormants < 1)
+    {
+        throw py::value_error("numFormants must be at least 1.");
+    }
+
+    py::array_t<double> freq({ (size_t)numFrames, (size_t)numFormants });
+    py::array_t<double> bw({ (size_t)numFrames, (size_t)numFormants });
+    py::array_t<int> numFound((size_t)numFrames);
+
+    double *tract = const_cast<double*>(tractParams.data());
+    double *freqData = freq.mutable_data();
+    double *bwData = bw.mutable_data();
+    int *numFoundData = numFound.mutable_data();
+    {
+        py::gil_scoped_release release;
+        vtl.vtlGetFormants(tract, numFrames, numFormants, freqData, bwData, numFoundData, numThreads);
+    }
+
+    py::dict result;
+    result["formant_freq_hz"] = freq;
+    result["formant_bw_hz"] = bw;
+    result["num_formants"] = numFound;
+    return result;
+}
+
+// Batch variant: jobs is a sequence of (tractParams, glottisParams, numFrames,
+// frameStep_samples) tuples. Returns one waveform array per job.
+static py::list synthAudioBatch(VocalTractLab &vtl, py::sequence jobList, int numThreads, int numLanes)
+{
+    int numGlottisParams = vtl.vtlGetNumGlottisParams();
+    size_t numJobs = jobList.size();
+    vector<DoubleArray> inputs;
+    vector<py::array_t<double> > outputs;
+    vector<VtlSynthesisJob> jobs;
+
+    for (size_t i = 0; i < numJobs; i++)
+    {
+        py::tuple t = jobList[i].cast<py::tuple>();
+        if (t.size() != 4)
+        {
+            throw py::value_error("Each job must be a tuple (tractParams, glottisParams, numFrames, frameStep_samples).");
+        }
+        DoubleArray tractParams = t[0].cast<DoubleArray>();
+        DoubleArray glottisParams = t[1].cast<DoubleArray>();
+        int numFrames = t[2].cast<int>();
+        int frameStep_samples = t[3].cast<int>();
+        if (numFrames < 2)
+        {
+            numFrames = 0;
+        }
+        if ((tractParams.size() < numFrames * VocalTract::NUM_PARAMS) ||
+            (glottisParams.size() < numFrames * numGlottisParams))
+        {
+            throw py::value_error("Job " + to_string(i) + ": parameter arrays hold fewer than numFrames frames.");
+        }
+
+        py::array_t<double> audio((size_t)(numFrames > 0 ? numFrames - 1 : 0) * frameStep_samples);
+        VtlSynthesisJob job;
+        job.tractParams = const_cast<double*>(tractParams.data());
+        job.glottisParams = const_cast<double*>(glottisParams.data());
+        job.numFrames = numFrames;
+        job.frameStep_samples = frameStep_samples;
+        job.audio = audio.mutable_data();
+
+        inputs.push_back(tractParams);
+        inputs.push_back(glottisParams);
+        outputs.push_back(audio);
+        jobs.push_back(job);
+    }
+
+    {
+        py::gil_scoped_release release;
+        vtl.vtlSynthAudioBatch(jobs, numThreads, numLanes);
+    }
+
+    py::list result;
+    for (size_t i = 0; i < numJobs; i++)
+    {
+        result.append(outputs[i]);
+    }
+    return result;
+}
+
+// Incremental synthesis: writes the samples of one frame into out (a writable
+// C-contiguous float64 array) or into a new array, with the GIL released.
+static py::array_t<double> pushFrame(VocalTractLab &vtl, DoubleArray tractParams,
+    DoubleArray glottisParams, int numSamples, py::object out)
+{
+    if (tractParams.size() < VocalTract::NUM_PARAMS)
+    {
+        throw py::value_error("tractParams holds fewer than one frame.");
+    }
+    if (glottisParams.size() < vtl.vtlGetNumGlottisParams())
+    {
+        throw py::value_error("glottisParams holds fewer than one frame.");
+    }
+    if (numSamples < 0)
+    {
+        numSamples = 0;
+    }
+
+    py::array_t<double> audio;
+    if (out.is_none())
+    {
+        audio = py::array_t<double>((size_t)numSamples);
+    }
+    else
+    {
+        if ((py::isinstance<py::array_t<double> >(out) == false) ||
+            ((out.cast<py::array>().flags() & py::array::c_style) == 0))
+        {
+            throw py::type_error("out must be a C-contiguous float64 array.");
+        }
+        audio = out.cast<py::array_t<double> >();
+        if (audio.size() < numSamples)
+        {
+            throw py::value_error("out is too small for numSamples samples.");
+        }
+    }
+
+    double *tract = const_cast<double*>(tractParams.data());
+    double *glottis = const_cast<double*>(glottisParams.data());
+    double *buffer = audio.mutable_data();
+    int numWritten;
+    {
+        py::gil_scoped_release release;
+        numWritten = vtl.vtlPushFrame(tract, glottis, numSamples, buffer);
+    }
+    if (numWritten < 0)
+    {
+        throw std::runtime_error("push_frame() called without begin_synthesis().");
+    }
+
+    return audio[py::slice(0, numWritten, 1)].cast<py::array_t<double> >();
+}
+
+// Returns a new snapshot of the synthesis session to continue it later
+// (possibly several times) with restore_synthesis_state().
+static VtlSynthesisState *saveSynthesisState(VocalTractLab &vtl)
+{
+    unique_ptr<VtlSynthesisState> state(new VtlSynthesisState());
+    if (vtl.vtlSaveSynthesisState(state.get()) != 0)
+    {
+        throw std::runtime_error("save_synthesis_state() called without begin_synthesis().");
+    }
+    return state.release();
+}
+
+static void restoreSynthesisState(VocalTractLab &vtl, const VtlSynthesisState &state)
+{
+    if (vtl.vtlRestoreSynthesisState(&state) != 0)
+    {
+        throw py::value_error("The state was saved for another speaker, glottis model or sampling rate.");
+    }
+}
+
+static void setSamplingRate(VocalTractLab &vtl, int samplingRate)
+{
+    if (vtl.vtlSetSamplingRate(samplingRate) != 0)
+    {
+        throw py::value_error("samplingRate must be in the range from " +
+            to_string(TdsModel::MIN_SAMPLING_RATE) + " to " + to_string(TdsModel::MAX_SAMPLING_RATE) + " Hz.");
+    }
+}
+
+// The solver of the acoustic simulation by name.
+static void setSolver(VocalTractLab &vtl, const string &solver)
+{
+    if (solver == "cholesky") { vtl.vtlSetSolverType(TdsModel::CHOLESKY_FACTORIZATION); }
+    else if (solver == "tree") { vtl.vtlSetSolverType(TdsModel::TREE_ELIMINATION); }
+    else if (solver == "sor") { vtl.vtlSetSolverType(TdsModel::SOR_GAUSS_SEIDEL); }
+    else
+    {
+        throw py::value_error("solver must be 'cholesky', 'tree' or 'sor'.");
+    }
+}
+
+static string getSolver(VocalTractLab &vtl)
+{
+    switch (vtl.vtlGetSolverType())
+    {
+    case TdsModel::TREE_ELIMINATION: return "tree";
+    case TdsModel::SOR_GAUSS_SEIDEL: return "sor";
+    default: return "cholesky";
+    }
+}
+
+// Counters of the shape caches of this instance and its worker threads.
+static py::dict getShapeCacheStats(VocalTractLab &vtl)
+{
+    VtlShapeCacheStats stats = vtl.vtlGetShapeCacheStats();
+
+    py::dict result;
+    result["hits"] = stats.numHits;
+    result["misses"] = stats.numMisses;
+    result["entries"] = stats.numEntries;
+    result["bytes"] = stats.numBytes;
+    return result;
+}
+
+// Counters of the Cholesky factorizations of this instance and its worker
+// threads.
+static py::dict getFactorizationStats(VocalTractLab &vtl)
+{
+    VtlFactorizationStats stats = vtl.vtlGetFactorizationStats();
+
+    py::dict result;
+    result["full"] = stats.numFullFactorizations;
+    result["partial"] = stats.numPartialFactorizations;
+    result["reused"] = stats.numReusedFactorizations;
+    result["factorized_rows"] = stats.numFactorizedRows;
+    return result;
+}
+
+// Renders one vocal tract shape without a display; the image format follows
+// the file extension (.png, .rgb or .bmp).
+static void saveTractFrame(VocalTractLab &vtl, DoubleArray tractParams, const string &fileName)
+{
+    if (tractParams.size() < VocalTract::NUM_PARAMS)
+    {
+        throw py::value_error("tractParams holds fewer than one frame.");
+    }
+
+    double *tract = const_cast<double*>(tractParams.data());
+    int result;
+    {
+        py::gil_scoped_release release;
+        result = vtl.vtlSaveTractFrame(tract, fileName.c_str());
+    }
+    if (result != 0)
+    {
+        throw std::runtime_error("Failed to write " + fileName + ".");
+    }
+}
+
+// Renders numFrames vocal tract shapes into folderName as vt<i>.bmp/.png/.rgb
+// or, with format "video", as the single rgb24 file vt.rgb.
+static void saveTractVideo(VocalTractLab &vtl, DoubleArray tractParams, int numFrames,
+    const string &folderName, const string &format, int numThreads)
+{
+    FrameWriter::Format f;
+    if (format == "bmp") { f = FrameWriter::BMP; }
+    else if (format == "png") { f = FrameWriter::PNG; }
+    else if (format == "rgb") { f = FrameWriter::RAW; }
+    else if (format == "video") { f = FrameWriter::RAW_VIDEO; }
+    else
+    {
+        throw py::value_error("format must be 'bmp', 'png', 'rgb' or 'video'.");
+    }
+    if (numFrames < 0)
+    {
+        numFrames = 0;
+    }
+    if (tractParams.size() < numFrames * VocalTract::NUM_PARAMS)
+    {
+        throw py::value_error("tractParams holds fewer than numFrames frames.");
+    }
+
+    double *tract = const_cast<double*>(tractParams.data());
+    int result;
+    {
+        py::gil_scoped_release release;
+        result = vtl.vtlSaveTractVideo(numFrames, tract, folderName.c_str(), f, numThreads);
+    }
+    if (result != 0)
+    {
+        throw std::runtime_error("Failed to write the frames to " + folderName + ".");
+    }
+}
+
 // From C++ to Python
 PYBIND11_MODULE(vtl, m)
 {
     m.doc() = "Vocal Tract Lab Backend API Library Python Edition";
-    py::class_<VocalTractLab>(m, "VocalTractLab")
-        .def(py::init<const string>())
+    py::class_<VtlSynthesisState>(m, "SynthesisState", "Snapshot of an incremental synthesis session.");
+    py::class_<VocalTractLab>(m, "VocalTractLab", "A speaker model for synthesis. The GIL is released during long calculations, "
+        "so an instance must not be used by several Python threads at the same time. Use clone() to get an instance per thread.")
+        .def(py::init<const string, int>(), py::arg("speakerFileName"), py::arg("samplingRate")=(int)SAMPLING_RATE)
         .def("getTractParamInfo", &VocalTractLab::vtlGetTractParamInfo, "Get Vocal Tract Parameters Info")
         .def("getGlottisParamInfo", &VocalTractLab::vtlGetGlottisParamInfo, "Get Glottis Model Parameters Info")
         .def("close", &VocalTractLab::vtlClose, "Close VTL")
+        .def("clone", &VocalTractLab::vtlClone, "Create another instance for the same speaker that shares its data (e.g., for another thread).",
+            py::return_value_policy::take_ownership)
         .def("set_anatomy", &VocalTractLab::vtlSetAnatomyParams, "Set Anatomy", py::arg("anatomyParams"))
         .def("get_anatomy", &VocalTractLab::vtlGetAnatomyParams, "Get Anatomy")
-        .def("synth_audio", &VocalTractLab::vtlSynthAudio, "Synthesize audio using given tract and glottis parameters.", 
+        .def("set_sampling_rate", &setSamplingRate, "Set the sampling rate of the synthesis in Hz (44100 by default). "
+            "Frame steps are given in samples of this rate.", py::arg("samplingRate"))
+        .def("get_sampling_rate", &VocalTractLab::vtlGetSamplingRate, "Get the sampling rate of the synthesis in Hz.")
+        .def("set_solver", &setSolver, "Set the solver of the acoustic simulation: 'cholesky' (default), 'tree' (fastest, "
+            "the same results up to rounding errors) or 'sor'.", py::arg("solver"))
+        .def("get_solver", &getSolver, "Get the solver of the acoustic simulation.")
+        .def("set_num_geometry_threads", &VocalTractLab::vtlSetNumGeometryThreads, "Set the number of threads that calculate "
+            "the cross-sections of each vocal tract shape (1 by default, 0 = one per hardware thread).", py::arg("numThreads"))
+        .def("get_num_geometry_threads", &VocalTractLab::vtlGetNumGeometryThreads, "Get the number of threads that calculate "
+            "the cross-sections of each vocal tract shape.")
+        .def("set_shape_cache", &VocalTractLab::vtlSetShapeCache, "Cache the tubes of up to maxBytes of recently calculated "
+            "vocal tract shapes (0 = disabled). With quantization > 0, parameter values within steps of quantization "
+            "times their range count as the same shape.", py::arg("maxBytes"), py::arg("quantization")=0.0)
+        .def("clear_shape_cache", &VocalTractLab::vtlClearShapeCache, "Remove all cached shapes and reset the counters.")
+        .def("get_shape_cache_stats", &getShapeCacheStats, "Get the hits, misses, entries and bytes of the shape cache.")
+        .def("get_factorization_stats", &getFactorizationStats, "Get how often the Cholesky factorization of the acoustic "
+            "simulation was computed in full, partially (from the first changed row on) or reused, and the number of "
+            "recomputed rows.")
+        .def("reset_factorization_stats", &VocalTractLab::vtlResetFactorizationStats, "Reset the counters of the "
+            "Cholesky factorizations.")
+        .def("synth_audio", &synthAudioArray, "Synthesize audio using given tract and glottis parameters (NumPy arrays, GIL released). "
+            "Returns a NumPy array if both parameter sets are ndarrays and a list otherwise.",
+            py::arg("tractParams"), py::arg("glottisParams"), py::arg("numFrames"),
+            py::arg("frameStep_samples"))
+        .def("synth_audio", (vector<double> (VocalTractLab::*)(vector<double>, vector<double>, int, int))&VocalTractLab::vtlSynthAudio, "Synthesize audio using given tract and glottis parameters.", 
             py::arg("tractParams"), py::arg("glottisParams"), py::arg("numFrames"), 
             py::arg("frameStep_samples"))
-        .def("tract2ema", &VocalTractLab::vtlTract2EMA, "Transform  vocal tract parameters to ema.", 
+        .def("synth_audio_batch", &synthAudioBatch, "Synthesize a list of (tractParams, glottisParams, numFrames, frameStep_samples) jobs in parallel. "
+            "With numLanes = 2, 4 or 8, each thread synthesizes this many jobs at a time in lockstep.",
+            py::arg("jobs"), py::arg("numThreads")=0, py::arg("numLanes")=1)
+        .def("begin_synthesis", &VocalTractLab::vtlBeginSynthesis, "Start an incremental synthesis session.")
+        .def("push_frame", &pushFrame, "Add the next frame to the synthesis session and return its numSamples samples "
+            "(written into out if given). The first frame only sets the initial state and returns no samples.",
+            py::arg("tractParams"), py::arg("glottisParams"), py::arg("numSamples"), py::arg("out")=py::none())
+        .def("end_synthesis", &VocalTractLab::vtlEndSynthesis, "End the incremental synthesis session.")
+        .def("save_synthesis_state", &saveSynthesisState, "Save the state of the synthesis session after the last frame.",
+            py::return_value_policy::take_ownership)
+        .def("restore_synthesis_state", &restoreSynthesisState, "Continue the synthesis session (of this instance or a clone) "
+            "from a saved state, e.g., to try several continuations of the same beginning.", py::arg("state"))
+        .def("tract2ema", &tract2EmaArray, "Transform vocal tract parameters to ema (NumPy arrays, GIL released, multi-threaded). "
+            "Returns a NumPy array if tractParams is an ndarray and a list otherwise.",
+            py::arg("tractParams"), py::arg("numFrames"), py::arg("numThreads")=0)
+        .def("tract2ema", (vector<double> (VocalTractLab::*)(vector<double>, int))&VocalTractLab::vtlTract2EMA, "Transform  vocal tract parameters to ema.", 
             py::arg("tractParams"), py::arg("numFrames"))
+        .def("tract_to_tube", &tractToTubeArray, "Calculate the area functions (tube_length_cm, tube_area_cm2, tube_articulator, "
+            "incisor_pos_cm, tongue_tip_side_elevation, velum_opening_cm2) of the given frames without acoustic simulation.",
+            py::arg("tractParams"), py::arg("numFrames"), py::arg("numThreads")=0)
+        .def("get_formants", &getFormantsArray, "Calculate the formant frequencies and bandwidths (formant_freq_hz, formant_bw_hz, "
+            "num_formants) of the given frames with the transmission line model.",
+            py::arg("tractParams"), py::arg("numFrames"), py::arg("numFormants")=4, py::arg("numThreads")=0)
         .def("get_ema_dim", &VocalTractLab::vtlGetEMANames, "Get EMA Names")
         .def("export_tract_svg", &VocalTractLab::vtlExportTractSvg, "Export Vocal Tract Shape SVG", 
-            py::arg("tractParams"),  py::arg("fileName"), py::arg("addCenterLine")=false, py::arg("addCutVectors")=false);
-    // m.def("export_tract_frame", &vtlSaveTractFrame, "Export Vocal Tract Shape Frame",  py::arg("tractParams"), py::arg("fileName"));
-    // m.def("export_tract_video", &vtlSaveTractVideo, "Export Vocal Tract Shape Video",  py::arg("duration"), py::arg("tractParams"), py::arg("folderName"));
+            py::arg("tractParams"),  py::arg("fileName"), py::arg("addCenterLine")=false, py::arg("addCutVectors")=false)
+        .def("export_tract_frame", &saveTractFrame, "Render a vocal tract shape without a display and save it as PNG, BMP or raw RGB image (by file extension).",
+            py::arg("tractParams"), py::arg("fileName"))
+        .def("export_tract_video", &saveTractVideo, "Render vocal tract shapes without a display into folderName as an image sequence "
+            "('bmp', 'png', 'rgb') or as one rgb24 video file vt.rgb ('video').",
+            py::arg("tractParams"), py::arg("numFrames"), py::arg("folderName"), py::arg("format")="png", py::arg("numThreads")=0);
 }
 
@@ -28,6 +28,7 @@
 #include <iostream>
 #include <cmath>
 #include <fstream>
+#include <thread>
 
 
 using namespace std;
@@ -46,6 +47,42 @@ const double VocalTract::EXTREME_PROFILE_VALUE = 1000000.0;
 
 static bool makeFasterIntersections = true;
 
+// The stage of the geometry calculation that each parameter is an input of.
+static const VocalTract::GeometryStage PARAM_STAGE[VocalTract::NUM_PARAMS] =
+{
+  VocalTract::COVER_STAGE, VocalTract::COVER_STAGE,     // HX, HY
+  VocalTract::COVER_STAGE, VocalTract::COVER_STAGE,     // JX, JA
+  VocalTract::COVER_STAGE, VocalTract::COVER_STAGE,     // LP, LD
+  VocalTract::COVER_STAGE, VocalTract::COVER_STAGE,     // VS, VO
+  VocalTract::TONGUE_STAGE, VocalTract::TONGUE_STAGE,   // TCX, TCY
+  VocalTract::TONGUE_STAGE, VocalTract::TONGUE_STAGE,   // TTX, TTY
+  VocalTract::TONGUE_STAGE, VocalTract::TONGUE_STAGE,   // TBX, TBY
+  VocalTract::TONGUE_STAGE, VocalTract::TONGUE_STAGE,   // TRX, TRY
+  VocalTract::TONGUE_STAGE, VocalTract::TONGUE_STAGE,   // TS1, TS2
+  VocalTract::TONGUE_STAGE                              // TS3
+};
+
+// The surfaces that are intersected for the cross-sectional profiles besides
+// the tongue. The upper-posterior surfaces are handled first, and then the 
+// other surfaces.
+static const int NUM_PROFILE_SURFACES = 10;
+static const int PROFILE_SURFACE[NUM_PROFILE_SURFACES] = 
+{
+  // Surfaces that contribute to the upper profile
+  VocalTract::UPPER_COVER, 
+  VocalTract::UPPER_TEETH, 
+  VocalTract::UPPER_LIP, 
+  VocalTract::UVULA, 
+  // Surfaces that contribute to the lower profile
+  VocalTract::LOWER_COVER,
+  VocalTract::LOWER_TEETH, 
+  VocalTract::LOWER_LIP, 
+  VocalTract::EPIGLOTTIS, 
+  // Surfaces that may contribute to the upper and lower profile
+  VocalTract::LEFT_COVER, 
+  VocalTract::RADIATION
+};
+
 
 // ****************************************************************************
 // Constructor.
@@ -53,10 +90,113 @@ static bool makeFasterIntersections = true;
 
 VocalTract::VocalTract()
 {
+  referenceSurface = surface;
+  numCrossSectionThreads = 1;
+  shapeCacheMaxBytes = 0;
+  shapeCacheQuantization = 0.0;
+  numShapeCacheHits = 0;
+  numShapeCacheMisses = 0;
   init();
 }
 
 
+// ****************************************************************************
+// Constructor for the vocal tract of an already loaded speaker. Takes the
+// given anatomy, parameter definitions and shapes instead of initializing
+// the default anatomy first, so that no XML data are parsed.
+// ****************************************************************************
+
+VocalTract::VocalTract(const Anatomy &anatomy, const Param *param, const vector<Shape> &shapes)
+{
+  int i;
+
+  referenceSurface = surface;
+  numCrossSectionThreads = 1;
+  shapeCacheMaxBytes = 0;
+  shapeCacheQuantization = 0.0;
+  numShapeCacheHits = 0;
+  numShapeCacheMisses = 0;
+  initSurfaces();
+
+  this->anatomy = anatomy;
+  for (i=0; i < NUM_PARAMS; i++)
+  {
+    this->param[i] = param[i];
+  }
+  this->shapes = shapes;
+
+  initReferenceSurfaces();
+  calculateAll();
+
+  hasStoredControlParams = false;
+  for (i = 0; i < NUM_PARAMS; i++)
+  {
+    storedControlParams[i] = this->param[i].neutral;
+  }
+}
+
+
+// ****************************************************************************
+// Constructor for another vocal tract of the same speaker as 
+// referenceSurfaceOwner (see SpeakerModel::createVocalTract()). The reference
+// surfaces of referenceSurfaceOwner, which only depend on the anatomy, are
+// shared instead of being allocated and calculated again. Only the surfaces
+// that change with the vocal tract parameters belong to this vocal tract.
+// The reference surfaces are calculated for this vocal tract alone again, 
+// when its anatomy changes (see initReferenceSurfaces()).
+// ****************************************************************************
+
+VocalTract::VocalTract(shared_ptr<const VocalTract> referenceSurfaceOwner)
+{
+  const VocalTract *ref = referenceSurfaceOwner.get();
+  int i;
+
+  this->referenceSurfaceOwner = referenceSurfaceOwner;
+  referenceSurface = ref->referenceSurface;
+  numCrossSectionThreads = 1;
+  shapeCacheMaxBytes = 0;
+  shapeCacheQuantization = 0.0;
+  numShapeCacheHits = 0;
+  numShapeCacheMisses = 0;
+  initSurfaces();
+
+  anatomy = ref->anatomy;
+  for (i=0; i < NUM_PARAMS; i++)
+  {
+    param[i] = ref->param[i];
+  }
+  shapes = ref->shapes;
+
+  // Take the other data that initReferenceSurfaces() calculates from the 
+  // anatomy.
+
+  for (i=0; i < surface[UPPER_TEETH].numVertices; i++)
+  {
+    surface[UPPER_TEETH].vertex[i].coord = ref->surface[UPPER_TEETH].vertex[i].coord;
+  }
+
+  for (i=0; i < NUM_JAW_RIBS; i++)
+  {
+    upperGumsInnerEdge[i] = ref->upperGumsInnerEdge[i];
+    upperGumsOuterEdge[i] = ref->upperGumsOuterEdge[i];
+    lowerGumsInnerEdgeOrig[i] = ref->lowerGumsInnerEdgeOrig[i];
+    lowerGumsOuterEdgeOrig[i] = ref->lowerGumsOuterEdgeOrig[i];
+  }
+
+  wideLipCornerPath = ref->wideLipCornerPath;
+  narrowLipCornerPath = ref->narrowLipCornerPath;
+
+  invalidateGeometry();
+  calculateAll();
+
+  hasStoredControlParams = false;
+  for (i = 0; i < NUM_PARAMS; i++)
+  {
+    storedControlParams[i] = param[i].neutral;
+  }
+}
+
+
 // ****************************************************************************
 /// Destructor.
 // ****************************************************************************
@@ -73,27 +213,9 @@ VocalTract::~VocalTract()
 
 void VocalTract::init()
 {
-  // ****************************************************************
-  // Init all sufaces.
-  // ****************************************************************
-
-  initSurfaceGrids();
-  setDefaultEmaPoints();
+  int i;
 
-  // ****************************************************************
-  // Initialize the tongue temporarily with a dummy shape.
-  // ****************************************************************
-
-  int i, k;
-  Surface *tongue = &surface[TONGUE];
-
-  for (i=0; i < tongue->numRibs; i++)
-  {
-    for (k=0; k < tongue->numRibPoints; k++)
-    {
-      tongue->setVertex(i, k, Point3D(-0.31, -1.02, 0));
-    }
-  }
+  initSurfaces();
 
   // ****************************************************************
   // Create the xml-string that defines the anatomy.
@@ -234,6 +356,38 @@ void VocalTract::init()
 }
 
 
+// ****************************************************************************
+// Allocate all surfaces, set the EMA points and a dummy tongue shape.
+// ****************************************************************************
+
+void VocalTract::initSurfaces()
+{
+  // ****************************************************************
+  // Init all sufaces.
+  // ****************************************************************
+
+  initSurfaceGrids();
+  setDefaultEmaPoints();
+
+  // ****************************************************************
+  // Initialize the tongue temporarily with a dummy shape.
+  // ****************************************************************
+
+  int i, k;
+  Surface *tongue = &surface[TONGUE];
+
+  for (i=0; i < tongue->numRibs; i++)
+  {
+    for (k=0; k < tongue->numRibPoints; k++)
+    {
+      tongue->setVertex(i, k, Point3D(-0.31, -1.02, 0));
+    }
+  }
+
+  invalidateGeometry();
+}
+
+
 // ****************************************************************************
 // Init the surfaces of the vocal tract.
 // ****************************************************************************
@@ -320,10 +474,16 @@ void VocalTract::initSurfaceGrids()
 
   surface[EPIGLOTTIS_TWOSIDE].swapTriangleOrientation();
 
-  // ****************************************************************
-  // Sufaces that are used internally only (not used for rendering).
-  // ****************************************************************
+}
+
+
+// ****************************************************************************
+// Allocate the reference surfaces (see initReferenceSurfaces()). They are 
+// used internally only (not for rendering).
+// ****************************************************************************
 
+void VocalTract::initReferenceSurfaceGrids()
+{
   surface[NARROW_LARYNX_FRONT].init(NUM_LARYNX_RIBS, NUM_LOWER_COVER_POINTS);
   surface[NARROW_LARYNX_BACK].init(NUM_LARYNX_RIBS, NUM_UPPER_COVER_POINTS);
   surface[WIDE_LARYNX_FRONT].init(NUM_LARYNX_RIBS, NUM_LOWER_COVER_POINTS);
@@ -348,9 +508,32 @@ void VocalTract::initSurfaceGrids()
 
 void VocalTract::initReferenceSurfaces()
 {
+  // From now on, this vocal tract has its own reference surfaces, because
+  // the shared ones must not change.
+  referenceSurfaceOwner.reset();
+  referenceSurface = surface;
+
+  if (surface[PALATE].numVertices == 0)
+  {
+    initReferenceSurfaceGrids();
+  }
+
   initLarynx();
   initJaws();
   initVelum();
+
+  invalidateGeometry();
+}
+
+
+// ****************************************************************************
+/// Returns the reference surface with the given index (see 
+/// initReferenceSurfaces()). It may be shared with other vocal tracts.
+// ****************************************************************************
+
+const Surface *VocalTract::getReferenceSurface(int index) const
+{
+  return &referenceSurface[index];
 }
 
 
@@ -1698,6 +1881,29 @@ void VocalTract::readFromXml(const string &speakerFileName) throw (std::string)
     throw std::string("Error parsing the file ") + speakerFileName + ".";
   }
 
+  try
+  {
+    readFromXml(rootNode, speakerFileName);
+  }
+  catch (std::string st)
+  {
+    delete rootNode;
+    throw;
+  }
+
+  // Delete the XML-tree.
+
+  delete rootNode;
+}
+
+
+// ****************************************************************************
+/// Read the speaker anatomy and vocal tract shape list from the already
+/// parsed <speaker> node of a speaker file.
+// ****************************************************************************
+
+void VocalTract::readFromXml(XmlNode *rootNode, const string &speakerFileName) throw (std::string)
+{
   XmlNode *vocalTractNode = rootNode->getChildElement("vocal_tract_model");
   if (vocalTractNode == NULL)
   {
@@ -1739,10 +1945,6 @@ void VocalTract::readFromXml(const string &speakerFileName) throw (std::string)
   {
     throw;
   }
-
-  // Delete the XML-tree.
-
-  delete rootNode;
 }
 
 
@@ -2391,28 +2593,163 @@ void VocalTract::setParams(double *controlParams)
 
 // ****************************************************************************
 /// Calculates all surfaces, the center line, and the area functions.
+/// Only the stages that depend on parameters (or the anatomy) that changed
+/// since the last call are recalculated (see calculateStages()).
 // ****************************************************************************
 
 void VocalTract::calculateAll()
 {
+  calculateStages(TUBE_SECTION_STAGE);
+}
+
+
+// ****************************************************************************
+/// Calculates only the surfaces (e.g., for the EMA point coordinates). The
+/// center line, the cross-sections and the tube sections keep the values of
+/// the last call of calculateAll().
+// ****************************************************************************
+
+void VocalTract::calculateSurfaces()
+{
+  calculateStages(TONGUE_STAGE);
+}
+
+
+// ****************************************************************************
+/// Must be called when the model was changed in another way than by its
+/// parameters or anatomy (e.g., when surfaces were modified directly), so 
+/// that the next call of calculateAll() recalculates all stages. The shapes
+/// in the cache of calculateTube() are discarded as well.
+// ****************************************************************************
+
+void VocalTract::invalidateGeometry()
+{
+  int i;
+
+  firstInvalidStage = COVER_STAGE;
+  for (i=0; i < NUM_SURFACES; i++)
+  {
+    intersectionsPrepared[i] = false;
+  }
+
+  shapeCacheEntries.clear();
+  shapeCacheIndex.clear();
+}
+
+
+// ****************************************************************************
+/// Calculates the stages of the geometry up to lastStage, but only those that
+/// are out of date. Each parameter is an input of a certain stage (see 
+/// PARAM_STAGE), and each stage is an input of the next one. So when a 
+/// parameter changed since the last calculation, its stage and all following
+/// stages must be recalculated, while the stages before keep their results.
+/// A change of the anatomy invalidates all stages. 
+/// For example, when only tongue parameters changed, the surfaces of the 
+/// covers, jaws, velum and lips are not recalculated, and when no parameter
+/// changed at all, nothing is recalculated.
+// ****************************************************************************
+
+void VocalTract::calculateStages(GeometryStage lastStage)
+{
+  int i;
+  GeometryStage firstStage = firstInvalidStage;
+
   // ****************************************************************
-  // Set the limited parameter values equal to the set values.
+  // Set the limited parameter values equal to the set values and
+  // restrict them. This is cheap and done in any case.
   // ****************************************************************
 
-  int i;
   for (i=0; i < NUM_PARAMS; i++)
   {
     param[i].limitedX = param[i].x;
   }
 
+  restrictParams();
+
+  // ****************************************************************
+  // Find the first stage with changed input values (bit by bit).
+  // ****************************************************************
+
+  if ((firstStage > COVER_STAGE) && 
+    (memcmp((const void*)&anatomy, (const void*)&calculatedAnatomy, sizeof(Anatomy)) != 0))
+  {
+    invalidateGeometry();
+    firstStage = COVER_STAGE;
+  }
+
+  for (i=0; i < NUM_PARAMS; i++)
+  {
+    double value[4] = { param[i].x, param[i].limitedX, param[i].min, param[i].max };
+
+    // The set values of TRX and TRY are replaced by calculated values.
+    if ((anatomy.automaticTongueRootCalc) && ((i == TRX) || (i == TRY)))
+    {
+      value[0] = calculatedParamValues[i][0];
+      value[1] = calculatedParamValues[i][1];
+    }
+
+    if ((PARAM_STAGE[i] < firstStage) && 
+      (memcmp(value, calculatedParamValues[i], sizeof(value)) != 0))
+    {
+      firstStage = PARAM_STAGE[i];
+    }
+
+    memcpy(calculatedParamValues[i], value, sizeof(value));
+  }
+  memcpy((void*)&calculatedAnatomy, (const void*)&anatomy, sizeof(Anatomy));
+
   // ****************************************************************
   // Do the calculations.
   // ****************************************************************
 
-  calcSurfaces();
-  calcCenterLine();
-  calcCrossSections();
-  crossSectionsToTubeSections();
+  if ((firstStage <= COVER_STAGE) && (lastStage >= COVER_STAGE))
+  {
+    calcCoverSurfaces();
+  }
+
+  if ((firstStage <= TONGUE_STAGE) && (lastStage >= TONGUE_STAGE))
+  {
+    calcTongueSurfaces();
+    
+    for (i=TCX; i <= TS3; i++)
+    {
+      tongueParamValues[i][0] = param[i].x;
+      tongueParamValues[i][1] = param[i].limitedX;
+    }
+  }
+  else
+  {
+    // The tongue stage also restricts the tongue parameters.
+    for (i=TCX; i <= TS3; i++)
+    {
+      param[i].x = tongueParamValues[i][0];
+      param[i].limitedX = tongueParamValues[i][1];
+    }
+  }
+
+  if ((firstStage <= CENTER_LINE_STAGE) && (lastStage >= CENTER_LINE_STAGE))
+  {
+    calcCenterLine();
+  }
+
+  if ((firstStage <= CROSS_SECTION_STAGE) && (lastStage >= CROSS_SECTION_STAGE))
+  {
+    calcCrossSections();
+  }
+
+  if ((firstStage <= TUBE_SECTION_STAGE) && (lastStage >= TUBE_SECTION_STAGE))
+  {
+    crossSectionsToTubeSections();
+  }
+
+  if (firstStage <= lastStage)
+  {
+    firstInvalidStage = (GeometryStage)(lastStage + 1);
+  }
+  else
+  {
+    firstInvalidStage = firstStage;
+  }
 }
 
 
@@ -2422,30 +2759,31 @@ void VocalTract::calculateAll()
 
 void VocalTract::calcSurfaces()
 {
-  int i, k;
-  int rib;
-  Point3D P, Q, R, A, v;
+  restrictParams();
+  calcCoverSurfaces();
+  calcTongueSurfaces();
+
+  // The surfaces may not correspond to the last call of calculateAll() any 
+  // more.
+  firstInvalidStage = COVER_STAGE;
+}
+
+
+// ****************************************************************************
+/// Restricts the parameter values to their ranges and to the positions that
+/// the larynx can take with respect to the jaw.
+// ****************************************************************************
+
+void VocalTract::restrictParams()
+{
+  int i;
+  Point3D P, Q;
   Point3D vertex;
-  double s, t;
+  double t;
   double dx, dy;
-  double x, y, z;
   double cosinus;
   double sinus;
   double angle_rad;
-  double shearCoeff = 
-    cos(anatomy.pharynxRotationAngle_deg*M_PI/180.0) / 
-    sin(anatomy.pharynxRotationAngle_deg*M_PI/180.0);
-  double shearX;
-
-  // ****************************************************************
-  // Because the surfaces change their shape here, all intersections
-  // need to be newly prepared before the intersectioning.
-  // ****************************************************************
-
-  for (i=0; i < NUM_SURFACES; i++)
-  {
-    intersectionsPrepared[i] = false;
-  }
 
   // ****************************************************************
   // Restrict the parameter values.
@@ -2469,7 +2807,7 @@ void VocalTract::calcSurfaces()
   sinus = sin(angle_rad);
 
   // Vertex of the lowest point of the most posterior jaw rib.
-  vertex = surface[MANDIBLE].getVertex(0, NUM_LOWER_COVER_POINTS - 1);
+  vertex = referenceSurface[MANDIBLE].getVertex(0, NUM_LOWER_COVER_POINTS - 1);
 
   // (dx, dy) is the vertex position relativ to the fulcrum before the rotation
   dx = vertex.x + anatomy.jawRestPos.x + param[JX].x - anatomy.jawFulcrum.x;
@@ -2485,8 +2823,8 @@ void VocalTract::calcSurfaces()
 
   // ****************************************************************
 
-  P = surface[NARROW_LARYNX_FRONT].getVertex(NUM_LARYNX_RIBS - 1, NUM_LOWER_COVER_POINTS - 1);
-  Q = surface[WIDE_LARYNX_FRONT].getVertex(NUM_LARYNX_RIBS - 1, NUM_LOWER_COVER_POINTS - 1);
+  P = referenceSurface[NARROW_LARYNX_FRONT].getVertex(NUM_LARYNX_RIBS - 1, NUM_LOWER_COVER_POINTS - 1);
+  Q = referenceSurface[WIDE_LARYNX_FRONT].getVertex(NUM_LARYNX_RIBS - 1, NUM_LOWER_COVER_POINTS - 1);
 
   // Horizontal offset for the larynx surfaces
   double xOffset = getPharynxBackX(param[HY].limitedX);
@@ -2512,6 +2850,51 @@ void VocalTract::calcSurfaces()
   {
     param[HX].limitedX = param[HX].max;
   }
+}
+
+
+// ****************************************************************************
+/// Calculates the surfaces of the covers, the jaws, the velum, the uvula and
+/// the lips (the cover stage of the geometry).
+// ****************************************************************************
+
+void VocalTract::calcCoverSurfaces()
+{
+  // The surfaces that are calculated here.
+  const int NUM_COVER_SURFACES = 16;
+  const int COVER_SURFACE[NUM_COVER_SURFACES] =
+  {
+    UPPER_COVER, LOWER_COVER, LOWER_TEETH, UPPER_LIP, LOWER_LIP, 
+    LEFT_COVER, RIGHT_COVER, UVULA, RADIATION,
+    UPPER_COVER_TWOSIDE, LOWER_COVER_TWOSIDE, UPPER_TEETH_TWOSIDE, 
+    LOWER_TEETH_TWOSIDE, UPPER_LIP_TWOSIDE, LOWER_LIP_TWOSIDE, 
+    UVULA_TWOSIDE
+  };
+
+  int i, k;
+  int rib;
+  Point3D P, Q, R, A;
+  Point3D vertex;
+  double s, t;
+  double dx, dy;
+  double x, y, z;
+  double cosinus;
+  double sinus;
+  double angle_rad;
+  double shearCoeff = 
+    cos(anatomy.pharynxRotationAngle_deg*M_PI/180.0) / 
+    sin(anatomy.pharynxRotationAngle_deg*M_PI/180.0);
+  double shearX;
+
+  // ****************************************************************
+  // Because the surfaces change their shape here, their intersections
+  // need to be newly prepared before the intersectioning.
+  // ****************************************************************
+
+  for (i=0; i < NUM_COVER_SURFACES; i++)
+  {
+    intersectionsPrepared[ COVER_SURFACE[i] ] = false;
+  }
 
   // ****************************************************************
   // The upper cover is the combination of the larynx, the pharynx
@@ -2532,8 +2915,8 @@ void VocalTract::calcSurfaces()
   {
     for (k=0; k < NUM_UPPER_COVER_POINTS; k++)
     {
-      P = surface[NARROW_LARYNX_BACK].getVertex(i, k);
-      Q = surface[WIDE_LARYNX_BACK].getVertex(i, k);
+      P = referenceSurface[NARROW_LARYNX_BACK].getVertex(i, k);
+      Q = referenceSurface[WIDE_LARYNX_BACK].getVertex(i, k);
       P = P*(1.0-t) + Q*t;
       shearX = P.y*shearCoeff;
       P.x+= x + shearX;
@@ -2589,9 +2972,9 @@ void VocalTract::calcSurfaces()
   {
     for (k=0; k < NUM_UPPER_COVER_POINTS; k++)
     {
-      P = surface[HIGH_VELUM].getVertex(i, k);
-      Q = surface[MID_VELUM].getVertex(i, k);
-      R = surface[LOW_VELUM].getVertex(i, k);
+      P = referenceSurface[HIGH_VELUM].getVertex(i, k);
+      Q = referenceSurface[MID_VELUM].getVertex(i, k);
+      R = referenceSurface[LOW_VELUM].getVertex(i, k);
 
       // The point between the high and mid closed shapes.
       A = (1.0-s)*P + s*Q;
@@ -2621,7 +3004,7 @@ void VocalTract::calcSurfaces()
       for (k=0; k < NUM_UPPER_COVER_POINTS; k++)
       {
         P = surface[UPPER_COVER].getVertex(lastVelumRib, k);
-        Q = surface[PALATE].getVertex(i, k);
+        Q = referenceSurface[PALATE].getVertex(i, k);
         vertex.x = Q.x;
         vertex.y = (1.0-factor)*P.y + factor*Q.y;
         if (Q.x < 0.01) { vertex.z = P.z; } else { vertex.z = Q.z; }
@@ -2632,7 +3015,7 @@ void VocalTract::calcSurfaces()
     {
       for (k=0; k < NUM_UPPER_COVER_POINTS; k++)
       {
-        vertex = surface[PALATE].getVertex(i, k);
+        vertex = referenceSurface[PALATE].getVertex(i, k);
         surface[UPPER_COVER].setVertex(rib, k, vertex);
       }
     }
@@ -2658,8 +3041,8 @@ void VocalTract::calcSurfaces()
   {
     for (k=0; k < NUM_LOWER_COVER_POINTS; k++)
     {
-      P = surface[NARROW_LARYNX_FRONT].getVertex(i, k);
-      Q = surface[WIDE_LARYNX_FRONT].getVertex(i, k);
+      P = referenceSurface[NARROW_LARYNX_FRONT].getVertex(i, k);
+      Q = referenceSurface[WIDE_LARYNX_FRONT].getVertex(i, k);
       P = P*(1.0-t) + Q*t;
       shearX = P.y*shearCoeff;
       P.x+= x + shearX;
@@ -2684,7 +3067,7 @@ void VocalTract::calcSurfaces()
   {
     for (k=0; k < NUM_LOWER_COVER_POINTS; k++)
     {
-      vertex = surface[MANDIBLE].getVertex(i, k);
+      vertex = referenceSurface[MANDIBLE].getVertex(i, k);
 
       // (dx, dy) is the vertex position relativ to the fulcrum before the rotation
       dx = vertex.x + anatomy.jawRestPos.x + param[JX].x - anatomy.jawFulcrum.x;
@@ -2756,7 +3139,7 @@ void VocalTract::calcSurfaces()
   {
     for (k=0; k < NUM_TEETH_POINTS; k++)
     {
-      vertex = surface[LOWER_TEETH_ORIGINAL].getVertex(i, k);
+      vertex = referenceSurface[LOWER_TEETH_ORIGINAL].getVertex(i, k);
       
       // (dx, dy) is the vertex position relativ to the fulcrum before the rotation
       dx = vertex.x + anatomy.jawRestPos.x + param[JX].x - anatomy.jawFulcrum.x;
@@ -2882,7 +3265,6 @@ void VocalTract::calcSurfaces()
 
   int upperCoverPoint = NUM_UPPER_COVER_POINTS-1;
   int lowerCoverPoint = NUM_LOWER_COVER_POINTS-1;
-  int tonguePoint     = NUM_TONGUE_POINTS/4;    // nicht genau den Punkt in der Mitte nehmen
   int lipRib          = NUM_LIP_RIBS-1;
   int teethRib        = NUM_TEETH_RIBS-1;
 
@@ -2935,65 +3317,7 @@ void VocalTract::calcSurfaces()
          lowerOutline.getControlPoint(lowerOutline.getNumPoints()-2).x) { lowerOutline.delPoint(); }
 
   // ****************************************************************
-  // Calculation of the tongue geometry.
-  // ****************************************************************
-
-  calcTongue();
-
-  // ****************************************************************
-  // Epiglottis. Must be calculated AFTER the tongue.
-  // ****************************************************************
-
-  P = surface[LOWER_COVER].getVertex(NUM_LARYNX_RIBS-2, NUM_LOWER_COVER_POINTS-1);
-  Q = surface[LOWER_COVER].getVertex(NUM_LARYNX_RIBS-1, NUM_LOWER_COVER_POINTS-1);
-  v = Q - P;
-  v.normalize();
-
-  A = P + anatomy.epiglottisWidth_cm*v;
-
-  // Align the first epiglottal rib with v
-  for (k=0; k < NUM_EPIGLOTTIS_POINTS; k++)
-  {
-    P = surface[EPIGLOTTIS_ORIGINAL].getVertex(0, k);
-    x = v.x*P.x - v.y*P.y;
-    y = v.y*P.x + v.x*P.y;
-    z = P.z;
-    surface[EPIGLOTTIS].setVertex(0, k, x + A.x, y + A.y, z + A.z);
-  }
-
-  // The 2nd, 3rd and 4th rib
-  double minAngle_rad = anatomy.epiglottisAngle_deg*M_PI/180.0;
-
-  for (i=1; i < 10; i++)        // Check the first few tongue ribs
-  {
-    P = surface[TONGUE].getVertex(i, NUM_TONGUE_POINTS/2) - A;
-    if (P.y < anatomy.epiglottisHeight_cm)
-    {
-      if (P.y < 0.01) { P.y = 0.01; }
-      angle_rad = atan2(P.y, P.x);
-      if (angle_rad > minAngle_rad) { minAngle_rad = angle_rad; }
-    }
-  }
-
-  minAngle_rad-= 0.5*M_PI;       // Subtract 90 deg
-  if (minAngle_rad > 0.25*M_PI) { minAngle_rad = 0.25*M_PI; }
-  sinus = sin(minAngle_rad);
-  cosinus = cos(minAngle_rad);
-
-  for (i=1; i < NUM_EPIGLOTTIS_RIBS; i++)
-  {
-    for (k=0; k < NUM_EPIGLOTTIS_POINTS; k++)
-    {
-      P = surface[EPIGLOTTIS_ORIGINAL].getVertex(i, k);
-      x = cosinus*P.x - sinus*P.y;
-      y = sinus*P.x + cosinus*P.y;
-      z = P.z;
-      surface[EPIGLOTTIS].setVertex(i, k, x + A.x, y + A.y, z + A.z);
-    }
-  }
-
-  // ****************************************************************
-  // Uvula. Must be calculated AFTER the tongue.
+  // Uvula.
   // ****************************************************************
 
   A = surface[UPPER_COVER].getVertex(NUM_LARYNX_RIBS+NUM_PHARYNX_RIBS+1, NUM_UPPER_COVER_POINTS-1);
@@ -3002,37 +3326,12 @@ void VocalTract::calcSurfaces()
   {
     for (k=0; k < NUM_UVULA_POINTS; k++)
     {
-      P = surface[UVULA_ORIGINAL].getVertex(i, k);
+      P = referenceSurface[UVULA_ORIGINAL].getVertex(i, k);
       P+= A;
       surface[UVULA].setVertex(i, k, P);
     }
   }
 
-  // ****************************************************************
-  // The tongue contour.
-  // ****************************************************************
-
-  tongueOutline.reset(0);
-  for (i=0; i < NUM_TONGUE_RIBS; i++)
-  {
-    tongueOutline.addPoint(surface[TONGUE].getVertex(i, tonguePoint).toPoint2D());
-  }
-
-  // ****************************************************************
-  // The epiglottis contour (for center line calculations).
-  // ****************************************************************
-
-  epiglottisOutline.reset(0);
-  for (i=0; i < NUM_EPIGLOTTIS_RIBS; i++)
-  {
-    epiglottisOutline.addPoint(surface[EPIGLOTTIS].getVertex(i, NUM_EPIGLOTTIS_POINTS-1).toPoint2D());
-  }
-  for (i=NUM_EPIGLOTTIS_RIBS-2; i >= 0; i--)
-  {
-    epiglottisOutline.addPoint(surface[EPIGLOTTIS].getVertex(i, 0).toPoint2D());
-  }
-
-
   // ****************************************************************
   // Two-sided grids for the upper and lower cover.        
   // ****************************************************************
@@ -3128,42 +3427,146 @@ void VocalTract::calcSurfaces()
   }
 
   // ****************************************************************
-  // The right filling surface between the upper and lower teeth.
+  // The right filling surface between the upper and lower teeth.
+  // ****************************************************************
+
+  source = &surface[LEFT_COVER];
+  target = &surface[RIGHT_COVER];
+
+  for (i=0; i < source->numRibs; i++)
+  {
+    for (k=0; k < source->numRibPoints; k++)
+    {
+      P = source->getVertex(i, k);
+      P.z = -P.z;
+      target->setVertex(i, k, P);
+    }
+  }
+
+  source = &surface[UVULA];
+  target = &surface[UVULA_TWOSIDE];
+
+  for (i=0; i < target->numRibs; i++)
+  {
+    for (k=0; k < source->numRibPoints; k++)
+    {
+      P = source->getVertex(i, k);
+      target->setVertex(i, k, P);
+      P.z = -P.z;
+      target->setVertex(i, target->numRibPoints-1-k, P);
+    }
+  }
+}
+
+
+// ****************************************************************************
+/// Calculates the surfaces of the tongue and the epiglottis (the tongue stage
+/// of the geometry), which depend on the surfaces of the cover stage.
+// ****************************************************************************
+
+void VocalTract::calcTongueSurfaces()
+{
+  int i, k;
+  Point3D P, Q, A, v;
+  double x, y, z;
+  double cosinus;
+  double sinus;
+  double angle_rad;
+  int tonguePoint = NUM_TONGUE_POINTS/4;    // nicht genau den Punkt in der Mitte nehmen
+  Surface *source, *target;
+
+  intersectionsPrepared[TONGUE] = false;
+  intersectionsPrepared[EPIGLOTTIS] = false;
+  intersectionsPrepared[EPIGLOTTIS_TWOSIDE] = false;
+
+  // ****************************************************************
+  // Calculation of the tongue geometry.
+  // ****************************************************************
+
+  calcTongue();
+
+  // ****************************************************************
+  // Epiglottis. Must be calculated AFTER the tongue.
+  // ****************************************************************
+
+  P = surface[LOWER_COVER].getVertex(NUM_LARYNX_RIBS-2, NUM_LOWER_COVER_POINTS-1);
+  Q = surface[LOWER_COVER].getVertex(NUM_LARYNX_RIBS-1, NUM_LOWER_COVER_POINTS-1);
+  v = Q - P;
+  v.normalize();
+
+  A = P + anatomy.epiglottisWidth_cm*v;
+
+  // Align the first epiglottal rib with v
+  for (k=0; k < NUM_EPIGLOTTIS_POINTS; k++)
+  {
+    P = referenceSurface[EPIGLOTTIS_ORIGINAL].getVertex(0, k);
+    x = v.x*P.x - v.y*P.y;
+    y = v.y*P.x + v.x*P.y;
+    z = P.z;
+    surface[EPIGLOTTIS].setVertex(0, k, x + A.x, y + A.y, z + A.z);
+  }
+
+  // The 2nd, 3rd and 4th rib
+  double minAngle_rad = anatomy.epiglottisAngle_deg*M_PI/180.0;
+
+  for (i=1; i < 10; i++)        // Check the first few tongue ribs
+  {
+    P = surface[TONGUE].getVertex(i, NUM_TONGUE_POINTS/2) - A;
+    if (P.y < anatomy.epiglottisHeight_cm)
+    {
+      if (P.y < 0.01) { P.y = 0.01; }
+      angle_rad = atan2(P.y, P.x);
+      if (angle_rad > minAngle_rad) { minAngle_rad = angle_rad; }
+    }
+  }
+
+  minAngle_rad-= 0.5*M_PI;       // Subtract 90 deg
+  if (minAngle_rad > 0.25*M_PI) { minAngle_rad = 0.25*M_PI; }
+  sinus = sin(minAngle_rad);
+  cosinus = cos(minAngle_rad);
+
+  for (i=1; i < NUM_EPIGLOTTIS_RIBS; i++)
+  {
+    for (k=0; k < NUM_EPIGLOTTIS_POINTS; k++)
+    {
+      P = referenceSurface[EPIGLOTTIS_ORIGINAL].getVertex(i, k);
+      x = cosinus*P.x - sinus*P.y;
+      y = sinus*P.x + cosinus*P.y;
+      z = P.z;
+      surface[EPIGLOTTIS].setVertex(i, k, x + A.x, y + A.y, z + A.z);
+    }
+  }
+
+  // ****************************************************************
+  // The tongue contour.
   // ****************************************************************
 
-  source = &surface[LEFT_COVER];
-  target = &surface[RIGHT_COVER];
-
-  for (i=0; i < source->numRibs; i++)
+  tongueOutline.reset(0);
+  for (i=0; i < NUM_TONGUE_RIBS; i++)
   {
-    for (k=0; k < source->numRibPoints; k++)
-    {
-      P = source->getVertex(i, k);
-      P.z = -P.z;
-      target->setVertex(i, k, P);
-    }
+    tongueOutline.addPoint(surface[TONGUE].getVertex(i, tonguePoint).toPoint2D());
   }
 
   // ****************************************************************
-  // The epiglottis and uvula.
+  // The epiglottis contour (for center line calculations).
   // ****************************************************************
 
-  source = &surface[EPIGLOTTIS];
-  target = &surface[EPIGLOTTIS_TWOSIDE];
-
-  for (i=0; i < target->numRibs; i++)
+  epiglottisOutline.reset(0);
+  for (i=0; i < NUM_EPIGLOTTIS_RIBS; i++)
   {
-    for (k=0; k < source->numRibPoints; k++)
-    {
-      P = source->getVertex(i, k);
-      target->setVertex(i, k, P);
-      P.z = -P.z;
-      target->setVertex(i, target->numRibPoints-1-k, P);
-    }
+    epiglottisOutline.addPoint(surface[EPIGLOTTIS].getVertex(i, NUM_EPIGLOTTIS_POINTS-1).toPoint2D());
+  }
+  for (i=NUM_EPIGLOTTIS_RIBS-2; i >= 0; i--)
+  {
+    epiglottisOutline.addPoint(surface[EPIGLOTTIS].getVertex(i, 0).toPoint2D());
   }
 
-  source = &surface[UVULA];
-  target = &surface[UVULA_TWOSIDE];
+  // ****************************************************************
+  // The two-sided grid for the epiglottis.
+  // ****************************************************************
+
+  source = &surface[EPIGLOTTIS];
+  target = &surface[EPIGLOTTIS_TWOSIDE];
 
   for (i=0; i < target->numRibs; i++)
   {
@@ -3175,7 +3578,6 @@ void VocalTract::calcSurfaces()
       target->setVertex(i, target->numRibPoints-1-k, P);
     }
   }
-
 }
 
 
@@ -5567,6 +5969,32 @@ void VocalTract::verifyCenterLineNormal(int l, int m, int r)
 }
 
 
+// ****************************************************************************
+/// Sets the number of threads that calculate the cross-sectional profiles
+/// in calcCrossSections() (1 by default). More threads reduce the time for a
+/// single shape, but should only be used when the calling threads do not 
+/// calculate multiple shapes in parallel anyway. The results do not depend
+/// on the number of threads.
+// ****************************************************************************
+
+void VocalTract::setNumCrossSectionThreads(int numThreads)
+{
+  if (numThreads < 1) { numThreads = 1; }
+  if (numThreads > NUM_CENTERLINE_POINTS) { numThreads = NUM_CENTERLINE_POINTS; }
+  numCrossSectionThreads = numThreads;
+}
+
+
+// ****************************************************************************
+/// Returns the number of threads that calculate the cross-sectional profiles.
+// ****************************************************************************
+
+int VocalTract::getNumCrossSectionThreads()
+{
+  return numCrossSectionThreads;
+}
+
+
 // ****************************************************************************
 /// Calculates for each cut vector on the center line the cross-sectional
 /// profile.
@@ -5574,21 +6002,47 @@ void VocalTract::verifyCenterLineNormal(int l, int m, int r)
 
 void VocalTract::calcCrossSections()
 {
-  double upperProfile[NUM_PROFILE_SAMPLES];
-  double lowerProfile[NUM_PROFILE_SAMPLES];
   double tongueTipRadius = anatomy.tongueTipRadius_cm;
-  Tube::Articulator articulator;
   int i;
 
+  // ****************************************************************
+  // The profiles of the cross-sections only depend on the surfaces
+  // and the center line, so that they are calculated by multiple 
+  // threads, if desired. Each thread takes every numThreads-th 
+  // cross-section and intersects the surfaces with its own 
+  // intersection states, so that the results are the same as with 
+  // one thread.
   // ****************************************************************
 
-  for (i=0; i < NUM_CENTERLINE_POINTS; i++)
+  if (numCrossSectionThreads > 1)
   {
-    getCrossProfiles(centerLine[i].point, centerLine[i].normal, upperProfile, lowerProfile, true, articulator);
-    getCrossSection(upperProfile, lowerProfile, &crossSection[i]);
+    int numThreads = numCrossSectionThreads;
 
-    crossSection[i].pos = centerLine[i].pos;
-    crossSection[i].articulator = articulator;
+    // The threads must not change the surfaces.
+    prepareProfileIntersections();
+
+    if ((int)crossSectionIntersectionStates.size() < numThreads*NUM_SURFACES)
+    {
+      crossSectionIntersectionStates.resize(numThreads*NUM_SURFACES);
+    }
+
+    vector<thread> threads;
+    for (i=1; i < numThreads; i++)
+    {
+      threads.push_back(thread(&VocalTract::calcCrossSectionProfiles, this, i, numThreads, 
+        &crossSectionIntersectionStates[i*NUM_SURFACES]));
+    }
+
+    calcCrossSectionProfiles(0, numThreads, &crossSectionIntersectionStates[0]);
+
+    for (i=0; i < (int)threads.size(); i++)
+    {
+      threads[i].join();
+    }
+  }
+  else
+  {
+    calcCrossSectionProfiles(0, 1, NULL);
   }
 
   // ****************************************************************
@@ -5753,13 +6207,73 @@ void VocalTract::calcCrossSections()
 }
 
 
+// ****************************************************************************
+/// Calculates the cross-sections firstSection, firstSection + sectionStep,
+/// firstSection + 2*sectionStep, ... from their profiles. The surfaces are
+/// intersected with the given intersection states (one per surface), or with
+/// the states of the surfaces themselves, if intersectionStates is NULL.
+// ****************************************************************************
+
+void VocalTract::calcCrossSectionProfiles(int firstSection, int sectionStep, 
+  Surface::IntersectionState *intersectionStates)
+{
+  double upperProfile[NUM_PROFILE_SAMPLES];
+  double lowerProfile[NUM_PROFILE_SAMPLES];
+  Tube::Articulator articulator;
+  int i;
+
+  for (i=firstSection; i < NUM_CENTERLINE_POINTS; i+= sectionStep)
+  {
+    getCrossProfiles(centerLine[i].point, centerLine[i].normal, upperProfile, lowerProfile, 
+      true, articulator, false, intersectionStates);
+    getCrossSection(upperProfile, lowerProfile, &crossSection[i]);
+
+    crossSection[i].pos = centerLine[i].pos;
+    crossSection[i].articulator = articulator;
+  }
+}
+
+
+// ****************************************************************************
+/// Prepares the bounding box trees of all surfaces that are intersected for
+/// the cross-sectional profiles, if this was not done yet for their current
+/// shape.
+// ****************************************************************************
+
+void VocalTract::prepareProfileIntersections()
+{
+  int i;
+  int globalIndex;
+
+  if (makeFasterIntersections == false)
+  {
+    return;
+  }
+
+  for (i=0; i <= NUM_PROFILE_SURFACES; i++)
+  {
+    globalIndex = (i < NUM_PROFILE_SURFACES) ? PROFILE_SURFACE[i] : (int)TONGUE;
+    if (intersectionsPrepared[globalIndex] == false)
+    {
+      surface[globalIndex].prepareIntersections();
+      intersectionsPrepared[globalIndex] = true;
+    }
+  }
+}
+
+
 // ****************************************************************************
 /// Calculates the upper and lower profile of a cross-section defined by the
 /// Point P and normal vector v on the center line.
+/// When intersectionStates is not NULL, the surfaces are intersected with the
+/// given states (indexed by the surface index) instead of their own states,
+/// so that multiple threads can calculate profiles at the same time (after
+/// prepareProfileIntersections()).
 // ****************************************************************************
 
 void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile, 
-       double *lowerProfile, bool considerTongue, Tube::Articulator &articulator, bool debug)
+       double *lowerProfile, bool considerTongue, Tube::Articulator &articulator, bool debug,
+       Surface::IntersectionState *intersectionStates)
 {
   const double MIN_SQUARED_NORMAL_LENGTH = 0.0000001;
   const double INVALID = INVALID_PROFILE_SAMPLE;
@@ -5767,10 +6281,10 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
   const int N2 = NUM_PROFILE_SAMPLES/2;
   const int TOP = 1;       // = Bit at pos. 0
   const int BOTTOM = 2;    // = Bit at pos. 1
-  const int NUM_PROFILE_SURFACES = 10;
 
   int i, k;
   Surface *s;
+  Surface::IntersectionState *state;
   Point2D Q, P0, P1, n;
   Point2D lowestTeethPoint;
   int left, right;
@@ -5784,25 +6298,6 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
   int upperProfileSurface[NUM_PROFILE_SAMPLES];
   int lowerProfileSurface[NUM_PROFILE_SAMPLES];
 
-  // Handle all upper-posterior surfaces first, and then the other
-  // surfaces.
-  int profileSurfaceIndex[NUM_PROFILE_SURFACES] = 
-  {
-    // Surfaces that contribute to the upper profile
-    UPPER_COVER, 
-    UPPER_TEETH, 
-    UPPER_LIP, 
-    UVULA, 
-    // Surfaces that contribute to the lower profile
-    LOWER_COVER,
-    LOWER_TEETH, 
-    LOWER_LIP, 
-    EPIGLOTTIS, 
-    // Surfaces that may contribute to the upper and lower profile
-    LEFT_COVER, 
-    RADIATION
-  };
-
   const int MAX_CUTS = 2048;
   
   struct Cut
@@ -5819,6 +6314,7 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
 
   const int MAX_LIST_ENTRIES = 1024;
   int indexList[MAX_LIST_ENTRIES];
+  Surface::TriangleIntersection triangleIntersection[MAX_LIST_ENTRIES];
   int numListEntries;
 
   // ****************************************************************
@@ -5842,12 +6338,13 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
   numCuts = 0;
   for (k=0; k < NUM_PROFILE_SURFACES; k++)
   {
-    globalIndex = profileSurfaceIndex[k];
+    globalIndex = PROFILE_SURFACE[k];
 
     if ((considerTongue) || ((considerTongue == false) && 
         (globalIndex != UVULA) && (globalIndex != EPIGLOTTIS)))
     {
       s = &surface[globalIndex];
+      state = (intersectionStates != NULL) ? &intersectionStates[globalIndex] : &s->intersectionState;
 
       // The fast intersection method.
 
@@ -5855,24 +6352,26 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
       {
         if (intersectionsPrepared[globalIndex] == false)
         {
-          // Assign all triangles to the tiles (only once !)
+          // Refit the bounding box tree (only once per geometry !)
           s->prepareIntersections();
           intersectionsPrepared[globalIndex] = true;
         }
 
-        s->prepareIntersection(P, v);
+        s->prepareIntersection(P, v, *state);
 
-        s->getTriangleList(indexList, numListEntries, MAX_LIST_ENTRIES);
+        s->getTriangleList(indexList, numListEntries, MAX_LIST_ENTRIES, *state);
+        s->getTriangleIntersections(indexList, numListEntries, triangleIntersection, *state);
 
         for (i=0; i < numListEntries; i++)
         {
-          if ((s->getTriangleIntersection(indexList[i], P0, P1, n)) && (numCuts < MAX_CUTS) &&
-              (P0.y < MAX_PROFILE_VALUE) && (P1.y < MAX_PROFILE_VALUE) &&
-              (P1.y > MIN_PROFILE_VALUE) && (P1.y > MIN_PROFILE_VALUE))
+          const Surface::TriangleIntersection &ti = triangleIntersection[i];
+          if ((ti.isIntersected) && (numCuts < MAX_CUTS) &&
+              (ti.P0.y < MAX_PROFILE_VALUE) && (ti.P1.y < MAX_PROFILE_VALUE) &&
+              (ti.P1.y > MIN_PROFILE_VALUE) && (ti.P1.y > MIN_PROFILE_VALUE))
           {
-            cut[numCuts].P0 = P0;
-            cut[numCuts].P1 = P1;
-            cut[numCuts].n = n;
+            cut[numCuts].P0 = ti.P0;
+            cut[numCuts].P1 = ti.P1;
+            cut[numCuts].n = ti.n;
             cut[numCuts].globalSurfaceIndex = globalIndex;
             cut[numCuts].localSurfaceIndex = k;
             numCuts++;
@@ -5884,11 +6383,11 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
       // The "normal", slower intersection method.
 
       {
-        s->prepareIntersection(P, v);
+        s->prepareIntersection(P, v, *state);
 
         for (i=0; i < s->numTriangles; i++)
         {
-          if ((s->getTriangleIntersection(i, P0, P1, n)) && (numCuts < MAX_CUTS) &&
+          if ((s->getTriangleIntersection(i, P0, P1, n, *state)) && (numCuts < MAX_CUTS) &&
               (P0.y < MAX_PROFILE_VALUE) && (P1.y < MAX_PROFILE_VALUE) &&
               (P1.y > MIN_PROFILE_VALUE) && (P1.y > MIN_PROFILE_VALUE))
           {
@@ -6326,6 +6825,7 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
     }
 
     s = &surface[TONGUE];
+    state = (intersectionStates != NULL) ? &intersectionStates[TONGUE] : &s->intersectionState;
 
     // Faster intersection method.
 
@@ -6333,22 +6833,21 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
     {
       if (intersectionsPrepared[TONGUE] == false)
       {
-        // Assign all triangles to the tiles (only once !)
+        // Refit the bounding box tree (only once per geometry !)
         s->prepareIntersections();
         intersectionsPrepared[TONGUE] = true;
       }
 
-      s->prepareIntersection(P, v);
-      s->getTriangleList(indexList, numListEntries, MAX_LIST_ENTRIES);
+      s->prepareIntersection(P, v, *state);
+      s->getTriangleList(indexList, numListEntries, MAX_LIST_ENTRIES, *state);
+      s->getTriangleIntersections(indexList, numListEntries, triangleIntersection, *state);
 
       for (i=0; i < numListEntries; i++)
       {
-        if (s->getTriangleIntersection(indexList[i], P0, P1, n))
+        const Surface::TriangleIntersection &ti = triangleIntersection[i];
+        if ((ti.isIntersected) && (ti.n.y >= 0.0))
         {
-          if (n.y >= 0.0) 
-          { 
-            insertLowerProfileLine(P0, P1, TONGUE, tongueProfile, tongueProfileSurface); 
-          }
+          insertLowerProfileLine(ti.P0, ti.P1, TONGUE, tongueProfile, tongueProfileSurface); 
         }
       }
     }
@@ -6357,10 +6856,10 @@ void VocalTract::getCrossProfiles(Point2D P, Point2D v, double *upperProfile,
     // Slower intersection method.
 
     {
-      s->prepareIntersection(P, v);
+      s->prepareIntersection(P, v, *state);
       for (i=0; i < s->numTriangles; i++)
       {
-        if (s->getTriangleIntersection(i, P0, P1, n))
+        if (s->getTriangleIntersection(i, P0, P1, n, *state))
         {
           if (n.y >= 0.0) 
           { 
@@ -7447,32 +7946,267 @@ double VocalTract::getPharynxBackX(double y)
 
 void VocalTract::getTube(Tube *tube)
 {
-  const int N = Tube::NUM_PHARYNX_MOUTH_SECTIONS;
+  TubeGeometry geometry;
+
+  getTubeGeometry(geometry);
+  setTubeGeometry(tube, geometry);
+}
+
+
+// ****************************************************************************
+/// Same as calculateAll() followed by getTube(), but the shapes are cached
+/// if a memory bound was set with setShapeCache(). When the (quantized) 
+/// parameters are those of a cached shape, the tube is set from the cache 
+/// and nothing is calculated. In this case, only the tube is valid, and the
+/// surfaces, center line etc. keep the shape of the last calculation.
+// ****************************************************************************
+
+void VocalTract::calculateTube(Tube *tube)
+{
+  size_t maxEntries = shapeCacheMaxBytes / getShapeCacheEntryBytes();
+
+  if (maxEntries == 0)
+  {
+    calculateAll();
+    getTube(tube);
+    return;
+  }
+
+  // The cached shapes are only valid for the anatomy they were 
+  // calculated with.
+
+  if ((shapeCacheEntries.empty()) || 
+    (memcmp((const void*)&anatomy, (const void*)&shapeCacheAnatomy, sizeof(Anatomy)) != 0))
+  {
+    shapeCacheEntries.clear();
+    shapeCacheIndex.clear();
+    memcpy((void*)&shapeCacheAnatomy, (const void*)&anatomy, sizeof(Anatomy));
+  }
+
+  // The key must be taken before the calculation, which changes the
+  // values of the tongue parameters.
+
+  ShapeCacheKey key;
+  getShapeCacheKey(key);
+
+  unordered_map<ShapeCacheKey, list<ShapeCacheEntry>::iterator, ShapeCacheKeyHash>::iterator it = 
+    shapeCacheIndex.find(key);
+
+  if (it != shapeCacheIndex.end())
+  {
+    numShapeCacheHits++;
+    // Make it the most recently used entry.
+    shapeCacheEntries.splice(shapeCacheEntries.begin(), shapeCacheEntries, it->second);
+    setTubeGeometry(tube, it->second->geometry);
+    return;
+  }
+
+  numShapeCacheMisses++;
+  calculateAll();
+
+  trimShapeCache(maxEntries - 1);
+  shapeCacheEntries.push_front(ShapeCacheEntry());
+  ShapeCacheEntry &entry = shapeCacheEntries.front();
+  entry.key = key;
+  getTubeGeometry(entry.geometry);
+  shapeCacheIndex[key] = shapeCacheEntries.begin();
+
+  setTubeGeometry(tube, entry.geometry);
+}
+
+
+// ****************************************************************************
+/// Enables the cache of calculateTube() with the given memory bound in bytes
+/// (0 disables the cache). With quantization = 0, a shape is only taken from
+/// the cache for exactly the same parameter values. Otherwise, the range of 
+/// each parameter is divided into steps of quantization*(max - min), and all
+/// values within the same step are considered as the same shape, i.e., the
+/// first calculated shape of a step is used for all of them.
+// ****************************************************************************
+
+void VocalTract::setShapeCache(size_t maxBytes, double quantization)
+{
+  if (quantization < 0.0)
+  {
+    quantization = 0.0;
+  }
+
+  if (quantization != shapeCacheQuantization)
+  {
+    shapeCacheEntries.clear();
+    shapeCacheIndex.clear();
+  }
+
+  shapeCacheMaxBytes = maxBytes;
+  shapeCacheQuantization = quantization;
+  trimShapeCache(shapeCacheMaxBytes / getShapeCacheEntryBytes());
+}
+
+
+// ****************************************************************************
+/// Returns the settings of the cache of calculateTube().
+// ****************************************************************************
+
+void VocalTract::getShapeCache(size_t &maxBytes, double &quantization)
+{
+  maxBytes = shapeCacheMaxBytes;
+  quantization = shapeCacheQuantization;
+}
+
+
+// ****************************************************************************
+/// Removes all shapes from the cache of calculateTube() and resets the
+/// counters of the cache hits and misses.
+// ****************************************************************************
+
+void VocalTract::clearShapeCache()
+{
+  shapeCacheEntries.clear();
+  shapeCacheIndex.clear();
+  numShapeCacheHits = 0;
+  numShapeCacheMisses = 0;
+}
+
+
+// ****************************************************************************
+/// Returns the numbers of cache hits and misses of calculateTube() (since
+/// the last call of clearShapeCache()), the number of cached shapes and the
+/// (approximate) memory they take.
+// ****************************************************************************
+
+void VocalTract::getShapeCacheStats(long long &numHits, long long &numMisses, 
+  int &numEntries, size_t &numBytes)
+{
+  numHits = numShapeCacheHits;
+  numMisses = numShapeCacheMisses;
+  numEntries = (int)shapeCacheEntries.size();
+  numBytes = shapeCacheEntries.size() * getShapeCacheEntryBytes();
+}
 
-  double length_cm[N];
-  double area_cm2[N];
-  Tube::Articulator articulator[N];
 
+// ****************************************************************************
+/// Takes the part of the tube that depends on the parameters from the last
+/// calculation.
+// ****************************************************************************
+
+void VocalTract::getTubeGeometry(TubeGeometry &geometry)
+{
   TubeSection *ts = NULL;
   int i;
 
+  for (i=0; i < Tube::NUM_PHARYNX_MOUTH_SECTIONS; i++)
+  {
+    ts = &tubeSection[i];
+    geometry.length_cm[i] = ts->length;
+    geometry.area_cm2[i]  = ts->area;
+    geometry.articulator[i] = ts->articulator;
+  }
+
+  geometry.incisorPos_cm = incisorPos_cm;
+  geometry.tongueTipSideElevation = param[TS3].x;
+  geometry.velumOpening_cm2 = nasalPortArea_cm2;
+}
+
+
+// ****************************************************************************
+/// Writes the given geometry and the parts of the anatomy that belong to the
+/// tube into the tube object.
+// ****************************************************************************
+
+void VocalTract::setTubeGeometry(Tube *tube, const TubeGeometry &geometry)
+{
   tube->initPiriformFossa(anatomy.piriformFossaLength_cm, anatomy.piriformFossaVolume_cm3);
   tube->initSubglottalCavity(anatomy.subglottalCavityLength_cm);
   tube->initNasalCavity(anatomy.nasalCavityLength_cm);
 
-  for (i=0; i < Tube::NUM_PHARYNX_MOUTH_SECTIONS; i++)
+  tube->setPharynxMouthGeometry(geometry.length_cm, geometry.area_cm2, geometry.articulator, 
+    geometry.incisorPos_cm, geometry.tongueTipSideElevation);
+  tube->setVelumOpening(geometry.velumOpening_cm2);
+}
+
+
+// ****************************************************************************
+/// Returns the key of the current parameter values for the shape cache.
+/// Without quantization, the bit patterns of the values are taken.
+// ****************************************************************************
+
+void VocalTract::getShapeCacheKey(ShapeCacheKey &key)
+{
+  int i;
+  double step;
+
+  for (i=0; i < NUM_PARAMS; i++)
   {
-    ts = &tubeSection[i];
-    length_cm[i] = ts->length;
-    area_cm2[i]  = ts->area;
-    articulator[i] = ts->articulator;
+    step = (param[i].max - param[i].min) * shapeCacheQuantization;
+
+    // The set values of TRX and TRY are replaced by calculated values.
+    if ((anatomy.automaticTongueRootCalc) && ((i == TRX) || (i == TRY)))
+    {
+      key.value[i] = 0;
+    }
+    else
+    if (step > 0.0)
+    {
+      key.value[i] = (long long)floor(param[i].x / step + 0.5);
+    }
+    else
+    {
+      memcpy(&key.value[i], &param[i].x, sizeof(double));
+    }
+  }
+}
+
+
+// ****************************************************************************
+/// Returns the approximate memory for one cached shape, including the
+/// list and hash table nodes.
+// ****************************************************************************
+
+size_t VocalTract::getShapeCacheEntryBytes()
+{
+  return sizeof(ShapeCacheEntry) + sizeof(ShapeCacheKey) + 
+    sizeof(list<ShapeCacheEntry>::iterator) + 6*sizeof(void*);
+}
+
+
+// ****************************************************************************
+/// Removes the least recently used shapes until at most maxEntries are left.
+// ****************************************************************************
+
+void VocalTract::trimShapeCache(size_t maxEntries)
+{
+  while (shapeCacheEntries.size() > maxEntries)
+  {
+    shapeCacheIndex.erase(shapeCacheEntries.back().key);
+    shapeCacheEntries.pop_back();
   }
+}
 
-  double tongueTipSideElevation = param[TS3].x;
 
-  tube->setPharynxMouthGeometry(length_cm, area_cm2, articulator, 
-    incisorPos_cm, tongueTipSideElevation);
-  tube->setVelumOpening(nasalPortArea_cm2);
+// ****************************************************************************
+// ****************************************************************************
+
+bool VocalTract::ShapeCacheKey::operator==(const ShapeCacheKey &other) const
+{
+  return (memcmp(value, other.value, sizeof(value)) == 0);
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+size_t VocalTract::ShapeCacheKeyHash::operator()(const ShapeCacheKey &key) const
+{
+  // FNV-1a over the parameter values.
+  size_t hash = (size_t)14695981039346656037ULL;
+  int i;
+
+  for (i=0; i < NUM_PARAMS; i++)
+  {
+    hash^= (size_t)(key.value[i] ^ (key.value[i] >> 32));
+    hash*= (size_t)1099511628211ULL;
+  }
+  return hash;
 }
 
 
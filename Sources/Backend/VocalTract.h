@@ -23,6 +23,9 @@
 #define __VOCALTRACT_H__
 
 #include <string>
+#include <list>
+#include <memory>
+#include <unordered_map>
 #include "Surface.h"
 #include "Splines.h"
 #include "Tube.h"
@@ -167,6 +170,21 @@ public:
     NUM_PARAMS
   };
 
+  // ****************************************************************
+  // The stages of the geometry calculation in calculateAll(). Each
+  // stage depends on the results of the previous stages.
+  // ****************************************************************
+
+  enum GeometryStage
+  {
+    COVER_STAGE,          ///< Covers, jaws, velum, uvula and lips (HX ... VO)
+    TONGUE_STAGE,         ///< Tongue and epiglottis (TCX ... TS3)
+    CENTER_LINE_STAGE,
+    CROSS_SECTION_STAGE,
+    TUBE_SECTION_STAGE,
+    NUM_GEOMETRY_STAGES
+  };
+
   // ****************************************************************
   // Anatomical, articulation-invariant vocal tract shape parameters.
   // ****************************************************************
@@ -368,6 +386,8 @@ public:
 
 public:
   VocalTract();
+  VocalTract(const Anatomy &anatomy, const Param *param, const vector<Shape> &shapes);
+  VocalTract(shared_ptr<const VocalTract> referenceSurfaceOwner);
   ~VocalTract();
 
   // ****************************************************************
@@ -375,8 +395,11 @@ public:
   // ****************************************************************
 
   void init();    ///< Is automatically called by the constructor.
+  void initSurfaces();
   void initSurfaceGrids();
+  void initReferenceSurfaceGrids();
   void initReferenceSurfaces();
+  const Surface *getReferenceSurface(int index) const;
   void initLarynx();
   void initJaws();
   void initVelum();
@@ -391,6 +414,7 @@ public:
   void readAnatomyXml(XmlNode *anatomyNode) throw (std::string);
   void readShapesXml(XmlNode *shapeListNode) throw (std::string);
   void readFromXml(const string &speakerFileName) throw (std::string);
+  void readFromXml(XmlNode *rootNode, const string &speakerFileName) throw (std::string);
   void writeAnatomyXml(std::ostream &os, int indent);
   void writeShapesXml(std::ostream &os, int indent);
   void writeToXml(std::ostream &os, int indent);
@@ -407,12 +431,28 @@ public:
 
   void setParams(double *controlParams);
   void calculateAll();
+  void calculateSurfaces();
+  void invalidateGeometry();
+
+  // ****************************************************************
+  // Calculate the tube with a cache for recently calculated shapes.
+  // ****************************************************************
+
+  void calculateTube(Tube *tube);
+  void setShapeCache(size_t maxBytes, double quantization = 0.0);
+  void getShapeCache(size_t &maxBytes, double &quantization);
+  void clearShapeCache();
+  void getShapeCacheStats(long long &numHits, long long &numMisses, 
+    int &numEntries, size_t &numBytes);
   
   // ****************************************************************
   // Calculate all geometric surfaces.
   // ****************************************************************
 
   void calcSurfaces();
+  void restrictParams();
+  void calcCoverSurfaces();
+  void calcTongueSurfaces();
   void calcLips();
   void getImportantLipPoints(Point3D &onset, Point3D &corner, Point3D &F0, Point3D &F1, double &yClose);
   void calcRadiation(Point3D lipCorner);
@@ -437,8 +477,11 @@ public:
   // ****************************************************************
 
   void calcCrossSections();
+  void setNumCrossSectionThreads(int numThreads);
+  int getNumCrossSectionThreads();
   void getCrossProfiles(Point2D P, Point2D v, double *upperProfile, double *lowerProfile, 
-    bool considerTongue, Tube::Articulator &articulator, bool debug = false);
+    bool considerTongue, Tube::Articulator &articulator, bool debug = false,
+    Surface::IntersectionState *intersectionStates = NULL);
   void insertUpperProfileLine(Point2D P0, Point2D P1, int surfaceIndex, 
     double *upperProfile, int *upperProfileSurface);
   void insertLowerProfileLine(Point2D P0, Point2D P1, int surfaceIndex, 
@@ -484,10 +527,78 @@ private:
   bool hasStoredControlParams;
   double storedControlParams[NUM_PARAMS];
 
+  // The reference surfaces (see initReferenceSurfaces()) are either the
+  // entries of surface[] or the ones of another vocal tract of the same
+  // speaker, which is kept alive by referenceSurfaceOwner and never changed.
+  shared_ptr<const VocalTract> referenceSurfaceOwner;
+  const Surface *referenceSurface;
+
+  // For the recalculation of only the invalidated stages in calculateAll()
+  GeometryStage firstInvalidStage;
+  double calculatedParamValues[NUM_PARAMS][4];  // x, limitedX, min, max
+  double tongueParamValues[NUM_PARAMS][2];      // x, limitedX after the tongue stage
+  Anatomy calculatedAnatomy;
+
+  // For the calculation of the cross-sections by multiple threads
+  int numCrossSectionThreads;
+  vector<Surface::IntersectionState> crossSectionIntersectionStates;  // NUM_SURFACES per thread
+
+  // The part of the tube that depends on the vocal tract parameters.
+  struct TubeGeometry
+  {
+    double length_cm[Tube::NUM_PHARYNX_MOUTH_SECTIONS];
+    double area_cm2[Tube::NUM_PHARYNX_MOUTH_SECTIONS];
+    Tube::Articulator articulator[Tube::NUM_PHARYNX_MOUTH_SECTIONS];
+    double incisorPos_cm;
+    double tongueTipSideElevation;
+    double velumOpening_cm2;
+  };
+
+  // For the cache of recently calculated shapes in calculateTube()
+  struct ShapeCacheKey
+  {
+    long long value[NUM_PARAMS];    // Quantized parameter values
+    bool operator==(const ShapeCacheKey &other) const;
+  };
+
+  struct ShapeCacheKeyHash
+  {
+    size_t operator()(const ShapeCacheKey &key) const;
+  };
+
+  struct ShapeCacheEntry
+  {
+    ShapeCacheKey key;
+    TubeGeometry geometry;
+  };
+
+  size_t shapeCacheMaxBytes;
+  double shapeCacheQuantization;
+  list<ShapeCacheEntry> shapeCacheEntries;   // The most recently used first
+  unordered_map<ShapeCacheKey, list<ShapeCacheEntry>::iterator, ShapeCacheKeyHash> shapeCacheIndex;
+  Anatomy shapeCacheAnatomy;                 // The anatomy of the cached shapes
+  long long numShapeCacheHits;
+  long long numShapeCacheMisses;
+
   LineStrip2D upperOutline;
   LineStrip2D lowerOutline;
   LineStrip2D tongueOutline;
   LineStrip2D epiglottisOutline;
+
+  // **************************************************************************
+  /// Private functions.
+  // **************************************************************************
+
+private:
+  void calculateStages(GeometryStage lastStage);
+  void getTubeGeometry(TubeGeometry &geometry);
+  void setTubeGeometry(Tube *tube, const TubeGeometry &geometry);
+  void getShapeCacheKey(ShapeCacheKey &key);
+  static size_t getShapeCacheEntryBytes();
+  void trimShapeCache(size_t maxEntries);
+  void calcCrossSectionProfiles(int firstSection, int sectionStep, 
+    Surface::IntersectionState *intersectionStates);
+  void prepareProfileIntersections();
 };
 
 // ****************************************************************************
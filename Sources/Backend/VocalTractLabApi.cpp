@@ -5,20 +5,14 @@
 #include "XmlNode.h"
 #include "TlModel.h"
 #include "Geometry.h"
+#include "TdsModelBatch.h"
 
 
 #include <iostream>
 #include <fstream>
 #include <string>
-
-#ifdef __APPLE__
-#include <GLUT/glut.h>
-#else
-#include <GL/gl.h>
-#include <GL/glut.h>
-#endif
-
-#include "bitmap_image.hpp"
+#include <algorithm>
+#include <stdexcept>
 
 using namespace std;
 
@@ -26,38 +20,57 @@ using namespace std;
 // static VocalTract *vTract;
 // static VocalTractPicture *vtPicture;
 
-VocalTractLab::VocalTractLab(const string speakerFileName)
+VocalTractLab::VocalTractLab(const string speakerFileName, int samplingRate_Hz)
 {
   // ****************************************************************
-  // Init the vocal tract.
+  // Get the (possibly shared) speaker model.
   // ****************************************************************
-  vocalTract = new VocalTract();
-  vocalTract->calculateAll();
-  // vTract = vocalTract;
 
-  // ****************************************************************
-  // Init the list with glottis models
-  // ****************************************************************
+  speaker = SpeakerModel::load(speakerFileName);
+  if (!speaker)
+  {
+    throw runtime_error("Error in vtlInitialize(): vtlLoadSpeaker() failed.\n");
+  }
 
-  glottis[GEOMETRIC_GLOTTIS] = new GeometricGlottis();
-  glottis[TWO_MASS_MODEL] = new TwoMassModel();
-  glottis[TRIANGULAR_GLOTTIS] = new TriangularGlottis();
+  vtlInitModels();
 
-  selectedGlottis = GEOMETRIC_GLOTTIS;
+  if (vtlSetSamplingRate(samplingRate_Hz) != 0)
+  {
+    vtlClose();
+    throw runtime_error("Error in vtlInitialize(): The sampling rate is out of range.\n");
+  }
+}
 
-  bool ok = vtlLoadSpeaker(speakerFileName, vocalTract, glottis, selectedGlottis);
+// ****************************************************************************
+/// Creates an instance of an already loaded speaker without reading the
+/// speaker file again.
+// ****************************************************************************
 
-  if (ok == false)
-  {
-    int i;
-    for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
-    {
-      delete glottis[i];
-    }
-    delete vocalTract;
+VocalTractLab::VocalTractLab(shared_ptr<const SpeakerModel> speaker)
+{
+  this->speaker = speaker;
+  vtlInitModels();
+}
 
-    throw runtime_error("Error in vtlInitialize(): vtlLoadSpeaker() failed.\n");
+// ****************************************************************************
+/// Creates the mutable models of this instance from the speaker model.
+// ****************************************************************************
+
+void VocalTractLab::vtlInitModels()
+{
+  int i;
+
+  // ****************************************************************
+  // Init the vocal tract and the list with glottis models.
+  // ****************************************************************
+
+  vocalTract = speaker->createVocalTract();
+
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    glottis[i] = speaker->createGlottis(i);
   }
+  selectedGlottis = speaker->selectedGlottis;
 
   // ****************************************************************
   // Init the object for the time domain simulation.
@@ -73,99 +86,50 @@ VocalTractLab::VocalTractLab(const string speakerFileName)
 
   tube = new Tube();
 
-  anatomyParams = new AnatomyParams();
+  // Created on demand, because it needs a vocal tract of its own.
+  anatomyParams = NULL;
+  // Created on demand by vtlGetFormants(), because it is large.
+  tlModel = NULL;
+  // Created on demand by vtlSaveTractFrame() and vtlSaveTractVideo().
+  renderer = NULL;
 
-  // ****************************************************************
-  // Init the Vocal Tract Picture.
-  // ****************************************************************
-  vtPicture  = new VocalTractPicture(vocalTract);
+  synthesisSessionActive = false;
 }
 
-bool VocalTractLab::vtlLoadSpeaker(string speakerFileName, VocalTract *vocalTract, 
-  Glottis *glottis[], int &selectedGlottis)
-{
-  // ****************************************************************
-  // Load the XML data from the speaker file.
-  // ****************************************************************
-
-  vector<XmlError> xmlErrors;
-  XmlNode *rootNode = xmlParseFile(speakerFileName, "speaker", &xmlErrors);
-  if (rootNode == NULL)
-  {
-    xmlPrintErrors(xmlErrors);
-    return false;
-  }
-
-  // ****************************************************************
-  // Load the data for the glottis models.
-  // ****************************************************************
-
-  // This may be overwritten later.
-  selectedGlottis = GEOMETRIC_GLOTTIS;
-
-  XmlNode *glottisModelsNode = rootNode->getChildElement("glottis_models");
-  if (glottisModelsNode != NULL)
-  {
-    int i;
-    XmlNode *glottisNode;
-
-    for (i=0; (i < (int)glottisModelsNode->childElement.size()) && (i < NUM_GLOTTIS_MODELS); i++)
-    {
-      glottisNode = glottisModelsNode->childElement[i];
-      if (glottisNode->getAttributeString("type") == glottis[i]->getName())
-      {
-        if (glottisNode->getAttributeInt("selected") == 1)
-        {
-          selectedGlottis = i;
-        }
-        if (glottis[i]->readFromXml(*glottisNode) == false)
-        {
-          printf("Error: Failed to read glottis data for glottis model %d!\n", i);
-          delete rootNode;
-          return false;
-        }
-      }
-      else
-      {
-        printf("Error: The type of the glottis model %d in the speaker file is '%s' "
-          "but should be '%s'!\n", i, 
-          glottisNode->getAttributeString("type").c_str(), 
-          glottis[i]->getName().c_str());
-
-        delete rootNode;
-        return false;
-      }
-    }
-  }
-  else
-  {
-    printf("Warning: No glottis model data found in the speaker file %s!\n", speakerFileName.c_str());
-  }
-
-  // Free the memory of the XML tree !
-  delete rootNode;
+// ****************************************************************************
+/// Returns a new instance for the same speaker (including an adapted
+/// anatomy) that can be used in another thread. It shares the speaker model
+/// with this instance and must be deleted by the caller.
+// ****************************************************************************
 
-  // ****************************************************************
-  // Load the vocal tract anatomy and vocal tract shapes.
-  // ****************************************************************
+VocalTractLab *VocalTractLab::vtlClone()
+{
+  size_t maxBytes;
+  double quantization;
+
+  VocalTractLab *clone = new VocalTractLab(speaker);
+  clone->vtlSetSamplingRate(vtlGetSamplingRate());
+  clone->vtlSetSolverType(vtlGetSolverType());
+  // The clone has its own (empty) cache with the same settings.
+  vocalTract->getShapeCache(maxBytes, quantization);
+  clone->vocalTract->setShapeCache(maxBytes, quantization);
+  return clone;
+}
 
-  try
-  {
-    vocalTract->readFromXml(speakerFileName);
-    vocalTract->calculateAll();
-  }
-  catch (std::string st)
+void VocalTractLab::vtlClearWorkers()
+{
+  int i;
+  for (i = 0; i < (int)workers.size(); i++)
   {
-    printf("%s\n", st.c_str());
-    printf("Error reading the anatomy data from %s.\n", speakerFileName.c_str());
-    return false;
+    delete workers[i];
   }
-
-  return true;
+  workers.clear();
 }
 
 int VocalTractLab::vtlClose()
 {
+  vtlClearWorkers();
+
   delete synthesizer;
   delete tdsModel;
 
@@ -176,8 +140,23 @@ int VocalTractLab::vtlClose()
   }
 
   delete vocalTract;
+  delete tube;
 
   delete anatomyParams;
+  delete tlModel;
+  delete renderer;
+
+  synthesizer = NULL;
+  tdsModel = NULL;
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    glottis[i] = NULL;
+  }
+  vocalTract = NULL;
+  tube = NULL;
+  anatomyParams = NULL;
+  tlModel = NULL;
+  renderer = NULL;
 
   return 0;
 }
@@ -245,17 +224,22 @@ vector<double> VocalTractLab::vtlGetTractParamInfo()
 
 int VocalTractLab::vtlSetAnatomyParams(vector<double> params)
 {
+  AnatomyParams *anatomyParams = vtlGetAnatomyParamsObject();
   for (int i=0; i<AnatomyParams::NUM_ANATOMY_PARAMS; i++)
   {
     anatomyParams->param[i].x = params[i];
   }
 
   anatomyParams->setFor(vocalTract);
+  // The adapted speaker is a new model for clones and worker threads.
+  speaker = SpeakerModel::createFrom(vocalTract, glottis, selectedGlottis);
+  vtlClearWorkers();
   return 0;
 }
 
 int VocalTractLab::vtlSetAnatomyParams2(double* params)
 {
+  AnatomyParams *anatomyParams = vtlGetAnatomyParamsObject();
   for (int i=0; i<AnatomyParams::NUM_ANATOMY_PARAMS; i++)
   {
     anatomyParams->param[i].x = *params;
@@ -263,11 +247,28 @@ int VocalTractLab::vtlSetAnatomyParams2(double* params)
   }
 
   anatomyParams->setFor(vocalTract);
+  // The adapted speaker is a new model for clones and worker threads.
+  speaker = SpeakerModel::createFrom(vocalTract, glottis, selectedGlottis);
+  vtlClearWorkers();
   return 0;
 }
 
+// ****************************************************************************
+/// Returns the AnatomyParams object and creates it on the first call.
+// ****************************************************************************
+
+AnatomyParams *VocalTractLab::vtlGetAnatomyParamsObject()
+{
+  if (anatomyParams == NULL)
+  {
+    anatomyParams = new AnatomyParams();
+  }
+  return anatomyParams;
+}
+
 vector<double> VocalTractLab::vtlGetAnatomyParams()
 {
+  AnatomyParams *anatomyParams = vtlGetAnatomyParamsObject();
   vector<double> ana_params;
   ana_params.resize(13);
   for (int i=0; i<AnatomyParams::NUM_ANATOMY_PARAMS; i++)
@@ -283,55 +284,612 @@ int VocalTractLab::vtlSynthesisReset()
 {
   synthesizer->reset();
   tube->resetDynamicPart();
+  // Resetting the synthesizer ends any incremental synthesis session.
+  synthesisSessionActive = false;
 
   return 0;
 }
 
 vector<double> VocalTractLab::vtlSynthAudio(vector<double> tractParams, vector<double> glottisParams, int numFrames, 
   int frameStep_samples)
+{
+  vector<double> audio;
+  if (numFrames < 2)
+  {
+    return audio;
+  }
+  audio.resize((numFrames-1) * frameStep_samples);
+
+  vtlSynthAudio(&tractParams[0], &glottisParams[0], numFrames, frameStep_samples, &audio[0]);
+
+  return audio;
+}
+
+// ****************************************************************************
+/// Same as above, but works directly on caller owned buffers so that no copies
+/// of the parameter matrices or the waveform are needed. The buffers are
+/// row-major (one row per frame) and audio must provide room for
+/// (numFrames-1)*frameStep_samples samples.
+/// Does not touch any Python objects, so the caller may release the GIL.
+// ****************************************************************************
+
+int VocalTractLab::vtlSynthAudio(double *tractParams, double *glottisParams, int numFrames, 
+  int frameStep_samples, double *audio)
 {
   int i;
   int samplePos = 0;
   int numGlottisParams = (int)glottis[selectedGlottis]->controlParam.size();
 
-  vector<double> audio;
-  audio.resize((numFrames-1) * frameStep_samples);
-
   vtlSynthesisReset();
 
   for (i = 0; i < numFrames; i++)
   {
-    // cout << "In frame #" << i << ":" << endl;
     if (i == 0)
     {
       // Only set the initial state of the vocal tract and glottis without generating audio.
-      vector<double> audioVector;
       synthesizer->add(&glottisParams[i*numGlottisParams], 
         &tractParams[i*VocalTract::NUM_PARAMS], 
-        0, audioVector);
+        0, audio);
     }
     else
     {
-      vector<double> audioVector;
-      synthesizer->add(&glottisParams[i*numGlottisParams], 
+      // The samples are written directly into the given buffer.
+      if (synthesizer->add(&glottisParams[i*numGlottisParams], 
         &tractParams[i*VocalTract::NUM_PARAMS], 
-        frameStep_samples, audioVector);
-      if ((int)audioVector.size() != frameStep_samples)
+        frameStep_samples, &audio[samplePos]) != frameStep_samples)
+      {
+        throw runtime_error("Error in vtlSynthAudio(): Number of audio samples is wrong.");
+      }
+      samplePos += frameStep_samples;
+    }
+  }
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Synthesizes several utterances in parallel with numThreads threads
+/// (numThreads < 1 means one per hardware thread). Each thread works on its
+/// own clone of this speaker and takes the next pending job when it is done,
+/// longest jobs first, so that utterances of very different lengths keep all
+/// threads busy. The clones are kept for subsequent calls.
+/// With numLanes = 2, 4 or 8, each thread synthesizes this many utterances 
+/// at a time in lockstep (see vtlSynthAudioLockstep()). The results are the
+/// same in any case.
+// ****************************************************************************
+
+int VocalTractLab::vtlSynthAudioBatch(vector<VtlSynthesisJob> &jobs, int numThreads, 
+  int numLanes)
+{
+  int i;
+  int numJobs = (int)jobs.size();
+
+  if ((numLanes != 1) && (numLanes != 2) && (numLanes != 4) && (numLanes != 8))
+  {
+    throw runtime_error("Error in vtlSynthAudioBatch(): numLanes must be 1, 2, 4 or 8.");
+  }
+
+  if (numJobs == 0)
+  {
+    return 0;
+  }
+
+  if (numThreads < 1)
+  {
+    numThreads = (int)thread::hardware_concurrency();
+    if (numThreads < 1)
+    {
+      numThreads = 1;
+    }
+  }
+  while (numLanes > numJobs)
+  {
+    numLanes /= 2;
+  }
+  if (numThreads * numLanes > numJobs)
+  {
+    numThreads = (numJobs + numLanes - 1) / numLanes;
+  }
+
+  // Longest jobs first.
+  vector<int> order(numJobs);
+  for (i = 0; i < numJobs; i++)
+  {
+    order[i] = i;
+  }
+  stable_sort(order.begin(), order.end(), [&jobs](int a, int b)
+    {
+      return (long long)jobs[a].numFrames * jobs[a].frameStep_samples >
+        (long long)jobs[b].numFrames * jobs[b].frameStep_samples;
+    });
+
+  // This object is the first worker (or the first lane of the first
+  // worker).
+  while ((int)workers.size() < numThreads * numLanes - 1)
+  {
+    workers.push_back(vtlClone());
+  }
+  vector<VocalTractLab*> lanes(1, this);
+  lanes.insert(lanes.end(), workers.begin(), workers.end());
+
+  // The jobs already run in parallel (see vtlSetNumGeometryThreads()).
+  int numGeometryThreads = vtlGetNumGeometryThreads();
+  if (numThreads > 1)
+  {
+    vocalTract->setNumCrossSectionThreads(1);
+  }
+
+  atomic<int> nextJob(0);
+  mutex errorMutex;
+  string errorMessage;
+
+  auto work = [&](VocalTractLab **vtl)
+  {
+    int k;
+    while ((numLanes == 1) && ((k = nextJob++) < numJobs))
+    {
+      VtlSynthesisJob &job = jobs[order[k]];
+      try
+      {
+        vtl[0]->vtlSynthAudio(job.tractParams, job.glottisParams, job.numFrames,
+          job.frameStep_samples, job.audio);
+      }
+      catch (std::exception &e)
       {
-        throw runtime_error("Error in vtlSynthesisAddTube(): Number of audio samples is wrong.");
-        return audio;
+        lock_guard<mutex> lock(errorMutex);
+        if (errorMessage.empty())
+        {
+          errorMessage = e.what();
+        }
       }
-      // Copy the audio samples in the given buffer.
-      int i;
-      for (i = 0; i < frameStep_samples; i++)
+    }
+
+    try
+    {
+      switch (numLanes)
       {
-        audio[samplePos+i] = audioVector[i];
+        case 2: vtlSynthAudioLockstep<2>(vtl, jobs, order, nextJob); break;
+        case 4: vtlSynthAudioLockstep<4>(vtl, jobs, order, nextJob); break;
+        case 8: vtlSynthAudioLockstep<8>(vtl, jobs, order, nextJob); break;
+        default: break;
       }
-      samplePos += frameStep_samples;
     }
+    catch (std::exception &e)
+    {
+      lock_guard<mutex> lock(errorMutex);
+      if (errorMessage.empty())
+      {
+        errorMessage = e.what();
+      }
+    }
+  };
+
+  vector<thread> threads;
+  for (i = 1; i < numThreads; i++)
+  {
+    threads.push_back(thread(work, &lanes[i * numLanes]));
+  }
+  work(&lanes[0]);
+  for (i = 0; i < (int)threads.size(); i++)
+  {
+    threads[i].join();
   }
+  vocalTract->setNumCrossSectionThreads(numGeometryThreads);
 
-  return audio;
+  if (errorMessage.empty() == false)
+  {
+    throw runtime_error(errorMessage);
+  }
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Synthesizes the pending jobs of a batch (in the given order) with the K 
+/// instances in lanes, which run their time steps in lockstep (see 
+/// TdsModelBatch). A lane takes the next job as soon as it is done with its
+/// current job. The results are exactly the same as with vtlSynthAudio().
+// ****************************************************************************
+
+template<int K> void VocalTractLab::vtlSynthAudioLockstep(VocalTractLab **lanes,
+  vector<VtlSynthesisJob> &jobs, const vector<int> &order, atomic<int> &nextJob)
+{
+  int l;
+  int numJobs = (int)jobs.size();
+  bool hasJobsLeft = true;
+
+  VtlSynthesisJob *job[K];
+  int frameIndex[K];      // Index of the next frame
+  int sampleIndex[K];     // Index of the next sample in the current frame
+  int audioPos[K];
+  bool isActive[K];
+  double radiatedFlow_cm3_s[K];
+
+  // On the heap because of its size, and freed when a job throws.
+  unique_ptr<TdsModelBatch<K> > batch(new TdsModelBatch<K>());
+
+  for (l = 0; l < K; l++)
+  {
+    batch->setLane(l, lanes[l]->tdsModel);
+    isActive[l] = false;
+  }
+
+  // Starts the next frame with samples of the job of lane l.
+  auto beginNextFrame = [&](int l) -> bool
+  {
+    VtlSynthesisJob *j = job[l];
+    int numGlottisParams = lanes[l]->vtlGetNumGlottisParams();
+
+    while (frameIndex[l] < j->numFrames)
+    {
+      int i = frameIndex[l]++;
+      if (lanes[l]->synthesizer->beginFrame(&j->glottisParams[i*numGlottisParams],
+        &j->tractParams[i*VocalTract::NUM_PARAMS], j->frameStep_samples))
+      {
+        sampleIndex[l] = 0;
+        return true;
+      }
+    }
+    return false;
+  };
+
+  while (true)
+  {
+    // Give new jobs to the lanes that are done.
+    for (l = 0; l < K; l++)
+    {
+      while ((isActive[l] == false) && (hasJobsLeft))
+      {
+        int k = nextJob++;
+        if (k >= numJobs)
+        {
+          hasJobsLeft = false;
+          break;
+        }
+
+        job[l] = &jobs[order[k]];
+        lanes[l]->vtlSynthesisReset();
+        frameIndex[l] = 0;
+        audioPos[l] = 0;
+        // The first frame only sets the initial state.
+        isActive[l] = beginNextFrame(l);
+      }
+    }
+
+    bool isAnyActive = false;
+    for (l = 0; l < K; l++)
+    {
+      if (isActive[l])
+      {
+        isAnyActive = true;
+        lanes[l]->synthesizer->prepareSample();
+      }
+    }
+
+    if (isAnyActive == false)
+    {
+      break;
+    }
+
+    batch->proceedTimeStep(isActive, radiatedFlow_cm3_s);
+
+    for (l = 0; l < K; l++)
+    {
+      if (isActive[l])
+      {
+        job[l]->audio[audioPos[l]++] = 
+          lanes[l]->synthesizer->finishSample(radiatedFlow_cm3_s[l]);
+
+        if (++sampleIndex[l] == job[l]->frameStep_samples)
+        {
+          isActive[l] = beginNextFrame(l);
+        }
+      }
+    }
+  }
+
+  // The factorizations of the combined system count for the first lane.
+  TdsModel::FactorizationStatistics &stats = lanes[0]->tdsModel->factorizationStatistics;
+  stats.numFullFactorizations+= batch->factorizationStatistics.numFullFactorizations;
+  stats.numPartialFactorizations+= batch->factorizationStatistics.numPartialFactorizations;
+  stats.numReusedFactorizations+= batch->factorizationStatistics.numReusedFactorizations;
+  stats.numFactorizedRows+= batch->factorizationStatistics.numFactorizedRows;
+}
+
+// ****************************************************************************
+/// Starts an incremental synthesis session. The frames are then passed one
+/// by one with vtlPushFrame(), and the acoustic state is kept between the
+/// calls. Any running session is discarded, and calls of vtlSynthAudio() or
+/// vtlTract2EMA() end the session.
+// ****************************************************************************
+
+int VocalTractLab::vtlBeginSynthesis()
+{
+  vtlSynthesisReset();
+  synthesisSessionActive = true;
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Adds the next frame to the current synthesis session and writes the
+/// numSamples samples interpolated from the previous to this frame into
+/// audio. The first frame of a session only sets the initial state and
+/// produces no samples.
+/// Returns the number of samples written, or -1 if no session is active.
+// ****************************************************************************
+
+int VocalTractLab::vtlPushFrame(double *tractParams, double *glottisParams, int numSamples, 
+  double *audio)
+{
+  if (synthesisSessionActive == false)
+  {
+    return -1;
+  }
+
+  return synthesizer->add(glottisParams, tractParams, numSamples, audio);
+}
+
+// ****************************************************************************
+/// Ends the current synthesis session.
+// ****************************************************************************
+
+int VocalTractLab::vtlEndSynthesis()
+{
+  synthesisSessionActive = false;
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Saves the state of the current synthesis session after the last frame
+/// into state, so that the session can be continued from there several
+/// times with vtlRestoreSynthesisState(), e.g., to try different 
+/// continuations of an utterance without synthesizing its beginning again.
+/// Returns -1 if no session is active.
+// ****************************************************************************
+
+int VocalTractLab::vtlSaveSynthesisState(VtlSynthesisState *state)
+{
+  if (synthesisSessionActive == false)
+  {
+    return -1;
+  }
+
+  state->speaker = speaker;
+  state->selectedGlottis = selectedGlottis;
+  synthesizer->saveState(state->synthesizerState);
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Continues a synthesis session from the given saved state. The samples of
+/// the next frames pushed with vtlPushFrame() are exactly the same as those
+/// after saving the state. Any running session is replaced.
+/// Returns -1 if the state was saved by an instance of another speaker, with
+/// another glottis model or at another sampling rate.
+// ****************************************************************************
+
+int VocalTractLab::vtlRestoreSynthesisState(const VtlSynthesisState *state)
+{
+  if ((state->speaker != speaker) || (state->selectedGlottis != selectedGlottis))
+  {
+    return -1;
+  }
+
+  if (synthesizer->restoreState(state->synthesizerState) == false)
+  {
+    return -1;
+  }
+  synthesisSessionActive = true;
+
+  return 0;
+}
+
+int VocalTractLab::vtlGetNumGlottisParams()
+{
+  return (int)glottis[selectedGlottis]->controlParam.size();
+}
+
+// ****************************************************************************
+/// Sets the sampling rate of the synthesized audio (44100 Hz by default).
+/// The acoustic simulation runs at this rate, so that lower rates need
+/// proportionally less time. The frame steps passed to vtlSynthAudio() and
+/// vtlPushFrame() are in samples of this rate. Ends any incremental 
+/// synthesis session.
+/// Returns -1 if the rate is outside of the range from 
+/// TdsModel::MIN_SAMPLING_RATE to TdsModel::MAX_SAMPLING_RATE.
+// ****************************************************************************
+
+int VocalTractLab::vtlSetSamplingRate(int samplingRate_Hz)
+{
+  if (samplingRate_Hz == tdsModel->getSamplingRate())
+  {
+    return 0;
+  }
+
+  if (tdsModel->setSamplingRate(samplingRate_Hz) == false)
+  {
+    return -1;
+  }
+
+  int i;
+  for (i = 0; i < NUM_GLOTTIS_MODELS; i++)
+  {
+    glottis[i]->setSamplingRate(samplingRate_Hz);
+  }
+
+  // The synthesizer takes the rate from the TDS model.
+  vtlSynthesisReset();
+  // Worker threads are created again with the new rate.
+  vtlClearWorkers();
+
+  return 0;
+}
+
+int VocalTractLab::vtlGetSamplingRate()
+{
+  return tdsModel->getSamplingRate();
+}
+
+// ****************************************************************************
+/// Sets the solver for the system of equations of the acoustic simulation:
+/// CHOLESKY_FACTORIZATION (the default), TREE_ELIMINATION (the fastest, 
+/// with the same results up to rounding errors) or SOR_GAUSS_SEIDEL.
+/// Clones and worker threads use the same solver.
+/// Returns -1 for an unknown solver type.
+// ****************************************************************************
+
+int VocalTractLab::vtlSetSolverType(TdsModel::SolverType solverType)
+{
+  if ((solverType < 0) || (solverType >= TdsModel::NUM_SOLVER_TYPES))
+  {
+    return -1;
+  }
+
+  tdsModel->options.solverType = solverType;
+  // Worker threads are created again with the new solver.
+  vtlClearWorkers();
+
+  return 0;
+}
+
+TdsModel::SolverType VocalTractLab::vtlGetSolverType()
+{
+  return tdsModel->options.solverType;
+}
+
+// ****************************************************************************
+/// Sets the number of threads that calculate the cross-sections of each
+/// vocal tract shape of this instance (1 by default; numThreads < 1 means 
+/// one per hardware thread). This reduces the latency for single shapes, 
+/// e.g., for interactive control. The results do not depend on the number 
+/// of threads. Clones keep one thread per shape, and so does this instance
+/// while it works in parallel with clones (e.g., in vtlSynthAudioBatch()).
+// ****************************************************************************
+
+int VocalTractLab::vtlSetNumGeometryThreads(int numThreads)
+{
+  if (numThreads < 1)
+  {
+    numThreads = (int)thread::hardware_concurrency();
+  }
+
+  vocalTract->setNumCrossSectionThreads(numThreads);
+  return 0;
+}
+
+int VocalTractLab::vtlGetNumGeometryThreads()
+{
+  return vocalTract->getNumCrossSectionThreads();
+}
+
+// ****************************************************************************
+/// Enables a cache for the tubes of recently calculated vocal tract shapes
+/// with a memory bound of maxBytes (0 = disabled, the default), so that 
+/// repeated shapes (e.g., held vowels or the targets of the same phones) 
+/// are calculated only once in the synthesis and in vtlTractToTube() and 
+/// vtlGetFormants(). With quantization > 0, the parameter values are 
+/// rounded to steps of quantization times their range, and shapes in the 
+/// same step are taken as the same (see VocalTract::setShapeCache()). The
+/// default 0 only reuses exactly the same shapes, which gives the same 
+/// results as without the cache. Each worker thread has its own cache with
+/// the same settings.
+// ****************************************************************************
+
+int VocalTractLab::vtlSetShapeCache(size_t maxBytes, double quantization)
+{
+  if (quantization < 0.0)
+  {
+    throw runtime_error("Error in vtlSetShapeCache(): quantization must not be negative.");
+  }
+
+  vocalTract->setShapeCache(maxBytes, quantization);
+  // Worker threads are created again with the new settings.
+  vtlClearWorkers();
+
+  return 0;
+}
+
+int VocalTractLab::vtlClearShapeCache()
+{
+  int i;
+
+  vocalTract->clearShapeCache();
+  for (i = 0; i < (int)workers.size(); i++)
+  {
+    workers[i]->vocalTract->clearShapeCache();
+  }
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Returns the cache hits and misses (since the last vtlClearShapeCache()), 
+/// the number of cached shapes and their memory, summed over this instance
+/// and its worker threads.
+// ****************************************************************************
+
+VtlShapeCacheStats VocalTractLab::vtlGetShapeCacheStats()
+{
+  VtlShapeCacheStats stats = { 0, 0, 0, 0 };
+  long long numHits, numMisses;
+  int numEntries;
+  size_t numBytes;
+  int i;
+
+  for (i = -1; i < (int)workers.size(); i++)
+  {
+    VocalTract *tract = (i < 0) ? vocalTract : workers[i]->vocalTract;
+    tract->getShapeCacheStats(numHits, numMisses, numEntries, numBytes);
+    stats.numHits+= numHits;
+    stats.numMisses+= numMisses;
+    stats.numEntries+= numEntries;
+    stats.numBytes+= numBytes;
+  }
+
+  return stats;
+}
+
+// ****************************************************************************
+/// Returns how often the Cholesky factorization of the acoustic simulation
+/// was computed from scratch, recomputed from the first changed row on, or
+/// reused completely, and the total number of recomputed rows, summed over
+/// this instance and its worker threads (including the lockstep lanes of 
+/// vtlSynthAudioBatch()) since the last vtlResetFactorizationStats(). Only
+/// the solver type TdsModel::CHOLESKY_FACTORIZATION counts.
+// ****************************************************************************
+
+VtlFactorizationStats VocalTractLab::vtlGetFactorizationStats()
+{
+  VtlFactorizationStats stats = { 0, 0, 0, 0 };
+  TdsModel::FactorizationStatistics s;
+  int i;
+
+  for (i = -1; i < (int)workers.size(); i++)
+  {
+    s = ((i < 0) ? tdsModel : workers[i]->tdsModel)->getFactorizationStatistics();
+    stats.numFullFactorizations+= s.numFullFactorizations;
+    stats.numPartialFactorizations+= s.numPartialFactorizations;
+    stats.numReusedFactorizations+= s.numReusedFactorizations;
+    stats.numFactorizedRows+= s.numFactorizedRows;
+  }
+
+  return stats;
+}
+
+int VocalTractLab::vtlResetFactorizationStats()
+{
+  int i;
+
+  tdsModel->resetFactorizationStatistics();
+  for (i = 0; i < (int)workers.size(); i++)
+  {
+    workers[i]->tdsModel->resetFactorizationStatistics();
+  }
+
+  return 0;
 }
 
 vector<string> VocalTractLab::vtlGetEMANames()
@@ -342,33 +900,263 @@ vector<string> VocalTractLab::vtlGetEMANames()
 }
 
 vector<double> VocalTractLab::vtlTract2EMA(vector<double> tractParams, int numFrames)
+{
+  vector<double> ema;
+  ema.resize(numFrames * vtlGetNumEmaPoints() * 2);
+
+  if (numFrames > 0)
+  {
+    vtlTract2EMA(&tractParams[0], numFrames, &ema[0]);
+  }
+
+  return ema;
+}
+
+// ****************************************************************************
+/// Calculates the (x, y) coordinates of the EMA points for numFrames frames
+/// of vocal tract parameters and writes them into ema, which must hold
+/// numFrames * 2 * vtlGetNumEmaPoints() values (x and y of each point, one
+/// row per frame). Only the surfaces of the vocal tract are calculated, not
+/// its center line and area function. The frames are processed with
+/// numThreads threads (see vtlProcessFrames()).
+// ****************************************************************************
+
+int VocalTractLab::vtlTract2EMA(double *tractParams, int numFrames, double *ema, int numThreads)
 {
   vtlSynthesisReset();
   vocalTract->setDefaultEmaPoints();
-  int numEmaPoints = (int)vocalTract->emaPoints.size();
 
-  vector<double> ema;
-  ema.resize(numFrames * numEmaPoints * 2);
-  Point3D P;
-  
-  for (int i=0; i < numFrames; i++)
+  vtlProcessFrames(numFrames, numThreads, [=](VocalTractLab *vtl, int firstFrame, int numChunkFrames)
+    {
+      int i, k;
+      VocalTract *tract = vtl->vocalTract;
+      int numEmaPoints = (int)tract->emaPoints.size();
+      Point3D P;
+
+      for (i = firstFrame; i < firstFrame + numChunkFrames; i++)
+      {
+        tract->setParams(&tractParams[i*VocalTract::NUM_PARAMS]);
+        tract->calculateSurfaces();
+
+        for (k = 0; k < numEmaPoints; k++)
+        {
+          P = tract->getEmaPointCoord(k);
+          ema[i * numEmaPoints * 2 + k * 2] = P.x;
+          ema[i * numEmaPoints * 2 + k * 2 + 1] = P.y;
+        }
+      }
+    });
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Calculates the area functions of the pharynx and mouth (as given by
+/// VocalTract::getTube()) for numFrames frames of vocal tract parameters
+/// without any acoustic simulation. Per frame, the lengths, areas and
+/// articulators (Tube::Articulator) of the Tube::NUM_PHARYNX_MOUTH_SECTIONS
+/// tube sections are written into tubeLength_cm, tubeArea_cm2 and
+/// tubeArticulator (one row per frame), and the position of the incisors,
+/// the elevation of the tongue tip side and the velic opening into
+/// incisorPos_cm, tongueTipSideElevation and velumOpening_cm2.
+/// Outputs that are not needed may be NULL. The frames are processed with
+/// numThreads threads (see vtlProcessFrames()).
+// ****************************************************************************
+
+int VocalTractLab::vtlTractToTube(double *tractParams, int numFrames,
+  double *tubeLength_cm, double *tubeArea_cm2, int *tubeArticulator,
+  double *incisorPos_cm, double *tongueTipSideElevation, double *velumOpening_cm2,
+  int numThreads)
+{
+  vtlSynthesisReset();
+
+  vtlProcessFrames(numFrames, numThreads, [=](VocalTractLab *vtl, int firstFrame, int numChunkFrames)
+    {
+      const int N = Tube::NUM_PHARYNX_MOUTH_SECTIONS;
+      int i, k;
+      VocalTract *tract = vtl->vocalTract;
+      Tube *tube = vtl->tube;
+
+      for (i = firstFrame; i < firstFrame + numChunkFrames; i++)
+      {
+        tract->setParams(&tractParams[i*VocalTract::NUM_PARAMS]);
+        tract->calculateTube(tube);
+
+        for (k = 0; k < N; k++)
+        {
+          Tube::Section *ts = &tube->pharynxMouthSection[k];
+          if (tubeLength_cm != NULL) { tubeLength_cm[i*N + k] = ts->length_cm; }
+          if (tubeArea_cm2 != NULL) { tubeArea_cm2[i*N + k] = ts->area_cm2; }
+          if (tubeArticulator != NULL) { tubeArticulator[i*N + k] = (int)ts->articulator; }
+        }
+        if (incisorPos_cm != NULL) { incisorPos_cm[i] = tube->teethPosition_cm; }
+        if (tongueTipSideElevation != NULL) { tongueTipSideElevation[i] = tube->tongueTipSideElevation; }
+        if (velumOpening_cm2 != NULL) { velumOpening_cm2[i] = tube->getVelumOpening_cm2(); }
+      }
+    });
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Calculates the first maxFormants formants of the vocal tract transfer
+/// function (TlModel::getFormants()) for numFrames frames of vocal tract
+/// parameters with a closed glottis. The frequencies and bandwidths in Hz
+/// are written into formantFreq_Hz and formantBW_Hz (numFrames*maxFormants
+/// values, one row per frame) and the number of formants found per frame
+/// into numFormants (may be NULL). Missing formants are set to zero.
+/// Each thread (see vtlProcessFrames()) uses its own TlModel, which skips
+/// its preparations if the tube did not change, and a frame with the same
+/// parameters as the one before is not calculated again.
+// ****************************************************************************
+
+int VocalTractLab::vtlGetFormants(double *tractParams, int numFrames, int maxFormants,
+  double *formantFreq_Hz, double *formantBW_Hz, int *numFormants, int numThreads)
+{
+  if ((maxFormants < 1) || (maxFormants > MAX_FORMANTS))
+  {
+    throw runtime_error("Error in vtlGetFormants(): maxFormants must be in the range 1..." +
+      to_string(MAX_FORMANTS) + ".");
+  }
+
+  vtlSynthesisReset();
+
+  vtlProcessFrames(numFrames, numThreads, [=](VocalTractLab *vtl, int firstFrame, int numChunkFrames)
+    {
+      int i, k;
+      VocalTract *tract = vtl->vocalTract;
+      bool frictionNoise, isClosure, isNasal;
+      int numFound = 0;
+      double *params;
+      double *prevParams = NULL;
+
+      if (vtl->tlModel == NULL)
+      {
+        vtl->tlModel = new TlModel();
+      }
+      TlModel *tlModel = vtl->tlModel;
+
+      for (i = firstFrame; i < firstFrame + numChunkFrames; i++)
+      {
+        double *freq = &formantFreq_Hz[i*maxFormants];
+        double *bw = &formantBW_Hz[i*maxFormants];
+        params = &tractParams[i*VocalTract::NUM_PARAMS];
+
+        if ((prevParams != NULL) &&
+          (equal(params, params + VocalTract::NUM_PARAMS, prevParams)))
+        {
+          copy(freq - maxFormants, freq, freq);
+          copy(bw - maxFormants, bw, bw);
+        }
+        else
+        {
+          tract->setParams(params);
+          tract->calculateTube(&tlModel->tube);
+          tlModel->tube.setGlottisArea(0.0);
+
+          tlModel->getFormants(freq, bw, numFound, maxFormants,
+            frictionNoise, isClosure, isNasal);
+
+          for (k = numFound; k < maxFormants; k++)
+          {
+            freq[k] = 0.0;
+            bw[k] = 0.0;
+          }
+        }
+
+        if (numFormants != NULL)
+        {
+          numFormants[i] = numFound;
+        }
+        prevParams = params;
+      }
+    });
+
+  return 0;
+}
+
+// ****************************************************************************
+/// Runs processChunk(vtl, firstFrame, numChunkFrames) over the frames
+/// 0...numFrames-1 in chunks of FRAMES_PER_CHUNK frames. The chunks are split
+/// among numThreads threads (numThreads < 1 means one per hardware thread)
+/// that use this object and the worker clones of vtlSynthAudioBatch(), so
+/// the frames must not depend on each other. Short sequences are processed
+/// by the calling thread alone.
+// ****************************************************************************
+
+void VocalTractLab::vtlProcessFrames(int numFrames, int numThreads,
+  function<void (VocalTractLab*, int, int)> processChunk)
+{
+  int i;
+
+  if (numFrames < 1)
+  {
+    return;
+  }
+
+  if (numThreads < 1)
   {
-    for (int j  = 0; j < VocalTract::NUM_PARAMS; j++)
+    numThreads = (int)thread::hardware_concurrency();
+    if (numThreads < 1)
     {
-      VocalTract::Param *param = &(vocalTract->param[j]);
-      param->x = tractParams[i*VocalTract::NUM_PARAMS + j];
-      param->limitedX = param->x;
+      numThreads = 1;
     }
-    vocalTract->calculateAll();
-    for (int k = 0; k < numEmaPoints; k++)
+  }
+  // Don't set up threads (and clones) for short sequences.
+  int maxThreads = (numFrames + MIN_FRAMES_PER_THREAD - 1) / MIN_FRAMES_PER_THREAD;
+  if (numThreads > maxThreads)
+  {
+    numThreads = maxThreads;
+  }
+
+  if (numThreads == 1)
+  {
+    processChunk(this, 0, numFrames);
+    return;
+  }
+
+  // This object is the first worker.
+  while ((int)workers.size() < numThreads - 1)
+  {
+    workers.push_back(vtlClone());
+  }
+
+  atomic<int> nextFrame(0);
+
+  // The frames already run in parallel (see vtlSetNumGeometryThreads()).
+  int numGeometryThreads = vtlGetNumGeometryThreads();
+  vocalTract->setNumCrossSectionThreads(1);
+
+  auto work = [&](VocalTractLab *vtl)
+  {
+    int firstFrame, numChunkFrames;
+    while ((firstFrame = nextFrame.fetch_add(FRAMES_PER_CHUNK)) < numFrames)
     {
-      P = vocalTract->getEmaPointCoord(k);
-      ema[i * numEmaPoints * 2 + k * 2] = P.x;
-      ema[i * numEmaPoints * 2 + k * 2 + 1] = P.y;
+      numChunkFrames = numFrames - firstFrame;
+      if (numChunkFrames > FRAMES_PER_CHUNK)
+      {
+        numChunkFrames = FRAMES_PER_CHUNK;
+      }
+      processChunk(vtl, firstFrame, numChunkFrames);
     }
+  };
+
+  vector<thread> threads;
+  for (i = 0; i < numThreads - 1; i++)
+  {
+    threads.push_back(thread(work, workers[i]));
   }
+  work(this);
+  for (i = 0; i < (int)threads.size(); i++)
+  {
+    threads[i].join();
+  }
+  vocalTract->setNumCrossSectionThreads(numGeometryThreads);
+}
 
-  return ema;
+int VocalTractLab::vtlGetNumEmaPoints()
+{
+  return (int)vocalTract->emaPoints.size();
 }
 
 int VocalTractLab::vtlExportTractSvg(vector<double> tractParams, const char *fileName, bool addCenterLine, bool addCutVectors)
@@ -392,103 +1180,107 @@ int VocalTractLab::vtlExportTractSvg(vector<double> tractParams, const char *fil
   }
 }
 
-int VocalTractLab::vtlSaveTractFrame( double* tractParams, const char *fileName)
-{
-  int arg = 0;
-  char **argv=NULL;
-
-  glutInit(&arg, argv);
-  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
-	glutInitWindowSize(400, 400); //Set the window size
-  glutCreateWindow("Test");
+// ****************************************************************************
+/// Renders the vocal tract with the given parameters (as shown by
+/// VocalTractPicture) and saves the image. The format follows the extension
+/// of the file name: .png, .rgb/.raw (headerless rgb24) or .bmp (default).
+/// No display or OpenGL context is needed.
+/// Returns 0 on success and -1 if the file could not be written.
+// ****************************************************************************
 
-  cout << "Rendering Frame..." << endl;
-  for (int i=0; i < VocalTract::NUM_PARAMS; i++)
+int VocalTractLab::vtlSaveTractFrame(double* tractParams, const char *fileName)
+{
+  int i;
+  for (i = 0; i < VocalTract::NUM_PARAMS; i++)
   {
-    vocalTract->param[i].x = *tractParams;
-    tractParams++;
+    vocalTract->param[i].x = tractParams[i];
   }
   vocalTract->calculateAll();
-  vtPicture->setVocalTract(vocalTract);
-  vtPicture->display();
 
-  GLint viewport[4];  // current viewport
-  glGetIntegerv(GL_VIEWPORT, viewport);  // get current viewport
-  int w = viewport[2];
-  int h = viewport[3];
+  TractRenderer *r = vtlGetRenderer();
+  r->render(vocalTract, viewOptions);
 
-  unsigned char* imageData = (unsigned char *)malloc((int)(400*400*3));  // allocate memory for image
-  glReadPixels(0, 0, 400, 400, GL_BGR, GL_UNSIGNED_BYTE, imageData);  // copy data
-  // build writer
-  bitmap_image image(400, 400);
-  image_drawer draw(image);
+  vector<unsigned char> image(r->getWidth()*r->getHeight()*3);
+  r->getImage(&image[0]);
 
-// write from imageData to bitmap image
-  for (unsigned int i=0; i < h; i++)
+  if (FrameWriter::writeImage(&image[0], r->getWidth(), r->getHeight(),
+    FrameWriter::getFormatFromFileName(fileName), fileName) == false)
   {
-    for (unsigned int j=0; j < w; j++)
-    {
-      image.set_pixel(j, h-1-i, *(imageData+2), *(imageData+1), *(imageData+3));
-      imageData += 3;
-    }
+    return -1;
   }
-
-  image.save_image(fileName);
-  cout << "Rendered Frame ! Saved image to " << fileName << endl;
+  return 0;
 }
 
-int VocalTractLab::vtlSaveTractVideo(int numFrames, double* tractParams, const char *folderName)
-{
 
-  int arg = 0;
-  char **argv=NULL;
+// ****************************************************************************
+/// Renders the vocal tract for each of the numFrames rows of tractParams and
+/// saves the images in the given folder, either as the files vt<i>.bmp,
+/// vt<i>.png or vt<i>.rgb, or (with FrameWriter::RAW_VIDEO) as the single
+/// rgb24 video file vt.rgb.
+/// The frames are rendered here one after the other into the same frame
+/// buffer and encoded and written by numThreads background threads
+/// (0 = one per hardware thread).
+/// Returns 0 on success and -1 if any of the files could not be written.
+// ****************************************************************************
+
+int VocalTractLab::vtlSaveTractVideo(int numFrames, double* tractParams, const char *folderName,
+  FrameWriter::Format format, int numThreads)
+{
+  int i, frameIndex;
+  string fileName;
 
-  glutInit(&arg, argv);
-  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
-	glutInitWindowSize(400, 400); //Set the window size
-  glutCreateWindow("Test");
+  TractRenderer *r = vtlGetRenderer();
+  FrameWriter writer(r->getWidth(), r->getHeight(), format, numThreads);
 
-  for (int frameIndex = 0; frameIndex < numFrames; frameIndex++)
+  if (format == FrameWriter::RAW_VIDEO)
   {
-    string fileName(folderName);
-    fileName += "/vt" + to_string(frameIndex) + ".bmp";
-
-    cout << "Rendering frame #" << frameIndex << "..." << endl;
+    fileName = string(folderName) + "/vt.rgb";
+    if (writer.openVideo(fileName) == false)
+    {
+      return -1;
+    }
+  }
 
-    for (int i=0; i < VocalTract::NUM_PARAMS; i++)
+  for (frameIndex = 0; frameIndex < numFrames; frameIndex++)
+  {
+    for (i = 0; i < VocalTract::NUM_PARAMS; i++)
     {
-      vocalTract->param[i].x = *tractParams;
-      tractParams++;
+      vocalTract->param[i].x = tractParams[frameIndex*VocalTract::NUM_PARAMS + i];
     }
     vocalTract->calculateAll();
-    vtPicture->setVocalTract(vocalTract);
-
-    vtPicture->display();
-    GLint viewport[4];  //current viewport
-    glGetIntegerv(GL_VIEWPORT, viewport);  //get current viewport
+    r->render(vocalTract, viewOptions);
 
-    int w = viewport[2];
-    int h = viewport[3];
+    unsigned char *buffer = writer.getBuffer();
+    r->getImage(buffer);
 
-    unsigned char* imageData = (unsigned char *)malloc((int)(400*400*(3)));
-	  glReadPixels(0, 0, 400, 400, GL_BGR, GL_UNSIGNED_BYTE, imageData);
-    //write 
-    bitmap_image image(400,400);
-    image_drawer draw(image);
-
-    for (unsigned int i = 0; i < h; ++i)
+    if (format != FrameWriter::RAW_VIDEO)
     {
-      for (unsigned int j = 0; j < w; ++j)
-      {
-        image.set_pixel(j, h-1-i, *(imageData+2),*(imageData+1), *(imageData+3));
-        imageData += 3;
-      }
+      fileName = string(folderName) + "/vt" + to_string(frameIndex) + "." +
+        FrameWriter::getExtension(format);
     }
+    writer.submit(buffer, fileName, frameIndex);
+  }
+
+  if (writer.finish() == false)
+  {
+    return -1;
+  }
+  return 0;
+}
+
 
-    image.save_image(fileName);
-    cout << "Frame #" << frameIndex << " has stored in " << fileName << endl;
+// ****************************************************************************
+/// Returns the renderer for vtlSaveTractFrame() and vtlSaveTractVideo() with
+/// the size of the picture.
+// ****************************************************************************
+
+TractRenderer *VocalTractLab::vtlGetRenderer()
+{
+  if (renderer == NULL)
+  {
+    renderer = new TractRenderer(400, 400);
   }
-  
+  return renderer;
 }
 
 VocalTractLab* VTL_new(const char *speakerFileName) 
@@ -1,13 +1,20 @@
 #include <vector>
 #include <string>
 #include <new>  // For std::nothrow
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <functional>
 
+#include "SpeakerModel.h"
 #include "AnatomyParams.h"
 #include "VocalTract.h"
 #include "TdsModel.h"
 #include "TlModel.h"
 #include "Synthesizer.h"
-#include "VocalTractPicture.h"
+#include "TractRenderer.h"
+#include "FrameWriter.h"
 
 #include "GeometricGlottis.h"
 #include "TwoMassModel.h"
@@ -16,17 +23,61 @@
 
 using namespace std;
 
-enum GlottisModel
+// One utterance of a batch synthesis. The parameter buffers are row-major
+// (one row per frame) and audio must hold (numFrames-1)*frameStep_samples
+// samples.
+struct VtlSynthesisJob
 {
-  GEOMETRIC_GLOTTIS,
-  TWO_MASS_MODEL,
-  TRIANGULAR_GLOTTIS,
-  NUM_GLOTTIS_MODELS
+  double *tractParams;
+  double *glottisParams;
+  int numFrames;
+  int frameStep_samples;
+  double *audio;
 };
 
+// Snapshot of an incremental synthesis session (see vtlSaveSynthesisState()).
+// It may be restored any number of times into the instance that saved it or
+// into a clone of it.
+struct VtlSynthesisState
+{
+  shared_ptr<const SpeakerModel> speaker;
+  int selectedGlottis;
+  Synthesizer::State synthesizerState;
+};
+
+// Counters of the shape caches of an instance and its worker threads (see
+// vtlSetShapeCache()).
+struct VtlShapeCacheStats
+{
+  long long numHits;
+  long long numMisses;
+  int numEntries;
+  size_t numBytes;
+};
+
+// Counters of how the Cholesky factorizations of the acoustic simulation
+// were obtained in an instance and its worker threads (see
+// TdsModel::FactorizationStatistics).
+struct VtlFactorizationStats
+{
+  long long numFullFactorizations;
+  long long numPartialFactorizations;
+  long long numReusedFactorizations;
+  long long numFactorizedRows;
+};
+
+// ****************************************************************************
+/// All model state lives in the instance, so different instances may be used
+/// concurrently from different threads (one instance per thread).
+/// The immutable speaker data are shared by all instances of the same speaker
+/// (see SpeakerModel), so that vtlClone() is cheap.
+// ****************************************************************************
+
 class VocalTractLab
 {
   private:
+    shared_ptr<const SpeakerModel> speaker;
+
     Glottis *glottis[NUM_GLOTTIS_MODELS];
     int selectedGlottis;
 
@@ -35,16 +86,41 @@ class VocalTractLab
     Synthesizer *synthesizer;
     Tube *tube;
     AnatomyParams *anatomyParams;
-    VocalTractPicture *vtPicture;
+    TlModel *tlModel;
+    TractRenderer *renderer;
+    // The view of the vocal tract for vtlSaveTractFrame() and vtlSaveTractVideo().
+    TractViewOptions viewOptions;
+
+    // State of the incremental synthesis session (vtlBeginSynthesis() etc.).
+    bool synthesisSessionActive;
 
-    bool vtlLoadSpeaker(string speakerFileName, VocalTract *vocalTract,
-      Glottis *glottis[], int &selectedGlottis);
+    // Clones of this speaker for the worker threads of vtlSynthAudioBatch().
+    vector<VocalTractLab*> workers;
+
+    // Minimum number of frames per thread in vtlProcessFrames() and the
+    // number of frames the threads take at a time.
+    static const int MIN_FRAMES_PER_THREAD = 64;
+    static const int FRAMES_PER_CHUNK = 16;
+    // Maximum number of formants that TlModel::getFormants() can find.
+    static const int MAX_FORMANTS = 32;
+
+    VocalTractLab(shared_ptr<const SpeakerModel> speaker);
+    void vtlInitModels();
+    void vtlClearWorkers();
+    AnatomyParams *vtlGetAnatomyParamsObject();
+    TractRenderer *vtlGetRenderer();
     int vtlSynthesisReset();
+    template<int K> static void vtlSynthAudioLockstep(VocalTractLab **lanes,
+      vector<VtlSynthesisJob> &jobs, const vector<int> &order, atomic<int> &nextJob);
+    void vtlProcessFrames(int numFrames, int numThreads,
+      function<void (VocalTractLab*, int, int)> processChunk);
 
   public:
-    VocalTractLab(const string speakerFileName);
+    VocalTractLab(const string speakerFileName, int samplingRate_Hz = SAMPLING_RATE);
     ~VocalTractLab();
 
+    VocalTractLab *vtlClone();
+
     int vtlInitialize(const char *speakerFileName);
     int vtlClose();
     vector<double> vtlGetTractParamInfo();
@@ -54,12 +130,41 @@ class VocalTractLab
     vector<double> vtlGetAnatomyParams();
     vector<double> vtlSynthAudio(vector<double> tractParams, vector<double> glottisParams, int numFrames,
         int frameStep_samples);
+    int vtlSynthAudio(double *tractParams, double *glottisParams, int numFrames,
+        int frameStep_samples, double *audio);
+    int vtlGetNumGlottisParams();
+    int vtlSetSamplingRate(int samplingRate_Hz);
+    int vtlGetSamplingRate();
+    int vtlSetSolverType(TdsModel::SolverType solverType);
+    TdsModel::SolverType vtlGetSolverType();
+    int vtlSetNumGeometryThreads(int numThreads);
+    int vtlGetNumGeometryThreads();
+    int vtlSetShapeCache(size_t maxBytes, double quantization = 0.0);
+    int vtlClearShapeCache();
+    VtlShapeCacheStats vtlGetShapeCacheStats();
+    VtlFactorizationStats vtlGetFactorizationStats();
+    int vtlResetFactorizationStats();
+    int vtlSynthAudioBatch(vector<VtlSynthesisJob> &jobs, int numThreads = 0, int numLanes = 1);
+    int vtlBeginSynthesis();
+    int vtlPushFrame(double *tractParams, double *glottisParams, int numSamples, double *audio);
+    int vtlEndSynthesis();
+    int vtlSaveSynthesisState(VtlSynthesisState *state);
+    int vtlRestoreSynthesisState(const VtlSynthesisState *state);
     vector<double> vtlTract2EMA(vector<double> tractParams, int numFrames);
+    int vtlTract2EMA(double *tractParams, int numFrames, double *ema, int numThreads = 0);
+    int vtlGetNumEmaPoints();
+    int vtlTractToTube(double *tractParams, int numFrames,
+        double *tubeLength_cm, double *tubeArea_cm2, int *tubeArticulator,
+        double *incisorPos_cm, double *tongueTipSideElevation, double *velumOpening_cm2,
+        int numThreads = 0);
+    int vtlGetFormants(double *tractParams, int numFrames, int maxFormants,
+        double *formantFreq_Hz, double *formantBW_Hz, int *numFormants = NULL, int numThreads = 0);
     vector<string> vtlGetEMANames();
     int vtlExportTractSvg(vector<double> tractParams, const char *fileName, bool addCenterLine = false, bool addCutVectors = false);
 
     int vtlSaveTractFrame(double* tractParams, const char *fileName);
-    int vtlSaveTractVideo(int numFrames, double* tractParams, const char *folderName);
+    int vtlSaveTractVideo(int numFrames, double* tractParams, const char *folderName,
+        FrameWriter::Format format = FrameWriter::BMP, int numThreads = 0);
 };
 
 #ifdef __cplusplus
@@ -984,11 +984,8 @@ void VocalTractPicture::setControlPoint(int pointIndex, int screenX, int screenY
       rib = VocalTract::NUM_LARYNX_RIBS - 1;
       ribPoint = VocalTract::NUM_LOWER_COVER_POINTS - 1;
 
-      surface = &tract->surface[VocalTract::NARROW_LARYNX_FRONT];
-      narrowPoint = surface->getVertex(rib, ribPoint);
-
-      surface = &tract->surface[VocalTract::WIDE_LARYNX_FRONT];
-      widePoint = surface->getVertex(rib, ribPoint);
+      narrowPoint = tract->getReferenceSurface(VocalTract::NARROW_LARYNX_FRONT)->getVertex(rib, ribPoint);
+      widePoint = tract->getReferenceSurface(VocalTract::WIDE_LARYNX_FRONT)->getVertex(rib, ribPoint);
 
       double hyoidY = tract->surface[VocalTract::LOWER_COVER].getVertex(
         VocalTract::NUM_LARYNX_RIBS-1, VocalTract::NUM_LOWER_COVER_POINTS-1).y;
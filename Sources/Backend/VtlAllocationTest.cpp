@@ -0,0 +1,216 @@
+// ****************************************************************************
+// Checks that the synthesis into buffers of the caller does not allocate heap
+// memory per frame. The global operator new is replaced by a version that
+// counts the allocations.
+// - vtlSynthAudio() with an audio buffer of the caller must make the same
+//   number of allocations for a short and a long utterance (after a first
+//   call that initializes everything).
+// - vtlPushFrame() must not allocate at all after the first frames of a
+//   session.
+//
+// Usage: VtlAllocationTest <speaker file>
+// Returns 0 when all checks pass and 1 otherwise.
+// ****************************************************************************
+
+#include "VocalTractLabApi.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+static const int NUM_FRAMES = 200;
+static const int NUM_SHORT_FRAMES = 20;
+static const int FRAME_STEP_SAMPLES = 110;
+
+// ****************************************************************************
+// Counting replacement of the global operator new (all threads).
+// ****************************************************************************
+
+static atomic<long> numAllocations(0);
+
+void *operator new(size_t size)
+{
+  numAllocations++;
+  void *p = malloc(size > 0 ? size : 1);
+  if (p == NULL)
+  {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  free(p);
+}
+
+
+// ****************************************************************************
+/// Creates the parameters of an utterance: the tract parameters move around
+/// their neutral values, and the voice is switched on and off smoothly.
+// ****************************************************************************
+
+static void createUtterance(VocalTractLab &vtl, vector<double> &tractParams,
+  vector<double> &glottisParams)
+{
+  const int NUM_PARAMS = VocalTract::NUM_PARAMS;
+  vector<double> tractInfo = vtl.vtlGetTractParamInfo();
+  vector<double> glottisInfo = vtl.vtlGetGlottisParamInfo();
+  int numGlottisParams = (int)glottisInfo.size() / 3;
+  int i, k;
+  double min, max, t;
+  double *x;
+
+  tractParams.resize(NUM_FRAMES * NUM_PARAMS);
+  glottisParams.resize(NUM_FRAMES * numGlottisParams);
+
+  for (i = 0; i < NUM_FRAMES; i++)
+  {
+    t = (double)i / NUM_FRAMES;
+
+    for (k = 0; k < NUM_PARAMS; k++)
+    {
+      min = tractInfo[k];
+      max = tractInfo[k + NUM_PARAMS];
+      x = &tractParams[i*NUM_PARAMS + k];
+      *x = tractInfo[k + 2 * NUM_PARAMS] + 0.3 * (max - min) * sin(6.0 * M_PI * t + k);
+      if (*x < min) { *x = min; }
+      if (*x > max) { *x = max; }
+    }
+
+    for (k = 0; k < numGlottisParams; k++)
+    {
+      glottisParams[i*numGlottisParams + k] = glottisInfo[k + 2 * numGlottisParams];
+    }
+    // F0 and the subglottal pressure.
+    glottisParams[i*numGlottisParams + 0] = 120.0;
+    glottisParams[i*numGlottisParams + 1] = 8000.0 * sin(M_PI * t);
+  }
+}
+
+
+// ****************************************************************************
+/// Returns the number of allocations of vtlSynthAudio() for the first
+/// numFrames frames of the utterance.
+// ****************************************************************************
+
+static long countSynthAudio(VocalTractLab &vtl, vector<double> &tractParams,
+  vector<double> &glottisParams, int numFrames, vector<double> &audio)
+{
+  long start = numAllocations;
+  if (vtl.vtlSynthAudio(&tractParams[0], &glottisParams[0], numFrames,
+    FRAME_STEP_SAMPLES, &audio[0]) != 0)
+  {
+    throw runtime_error("vtlSynthAudio() failed.");
+  }
+  return numAllocations - start;
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s <speaker file>\n", argv[0]);
+    return 1;
+  }
+
+  bool ok = true;
+  int i;
+
+  try
+  {
+    VocalTractLab vtl(argv[1]);
+    vector<double> tractParams;
+    vector<double> glottisParams;
+    vector<double> audio((NUM_FRAMES - 1) * FRAME_STEP_SAMPLES);
+    int numGlottisParams = vtl.vtlGetNumGlottisParams();
+
+    createUtterance(vtl, tractParams, glottisParams);
+
+    // Make sure that the allocations are really counted.
+    long start = numAllocations;
+    delete new int(0);
+    if (numAllocations == start)
+    {
+      throw runtime_error("The allocations are not counted.");
+    }
+
+    // The first call initializes the models.
+    countSynthAudio(vtl, tractParams, glottisParams, NUM_FRAMES, audio);
+
+    long numShort = countSynthAudio(vtl, tractParams, glottisParams, NUM_SHORT_FRAMES, audio);
+    long numLong = countSynthAudio(vtl, tractParams, glottisParams, NUM_FRAMES, audio);
+
+    printf("vtlSynthAudio(): %ld allocations for %d frames, %ld for %d frames.\n",
+      numShort, NUM_SHORT_FRAMES, numLong, NUM_FRAMES);
+    if (numLong != numShort)
+    {
+      printf("FAILED: vtlSynthAudio() allocates memory per frame.\n");
+      ok = false;
+    }
+
+    // The incremental synthesis: the first two frames start the session.
+
+    if ((vtl.vtlBeginSynthesis() != 0) ||
+      (vtl.vtlPushFrame(&tractParams[0], &glottisParams[0], FRAME_STEP_SAMPLES, &audio[0]) < 0) ||
+      (vtl.vtlPushFrame(&tractParams[VocalTract::NUM_PARAMS], &glottisParams[numGlottisParams],
+        FRAME_STEP_SAMPLES, &audio[0]) < 0))
+    {
+      throw runtime_error("The synthesis session could not be started.");
+    }
+
+    start = numAllocations;
+    for (i = 2; i < NUM_FRAMES; i++)
+    {
+      vtl.vtlPushFrame(&tractParams[i*VocalTract::NUM_PARAMS], &glottisParams[i*numGlottisParams],
+        FRAME_STEP_SAMPLES, &audio[(i - 1)*FRAME_STEP_SAMPLES]);
+    }
+    long numPush = numAllocations - start;
+    vtl.vtlEndSynthesis();
+
+    printf("vtlPushFrame(): %ld allocations for %d frames.\n", numPush, NUM_FRAMES - 2);
+    if (numPush != 0)
+    {
+      printf("FAILED: vtlPushFrame() allocates memory.\n");
+      ok = false;
+    }
+  }
+  catch (const exception &e)
+  {
+    printf("FAILED: %s\n", e.what());
+    return 1;
+  }
+
+  printf(ok ? "All checks passed.\n" : "Some checks FAILED.\n");
+  return ok ? 0 : 1;
+}
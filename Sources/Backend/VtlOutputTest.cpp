@@ -0,0 +1,198 @@
+// ****************************************************************************
+// Pins the synthesized audio of a fixed utterance:
+// - Tube::operator=() must copy the dimensions of the static parts of the
+//   tube (subglottal system, nasal cavity and piriform fossae), so that a
+//   copied tube keeps the speaker's dimensions.
+// - Selected samples and the energy of the utterance must match the
+//   reference values below, which were calculated with this behaviour.
+//   Before, the synthesizer interpolated the piriform fossae within every
+//   frame from the default dimensions to the speaker's, and the pinned
+//   samples differed by up to 3.6e-4 (energy 0.15519 instead of 0.15415).
+//
+// Usage: VtlOutputTest <speaker file>
+// Returns 0 when all checks pass and 1 otherwise. When the output changes on
+// purpose, the printed values are the new reference values.
+// ****************************************************************************
+
+#include "VocalTractLabApi.h"
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+static const int NUM_FRAMES = 60;
+static const int FRAME_STEP_SAMPLES = 110;
+
+static const int NUM_PINNED_SAMPLES = 8;
+static const int PINNED_SAMPLE_INDEX[NUM_PINNED_SAMPLES] =
+{
+  500, 1200, 2000, 2800, 3500, 4300, 5100, 6000
+};
+
+static const double REFERENCE_SAMPLE[NUM_PINNED_SAMPLES] =
+{
+  0.0055823301689268212, 0.01217520961286697, -0.0030582779103647435,
+  0.000762480580809059, -0.0011228395246483756, -0.001418391480927095,
+  0.00028828475443206248, -2.822912990174477e-05
+};
+static const double REFERENCE_ENERGY = 0.15415057431304852;
+
+// Max. difference to the reference samples relative to the peak, and max.
+// relative difference to the reference energy. They allow for rounding
+// differences between compilers and math libraries.
+static const double MAX_RELATIVE_SAMPLE_DIFFERENCE = 1e-6;
+static const double MAX_RELATIVE_ENERGY_DIFFERENCE = 1e-6;
+
+
+// ****************************************************************************
+/// Checks that a copy of the tube of the neutral vocal tract has the same
+/// static dimensions as the original.
+// ****************************************************************************
+
+static bool checkTubeCopy(const string &speakerFileName)
+{
+  shared_ptr<const SpeakerModel> speaker = SpeakerModel::load(speakerFileName);
+  if (!speaker)
+  {
+    throw runtime_error("The speaker file could not be loaded.");
+  }
+
+  unique_ptr<VocalTract> tract(speaker->createVocalTract());
+  Tube tube;
+  Tube copy;
+  double original[4];
+  double copied[4];
+  int i;
+
+  tract->calculateAll();
+  tract->getTube(&tube);
+  copy = tube;
+
+  tube.getStaticTubeDimensions(original[0], original[1], original[2], original[3]);
+  copy.getStaticTubeDimensions(copied[0], copied[1], copied[2], copied[3]);
+
+  for (i = 0; i < 4; i++)
+  {
+    if (copied[i] != original[i])
+    {
+      printf("FAILED: Static tube dimension %d is %f in the copy and %f in the original.\n",
+        i, copied[i], original[i]);
+      return false;
+    }
+  }
+
+  printf("The tube copy has the static dimensions %.2f cm, %.2f cm, %.2f cm, %.2f cm^3.\n",
+    copied[0], copied[1], copied[2], copied[3]);
+  return true;
+}
+
+
+// ****************************************************************************
+/// Synthesizes the fixed utterance: the tract parameters move around their
+/// neutral values, and the voice is switched on and off smoothly.
+// ****************************************************************************
+
+static vector<double> synthesizeUtterance(VocalTractLab &vtl)
+{
+  const int NUM_PARAMS = VocalTract::NUM_PARAMS;
+  vector<double> tractInfo = vtl.vtlGetTractParamInfo();
+  vector<double> glottisInfo = vtl.vtlGetGlottisParamInfo();
+  int numGlottisParams = (int)glottisInfo.size() / 3;
+  vector<double> tractParams(NUM_FRAMES * NUM_PARAMS);
+  vector<double> glottisParams(NUM_FRAMES * numGlottisParams);
+  int i, k;
+  double min, max, t;
+  double *x;
+
+  for (i = 0; i < NUM_FRAMES; i++)
+  {
+    t = (double)i / NUM_FRAMES;
+
+    for (k = 0; k < NUM_PARAMS; k++)
+    {
+      min = tractInfo[k];
+      max = tractInfo[k + NUM_PARAMS];
+      x = &tractParams[i*NUM_PARAMS + k];
+      *x = tractInfo[k + 2 * NUM_PARAMS] + 0.3 * (max - min) * sin(2.0 * M_PI * t + k);
+      if (*x < min) { *x = min; }
+      if (*x > max) { *x = max; }
+    }
+
+    for (k = 0; k < numGlottisParams; k++)
+    {
+      glottisParams[i*numGlottisParams + k] = glottisInfo[k + 2 * numGlottisParams];
+    }
+    // F0 and the subglottal pressure.
+    glottisParams[i*numGlottisParams + 0] = 120.0;
+    glottisParams[i*numGlottisParams + 1] = 8000.0 * sin(M_PI * t);
+  }
+
+  return vtl.vtlSynthAudio(tractParams, glottisParams, NUM_FRAMES, FRAME_STEP_SAMPLES);
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s <speaker file>\n", argv[0]);
+    return 1;
+  }
+
+  bool ok = true;
+  int i;
+
+  try
+  {
+    ok = checkTubeCopy(argv[1]);
+
+    VocalTractLab vtl(argv[1]);
+    vector<double> audio = synthesizeUtterance(vtl);
+
+    double peak = 0.0;
+    double energy = 0.0;
+    for (i = 0; i < (int)audio.size(); i++)
+    {
+      if (fabs(audio[i]) > peak) { peak = fabs(audio[i]); }
+      energy += audio[i] * audio[i];
+    }
+
+    if (audio.size() <= (size_t)PINNED_SAMPLE_INDEX[NUM_PINNED_SAMPLES - 1])
+    {
+      throw runtime_error("The utterance is too short.");
+    }
+
+    for (i = 0; i < NUM_PINNED_SAMPLES; i++)
+    {
+      double x = audio[PINNED_SAMPLE_INDEX[i]];
+      printf("Sample %d: %.17g\n", PINNED_SAMPLE_INDEX[i], x);
+      if (fabs(x - REFERENCE_SAMPLE[i]) > MAX_RELATIVE_SAMPLE_DIFFERENCE * peak)
+      {
+        printf("FAILED: The sample should be %.17g.\n", REFERENCE_SAMPLE[i]);
+        ok = false;
+      }
+    }
+
+    printf("Energy: %.17g\n", energy);
+    if (fabs(energy - REFERENCE_ENERGY) > MAX_RELATIVE_ENERGY_DIFFERENCE * REFERENCE_ENERGY)
+    {
+      printf("FAILED: The energy should be %.17g.\n", REFERENCE_ENERGY);
+      ok = false;
+    }
+  }
+  catch (const exception &e)
+  {
+    printf("FAILED: %s\n", e.what());
+    return 1;
+  }
+
+  printf(ok ? "All checks passed.\n" : "Some checks FAILED.\n");
+  return ok ? 0 : 1;
+}
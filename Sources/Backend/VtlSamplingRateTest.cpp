@@ -0,0 +1,369 @@
+// ****************************************************************************
+// Checks the synthesis at different sampling rates (see
+// VocalTractLab::vtlSetSamplingRate()):
+// - The formants of the static vowels /a/, /i/ and /u/, synthesized at 16,
+//   22.05 and 44.1 kHz, must agree. They are estimated by linear prediction
+//   after the audio was resampled to 10 kHz. At low rates the TDS model
+//   shifts the formants a bit (F3 by up to 8 % at 16 kHz), so the tolerance
+//   is rather large. A wrong scaling with the sampling rate would shift the
+//   formants much more.
+// - At 44.1 kHz, the audio must be bit-identical for an instance created
+//   with the default rate, an instance created with 44100 Hz, an instance
+//   that was switched to 16 kHz and back, and a clone. (VtlOutputTest pins
+//   the absolute output at this rate.)
+// The formants of the transmission-line model are printed for comparison.
+//
+// Usage: VtlSamplingRateTest <speaker file>
+// Returns 0 when all checks pass and 1 otherwise.
+// ****************************************************************************
+
+#include "VocalTractLabApi.h"
+
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+static const int NUM_RATES = 3;
+static const int SAMPLING_RATES[NUM_RATES] = { 16000, 22050, 44100 };
+static const int REFERENCE_RATE_INDEX = 2;
+
+static const int NUM_VOWELS = 3;
+static const char *VOWELS[NUM_VOWELS] = { "a", "i", "u" };
+
+static const int NUM_FORMANTS = 3;
+// Max. difference to the formants at 44.1 kHz relative to those.
+static const double MAX_RELATIVE_FORMANT_DIFFERENCE = 0.12;
+
+// The audio is analyzed at this rate between 0.2 s and 0.5 s.
+static const int ANALYSIS_RATE = 10000;
+static const double ANALYSIS_START_S = 0.2;
+static const double ANALYSIS_END_S = 0.5;
+static const double MAX_FORMANT_FREQ = 4500.0;
+
+// Parameters of the synthesis: 10 ms frames and 0.6 s per vowel.
+static const int NUM_FRAMES = 61;
+static const double F0 = 110.0;
+static const double LUNG_PRESSURE_DPA = 8000.0;
+
+
+// ****************************************************************************
+/// Returns the tract parameters of the shape with the given name.
+// ****************************************************************************
+
+static vector<double> getShapeParams(const SpeakerModel &speaker, const string &name)
+{
+  int i;
+
+  for (i = 0; i < (int)speaker.shapes.size(); i++)
+  {
+    if (speaker.shapes[i].name == name)
+    {
+      return vector<double>(speaker.shapes[i].param,
+        speaker.shapes[i].param + VocalTract::NUM_PARAMS);
+    }
+  }
+  throw runtime_error("The speaker has no shape " + name + ".");
+}
+
+
+// ****************************************************************************
+/// Synthesizes the static vowel with the given tract parameters for 0.6 s.
+/// The voice starts within the first 50 ms.
+// ****************************************************************************
+
+static vector<double> synthesizeVowel(VocalTractLab &vtl, const vector<double> &shape)
+{
+  vector<double> glottisInfo = vtl.vtlGetGlottisParamInfo();
+  int numGlottisParams = (int)glottisInfo.size() / 3;
+  vector<double> tractParams;
+  vector<double> glottisParams;
+  int i, k;
+
+  for (i = 0; i < NUM_FRAMES; i++)
+  {
+    tractParams.insert(tractParams.end(), shape.begin(), shape.end());
+    for (k = 0; k < numGlottisParams; k++)
+    {
+      glottisParams.push_back(glottisInfo[k + 2 * numGlottisParams]);
+    }
+    // F0 and the subglottal pressure.
+    glottisParams[i*numGlottisParams + 0] = F0;
+    glottisParams[i*numGlottisParams + 1] = (i < 5) ? LUNG_PRESSURE_DPA * i / 5.0 : LUNG_PRESSURE_DPA;
+  }
+
+  return vtl.vtlSynthAudio(tractParams, glottisParams, NUM_FRAMES, vtl.vtlGetSamplingRate() / 100);
+}
+
+
+// ****************************************************************************
+/// Resamples the section of x between the given times from the rate fs to
+/// ANALYSIS_RATE with a windowed sinc lowpass filter at MAX_FORMANT_FREQ.
+// ****************************************************************************
+
+static vector<double> resample(const vector<double> &x, int fs, double start_s, double end_s)
+{
+  const int HALF_WIDTH = 64;
+  const double cutoff = MAX_FORMANT_FREQ / fs;
+  int first = (int)(start_s * ANALYSIS_RATE);
+  int n = (int)((end_s - start_s) * ANALYSIS_RATE);
+  vector<double> y(n);
+  int i, k, center;
+  double t, d, h, w, sum;
+
+  for (i = 0; i < n; i++)
+  {
+    t = (double)(first + i) * fs / ANALYSIS_RATE;
+    center = (int)t;
+    sum = 0.0;
+    for (k = center - HALF_WIDTH; k <= center + HALF_WIDTH; k++)
+    {
+      if ((k < 0) || (k >= (int)x.size()))
+      {
+        continue;
+      }
+      d = t - k;
+      h = (d == 0.0) ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * d) / (M_PI * d);
+      w = 0.5 + 0.5 * cos(M_PI * d / (HALF_WIDTH + 1));
+      sum += x[k] * h * w;
+    }
+    y[i] = sum;
+  }
+
+  return y;
+}
+
+
+// ****************************************************************************
+/// Estimates the formants of the section of the audio signal x (rate fs)
+/// between ANALYSIS_START_S and ANALYSIS_END_S as the peaks of the LPC
+/// spectrum (autocorrelation method with pre-emphasis and a Hamming window).
+// ****************************************************************************
+
+static vector<double> estimateFormants(const vector<double> &x, int fs)
+{
+  const int ORDER = 2 + ANALYSIS_RATE / 1000;
+  const double FREQ_STEP = 1.0;
+  const double MIN_FORMANT_FREQ = 150.0;
+  vector<double> y = resample(x, fs, ANALYSIS_START_S, ANALYSIS_END_S);
+  int n = (int)y.size();
+  vector<double> s(n, 0.0);
+  vector<double> r(ORDER + 1, 0.0);
+  vector<double> a(ORDER + 1, 0.0);
+  vector<double> prevA;
+  vector<double> formants;
+  double error, k, f, m, prevM, prevPrevM;
+  complex<double> sum;
+  int i, j;
+
+  for (i = 1; i < n; i++)
+  {
+    s[i] = (y[i] - 0.97 * y[i - 1]) * (0.54 - 0.46 * cos(2.0 * M_PI * i / (n - 1)));
+  }
+
+  for (j = 0; j <= ORDER; j++)
+  {
+    for (i = j; i < n; i++)
+    {
+      r[j] += s[i] * s[i - j];
+    }
+  }
+
+  // Levinson-Durbin recursion.
+  a[0] = 1.0;
+  error = r[0];
+  for (i = 1; i <= ORDER; i++)
+  {
+    k = r[i];
+    for (j = 1; j < i; j++)
+    {
+      k += a[j] * r[i - j];
+    }
+    k = -k / error;
+    prevA = a;
+    for (j = 1; j < i; j++)
+    {
+      a[j] = prevA[j] + k * prevA[i - j];
+    }
+    a[i] = k;
+    error *= 1.0 - k * k;
+  }
+
+  // Peaks of the spectral envelope 1/|A|.
+  prevM = 0.0;
+  prevPrevM = 0.0;
+  for (f = 0.0; f < MAX_FORMANT_FREQ; f += FREQ_STEP)
+  {
+    sum = 0.0;
+    for (j = 0; j <= ORDER; j++)
+    {
+      sum += a[j] * exp(complex<double>(0.0, -2.0 * M_PI * f / ANALYSIS_RATE * j));
+    }
+    m = -log(abs(sum));
+    if ((f >= 2.0 * FREQ_STEP) && (prevM > prevPrevM) && (prevM > m) && (f > MIN_FORMANT_FREQ))
+    {
+      formants.push_back(f - FREQ_STEP);
+    }
+    prevPrevM = prevM;
+    prevM = m;
+  }
+
+  return formants;
+}
+
+
+// ****************************************************************************
+/// Checks the formants of the vowels at all sampling rates.
+// ****************************************************************************
+
+static bool checkFormants(const string &speakerFileName, const SpeakerModel &speaker)
+{
+  double formants[NUM_RATES][NUM_FORMANTS];
+  double tlFormant_Hz[NUM_FORMANTS];
+  double tlBandwidth_Hz[NUM_FORMANTS];
+  double d;
+  bool ok = true;
+  int i, k, v;
+
+  for (v = 0; v < NUM_VOWELS; v++)
+  {
+    vector<double> shape = getShapeParams(speaker, VOWELS[v]);
+
+    for (i = 0; i < NUM_RATES; i++)
+    {
+      VocalTractLab vtl(speakerFileName, SAMPLING_RATES[i]);
+      vector<double> f = estimateFormants(synthesizeVowel(vtl, shape), SAMPLING_RATES[i]);
+      if ((int)f.size() < NUM_FORMANTS)
+      {
+        printf("FAILED: Only %d formants were found for /%s/ at %d Hz.\n",
+          (int)f.size(), VOWELS[v], SAMPLING_RATES[i]);
+        return false;
+      }
+      for (k = 0; k < NUM_FORMANTS; k++)
+      {
+        formants[i][k] = f[k];
+      }
+    }
+
+    VocalTractLab vtl(speakerFileName);
+    vtl.vtlGetFormants(&shape[0], 1, NUM_FORMANTS, tlFormant_Hz, tlBandwidth_Hz);
+    printf("/%s/ TL model : %6.0f %6.0f %6.0f Hz\n", VOWELS[v],
+      tlFormant_Hz[0], tlFormant_Hz[1], tlFormant_Hz[2]);
+
+    for (i = 0; i < NUM_RATES; i++)
+    {
+      printf("/%s/ %5d Hz: %6.0f %6.0f %6.0f Hz\n", VOWELS[v], SAMPLING_RATES[i],
+        formants[i][0], formants[i][1], formants[i][2]);
+
+      for (k = 0; k < NUM_FORMANTS; k++)
+      {
+        d = fabs(formants[i][k] - formants[REFERENCE_RATE_INDEX][k]) /
+          formants[REFERENCE_RATE_INDEX][k];
+        if (d > MAX_RELATIVE_FORMANT_DIFFERENCE)
+        {
+          printf("FAILED: F%d differs by %.0f %% from the one at %d Hz.\n", k + 1,
+            100.0 * d, SAMPLING_RATES[REFERENCE_RATE_INDEX]);
+          ok = false;
+        }
+      }
+    }
+  }
+
+  return ok;
+}
+
+
+// ****************************************************************************
+/// Checks that the audio at 44.1 kHz does not depend on how the rate was
+/// set.
+// ****************************************************************************
+
+static bool checkDefaultRate(const string &speakerFileName, const SpeakerModel &speaker)
+{
+  vector<double> shape = getShapeParams(speaker, VOWELS[0]);
+  VocalTractLab defaultRate(speakerFileName);
+  VocalTractLab explicitRate(speakerFileName, 44100);
+  VocalTractLab switchedRate(speakerFileName, 16000);
+  bool ok = true;
+  int i;
+
+  if (defaultRate.vtlGetSamplingRate() != 44100)
+  {
+    printf("FAILED: The default sampling rate is %d Hz.\n", defaultRate.vtlGetSamplingRate());
+    return false;
+  }
+
+  // Synthesize at 16 kHz first, so that the models really change the rate.
+  synthesizeVowel(switchedRate, shape);
+  switchedRate.vtlSetSamplingRate(44100);
+  unique_ptr<VocalTractLab> clone(switchedRate.vtlClone());
+
+  vector<double> reference = synthesizeVowel(defaultRate, shape);
+  vector<double> audio[3] =
+  {
+    synthesizeVowel(explicitRate, shape),
+    synthesizeVowel(switchedRate, shape),
+    synthesizeVowel(*clone, shape)
+  };
+  const char *names[3] = { "created with 44100 Hz", "switched back to 44100 Hz", "clone" };
+
+  for (i = 0; i < 3; i++)
+  {
+    if ((audio[i].size() != reference.size()) ||
+      (memcmp(&audio[i][0], &reference[0], reference.size() * sizeof(double)) != 0))
+    {
+      printf("FAILED: The audio of the instance %s differs from the default.\n", names[i]);
+      ok = false;
+    }
+  }
+
+  if (ok)
+  {
+    printf("The audio at 44100 Hz is bit-identical for all instances (%d samples).\n",
+      (int)reference.size());
+  }
+  return ok;
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s <speaker file>\n", argv[0]);
+    return 1;
+  }
+
+  bool ok = true;
+
+  try
+  {
+    shared_ptr<const SpeakerModel> speaker = SpeakerModel::load(argv[1]);
+    if (!speaker)
+    {
+      throw runtime_error("The speaker file could not be loaded.");
+    }
+
+    ok = checkFormants(argv[1], *speaker);
+    if (checkDefaultRate(argv[1], *speaker) == false)
+    {
+      ok = false;
+    }
+  }
+  catch (const exception &e)
+  {
+    printf("FAILED: %s\n", e.what());
+    return 1;
+  }
+
+  printf(ok ? "All checks passed.\n" : "Some checks FAILED.\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,392 @@
+// ****************************************************************************
+// Checks the tree elimination solver of TdsModel against the Cholesky
+// factorization:
+// - In each time step of an acoustic simulation, both solvers must give the
+//   same solution of the system of equations up to rounding errors.
+// - Utterances synthesized with both solvers (see 
+//   VocalTractLab::vtlSetSolverType()) must agree closely. The rounding
+//   errors grow over time here, because the glottis and the noise sources
+//   feed the flow back into the model.
+// - The batch synthesis in lockstep lanes must give the same samples with
+//   the tree elimination as the synthesis one utterance at a time.
+// - The counters of the Cholesky factorizations (see
+//   VocalTractLab::vtlGetFactorizationStats()) must count the time steps of
+//   the synthesis one utterance at a time and in lockstep lanes, and they
+//   must be reset by vtlResetFactorizationStats().
+// The time per sample of both solvers is printed.
+//
+// Usage: VtlSolverTest <speaker file>
+// Returns 0 when all checks pass and 1 otherwise.
+// ****************************************************************************
+
+#include "VocalTractLabApi.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+static const int NUM_UTTERANCES = 4;
+static const int NUM_FRAMES = 100;
+static const int FRAME_STEP_SAMPLES = 110;
+
+static const int NUM_TIME_STEPS = 20000;
+
+// Max. difference between the solutions of one time step relative to the
+// largest flow.
+static const double MAX_RELATIVE_SOLUTION_DIFFERENCE = 1e-12;
+// Max. difference between the synthesized waveforms relative to their peak.
+static const double MAX_RELATIVE_AUDIO_DIFFERENCE = 1e-4;
+
+// ****************************************************************************
+/// The parameters of one utterance.
+// ****************************************************************************
+
+struct Utterance
+{
+  vector<double> tractParams;
+  vector<double> glottisParams;
+};
+
+
+// ****************************************************************************
+/// Creates the parameter trajectories of the utterance with the given index:
+/// the tract parameters move around their neutral values with a different
+/// speed for each utterance, and the voice is switched on and off smoothly.
+// ****************************************************************************
+
+static void createUtterance(VocalTractLab &vtl, int index, Utterance &u)
+{
+  const int NUM_PARAMS = VocalTract::NUM_PARAMS;
+  vector<double> tractInfo = vtl.vtlGetTractParamInfo();
+  vector<double> glottisInfo = vtl.vtlGetGlottisParamInfo();
+  int numGlottisParams = (int)glottisInfo.size() / 3;
+  int i, k;
+  double min, max, t;
+  double *x;
+
+  u.tractParams.resize(NUM_FRAMES * NUM_PARAMS);
+  u.glottisParams.resize(NUM_FRAMES * numGlottisParams);
+
+  for (i = 0; i < NUM_FRAMES; i++)
+  {
+    t = (double)i / NUM_FRAMES;
+
+    for (k = 0; k < NUM_PARAMS; k++)
+    {
+      min = tractInfo[k];
+      max = tractInfo[k + NUM_PARAMS];
+      x = &u.tractParams[i*NUM_PARAMS + k];
+      *x = tractInfo[k + 2 * NUM_PARAMS] +
+        0.3 * (max - min) * sin(2.0 * M_PI * (1.0 + 0.5 * index) * t + k);
+      if (*x < min) { *x = min; }
+      if (*x > max) { *x = max; }
+    }
+
+    for (k = 0; k < numGlottisParams; k++)
+    {
+      u.glottisParams[i*numGlottisParams + k] = glottisInfo[k + 2 * numGlottisParams];
+    }
+    // F0 and the subglottal pressure.
+    u.glottisParams[i*numGlottisParams + 0] = 110.0 + 15.0 * index;
+    u.glottisParams[i*numGlottisParams + 1] = 8000.0 * sin(M_PI * t);
+  }
+}
+
+
+// ****************************************************************************
+/// Runs an acoustic simulation with a voiced glottis and a moving vocal tract.
+/// Each time step is calculated with both solvers from the same state (see
+/// TdsModel::saveMotionState()), and the largest difference between the two
+/// solutions relative to the largest flow is returned.
+// ****************************************************************************
+
+static double compareTimeSteps(const string &speakerFileName)
+{
+  const int N = TdsModel::NUM_BRANCH_CURRENTS;
+  shared_ptr<const SpeakerModel> speaker = SpeakerModel::load(speakerFileName);
+  if (!speaker)
+  {
+    throw runtime_error("The speaker file could not be loaded.");
+  }
+
+  unique_ptr<VocalTract> tract(speaker->createVocalTract());
+  unique_ptr<Glottis> glottis(speaker->createGlottis(speaker->selectedGlottis));
+  unique_ptr<TdsModel> model(new TdsModel());
+  Tube tube;
+  double length_cm[Tube::NUM_GLOTTIS_SECTIONS];
+  double area_cm2[Tube::NUM_GLOTTIS_SECTIONS];
+  double pressure_dPa[4];
+  double mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s;
+  unique_ptr<TdsModel::MotionState> state(new TdsModel::MotionState());
+  double flow[N];
+  double maxFlow, maxDifference;
+  double maxRelativeDifference = 0.0;
+  int i, j, k;
+
+  for (k = 0; k < (int)glottis->controlParam.size(); k++)
+  {
+    glottis->controlParam[k].x = glottis->controlParam[k].neutral;
+  }
+  glottis->controlParam[Glottis::PRESSURE].x = 8000.0;
+
+  for (i = 0; i < NUM_TIME_STEPS; i++)
+  {
+    // A new vocal tract shape every 1000 samples.
+    if ((i % 1000) == 0)
+    {
+      for (k = 0; k < VocalTract::NUM_PARAMS; k++)
+      {
+        VocalTract::Param *param = &tract->param[k];
+        param->x = param->neutral + 0.3 * (param->max - param->min) * sin(0.001 * i + k);
+        if (param->x < param->min) { param->x = param->min; }
+        if (param->x > param->max) { param->x = param->max; }
+        param->limitedX = param->x;
+      }
+      tract->calculateAll();
+      tract->getTube(&tube);
+    }
+
+    glottis->calcGeometry();
+    glottis->getTubeData(length_cm, area_cm2);
+    tube.setGlottisGeometry(length_cm, area_cm2);
+    tube.setAspirationStrength(glottis->getAspirationStrength_dB());
+
+    model->setTube(&tube, i > 0);
+    model->setFlowSource(0.0, -1);
+    model->setPressureSource(glottis->controlParam[Glottis::PRESSURE].x, Tube::FIRST_TRACHEA_SECTION);
+
+    pressure_dPa[0] = model->getSectionPressure(Tube::LAST_TRACHEA_SECTION);
+    pressure_dPa[1] = model->getSectionPressure(Tube::LOWER_GLOTTIS_SECTION);
+    pressure_dPa[2] = model->getSectionPressure(Tube::UPPER_GLOTTIS_SECTION);
+    pressure_dPa[3] = model->getSectionPressure(Tube::FIRST_PHARYNX_SECTION);
+    glottis->incTime(model->timeStep, pressure_dPa);
+
+    model->saveMotionState(*state);
+    model->options.solverType = TdsModel::CHOLESKY_FACTORIZATION;
+    model->proceedTimeStep(mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s);
+
+    maxFlow = 0.0;
+    for (j = 0; j < N; j++)
+    {
+      flow[j] = model->flowVector[j];
+      maxFlow = fmax(maxFlow, fabs(flow[j]));
+    }
+
+    // The same step again with the tree elimination (the simulation 
+    // continues from its result).
+
+    model->restoreMotionState(*state);
+    model->options.solverType = TdsModel::TREE_ELIMINATION;
+    model->proceedTimeStep(mouthFlow_cm3_s, nostrilFlow_cm3_s, skinFlow_cm3_s);
+
+    maxDifference = 0.0;
+    for (j = 0; j < N; j++)
+    {
+      maxDifference = fmax(maxDifference, fabs(model->flowVector[j] - flow[j]));
+    }
+
+    if (maxFlow > 0.0)
+    {
+      maxRelativeDifference = fmax(maxRelativeDifference, maxDifference / maxFlow);
+    }
+  }
+
+  return maxRelativeDifference;
+}
+
+
+// ****************************************************************************
+/// Synthesizes all utterances, one after the other or with vtlSynthAudioBatch()
+/// in lockstep lanes, and returns the time per sample in ns.
+// ****************************************************************************
+
+static double synthesize(VocalTractLab &vtl, vector<Utterance> &utterances,
+  vector<vector<double> > &audio, int numLanes)
+{
+  int i;
+  int numSamples = (NUM_FRAMES - 1) * FRAME_STEP_SAMPLES;
+  vector<VtlSynthesisJob> jobs(utterances.size());
+
+  audio.assign(utterances.size(), vector<double>(numSamples, 0.0));
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  if (numLanes < 2)
+  {
+    for (i = 0; i < (int)utterances.size(); i++)
+    {
+      vtl.vtlSynthAudio(&utterances[i].tractParams[0], &utterances[i].glottisParams[0],
+        NUM_FRAMES, FRAME_STEP_SAMPLES, &audio[i][0]);
+    }
+  }
+  else
+  {
+    for (i = 0; i < (int)utterances.size(); i++)
+    {
+      jobs[i].tractParams = &utterances[i].tractParams[0];
+      jobs[i].glottisParams = &utterances[i].glottisParams[0];
+      jobs[i].numFrames = NUM_FRAMES;
+      jobs[i].frameStep_samples = FRAME_STEP_SAMPLES;
+      jobs[i].audio = &audio[i][0];
+    }
+    vtl.vtlSynthAudioBatch(jobs, 1, numLanes);
+  }
+
+  double duration_ns = (double)chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start).count();
+
+  return duration_ns / ((double)utterances.size() * numSamples);
+}
+
+
+// ****************************************************************************
+/// Prints the counters of the Cholesky factorizations and returns the number
+/// of solved systems of equations.
+// ****************************************************************************
+
+static long long printFactorizationStats(VocalTractLab &vtl, const char *title)
+{
+  VtlFactorizationStats stats = vtl.vtlGetFactorizationStats();
+  long long numSolutions = stats.numFullFactorizations + stats.numPartialFactorizations +
+    stats.numReusedFactorizations;
+
+  printf("%s: %lld full, %lld partial, %lld reused factorizations, %.1f rows per solution\n",
+    title, stats.numFullFactorizations, stats.numPartialFactorizations,
+    stats.numReusedFactorizations,
+    (numSolutions > 0) ? (double)stats.numFactorizedRows / numSolutions : 0.0);
+
+  if ((stats.numFactorizedRows < 0) ||
+    (stats.numFactorizedRows > numSolutions * TdsModel::NUM_BRANCH_CURRENTS))
+  {
+    return -1;
+  }
+  return numSolutions;
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s <speaker file>\n", argv[0]);
+    return 1;
+  }
+
+  int i, k;
+  int numFailures = 0;
+
+  try
+  {
+    double stepDifference = compareTimeSteps(argv[1]);
+    printf("Time steps: max. relative difference of the solutions %g\n", stepDifference);
+    if (stepDifference > MAX_RELATIVE_SOLUTION_DIFFERENCE)
+    {
+      printf("The tree elimination solves the systems of equations differently.\n");
+      numFailures++;
+    }
+
+    VocalTractLab vtl(argv[1]);
+    vector<Utterance> utterances(NUM_UTTERANCES);
+    vector<vector<double> > choleskyAudio, choleskyBatchAudio, treeAudio, treeBatchAudio;
+    long long numSolutions;
+
+    for (i = 0; i < NUM_UTTERANCES; i++)
+    {
+      createUtterance(vtl, i, utterances[i]);
+    }
+
+    if (vtl.vtlSetSolverType(TdsModel::NUM_SOLVER_TYPES) != -1)
+    {
+      printf("An invalid solver type was accepted.\n");
+      numFailures++;
+    }
+
+    vtl.vtlSetSolverType(TdsModel::CHOLESKY_FACTORIZATION);
+    double choleskyTime_ns = synthesize(vtl, utterances, choleskyAudio, 1);
+
+    // At least one solution per sample.
+    numSolutions = printFactorizationStats(vtl, "Cholesky factorization");
+    if (numSolutions < (long long)NUM_UTTERANCES * (NUM_FRAMES - 1) * FRAME_STEP_SAMPLES)
+    {
+      printf("The factorizations were not counted correctly.\n");
+      numFailures++;
+    }
+
+    vtl.vtlResetFactorizationStats();
+    if (printFactorizationStats(vtl, "After the reset") != 0)
+    {
+      printf("The counters of the factorizations were not reset.\n");
+      numFailures++;
+    }
+
+    // The lanes share one factorization per time step.
+    synthesize(vtl, utterances, choleskyBatchAudio, 4);
+    numSolutions = printFactorizationStats(vtl, "Cholesky factorization in lockstep lanes");
+    if (numSolutions < (long long)(NUM_FRAMES - 1) * FRAME_STEP_SAMPLES)
+    {
+      printf("The factorizations in lockstep lanes were not counted correctly.\n");
+      numFailures++;
+    }
+
+    vtl.vtlSetSolverType(TdsModel::TREE_ELIMINATION);
+    double treeTime_ns = synthesize(vtl, utterances, treeAudio, 1);
+    synthesize(vtl, utterances, treeBatchAudio, 4);
+
+    printf("Cholesky factorization: %.0f ns/sample\n", choleskyTime_ns);
+    printf("Tree elimination:       %.0f ns/sample\n", treeTime_ns);
+
+    for (i = 0; i < NUM_UTTERANCES; i++)
+    {
+      double peak = 0.0;
+      double maxDifference = 0.0;
+
+      for (k = 0; k < (int)choleskyAudio[i].size(); k++)
+      {
+        peak = fmax(peak, fabs(choleskyAudio[i][k]));
+        maxDifference = fmax(maxDifference, fabs(treeAudio[i][k] - choleskyAudio[i][k]));
+      }
+
+      printf("Utterance %d: peak %g, max. difference %g\n", i, peak, maxDifference);
+
+      if ((peak == 0.0) || (maxDifference > MAX_RELATIVE_AUDIO_DIFFERENCE * peak))
+      {
+        printf("Utterance %d: the tree elimination differs from the Cholesky factorization.\n", i);
+        numFailures++;
+      }
+
+      if (memcmp(&choleskyAudio[i][0], &choleskyBatchAudio[i][0], choleskyAudio[i].size() * sizeof(double)) != 0)
+      {
+        printf("Utterance %d: the Cholesky factorization gives other samples in lockstep lanes.\n", i);
+        numFailures++;
+      }
+
+      if (memcmp(&treeAudio[i][0], &treeBatchAudio[i][0], treeAudio[i].size() * sizeof(double)) != 0)
+      {
+        printf("Utterance %d: the tree elimination gives other samples in lockstep lanes.\n", i);
+        numFailures++;
+      }
+    }
+  }
+  catch (std::exception &e)
+  {
+    printf("Error: %s\n", e.what());
+    return 1;
+  }
+
+  if (numFailures > 0)
+  {
+    printf("FAILED: %d checks.\n", numFailures);
+    return 1;
+  }
+
+  printf("PASSED\n");
+  return 0;
+}
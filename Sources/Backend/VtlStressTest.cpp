@@ -0,0 +1,280 @@
+// ****************************************************************************
+// Stress test for the concurrent use of the backend: numInstances instances
+// of VocalTractLab synthesize different utterances at the same time (one
+// thread per instance), and the audio and EMA trajectories must be bit by
+// bit the same as those of the same utterances synthesized one after the
+// other. This fails when instances share mutable state.
+// The threads start together, and the test fails when they did not run
+// at the same time. On a single core, they only overlap by time slicing,
+// which finds shared state that is not synchronized, but not data races
+// that need truly simultaneous access, so the number of cores is printed.
+//
+// Usage: VtlStressTest <speaker file> [numInstances] [numRounds]
+// By default, at least 8 instances run in 3 rounds, so that the threads
+// interleave often enough even on few cores.
+// Returns 0 when all results are identical and 1 otherwise.
+// ****************************************************************************
+
+#include "VocalTractLabApi.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const int NUM_FRAMES = 120;
+static const int FRAME_STEP_SAMPLES = 110;
+
+// ****************************************************************************
+/// The parameters and results of one utterance.
+// ****************************************************************************
+
+struct Utterance
+{
+  vector<double> tractParams;
+  vector<double> glottisParams;
+  vector<double> audio;
+  vector<double> ema;
+};
+
+
+// ****************************************************************************
+/// Creates the parameter trajectories of the utterance with the given index.
+/// The tract parameters move around their neutral values within their
+/// ranges, with a different speed and phase for each utterance, and the
+/// glottis is opened and closed smoothly at the beginning and end.
+// ****************************************************************************
+
+static void createUtterance(VocalTractLab &vtl, int index, Utterance &u)
+{
+  const int NUM_PARAMS = VocalTract::NUM_PARAMS;
+  vector<double> tractInfo = vtl.vtlGetTractParamInfo();
+  vector<double> glottisInfo = vtl.vtlGetGlottisParamInfo();
+  int numGlottisParams = (int)glottisInfo.size() / 3;
+  int i, k;
+  double min, max, neutral, t;
+
+  u.tractParams.resize(NUM_FRAMES * NUM_PARAMS);
+  u.glottisParams.resize(NUM_FRAMES * numGlottisParams);
+
+  for (i = 0; i < NUM_FRAMES; i++)
+  {
+    t = (double)i / NUM_FRAMES;
+
+    for (k = 0; k < NUM_PARAMS; k++)
+    {
+      min = tractInfo[k];
+      max = tractInfo[k + NUM_PARAMS];
+      neutral = tractInfo[k + 2 * NUM_PARAMS];
+      u.tractParams[i*NUM_PARAMS + k] = neutral +
+        0.3 * (max - min) * sin(2.0 * M_PI * (1.0 + 0.37 * index) * t + k + index);
+      if (u.tractParams[i*NUM_PARAMS + k] < min) { u.tractParams[i*NUM_PARAMS + k] = min; }
+      if (u.tractParams[i*NUM_PARAMS + k] > max) { u.tractParams[i*NUM_PARAMS + k] = max; }
+    }
+
+    for (k = 0; k < numGlottisParams; k++)
+    {
+      u.glottisParams[i*numGlottisParams + k] = glottisInfo[k + 2 * numGlottisParams];
+    }
+    // F0 and the subglottal pressure.
+    u.glottisParams[i*numGlottisParams + 0] = 100.0 + 10.0 * index + 20.0 * sin(2.0 * M_PI * t);
+    u.glottisParams[i*numGlottisParams + 1] = 8000.0 * sin(M_PI * t);
+  }
+}
+
+
+// ****************************************************************************
+/// Synthesizes the audio and the EMA trajectories of the utterance.
+// ****************************************************************************
+
+static void synthesize(VocalTractLab &vtl, Utterance &u)
+{
+  u.audio.assign((NUM_FRAMES - 1) * FRAME_STEP_SAMPLES, 0.0);
+
+  vtl.vtlSynthAudio(&u.tractParams[0], &u.glottisParams[0], NUM_FRAMES,
+    FRAME_STEP_SAMPLES, &u.audio[0]);
+  u.ema = vtl.vtlTract2EMA(u.tractParams, NUM_FRAMES);
+}
+
+
+// ****************************************************************************
+/// Counts the threads that synthesize at the same time and keeps their
+/// maximum number.
+// ****************************************************************************
+
+struct OverlapCounter
+{
+  atomic<int> numReady;
+  atomic<int> numRunning;
+  atomic<int> maxRunning;
+
+  OverlapCounter() : numReady(0), numRunning(0), maxRunning(0) {}
+
+  /// Waits until numThreads threads have called this function, so that they
+  /// all start at once.
+  void start(int numThreads)
+  {
+    numReady++;
+    while (numReady < numThreads)
+    {
+      this_thread::yield();
+    }
+
+    int n = ++numRunning;
+    int max = maxRunning;
+    while ((n > max) && (maxRunning.compare_exchange_weak(max, n) == false))
+    {
+    }
+  }
+
+  void stop() { numRunning--; }
+};
+
+
+// ****************************************************************************
+/// Returns true when both vectors have exactly the same contents.
+// ****************************************************************************
+
+static bool isIdentical(const vector<double> &a, const vector<double> &b)
+{
+  return (a.size() == b.size()) &&
+    ((a.empty()) || (memcmp(&a[0], &b[0], a.size() * sizeof(double)) == 0));
+}
+
+
+// ****************************************************************************
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s <speaker file> [numInstances] [numRounds]\n", argv[0]);
+    return 1;
+  }
+
+  int numInstances = (argc > 2) ? atoi(argv[2]) : (int)thread::hardware_concurrency();
+  int numRounds = (argc > 3) ? atoi(argv[3]) : 3;
+  int i, round;
+  int numFailures = 0;
+
+  if ((argc <= 2) && (numInstances < 8)) { numInstances = 8; }
+  if (numInstances < 2) { numInstances = 2; }
+  if (numRounds < 1) { numRounds = 1; }
+
+  printf("%d instances on %d cores.\n", numInstances, (int)thread::hardware_concurrency());
+
+  try
+  {
+    // ****************************************************************
+    // The reference results: all utterances one after the other, each
+    // with a new instance.
+    // ****************************************************************
+
+    vector<Utterance> reference(numInstances);
+    for (i = 0; i < numInstances; i++)
+    {
+      VocalTractLab vtl(argv[1]);
+      createUtterance(vtl, i, reference[i]);
+      synthesize(vtl, reference[i]);
+    }
+
+    // ****************************************************************
+    // All utterances at the same time, each instance in its own thread.
+    // In later rounds, the instances continue with another utterance.
+    // ****************************************************************
+
+    vector<VocalTractLab*> instances(numInstances);
+    for (i = 0; i < numInstances; i++)
+    {
+      instances[i] = new VocalTractLab(argv[1]);
+    }
+
+    for (round = 0; round < numRounds; round++)
+    {
+      vector<Utterance> result(numInstances);
+      vector<thread> threads;
+      vector<string> errors(numInstances);
+      OverlapCounter overlap;
+
+      for (i = 0; i < numInstances; i++)
+      {
+        result[i].tractParams = reference[(i + round) % numInstances].tractParams;
+        result[i].glottisParams = reference[(i + round) % numInstances].glottisParams;
+      }
+
+      for (i = 0; i < numInstances; i++)
+      {
+        threads.push_back(thread([&, i]()
+          {
+            overlap.start(numInstances);
+            try
+            {
+              synthesize(*instances[i], result[i]);
+            }
+            catch (std::exception &e)
+            {
+              errors[i] = e.what();
+            }
+            overlap.stop();
+          }));
+      }
+      for (i = 0; i < numInstances; i++)
+      {
+        threads[i].join();
+      }
+
+      if (overlap.maxRunning < 2)
+      {
+        printf("Round %d: the threads did not synthesize at the same time.\n", round);
+        numFailures++;
+      }
+
+      for (i = 0; i < numInstances; i++)
+      {
+        const Utterance &r = reference[(i + round) % numInstances];
+
+        if (errors[i].empty() == false)
+        {
+          printf("Round %d, instance %d: %s\n", round, i, errors[i].c_str());
+          numFailures++;
+        }
+        else
+        if ((isIdentical(result[i].audio, r.audio) == false) ||
+          (isIdentical(result[i].ema, r.ema) == false))
+        {
+          printf("Round %d, instance %d: the results differ from the serial run.\n", round, i);
+          numFailures++;
+        }
+      }
+    }
+
+    for (i = 0; i < numInstances; i++)
+    {
+      delete instances[i];
+    }
+  }
+  catch (std::exception &e)
+  {
+    printf("Error: %s\n", e.what());
+    return 1;
+  }
+
+  if (numFailures > 0)
+  {
+    printf("FAILED: %d of %d parallel runs differ from the serial runs.\n",
+      numFailures, numInstances * numRounds);
+    return 1;
+  }
+
+  printf("PASSED: %d instances in %d rounds give bit-identical results to serial runs.\n",
+    numInstances, numRounds);
+  return 0;
+}
@@ -2893,7 +2893,7 @@ void Data::getTubeSectionQuantity(TdsModel *model, int sectionIndex, double &lef
   {
     if ((sectionIndex >= 0) && (sectionIndex < Tube::NUM_SECTIONS))
     {
-      leftValue = model->tubeSection[sectionIndex].area;
+      leftValue = model->sections.area[sectionIndex];
       rightValue = leftValue;
     }
   }
@@ -2904,7 +2904,7 @@ void Data::getTubeSectionQuantity(TdsModel *model, int sectionIndex, double &lef
     if ((sectionIndex >= 0) && (sectionIndex < Tube::NUM_SECTIONS))
     {
       model->getSectionFlow(sectionIndex, leftValue, rightValue);
-      double area = model->tubeSection[sectionIndex].area;
+      double area = model->sections.area[sectionIndex];
       if (area < TdsModel::MIN_AREA_CM2)
       {
         area = TdsModel::MIN_AREA_CM2;
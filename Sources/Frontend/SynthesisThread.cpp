@@ -194,7 +194,7 @@ void *SynthesisThread::Entry()
       data->userProbeFlow[k] = inflow_cm3_s;
       data->userProbePressure[k] = tdsModel->getSectionPressure(data->userProbeSection);
       
-      double area = tdsModel->tubeSection[data->userProbeSection].area;
+      double area = tdsModel->sections.area[data->userProbeSection];
       if (area < TdsModel::MIN_AREA_CM2)
       {
         area = TdsModel::MIN_AREA_CM2;
@@ -142,7 +142,8 @@ void TdsOptionsDialog::initWidgets()
   const wxString SOLVER_CHOICES[NUM_SOLVER_CHOICES] =
   {
     "Gauss-Seidel SOR",
-    "Cholesky factorization"
+    "Cholesky factorization",
+    "Tree elimination"
   };
 
   radSolverOptions = new wxRadioBox(this, IDR_SOLVER_OPTIONS, "Numeric solver options",
@@ -211,7 +211,7 @@ void TdsSpatialSignalPicture::draw(wxDC &dc)
       ts = &model->tubeSection[i];
 
       leftX = graph->getXPos(ts->pos);
-      rightX = graph->getXPos(ts->pos + ts->length);
+      rightX = graph->getXPos(ts->pos + model->sections.length[i]);
 
       data->getTubeSectionQuantity(model, i, leftValue, rightValue);
       leftY[i] = graph->getYPos(leftValue);
@@ -249,7 +249,7 @@ void TdsSpatialSignalPicture::draw(wxDC &dc)
   {
     ts = &model->tubeSection[i];
 
-    leftX = graph->getXPos(ts->pos + 0.5*ts->length);
+    leftX = graph->getXPos(ts->pos + 0.5*model->sections.length[i]);
     if ((leftX >= graphX) && (leftX < graphX + graphW))
     {
       dc.SetPen(wxPen(*wxBLACK, 1, wxPENSTYLE_DOT));